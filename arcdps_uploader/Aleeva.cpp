@@ -3,30 +3,111 @@
 #include <cpr/cpr.h>
 #include <nlohmann/json.hpp>
 #include "loguru.hpp"
+#include "Metrics.h"
 #include "Settings.h"
 
 using json = nlohmann::json;
 
-bool Aleeva::login(Settings& settings) {
-	if (settings.aleeva.access_code.empty()) {
-		LOG_F(INFO, "Aleeva enabled but access code missing, skipping login.");
-		return false;
-	}
+std::future<Aleeva::Session> Aleeva::login_async(AleevaSettings credentials,
+	std::optional<DiscordLists> cached, CancelToken cancel) {
+	return std::async(std::launch::async, [credentials, cached, cancel]() {
+		Session session;
+		if (credentials.access_code.empty() && !is_refresh_token_valid(credentials)) {
+			LOG_F(INFO, "Aleeva enabled but access code missing, skipping login.");
+			return session;
+		}
 
-	if (Aleeva::authorize(settings)) {
-		if (Aleeva::is_refresh_token_valid(settings)) {
-			Aleeva::get_servers(settings);
-			for (const Aleeva::DiscordId& server : settings.aleeva.server_ids) {
-				Aleeva::get_channels(settings, server.id);
+		if (authorize(credentials, session, cancel)) {
+			int64_t now = time(nullptr);
+			if (cached && now - cached->fetched_at < DISCORD_LIST_TTL) {
+				session.lists = cached;
+			}
+			else {
+				DiscordLists lists;
+				auto servers = get_servers(session.api_key, cancel);
+				bool complete = servers.has_value();
+				if (servers) {
+					lists.server_ids = std::move(*servers);
+				}
+
+				// One request per server, all in flight at once
+				std::vector<std::future<std::optional<std::vector<DiscordId>>>> channels;
+				for (const DiscordId& server : lists.server_ids) {
+					channels.push_back(std::async(std::launch::async,
+						get_channels, session.api_key, server.id, cancel));
+				}
+				for (size_t i = 0; i < channels.size(); ++i) {
+					auto server_channels = channels[i].get();
+					if (!server_channels) {
+						complete = false;
+						continue;
+					}
+					lists.channel_ids[lists.server_ids[i].id] = std::move(*server_channels);
+				}
+
+				if (complete) {
+					lists.fetched_at = now;
+					session.lists = lists;
+					session.lists_fetched = true;
+				}
+				else {
+					// Partial lists would replace the settings and be cached
+					// for a day, the stale ones are better than that
+					LOG_F(WARNING, "Aleeva server/channel lists unavailable, keeping the previous ones.");
+					session.lists = cached;
+				}
 			}
-			return true;
 		}
+
+		return session;
+	});
+}
+
+void Aleeva::apply_session(AleevaSettings& settings, const Session& session) {
+	if (session.unauthorized) {
+		settings.authorised = false;
+		settings.refresh_token = "";
+		settings.token_expiration = 0;
+		return;
+	}
+	if (!session.authorised) {
+		return;
 	}
 
-	return false;
+	settings.authorised = true;
+	settings.api_key = session.api_key;
+	settings.refresh_token = session.refresh_token;
+	settings.token_expiration = session.token_expiration;
+	settings.api_key_expiration = session.api_key_expiration;
+
+	if (session.lists) {
+		settings.server_ids = session.lists->server_ids;
+		settings.channel_ids = session.lists->channel_ids;
+	}
+	if (settings.server_ids.size() > 0 && settings.selected_server_id == "") {
+		settings.selected_server_id = settings.server_ids[0].id;
+	}
+	if (settings.selected_channel_id == "" && settings.channel_ids.count(settings.selected_server_id)) {
+		const auto& channels = settings.channel_ids.at(settings.selected_server_id);
+		if (channels.size() > 0) {
+			settings.selected_channel_id = channels[0].id;
+		}
+	}
 }
 
-bool Aleeva::authorize(Settings& settings)
+bool Aleeva::needs_refresh(const AleevaSettings& settings) {
+	if (!settings.enabled || !settings.authorised) {
+		return false;
+	}
+
+	int64_t now = time(nullptr);
+	if (settings.api_key_expiration > 0 && now > settings.api_key_expiration - TOKEN_REFRESH_MARGIN) {
+		return true;
+	}
+	return now > settings.token_expiration - TOKEN_REFRESH_MARGIN;
+}
+
+bool Aleeva::authorize(const AleevaSettings& settings, Session& session, const CancelToken& cancel)
 {
 	std::string grant_type = "access_code";
 
@@ -34,6 +115,7 @@ bool Aleeva::authorize(Settings& settings)
 		grant_type = "refresh_token";
 	}
 
+	Metrics::Timer timer;
 	cpr::Response response;
 	response = cpr::Post(
 		cpr::Url{ "https://api.aleeva.io/auth/token" },
@@ -41,26 +123,28 @@ bool Aleeva::authorize(Settings& settings)
 			{"grant_type", grant_type},
 			{"client_id", "arc_dps_uploader"},
 			{"client_secret", "9568468d-810a-4ce2-861e-e8011b658a28"},
-			{"access_code", settings.aleeva.access_code},
-			{"refresh_token", settings.aleeva.refresh_token},
-			{"scopes", "report:write server:read channel:read"} });
+			{"access_code", settings.access_code},
+			{"refresh_token", settings.refresh_token},
+			{"scopes", "report:write server:read channel:read"} },
+		cancel.progress());
+	Metrics::observe_http("aleeva/auth", (int)response.status_code, timer.seconds());
 
-	LOG_F(INFO, "Aleeva Auth response: %s", response.text.c_str());
+	LOG_F(INFO, "Aleeva Auth response: %d", (int)response.status_code);
 
 	if (response.status_code == 200) {
 		if (response.header.count("Content-Type") && response.header["Content-Type"] == "application/json") {
 			try {
 				json parsed = json::parse(response.text);
-				settings.aleeva.api_key = parsed["accessToken"];
-				settings.aleeva.refresh_token = parsed["refreshToken"];
+				session.api_key = parsed["accessToken"];
+				session.refresh_token = parsed["refreshToken"];
 
 				auto now = time(nullptr);
 				int64_t expires_in = parsed["refreshExpiresIn"];
-				settings.aleeva.token_expiration = now + expires_in;
-
-				settings.save();
+				session.token_expiration = now + expires_in;
+				int64_t api_key_expires_in = parsed.value("expiresIn", (int64_t)0);
+				session.api_key_expiration = api_key_expires_in > 0 ? now + api_key_expires_in : 0;
 
-				settings.aleeva.authorised = true;
+				session.authorised = true;
 				return true;
 			}
 			catch (const json::exception& e) {
@@ -69,9 +153,7 @@ bool Aleeva::authorize(Settings& settings)
 		}
 	}
 	else if (response.status_code == 401) {
-		settings.aleeva.authorised = false;
-		settings.aleeva.refresh_token = "";
-		settings.aleeva.token_expiration = 0;
+		session.unauthorized = true;
 	}
 
 	return false;
@@ -81,36 +163,38 @@ void Aleeva::deauthorize(Settings& settings) {
 	settings.aleeva.authorised = false;
 	settings.aleeva.refresh_token = "";
 	settings.aleeva.token_expiration = 0;
+	settings.aleeva.api_key_expiration = 0;
 }
 
-bool Aleeva::is_refresh_token_valid(Settings& settings)
+bool Aleeva::is_refresh_token_valid(const AleevaSettings& settings)
 {
-	if (settings.aleeva.refresh_token.length() == 0) {
+	if (settings.refresh_token.length() == 0) {
 		return false;
 	}
 
 	time_t now = time(nullptr);
-	if (now > settings.aleeva.token_expiration - 60) {
+	if (now > settings.token_expiration - 60) {
 		return false;
 	}
 
 	return true;
 }
 
-void Aleeva::get_servers(Settings& settings)
+std::optional<std::vector<Aleeva::DiscordId>> Aleeva::get_servers(const std::string& api_key, const CancelToken& cancel)
 {
-	if (!settings.aleeva.authorised) {
-		return;
-	}
+	std::vector<DiscordId> servers;
 
+	Metrics::Timer timer;
 	cpr::Response response;
 	response = cpr::Get(
 		cpr::Url{ "https://api.aleeva.io/server" },
-		cpr::Bearer(settings.aleeva.api_key),
+		cpr::Bearer(api_key),
 		cpr::Parameters{
 			{"mode", "UPLOADS"}
-		}
+		},
+		cancel.progress()
 	);
+	Metrics::observe_http("aleeva/server", (int)response.status_code, timer.seconds());
 
 	if (response.status_code == 200) {
 		if (response.header.count("Content-Type") && response.header["Content-Type"] == "application/json") {
@@ -120,75 +204,71 @@ void Aleeva::get_servers(Settings& settings)
 					DiscordId server_id;
 					server_id.id = server["id"];
 					server_id.name = server["name"];
-					settings.aleeva.server_ids.push_back(server_id);
-				}
-				if (settings.aleeva.server_ids.size() > 0 && settings.aleeva.selected_server_id == "") {
-					settings.aleeva.selected_server_id = settings.aleeva.server_ids[0].id;
+					servers.push_back(server_id);
 				}
 			}
 			catch (const json::exception& e) {
 				LOG_F(ERROR, "Aleeva Servers JSON Parse Fail: %s", e.what());
+				return std::nullopt;
 			}
+			return servers;
 		}
 	}
 	else {
 		LOG_F(INFO, "Aleeva Servers response: %s", response.text.c_str());
 	}
+	return std::nullopt;
 }
 
-void Aleeva::get_channels(Settings& settings, const std::string& server_id) {
-	if (!settings.aleeva.authorised) {
-		return;
-	}
+std::optional<std::vector<Aleeva::DiscordId>> Aleeva::get_channels(const std::string& api_key, const std::string& server_id,
+	const CancelToken& cancel) {
+	std::vector<DiscordId> channels;
 
+	Metrics::Timer timer;
 	cpr::Response response;
 	response = cpr::Get(
 		cpr::Url{ "https://api.aleeva.io/server/" + server_id + "/channel" },
-		cpr::Bearer{ settings.aleeva.api_key },
+		cpr::Bearer{ api_key },
 		cpr::Parameters{
 			{"mode", "UPLOADS"}
-		}
+		},
+		cancel.progress()
 	);
-
+	Metrics::observe_http("aleeva/channel", (int)response.status_code, timer.seconds());
 
 	if (response.status_code == 200) {
 		if (response.header.count("Content-Type") && response.header["Content-Type"] == "application/json") {
 			try {
 				json parsed = json::parse(response.text);
-				for (auto& server : parsed) {
+				for (auto& channel : parsed) {
 					DiscordId channel_id;
-					channel_id.id = server["id"];
-					channel_id.name = server["name"];
-
-					if (settings.aleeva.channel_ids.count(server_id) == 0) {
-						settings.aleeva.channel_ids.emplace(server_id, std::vector<DiscordId>());
-					}
-
-					auto& channels = settings.aleeva.channel_ids.at(server_id);
+					channel_id.id = channel["id"];
+					channel_id.name = channel["name"];
 					channels.push_back(channel_id);
-
-					if (channels.size() > 0 && settings.aleeva.selected_channel_id == "") {
-						settings.aleeva.selected_channel_id = channels[0].id;
-					}
 				}
 			}
 			catch (const json::exception& e) {
 				LOG_F(ERROR, "Aleeva Channels JSON Parse Fail: %s", e.what());
+				return std::nullopt;
 			}
+			return channels;
 		}
 	}
 	else {
 		LOG_F(INFO, "Aleeva Channels response: %s", response.text.c_str());
 	}
+	return std::nullopt;
 }
 
-void Aleeva::post_log(AleevaSettings& settings, const std::string& log_path) {
+bool Aleeva::post_log(const AleevaSettings& settings, const std::string& log_path, const CancelToken& cancel) {
 	json body;
 	body["sendNotification"] = settings.should_post;
 	body["notificationServerId"] = settings.selected_server_id;
 	body["notificationChannelId"] = settings.selected_channel_id;
 	body["dpsReportPermalink"] = log_path;
 
+	std::string payload = body.dump();
+	Metrics::Timer timer;
 	cpr::Response response;
 	response = cpr::Post(
 		cpr::Url{
@@ -198,9 +278,13 @@ void Aleeva::post_log(AleevaSettings& settings, const std::string& log_path) {
 				{"accept", "application/json"},
 				{"Content-Type", "application/json"},
 		},
-		cpr::Body{ body.dump() }
+		cpr::Body{ payload },
+		cancel.progress()
 	);
+	Metrics::observe_http("aleeva/report", (int)response.status_code, timer.seconds(), payload.size());
 	if (response.status_code != 200 && response.status_code != 201) {
 		LOG_F(ERROR, "Aleeva post log failed: %s", response.text.c_str());
+		return false;
 	}
+	return true;
 }
\ No newline at end of file
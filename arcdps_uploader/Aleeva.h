@@ -1,7 +1,14 @@
 #ifndef __ALEEVA_H__
 #define __ALEEVA_H__
 
+#include <cstdint>
+#include <future>
+#include <map>
+#include <optional>
 #include <string>
+#include <vector>
+
+#include "CancelToken.h"
 
 struct Settings;
 struct AleevaSettings;
@@ -12,15 +19,51 @@ namespace Aleeva {
         std::string name;
     };
 
-    bool login(Settings& settings);
+    // Servers and their channels as returned by the API
+    struct DiscordLists {
+        std::vector<DiscordId> server_ids;
+        std::map<std::string, std::vector<DiscordId>> channel_ids;
+        int64_t fetched_at = 0;
+    };
+
+    // Outcome of a login/token refresh. Produced on a worker thread and applied
+    // to AleevaSettings by the owner with apply_session.
+    struct Session {
+        bool authorised = false;
+        bool unauthorized = false; // credentials were rejected (401)
+        std::string api_key;
+        std::string refresh_token;
+        int64_t token_expiration = 0;
+        int64_t api_key_expiration = 0;
+        std::optional<DiscordLists> lists;
+        bool lists_fetched = false; // lists came from the API rather than cache
+    };
+
+    // Cached server/channel lists are reused for this long
+    inline constexpr int64_t DISCORD_LIST_TTL = 24 * 60 * 60;
+    // Tokens are refreshed this long before they expire
+    inline constexpr int64_t TOKEN_REFRESH_MARGIN = 5 * 60;
+
+    // Authorize and fetch server/channel lists (channels of all servers are
+    // requested concurrently). Nothing in credentials is modified; cached lists
+    // younger than DISCORD_LIST_TTL are used instead of the API, and kept if
+    // any list request fails. Once cancel is set the requests are aborted.
+    std::future<Session> login_async(AleevaSettings credentials,
+        std::optional<DiscordLists> cached, CancelToken cancel);
+
+    void apply_session(AleevaSettings& settings, const Session& session);
+    bool needs_refresh(const AleevaSettings& settings);
 
-    bool authorize(Settings& settings);
+    bool authorize(const AleevaSettings& settings, Session& session, const CancelToken& cancel);
     void deauthorize(Settings& settings);
-    bool is_refresh_token_valid(Settings& settings);
-    void get_servers(Settings& settings);
-    void get_channels(Settings& settings, const std::string& server_id);
+    bool is_refresh_token_valid(const AleevaSettings& settings);
+    // nullopt if the request or its response failed, unlike an empty list
+    std::optional<std::vector<DiscordId>> get_servers(const std::string& api_key, const CancelToken& cancel);
+    std::optional<std::vector<DiscordId>> get_channels(const std::string& api_key, const std::string& server_id,
+        const CancelToken& cancel);
 
-    void post_log(AleevaSettings& settings, const std::string& log_path);
+    // Returns true if Aleeva accepted the report
+    bool post_log(const AleevaSettings& settings, const std::string& log_path, const CancelToken& cancel);
 }
 
 #endif // __ALEEVA_H__
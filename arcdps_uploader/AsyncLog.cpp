@@ -0,0 +1,359 @@
+#include "AsyncLog.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Metrics.h"
+
+namespace fs = std::filesystem;
+
+namespace AsyncLog {
+namespace detail {
+std::atomic<bool> active{false};
+}
+
+namespace {
+constexpr const char* CALLBACK_ID = "async_log";
+// Records written per batch, bounds how long a flush waits on a busy ring
+constexpr size_t BATCH = 1024;
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(50);
+constexpr auto FLUSH_TIMEOUT = std::chrono::seconds(2);
+
+struct State {
+    std::unique_ptr<detail::Record[]> ring;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) size_t dequeue_pos = 0; // writer thread only
+    std::atomic<uint64_t> dropped{0};
+    uint64_t reported = 0;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable written;
+    bool stopping = false;
+    bool woken = false;
+    size_t written_pos = 0;
+
+    fs::path path;
+    Options options;
+    FILE* file = nullptr;
+    uint64_t file_bytes = 0;
+
+    // Date and time of the last second a line was written in
+    int64_t date_second = -1;
+    char date[32] = {};
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+size_t round_up_pow2(size_t n) {
+    size_t p = 2;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+FILE* open_file(const fs::path& path, bool append) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), append ? L"ab" : L"wb");
+#else
+    return fopen(path.c_str(), append ? "ab" : "wb");
+#endif
+}
+
+void rotate(State& s) {
+    fclose(s.file);
+    std::error_code ec;
+    for (int i = s.options.keep; i >= 1; --i) {
+        fs::path from = i == 1 ? s.path
+                               : fs::path(s.path.string() + "." +
+                                          std::to_string(i - 1));
+        fs::path to = s.path.string() + "." + std::to_string(i);
+        fs::remove(to, ec);
+        fs::rename(from, to, ec);
+    }
+    s.file = open_file(s.path, false);
+    s.file_bytes = 0;
+}
+
+void append_record(State& s, detail::Record& r, std::string& out) {
+    int64_t second = r.time_us / 1000000;
+    if (second != s.date_second) {
+        std::time_t t = (std::time_t)second;
+        std::tm local = {};
+#ifdef _WIN32
+        localtime_s(&local, &t);
+#else
+        localtime_r(&t, &local);
+#endif
+        strftime(s.date, sizeof(s.date), "%Y-%m-%d %H:%M:%S", &local);
+        s.date_second = second;
+    }
+
+    const char* file = r.file ? r.file : "";
+    for (const char* p = file; *p; ++p) {
+        if (*p == '/' || *p == '\\') file = p + 1;
+    }
+    const char* level = loguru::get_verbosity_name(r.verbosity);
+    char number[8];
+    if (!level) {
+        snprintf(number, sizeof(number), "%d", (int)r.verbosity);
+        level = number;
+    }
+    detail::format(out, "%s.%03d [%08x] %s:%u %4s| ", s.date,
+                   (int)(r.time_us / 1000 % 1000), r.thread, file, r.line,
+                   level);
+
+    if (r.heap) {
+        out += *r.heap;
+        delete r.heap;
+    } else if (r.render) {
+        r.render(out, r.format, r.payload);
+    } else {
+        out.append((const char*)r.payload, r.size);
+    }
+    out += '\n';
+}
+
+// Formats up to BATCH published records into out, returns how many
+size_t drain(State& s, std::string& out) {
+    size_t count = 0;
+    while (count < BATCH) {
+        detail::Record& r = s.ring[s.dequeue_pos & s.mask];
+        if (r.sequence.load(std::memory_order_acquire) != s.dequeue_pos + 1) {
+            break;
+        }
+        append_record(s, r, out);
+        r.sequence.store(s.dequeue_pos + s.mask + 1, std::memory_order_release);
+        ++s.dequeue_pos;
+        ++count;
+    }
+    return count;
+}
+
+void write_out(State& s, const std::string& batch) {
+    if (!s.file || batch.empty()) return;
+    fwrite(batch.data(), 1, batch.size(), s.file);
+    fflush(s.file);
+    s.file_bytes += batch.size();
+    if (s.options.max_bytes && s.file_bytes >= s.options.max_bytes) rotate(s);
+}
+
+void writer_loop(State& s) {
+    static Metrics::Counter& dropped_total = Metrics::counter(
+        "uploader_log_dropped_total",
+        "Log messages dropped because the log ring was full");
+    std::string batch;
+    for (;;) {
+        batch.clear();
+        size_t count = drain(s, batch);
+
+        uint64_t dropped = s.dropped.load(std::memory_order_relaxed);
+        if (dropped != s.reported) {
+            detail::format(batch, "%s %llu log messages dropped\n", s.date,
+                           (unsigned long long)(dropped - s.reported));
+            dropped_total.inc(dropped - s.reported);
+            s.reported = dropped;
+        }
+        write_out(s, batch);
+
+        std::unique_lock<std::mutex> lk(s.mutex);
+        s.written_pos = s.dequeue_pos;
+        s.written.notify_all();
+        if (count == BATCH) continue;
+        if (s.stopping &&
+            s.dequeue_pos == s.enqueue_pos.load(std::memory_order_acquire)) {
+            break;
+        }
+        if (count == 0 && !s.woken) {
+            s.wake.wait_for(lk, IDLE_WAIT,
+                            [&s] { return s.stopping || s.woken; });
+        }
+        s.woken = false;
+    }
+}
+
+void wake_writer(State& s) {
+    {
+        std::lock_guard<std::mutex> lk(s.mutex);
+        s.woken = true;
+    }
+    s.wake.notify_one();
+}
+
+// Already formatted by loguru, only the text is copied
+void on_loguru_message(void*, const loguru::Message& message) {
+    detail::Record* record =
+        detail::claim(message.verbosity, message.filename, message.line);
+    if (!record) return;
+    size_t prefix = strlen(message.prefix);
+    size_t size = prefix + strlen(message.message);
+    if (size <= detail::PAYLOAD) {
+        memcpy(record->payload, message.prefix, prefix);
+        memcpy(record->payload + prefix, message.message, size - prefix);
+        record->size = (uint32_t)size;
+    } else {
+        record->heap = new std::string(message.prefix);
+        *record->heap += message.message;
+    }
+    detail::publish(record);
+    // loguru aborts right after
+    if (message.verbosity <= loguru::Verbosity_FATAL) flush();
+}
+}  // namespace
+
+namespace detail {
+Record* claim(loguru::Verbosity verbosity, const char* file, unsigned line) {
+    State& s = state();
+    size_t pos = s.enqueue_pos.load(std::memory_order_relaxed);
+    Record* r;
+    for (;;) {
+        r = &s.ring[pos & s.mask];
+        size_t sequence = r->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (s.enqueue_pos.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            uint64_t dropped =
+                s.dropped.fetch_add(1, std::memory_order_relaxed);
+            if ((dropped & 255) == 0) wake_writer(s);
+            return nullptr;
+        } else {
+            pos = s.enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // The writer may be idling, get it going before the ring fills up
+    if ((pos & (s.mask >> 1)) == 0) wake_writer(s);
+
+    thread_local uint32_t thread =
+        (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+    r->time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+    r->thread = thread;
+    r->verbosity = verbosity;
+    r->file = file;
+    r->line = line;
+    r->format = nullptr;
+    r->render = nullptr;
+    r->heap = nullptr;
+    r->size = 0;
+    return r;
+}
+
+void publish(Record* record) {
+    // Still the position claim() took it at
+    size_t pos = record->sequence.load(std::memory_order_relaxed);
+    record->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void format(std::string& out, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list again;
+    va_copy(again, args);
+    char buffer[512];
+    int size = vsnprintf(buffer, sizeof(buffer), format, args);
+    if (size >= 0 && (size_t)size < sizeof(buffer)) {
+        out.append(buffer, (size_t)size);
+    } else if (size >= 0) {
+        size_t at = out.size();
+        out.resize(at + (size_t)size + 1);
+        vsnprintf(&out[at], (size_t)size + 1, format, again);
+        out.resize(at + (size_t)size);
+    }
+    va_end(again);
+    va_end(args);
+}
+}  // namespace detail
+
+bool start(const fs::path& path, const Options& options,
+           loguru::Verbosity verbosity) {
+    State& s = state();
+    if (s.writer.joinable()) return true;
+
+    s.file = open_file(path, options.append);
+    if (!s.file) {
+        LOG_F(ERROR, "Failed to open %s", path.string().c_str());
+        return false;
+    }
+    std::error_code ec;
+    s.file_bytes = options.append ? fs::file_size(path, ec) : 0;
+    if (ec) s.file_bytes = 0;
+    s.path = path;
+    s.options = options;
+
+    // Kept for the life of the process, a producer may still be in claim()
+    // when stop() returns
+    size_t slots = round_up_pow2(options.slots);
+    if (!s.ring || s.mask + 1 != slots) {
+        s.ring.reset(new detail::Record[slots]);
+        s.mask = slots - 1;
+    }
+    for (size_t i = 0; i < slots; ++i) {
+        s.ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    s.enqueue_pos.store(0);
+    s.dequeue_pos = 0;
+    s.written_pos = 0;
+    s.dropped.store(0);
+    s.reported = 0;
+    s.stopping = false;
+
+    s.writer = std::thread(writer_loop, std::ref(s));
+    detail::active.store(true);
+    // No flush handler: with g_flush_interval_ms at 0 loguru calls it after
+    // every message, which would make each one wait for the disk again
+    loguru::add_callback(CALLBACK_ID, on_loguru_message, nullptr, verbosity);
+    static bool stop_at_exit = (std::atexit(stop), true);
+    (void)stop_at_exit;
+    return true;
+}
+
+void stop() {
+    State& s = state();
+    if (!s.writer.joinable()) return;
+    loguru::remove_callback(CALLBACK_ID);
+    detail::active.store(false);
+    {
+        std::lock_guard<std::mutex> lk(s.mutex);
+        s.stopping = true;
+    }
+    s.wake.notify_one();
+    s.writer.join();
+    if (s.file) fclose(s.file);
+    s.file = nullptr;
+}
+
+void flush() {
+    State& s = state();
+    if (!s.writer.joinable() ||
+        s.writer.get_id() == std::this_thread::get_id()) {
+        return;
+    }
+    size_t target = s.enqueue_pos.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lk(s.mutex);
+    s.woken = true;
+    s.wake.notify_one();
+    // Bounded, a producer that claimed a slot and never published it
+    // would otherwise hold us forever
+    s.written.wait_for(lk, FLUSH_TIMEOUT,
+                       [&s, target] { return s.written_pos >= target; });
+}
+
+uint64_t dropped() { return state().dropped.load(std::memory_order_relaxed); }
+}  // namespace AsyncLog
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include "loguru.hpp"
+
+// Log file writer that keeps file I/O off the logging thread. Messages go
+// into a fixed ring of slots that producers claim without locking, and a
+// writer thread formats them and appends them to the file in batches,
+// rotating it by size. When the ring is full messages are dropped and
+// counted instead of blocking the caller.
+//
+// Once started every loguru message is routed through the ring in place of
+// loguru::add_file. Hot paths can use ASYNC_LOG_F, which skips loguru
+// altogether and only copies its arguments: formatting happens on the
+// writer thread.
+namespace AsyncLog
+{
+	struct Options
+	{
+		bool append = false;
+		// The file is moved to <path>.1 (and older ones up to .keep) when it
+		// grows past max_bytes, 0 never rotates
+		uint64_t max_bytes = 8 * 1024 * 1024;
+		int keep = 2;
+		size_t slots = 4096; // rounded up to a power of two
+	};
+
+	// Opens path and starts the writer. loguru messages up to verbosity are
+	// written to it from then on. Stops by itself at exit.
+	bool start(const std::filesystem::path& path, const Options& options = {},
+	           loguru::Verbosity verbosity = loguru::Verbosity_MAX);
+	// Writes out everything queued and closes the file
+	void stop();
+	// Blocks until everything queued so far is in the file
+	void flush();
+	// Messages lost to a full ring since start
+	uint64_t dropped();
+
+	namespace detail
+	{
+		constexpr size_t PAYLOAD = 192;
+
+		using Render = void (*)(std::string& out, const char* format, const uint8_t* payload);
+
+		struct Record
+		{
+			std::atomic<size_t> sequence;
+			int64_t time_us;
+			uint32_t thread;
+			loguru::Verbosity verbosity;
+			const char* file;
+			unsigned line;
+			// ASYNC_LOG_F: the format literal and how to apply it to payload.
+			// Otherwise payload or heap holds the finished text.
+			const char* format;
+			Render render;
+			std::string* heap;
+			uint32_t size;
+			uint8_t payload[PAYLOAD];
+		};
+
+		extern std::atomic<bool> active;
+
+		// nullptr if the ring is full
+		Record* claim(loguru::Verbosity verbosity, const char* file, unsigned line);
+		void publish(Record* record);
+		void format(std::string& out, const char* format, ...);
+
+		// Arguments are stored as the type printf will read them as
+		template <typename T>
+		struct Stored
+		{
+			static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value ||
+			              std::is_pointer<T>::value,
+			              "ASYNC_LOG_F takes numbers, pointers and strings");
+			using type = T;
+		};
+		template <> struct Stored<char*> { using type = const char*; };
+		template <> struct Stored<const char*> { using type = const char*; };
+		template <> struct Stored<std::string> { using type = const char*; };
+
+		template <typename T>
+		using stored_t = typename Stored<std::decay_t<T>>::type;
+
+		inline bool encode_string(uint8_t*& p, const uint8_t* end, const char* s, size_t size)
+		{
+			if ((size_t)(end - p) < sizeof(uint32_t) + size + 1) return false;
+			uint32_t length = (uint32_t)size;
+			memcpy(p, &length, sizeof(length));
+			memcpy(p + sizeof(length), s, size);
+			p[sizeof(length) + size] = '\0';
+			p += sizeof(length) + size + 1;
+			return true;
+		}
+
+		template <typename T>
+		bool encode(uint8_t*& p, const uint8_t* end, const T& value)
+		{
+			using S = stored_t<T>;
+			if constexpr (std::is_same<std::decay_t<T>, std::string>::value) {
+				return encode_string(p, end, value.data(), value.size());
+			} else if constexpr (std::is_same<S, const char*>::value) {
+				const char* s = value ? (const char*)value : "(null)";
+				return encode_string(p, end, s, strlen(s));
+			} else {
+				if ((size_t)(end - p) < sizeof(S)) return false;
+				S stored = (S)value;
+				memcpy(p, &stored, sizeof(stored));
+				p += sizeof(stored);
+				return true;
+			}
+		}
+
+		template <typename T>
+		stored_t<T> decode(const uint8_t*& p)
+		{
+			using S = stored_t<T>;
+			if constexpr (std::is_same<S, const char*>::value) {
+				uint32_t length;
+				memcpy(&length, p, sizeof(length));
+				const char* s = (const char*)p + sizeof(length);
+				p += sizeof(length) + length + 1;
+				return s;
+			} else {
+				S value;
+				memcpy(&value, p, sizeof(value));
+				p += sizeof(value);
+				return value;
+			}
+		}
+
+		template <typename... Args>
+		void render(std::string& out, const char* format, const uint8_t* payload)
+		{
+			// Braced initialization decodes the arguments in order
+			const uint8_t* p = payload;
+			(void)p;
+			std::tuple<stored_t<Args>...> values{decode<Args>(p)...};
+			std::apply([&](auto... v) { detail::format(out, format, v...); }, values);
+		}
+
+		template <typename T>
+		auto plain(const T& value)
+		{
+			if constexpr (std::is_same<std::decay_t<T>, std::string>::value) {
+				return value.c_str();
+			} else {
+				return (stored_t<T>)value;
+			}
+		}
+	}
+
+	// format must be a string literal, it is read after the call returns
+	template <typename... Args>
+	void write(loguru::Verbosity verbosity, const char* file, unsigned line,
+	           const char* format, const Args&... args)
+	{
+		if (!detail::active.load(std::memory_order_relaxed)) {
+			std::string text;
+			detail::format(text, format, detail::plain(args)...);
+			loguru::log(verbosity, file, line, "%s", text.c_str());
+			return;
+		}
+		detail::Record* record = detail::claim(verbosity, file, line);
+		if (!record) return;
+
+		uint8_t* p = record->payload;
+		const uint8_t* end = p + detail::PAYLOAD;
+		if ((detail::encode(p, end, args) && ...)) {
+			record->format = format;
+			record->render = &detail::render<Args...>;
+			record->size = (uint32_t)(p - record->payload);
+		} else {
+			// Too long to copy, pay for formatting here
+			record->heap = new std::string();
+			detail::format(*record->heap, format, detail::plain(args)...);
+		}
+		detail::publish(record);
+	}
+}
+
+#define ASYNC_LOG_F(verbosity_name, ...)                                          \
+	((loguru::Verbosity_##verbosity_name) > loguru::current_verbosity_cutoff())   \
+		? (void)0                                                                 \
+		: AsyncLog::write(loguru::Verbosity_##verbosity_name, __FILE__, __LINE__, \
+		                  __VA_ARGS__)
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cpr/cpr.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+// Longest libcurl goes without calling the progress callback, which is when
+// it is on a connection that has stalled
+inline constexpr std::chrono::milliseconds CURL_PROGRESS_INTERVAL(1000);
+
+// Shared cancellation flag for outbound transfers and long running jobs.
+// Copies refer to the same flag.
+class CancelToken
+{
+	std::shared_ptr<std::atomic<bool>> flag;
+public:
+	CancelToken() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+	void cancel() const { flag->store(true); }
+	bool cancelled() const { return flag->load(); }
+	// For code that takes a plain flag (LogScanner, migrate_log_schema),
+	// valid while a copy of the token is alive
+	const std::atomic<bool>* get() const { return flag.get(); }
+
+	// Pass to cpr::Get/Post, libcurl aborts the transfer at its next progress
+	// tick once cancelled (up to CURL_PROGRESS_INTERVAL on a stalled connection)
+	cpr::ProgressCallback progress() const
+	{
+		return cpr::ProgressCallback([flag = flag](auto&&...) { return !flag->load(); });
+	}
+};
+
+// Waits for ft (a future or shared_future), or returns nullopt if token was
+// cancelled. A cancelled transfer is still waited for until libcurl aborts
+// it at its next progress tick: nothing may run module code after the
+// owner, or on shutdown the module itself, is gone.
+template<typename Future>
+auto wait_unless_cancelled(Future& ft, const CancelToken& token)
+	-> std::optional<std::decay_t<decltype(ft.get())>>
+{
+	ft.wait();
+	if (token.cancelled()) {
+		return std::nullopt;
+	}
+	return ft.get();
+}
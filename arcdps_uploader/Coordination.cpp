@@ -0,0 +1,329 @@
+#include "Coordination.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <nlohmann/json.hpp>
+#include <random>
+
+#include "EvtcReader.h"
+#include "Metrics.h"
+#include "Routing.h"
+#include "loguru.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+// CBTS_LOGSTART is among the first events arcdps writes
+constexpr uint64_t LOGSTART_SEARCH = 4096;
+constexpr int32_t REQUEST_TIMEOUT_MS = 5000;
+constexpr auto EXPIRY_INTERVAL = std::chrono::minutes(1);
+
+std::string hex(uint64_t value) {
+    char text[17];
+    snprintf(text, sizeof(text), "%016" PRIx64, value);
+    return text;
+}
+
+Coordination::Claim failed(std::string error) {
+    Coordination::Claim claim;
+    claim.status = Coordination::Status::FAILED;
+    claim.error = std::move(error);
+    return claim;
+}
+
+Coordination::Claim post(const std::string& url, const char* route,
+                         const json& body, const CancelToken& cancel) {
+    std::string payload = body.dump();
+    Metrics::Timer timer;
+    cpr::Response response = cpr::Post(
+        cpr::Url{url + route},
+        cpr::Header{{"Content-Type", "application/json"}},
+        cpr::Body{payload}, cpr::Timeout{REQUEST_TIMEOUT_MS},
+        cancel.progress());
+    Metrics::observe_http(std::string("coordination") + route,
+                          (int)response.status_code, timer.seconds(),
+                          payload.size());
+    if (response.status_code == 0) {
+        return failed(response.error.message);
+    }
+    Coordination::Claim claim = Coordination::claim_from_json(response.text);
+    if (response.status_code != 200 &&
+        claim.status != Coordination::Status::FAILED) {
+        return failed("HTTP " + std::to_string(response.status_code));
+    }
+    return claim;
+}
+}  // namespace
+
+std::optional<FightFingerprint> FightFingerprint::read(EvtcReader& reader) {
+    FightFingerprint fingerprint;
+    fingerprint.boss_id = reader.header().boss_id;
+
+    std::vector<std::string> accounts;
+    EvtcSpan<EvtcAgent> agents = reader.agents();
+    for (size_t i = 0; i < agents.size(); ++i) {
+        EvtcAgent agent = agents[i];
+        if (agent.is_elite == EVTC_NPC_ELITE) continue;
+        // "character\0:account.1234\0subgroup\0"
+        size_t character = strnlen(agent.name, sizeof(agent.name));
+        if (character + 1 >= sizeof(agent.name)) continue;
+        const char* account = agent.name + character + 1;
+        size_t length = strnlen(account, sizeof(agent.name) - character - 1);
+        if (length > 0 && account[0] == ':') {
+            ++account;
+            --length;
+        }
+        if (length > 0) accounts.emplace_back(account, length);
+    }
+    if (accounts.empty()) return std::nullopt;
+    fingerprint.squad_hash = squad_hash_of(std::move(accounts));
+
+    uint64_t searched = 0;
+    while (searched < LOGSTART_SEARCH) {
+        EvtcSpan<cbtevent> events = reader.next_events();
+        if (events.empty()) break;
+        for (size_t i = 0; i < events.size() && searched < LOGSTART_SEARCH;
+             ++i, ++searched) {
+            cbtevent event = events[i];
+            if (event.is_statechange == CBTS_LOGSTART) {
+                fingerprint.server_start = (uint32_t)event.value;
+                return fingerprint;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<FightFingerprint> FightFingerprint::read(
+    const std::filesystem::path& path) {
+    // Only the start of the log is needed, keep the window small
+    EvtcReader reader;
+    if (!reader.open(path, 64 * 1024)) return std::nullopt;
+    return read(reader);
+}
+
+uint64_t FightFingerprint::squad_hash_of(std::vector<std::string> accounts) {
+    for (std::string& account : accounts) {
+        account = RouteRule::normalize_account(std::move(account));
+    }
+    std::sort(accounts.begin(), accounts.end());
+    accounts.erase(std::unique(accounts.begin(), accounts.end()),
+                   accounts.end());
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const std::string& account : accounts) {
+        // The terminator keeps "ab","c" apart from "a","bc"
+        for (size_t i = 0; i <= account.size(); ++i) {
+            hash ^= (uint8_t)account.c_str()[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+const char* Coordination::status_name(Status status) {
+    switch (status) {
+        case Status::CLAIMED:
+            return "claimed";
+        case Status::TAKEN:
+            return "taken";
+        case Status::OPEN:
+            return "open";
+        case Status::DONE:
+            return "done";
+        default:
+            return "failed";
+    }
+}
+
+std::string Coordination::to_json(const Claim& claim) {
+    json j;
+    j["status"] = status_name(claim.status);
+    if (!claim.fight.empty()) j["fight"] = claim.fight;
+    if (!claim.owner.empty()) j["owner"] = claim.owner;
+    if (claim.status == Status::DONE) {
+        j["permalink"] = claim.permalink;
+        j["boss_name"] = claim.boss_name;
+        j["success"] = claim.success;
+    }
+    if (!claim.error.empty()) j["error"] = claim.error;
+    return j.dump();
+}
+
+Coordination::Claim Coordination::claim_from_json(const std::string& text) {
+    json j = json::parse(text, nullptr, false);
+    if (!j.is_object()) return failed("Invalid response");
+    Claim claim;
+    std::string status = j.value("status", "");
+    for (Status s : {Status::CLAIMED, Status::TAKEN, Status::OPEN,
+                     Status::DONE, Status::FAILED}) {
+        if (status == status_name(s)) claim.status = s;
+    }
+    claim.fight = j.value("fight", "");
+    claim.owner = j.value("owner", "");
+    claim.permalink = j.value("permalink", "");
+    claim.boss_name = j.value("boss_name", "");
+    claim.success = j.value("success", false);
+    claim.error = j.value("error", "");
+    if (claim.status == Status::FAILED && claim.error.empty()) {
+        claim.error = "Unknown status \"" + status + "\"";
+    }
+    return claim;
+}
+
+std::string Coordination::new_client_id() {
+    std::random_device random;
+    return hex((uint64_t)random() << 32 | random());
+}
+
+Coordination::Claim Coordination::claim(const std::string& url,
+                                        const std::string& client,
+                                        const FightFingerprint& fingerprint,
+                                        const CancelToken& cancel) {
+    return post(url, "/claim",
+                {{"boss_id", fingerprint.boss_id},
+                 {"server_start", fingerprint.server_start},
+                 {"squad", hex(fingerprint.squad_hash)},
+                 {"client", client}},
+                cancel);
+}
+
+Coordination::Claim Coordination::complete(
+    const std::string& url, const std::string& client,
+    const std::string& fight, const std::string& permalink,
+    const std::string& boss_name, bool success, const CancelToken& cancel) {
+    return post(url, "/complete",
+                {{"fight", fight},
+                 {"client", client},
+                 {"permalink", permalink},
+                 {"boss_name", boss_name},
+                 {"success", success}},
+                cancel);
+}
+
+Coordination::Claim Coordination::release(const std::string& url,
+                                          const std::string& client,
+                                          const std::string& fight,
+                                          const CancelToken& cancel) {
+    return post(url, "/release", {{"fight", fight}, {"client", client}},
+                cancel);
+}
+
+Coordination::Claim Coordination::Registry::answer(const Fight& fight,
+                                                   Status status) const {
+    Claim claim;
+    claim.status = status;
+    claim.fight = fight.id;
+    claim.owner = fight.owner;
+    if (fight.done) {
+        claim.permalink = fight.permalink;
+        claim.boss_name = fight.boss_name;
+        claim.success = fight.success;
+    }
+    return claim;
+}
+
+void Coordination::Registry::expire(Clock::time_point now) {
+    if (now < next_expiry) return;
+    next_expiry = now + EXPIRY_INTERVAL;
+    for (auto it = by_start.begin(); it != by_start.end();) {
+        auto fight = fights.find(it->second);
+        if (now - fight->second.first_claimed > options.retention) {
+            fights.erase(fight);
+            it = by_start.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+Coordination::Claim Coordination::Registry::claim(
+    const FightFingerprint& fingerprint, const std::string& client,
+    Clock::time_point now) {
+    std::lock_guard<std::mutex> lk(mutex);
+    expire(now);
+
+    // Closest start time within the tolerance
+    Fight* fight = nullptr;
+    uint32_t closest = UINT32_MAX;
+    uint32_t start = fingerprint.server_start;
+    uint32_t from = start > options.start_tolerance
+                        ? start - options.start_tolerance
+                        : 0;
+    uint32_t to = UINT32_MAX - start > options.start_tolerance
+                      ? start + options.start_tolerance
+                      : UINT32_MAX;
+    for (auto it = by_start.lower_bound(std::make_tuple(
+             fingerprint.boss_id, fingerprint.squad_hash, from));
+         it != by_start.end() &&
+         it->first <= std::make_tuple(fingerprint.boss_id,
+                                      fingerprint.squad_hash, to);
+         ++it) {
+        uint32_t other = std::get<2>(it->first);
+        uint32_t distance = other > start ? other - start : start - other;
+        if (distance < closest) {
+            fight = &fights.at(it->second);
+            closest = distance;
+        }
+    }
+
+    if (!fight) {
+        Fight created;
+        created.id = std::to_string(fingerprint.boss_id) + "-" +
+                     std::to_string(fingerprint.server_start) + "-" +
+                     std::to_string(++next_id);
+        created.fingerprint = fingerprint;
+        created.owner = client;
+        created.lease_until = now + options.lease;
+        created.first_claimed = now;
+        by_start.emplace(std::make_tuple(fingerprint.boss_id,
+                                         fingerprint.squad_hash, start),
+                         created.id);
+        fight = &fights.emplace(created.id, std::move(created)).first->second;
+        return answer(*fight, Status::CLAIMED);
+    }
+    if (fight->done) return answer(*fight, Status::DONE);
+    // A retry from the owner renews the lease, an expired one is up for grabs
+    if (fight->owner == client || fight->owner.empty() ||
+        now >= fight->lease_until) {
+        fight->owner = client;
+        fight->lease_until = now + options.lease;
+        return answer(*fight, Status::CLAIMED);
+    }
+    return answer(*fight, Status::TAKEN);
+}
+
+Coordination::Claim Coordination::Registry::complete(
+    const std::string& fight_id, const std::string& client,
+    const std::string& permalink, const std::string& boss_name, bool success) {
+    std::lock_guard<std::mutex> lk(mutex);
+    auto it = fights.find(fight_id);
+    if (it == fights.end()) return failed("Unknown fight");
+    Fight& fight = it->second;
+    // The first permalink stands, even from an owner whose lease ran out
+    if (!fight.done) {
+        fight.done = true;
+        fight.owner = client;
+        fight.permalink = permalink;
+        fight.boss_name = boss_name;
+        fight.success = success;
+    }
+    return answer(fight, Status::DONE);
+}
+
+Coordination::Claim Coordination::Registry::release(
+    const std::string& fight_id, const std::string& client) {
+    std::lock_guard<std::mutex> lk(mutex);
+    auto it = fights.find(fight_id);
+    if (it == fights.end()) return failed("Unknown fight");
+    Fight& fight = it->second;
+    if (fight.done) return answer(fight, Status::DONE);
+    if (fight.owner == client) fight.owner.clear();
+    return answer(fight, fight.owner.empty() ? Status::OPEN : Status::TAKEN);
+}
+
+size_t Coordination::Registry::size() const {
+    std::lock_guard<std::mutex> lk(mutex);
+    return fights.size();
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "CancelToken.h"
+
+class EvtcReader;
+
+// Identifies one fight across the logs every squad member records of it
+struct FightFingerprint
+{
+	uint16_t boss_id = 0;
+	uint32_t server_start = 0; // CBTS_LOGSTART value, server unix time
+	uint64_t squad_hash = 0; // FNV-1a of the sorted, lower case account names
+
+	// From the header, the player agents and the first events. nullopt if
+	// the log has no players or no CBTS_LOGSTART.
+	static std::optional<FightFingerprint> read(EvtcReader& reader);
+	static std::optional<FightFingerprint> read(const std::filesystem::path& path);
+	static uint64_t squad_hash_of(std::vector<std::string> accounts);
+};
+
+// Keeps a squad from uploading the same fight once per member. Clients
+// claim a fight by its fingerprint before uploading; the first claim wins,
+// everyone else is told who has it and asks again later until the winner
+// has published the permalink. A claim whose owner goes quiet expires, so a
+// crashed client costs a delay and never the upload.
+//
+// The protocol is JSON over HTTP:
+//   POST /claim     {boss_id, server_start, squad, client}
+//   POST /complete  {fight, client, permalink, boss_name, success}
+//   POST /release   {fight, client}
+// each answered with a Claim. CoordinationServer is the reference server.
+namespace Coordination
+{
+	// OPEN: nobody holds the fight, its owner released it
+	enum class Status { CLAIMED, TAKEN, OPEN, DONE, FAILED };
+
+	struct Claim
+	{
+		Status status = Status::FAILED;
+		std::string fight;
+		std::string owner; // client holding the claim
+		// Set once DONE
+		std::string permalink;
+		std::string boss_name;
+		bool success = false;
+		std::string error; // FAILED only
+	};
+
+	const char* status_name(Status status);
+	std::string to_json(const Claim& claim);
+	Claim claim_from_json(const std::string& text);
+
+	// A random id for settings that have none yet
+	std::string new_client_id();
+
+	// Requests to the server at url. Any failure to reach it comes back as
+	// FAILED, callers then upload as if there were no coordination.
+	Claim claim(const std::string& url, const std::string& client,
+		const FightFingerprint& fingerprint, const CancelToken& cancel);
+	Claim complete(const std::string& url, const std::string& client, const std::string& fight,
+		const std::string& permalink, const std::string& boss_name, bool success,
+		const CancelToken& cancel);
+	Claim release(const std::string& url, const std::string& client, const std::string& fight,
+		const CancelToken& cancel);
+
+	// Server side state: fights by fingerprint, who holds each and what was
+	// published for it. Fingerprints of the same boss and squad whose start
+	// times are within start_tolerance are the same fight, members' logs
+	// start when their own client sees combat. Thread safe.
+	class Registry
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct Options
+		{
+			// How long a claim holds without being completed
+			std::chrono::seconds lease{180};
+			uint32_t start_tolerance = 15; // seconds
+			// Fights are forgotten this long after they were first claimed
+			std::chrono::seconds retention{6 * 60 * 60};
+		};
+
+		Registry() : Registry(Options{}) {}
+		explicit Registry(Options options) : options(options) {}
+
+		Claim claim(const FightFingerprint& fingerprint, const std::string& client,
+			Clock::time_point now = Clock::now());
+		Claim complete(const std::string& fight, const std::string& client,
+			const std::string& permalink, const std::string& boss_name, bool success);
+		Claim release(const std::string& fight, const std::string& client);
+
+		size_t size() const;
+
+	private:
+		struct Fight
+		{
+			std::string id;
+			FightFingerprint fingerprint;
+			std::string owner; // empty once released
+			Clock::time_point lease_until;
+			Clock::time_point first_claimed;
+			bool done = false;
+			std::string permalink;
+			std::string boss_name;
+			bool success = false;
+		};
+
+		Options options;
+		mutable std::mutex mutex;
+		std::map<std::string, Fight> fights;
+		// (boss, squad, start) to fight, so a claim looks at just the fights
+		// its tolerance reaches
+		std::multimap<std::tuple<uint16_t, uint64_t, uint32_t>, std::string> by_start;
+		uint64_t next_id = 0;
+		Clock::time_point next_expiry;
+
+		Claim answer(const Fight& fight, Status status) const;
+		void expire(Clock::time_point now);
+	};
+}
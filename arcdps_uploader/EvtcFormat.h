@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+#include "arcdps_defs.h"
+
+// On-disk layout of an arcdps .evtc log: header, uint32 agent count and
+// agents, uint32 skill count and skills, then cbtevent records (revision 1)
+// up to the end of the file. A .zevtc is the same bytes in a one entry zip.
+#pragma pack(push, 1)
+struct EvtcHeader
+{
+	char magic[4]; // "EVTC"
+	char build[8]; // arcdps build date, e.g. "20240101"
+	uint8_t revision;
+	uint16_t boss_id;
+	uint8_t unused;
+};
+
+struct EvtcAgent
+{
+	uint64_t addr;
+	uint32_t prof;     // players: profession, NPCs: species id, gadgets: 0xffff0000 | id
+	uint32_t is_elite; // players: elite spec, NPCs and gadgets: 0xffffffff
+	int16_t toughness;
+	int16_t concentration;
+	int16_t healing;
+	int16_t hitbox_width;
+	int16_t condition;
+	int16_t hitbox_height;
+	// players: "character\0:account.1234\0subgroup\0"
+	char name[64];
+	uint32_t pad;
+};
+
+struct EvtcSkill
+{
+	int32_t id;
+	char name[64];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(EvtcHeader) == 16, "EVTC header is 16 bytes");
+static_assert(sizeof(EvtcAgent) == 96, "EVTC agent is 96 bytes");
+static_assert(sizeof(EvtcSkill) == 68, "EVTC skill is 68 bytes");
+static_assert(sizeof(cbtevent) == 64, "revision 1 events are 64 bytes");
+
+constexpr uint32_t EVTC_NPC_ELITE = 0xffffffff;
+// src_agent of CBTS_LOGSTART/CBTS_LOGEND
+constexpr uint64_t EVTC_ARCDPS_ID = 0x637261;
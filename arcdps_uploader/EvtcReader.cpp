@@ -0,0 +1,344 @@
+#include "EvtcReader.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+// A corrupt count fails the log instead of allocating gigabytes
+constexpr uint32_t MAX_AGENTS = 1 << 18;
+constexpr uint32_t MAX_SKILLS = 1 << 18;
+constexpr size_t INPUT_CHUNK = 64 * 1024;
+// zlib's inflate state and its 32K history window
+constexpr size_t INFLATE_STATE = 40 * 1024;
+constexpr uint32_t ZIP_LOCAL_HEADER = 0x04034b50;
+
+template <typename T>
+T read(const uint8_t* p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+}  // namespace
+
+struct EvtcReader::Mapping {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE map = nullptr;
+
+    bool map_file(const fs::path& path, std::string& error) {
+        file = CreateFileW(path.c_str(), GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE |
+                               FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                           nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = "Failed to open log";
+            return false;
+        }
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+            error = "Log is empty";
+            return false;
+        }
+        map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (map) data = (const uint8_t*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+        if (!data) {
+            error = "Failed to map log";
+            return false;
+        }
+        size = (size_t)length.QuadPart;
+        return true;
+    }
+
+    ~Mapping() {
+        if (data) UnmapViewOfFile(data);
+        if (map) CloseHandle(map);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+#else
+    bool map_file(const fs::path& path, std::string& error) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = "Failed to open log";
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            error = "Log is empty";
+            return false;
+        }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            error = "Failed to map log";
+            return false;
+        }
+        madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+        data = (const uint8_t*)p;
+        size = (size_t)st.st_size;
+        return true;
+    }
+
+    ~Mapping() {
+        if (data) munmap((void*)data, size);
+    }
+#endif
+};
+
+// The single entry of a .zevtc, inflated on demand
+struct EvtcReader::Stream {
+    std::ifstream file;
+    std::vector<uint8_t> input;
+    z_stream zs = {};
+    bool inflating = false;
+    // Stored (method 0) entries are copied through, up to remaining bytes
+    bool stored = false;
+    uint64_t remaining = 0;
+    bool finished = false;
+    bool failed = false;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint64_t inflated = 0;
+
+    ~Stream() {
+        if (inflating) inflateEnd(&zs);
+    }
+
+    bool start(const fs::path& path, std::string& error) {
+        file.open(path, std::ios::binary);
+        if (!file) {
+            error = "Failed to open log";
+            return false;
+        }
+        uint8_t local[30];
+        file.read((char*)local, sizeof(local));
+        if (file.gcount() != sizeof(local) ||
+            read<uint32_t>(local) != ZIP_LOCAL_HEADER) {
+            error = "Not a zip archive";
+            return false;
+        }
+        uint16_t method = read<uint16_t>(local + 8);
+        uint16_t name_length = read<uint16_t>(local + 26);
+        uint16_t extra_length = read<uint16_t>(local + 28);
+        file.seekg(name_length + extra_length, std::ios::cur);
+
+        if (method == 0) {
+            stored = true;
+            remaining = read<uint32_t>(local + 18);
+            return true;
+        }
+        if (method != 8) {
+            error = "Unsupported zip compression method " + std::to_string(method);
+            return false;
+        }
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            error = "Failed to start inflate";
+            return false;
+        }
+        inflating = true;
+        input.resize(INPUT_CHUNK);
+        return true;
+    }
+
+    // Fills out with up to size bytes of the log, fewer only at the end of
+    // the entry or when the archive is damaged
+    size_t read_some(uint8_t* out, size_t size) {
+        size_t produced = 0;
+        if (stored) {
+            size_t want = (size_t)(std::min)((uint64_t)size, remaining);
+            file.read((char*)out, (std::streamsize)want);
+            produced = (size_t)file.gcount();
+            remaining -= produced;
+            finished = remaining == 0;
+            failed = produced < want;
+            account(out, produced);
+            return produced;
+        }
+
+        zs.next_out = out;
+        zs.avail_out = (uInt)size;
+        while (zs.avail_out > 0 && !finished && !failed) {
+            if (zs.avail_in == 0) {
+                file.read((char*)input.data(), (std::streamsize)input.size());
+                zs.next_in = input.data();
+                zs.avail_in = (uInt)file.gcount();
+                if (zs.avail_in == 0) {
+                    failed = true;
+                    break;
+                }
+            }
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                finished = true;
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                failed = true;
+            }
+        }
+        produced = size - zs.avail_out;
+        account(out, produced);
+        return produced;
+    }
+
+    void account(const uint8_t* data, size_t size) {
+        crc = crc32(crc, data, (uInt)size);
+        inflated += size;
+    }
+};
+
+EvtcReader::EvtcReader() = default;
+EvtcReader::~EvtcReader() = default;
+
+void EvtcReader::reset() {
+    log_mode = Mode::MEMORY;
+    error_message.clear();
+    base = nullptr;
+    base_size = 0;
+    prefix.clear();
+    agent_span = {};
+    skill_span = {};
+    events_at = 0;
+    event_count = 0;
+    exhausted = false;
+    mapping.reset();
+    stream.reset();
+    window.clear();
+    carry = 0;
+    carry_at = 0;
+}
+
+bool EvtcReader::fail(std::string message) {
+    error_message = std::move(message);
+    exhausted = true;
+    return false;
+}
+
+bool EvtcReader::open(const fs::path& path, size_t window_bytes) {
+    reset();
+    std::string error;
+    if (path.extension() == ".zevtc") {
+        log_mode = Mode::STREAM;
+        stream = std::make_unique<Stream>();
+        if (!stream->start(path, error)) return fail(error);
+        size_t events = (std::max)(window_bytes / sizeof(cbtevent), (size_t)1);
+        window.resize(events * sizeof(cbtevent));
+        return parse_prefix();
+    }
+
+    log_mode = Mode::MAPPED;
+    mapping = std::make_unique<Mapping>();
+    if (!mapping->map_file(path, error)) return fail(error);
+    base = mapping->data;
+    base_size = mapping->size;
+    return parse_prefix();
+}
+
+bool EvtcReader::open_memory(const uint8_t* data, size_t size) {
+    reset();
+    base = data;
+    base_size = size;
+    return parse_prefix();
+}
+
+bool EvtcReader::fill(size_t bytes) {
+    if (!stream) return bytes <= base_size;
+    size_t have = prefix.size();
+    if (bytes > have) {
+        prefix.resize(bytes);
+        size_t got = stream->read_some(prefix.data() + have, bytes - have);
+        prefix.resize(have + got);
+    }
+    base = prefix.data();
+    base_size = prefix.size();
+    return bytes <= base_size;
+}
+
+bool EvtcReader::parse_prefix() {
+    const size_t agents_at = sizeof(EvtcHeader) + 4;
+    if (!fill(agents_at)) return fail("Log is too short");
+    EvtcHeader h = read<EvtcHeader>(base);
+    if (memcmp(h.magic, "EVTC", 4) != 0) return fail("Not an EVTC log");
+    // Revision 0 events have a different layout
+    if (h.revision != 1) {
+        return fail("Unsupported EVTC revision " + std::to_string(h.revision));
+    }
+
+    uint32_t agent_count = read<uint32_t>(base + sizeof(EvtcHeader));
+    if (agent_count > MAX_AGENTS) return fail("Corrupt agent count");
+    size_t skills_at = agents_at + (size_t)agent_count * sizeof(EvtcAgent);
+    if (!fill(skills_at + 4)) return fail("Log ends inside the agent table");
+
+    uint32_t skill_count = read<uint32_t>(base + skills_at);
+    if (skill_count > MAX_SKILLS) return fail("Corrupt skill count");
+    events_at = skills_at + 4 + (size_t)skill_count * sizeof(EvtcSkill);
+    if (!fill(events_at)) return fail("Log ends inside the skill table");
+
+    agent_span = EvtcSpan<EvtcAgent>(base + agents_at, agent_count);
+    skill_span = EvtcSpan<EvtcSkill>(base + skills_at + 4, skill_count);
+    return true;
+}
+
+EvtcHeader EvtcReader::header() const {
+    EvtcHeader h = {};
+    if (base && base_size >= sizeof(h)) h = read<EvtcHeader>(base);
+    return h;
+}
+
+EvtcSpan<cbtevent> EvtcReader::next_events() {
+    if (exhausted) return {};
+
+    if (!stream) {
+        exhausted = true;
+        size_t count = (base_size - events_at) / sizeof(cbtevent);
+        event_count += count;
+        return EvtcSpan<cbtevent>(base + events_at, count);
+    }
+
+    // The caller is done with the previous window, keep only its tail
+    if (carry) memmove(window.data(), window.data() + carry_at, carry);
+    size_t total =
+        carry + stream->read_some(window.data() + carry, window.size() - carry);
+    size_t count = total / sizeof(cbtevent);
+    carry_at = count * sizeof(cbtevent);
+    carry = total - carry_at;
+
+    if (stream->failed) {
+        fail("Log is truncated or damaged");
+    } else if (count == 0) {
+        // A partial event at the very end, arcdps died mid write, is dropped
+        exhausted = true;
+    }
+    event_count += count;
+    return EvtcSpan<cbtevent>(window.data(), count);
+}
+
+uint32_t EvtcReader::crc() const {
+    return stream ? (uint32_t)stream->crc : 0;
+}
+
+uint64_t EvtcReader::inflated_bytes() const {
+    return stream ? stream->inflated : 0;
+}
+
+size_t EvtcReader::memory_usage() const {
+    size_t bytes = prefix.capacity() + window.capacity();
+    if (stream) bytes += stream->input.capacity() + INFLATE_STATE;
+    return bytes;
+}
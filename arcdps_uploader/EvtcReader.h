@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EvtcFormat.h"
+
+// Records of T stored back to back in a log. Views the reader's memory
+// directly; records are only copied out one at a time by operator[], since
+// events after the skill table are not necessarily aligned.
+template <typename T>
+class EvtcSpan
+{
+	const uint8_t* ptr = nullptr;
+	size_t count = 0;
+public:
+	EvtcSpan() = default;
+	EvtcSpan(const uint8_t* data, size_t count) : ptr(data), count(count) {}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	const uint8_t* bytes() const { return ptr; }
+	size_t size_bytes() const { return count * sizeof(T); }
+
+	T operator[](size_t i) const
+	{
+		T value;
+		memcpy(&value, ptr + i * sizeof(T), sizeof(T));
+		return value;
+	}
+};
+
+// Reads an arcdps log without loading all of it. A .evtc is memory mapped
+// and its events come back as a single span; a .zevtc is inflated through
+// a fixed window, so events come back a window at a time and memory stays
+// flat however long the fight was. Header, agents and skills are always
+// available once open() succeeds.
+class EvtcReader
+{
+public:
+	enum class Mode { MEMORY, MAPPED, STREAM };
+
+	EvtcReader();
+	~EvtcReader();
+	EvtcReader(const EvtcReader&) = delete;
+	EvtcReader& operator=(const EvtcReader&) = delete;
+
+	// .zevtc is streamed with a window of about window_bytes, anything
+	// else is mapped. Returns false with error() set if the log can't be read.
+	bool open(const std::filesystem::path& path, size_t window_bytes = 1024 * 1024);
+	// An uncompressed log already in memory, which must outlive the reader
+	bool open_memory(const uint8_t* data, size_t size);
+
+	Mode mode() const { return log_mode; }
+	const std::string& error() const { return error_message; }
+
+	EvtcHeader header() const;
+	EvtcSpan<EvtcAgent> agents() const { return agent_span; }
+	EvtcSpan<EvtcSkill> skills() const { return skill_span; }
+
+	// The next run of whole events, empty once the log is exhausted or on
+	// error. A streamed span is only valid until the next call.
+	EvtcSpan<cbtevent> next_events();
+	uint64_t events_read() const { return event_count; }
+	// CRC-32 and count of the bytes inflated so far, 0 unless streaming.
+	// Once every event has been read they cover the whole log.
+	uint32_t crc() const;
+	uint64_t inflated_bytes() const;
+
+	// Heap held for the log: agents and skills of a streamed log plus its
+	// window. Mapped pages belong to the page cache and aren't counted.
+	size_t memory_usage() const;
+
+private:
+	struct Mapping;
+	struct Stream;
+
+	Mode log_mode = Mode::MEMORY;
+	std::string error_message;
+	// Start of the log: the mapping, the caller's buffer or prefix
+	const uint8_t* base = nullptr;
+	size_t base_size = 0;
+	std::vector<uint8_t> prefix;
+	EvtcSpan<EvtcAgent> agent_span;
+	EvtcSpan<EvtcSkill> skill_span;
+	size_t events_at = 0;
+	uint64_t event_count = 0;
+	bool exhausted = false;
+
+	std::unique_ptr<Mapping> mapping;
+	std::unique_ptr<Stream> stream;
+	std::vector<uint8_t> window;
+	// Partial event at the end of the last window, moved to its start
+	size_t carry = 0;
+	size_t carry_at = 0;
+
+	void reset();
+	bool fail(std::string message);
+	bool fill(size_t bytes);
+	bool parse_prefix();
+};
@@ -0,0 +1,281 @@
+#include "EvtcScanner.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "EvtcReader.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EVTC_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define EVTC_TARGET_AVX2
+#else
+#define EVTC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+constexpr size_t EVENT_SIZE = sizeof(cbtevent);
+constexpr size_t STATECHANGE_OFFSET = offsetof(cbtevent, is_statechange);
+static_assert(STATECHANGE_OFFSET == 56, "revision 1 event layout");
+
+// State changes the summary is built from, one bit per cbtstatechange
+constexpr uint32_t WANTED = 1u << CBTS_CHANGEDEAD | 1u << CBTS_HEALTHUPDATE |
+                            1u << CBTS_REWARD;
+// Matches are collected per block of events so the index buffer stays small
+constexpr size_t BLOCK = 4096;
+
+// Events after the skill table are not aligned
+template <typename T>
+T read(const uint8_t* p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+// Each finder writes the indices in [begin, end) of events whose state
+// change is in WANTED to out and returns how many there were. Indices fit
+// in 32 bits because the scan goes BLOCK events at a time.
+using Finder = size_t (*)(const uint8_t*, size_t, size_t, uint32_t*);
+
+size_t find_scalar(const uint8_t* events, size_t begin, size_t end,
+                   uint32_t* out) {
+    size_t found = 0;
+    for (size_t i = begin; i < end; ++i) {
+        uint8_t sc = events[i * EVENT_SIZE + STATECHANGE_OFFSET];
+        out[found] = (uint32_t)i;
+        found += sc < 32 && (WANTED >> sc & 1);
+    }
+    return found;
+}
+
+#ifdef EVTC_SCAN_X86
+inline int lowest_bit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// The 8 bytes from the state change of two neighbouring events
+inline __m128i statechange_pair(const uint8_t* p) {
+    __m128i a = _mm_loadl_epi64((const __m128i*)(p + STATECHANGE_OFFSET));
+    __m128i b = _mm_loadl_epi64(
+        (const __m128i*)(p + EVENT_SIZE + STATECHANGE_OFFSET));
+    return _mm_unpacklo_epi64(a, b);
+}
+
+size_t find_sse2(const uint8_t* events, size_t begin, size_t end,
+                 uint32_t* out) {
+    const __m128i low = _mm_set_epi32(0, 0xff, 0, 0xff);
+    const __m128i dead = _mm_set1_epi8(CBTS_CHANGEDEAD);
+    const __m128i health = _mm_set1_epi8(CBTS_HEALTHUPDATE);
+    const __m128i reward = _mm_set1_epi8(CBTS_REWARD);
+
+    size_t found = 0;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const uint8_t* p = events + i * EVENT_SIZE;
+        __m128i v0 = _mm_and_si128(statechange_pair(p), low);
+        __m128i v1 = _mm_and_si128(statechange_pair(p + 2 * EVENT_SIZE), low);
+        __m128i v2 = _mm_and_si128(statechange_pair(p + 4 * EVENT_SIZE), low);
+        __m128i v3 = _mm_and_si128(statechange_pair(p + 6 * EVENT_SIZE), low);
+        // Byte 2 * k is the state change of event i + k, odd bytes are 0
+        __m128i sc = _mm_packus_epi16(_mm_packs_epi32(v0, v1),
+                                      _mm_packs_epi32(v2, v3));
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(sc, dead), _mm_cmpeq_epi8(sc, health)),
+            _mm_cmpeq_epi8(sc, reward));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit) & 0x5555;
+        while (mask) {
+            out[found++] = (uint32_t)(i + lowest_bit(mask) / 2);
+            mask &= mask - 1;
+        }
+    }
+    return found + find_scalar(events, i, end, out + found);
+}
+
+EVTC_TARGET_AVX2 size_t find_avx2(const uint8_t* events, size_t begin,
+                                  size_t end, uint32_t* out) {
+    // Byte offsets of 8 consecutive events
+    const __m256i offsets =
+        _mm256_setr_epi32(0, 64, 128, 192, 256, 320, 384, 448);
+    const __m256i low = _mm256_set1_epi32(0xff);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i wanted = _mm256_set1_epi32((int)WANTED);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t found = 0;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const int* base =
+            (const int*)(events + i * EVENT_SIZE + STATECHANGE_OFFSET);
+        __m256i sc =
+            _mm256_and_si256(_mm256_i32gather_epi32(base, offsets, 1), low);
+        // 1 << sc is 0 for sc >= 32, so anything outside WANTED drops out
+        __m256i hit = _mm256_and_si256(_mm256_sllv_epi32(one, sc), wanted);
+        unsigned mask = ~(unsigned)_mm256_movemask_ps(
+                            _mm256_castsi256_ps(_mm256_cmpeq_epi32(hit, zero))) &
+                        0xff;
+        while (mask) {
+            out[found++] = (uint32_t)(i + lowest_bit(mask));
+            mask &= mask - 1;
+        }
+    }
+    return found + find_scalar(events, i, end, out + found);
+}
+
+bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = info[2] & (1 << 27);
+    bool avx = info[2] & (1 << 28);
+    // The OS has to save the upper halves of the ymm registers
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+}  // namespace
+
+bool EvtcScanner::supported(Path path) {
+    switch (path) {
+        case Path::SCALAR:
+            return true;
+#ifdef EVTC_SCAN_X86
+        case Path::SSE2:
+            return true;
+        case Path::AVX2: {
+            static const bool avx2 = cpu_has_avx2();
+            return avx2;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+EvtcScanner::Path EvtcScanner::best_path() {
+    if (supported(Path::AVX2)) return Path::AVX2;
+    if (supported(Path::SSE2)) return Path::SSE2;
+    return Path::SCALAR;
+}
+
+const char* EvtcScanner::path_name(Path path) {
+    switch (path) {
+        case Path::SSE2:
+            return "sse2";
+        case Path::AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+EvtcSummary EvtcScanner::scan(const uint8_t* data, size_t size) {
+    return scan(data, size, best_path());
+}
+
+EvtcSummary EvtcScanner::scan(const uint8_t* data, size_t size, Path path) {
+    EvtcReader reader;
+    if (!reader.open_memory(data, size)) return EvtcSummary();
+    return scan(reader, path);
+}
+
+EvtcSummary EvtcScanner::scan(EvtcReader& reader) {
+    return scan(reader, best_path());
+}
+
+EvtcSummary EvtcScanner::scan(EvtcReader& reader, Path path) {
+    EvtcSummary summary;
+    if (!reader.error().empty()) return summary;
+    summary.boss_id = reader.header().boss_id;
+
+    std::vector<uint64_t> players;
+    std::vector<uint64_t> bosses;
+    EvtcSpan<EvtcAgent> agents = reader.agents();
+    for (size_t i = 0; i < agents.size(); ++i) {
+        const uint8_t* agent = agents.bytes() + i * sizeof(EvtcAgent);
+        uint64_t addr = read<uint64_t>(agent + offsetof(EvtcAgent, addr));
+        uint32_t prof = read<uint32_t>(agent + offsetof(EvtcAgent, prof));
+        uint32_t elite = read<uint32_t>(agent + offsetof(EvtcAgent, is_elite));
+        if (elite != EVTC_NPC_ELITE) {
+            players.push_back(addr);
+        } else if (prof == summary.boss_id) {
+            bosses.push_back(addr);
+        }
+    }
+    std::sort(players.begin(), players.end());
+
+    Finder find = find_scalar;
+#ifdef EVTC_SCAN_X86
+    if (path == Path::AVX2 && supported(Path::AVX2)) find = find_avx2;
+    if (path == Path::SSE2) find = find_sse2;
+#endif
+
+    auto is_boss = [&bosses](uint64_t addr) {
+        return std::find(bosses.begin(), bosses.end(), addr) != bosses.end();
+    };
+    bool boss_dead = false;
+    bool reward = false;
+    int64_t first = 0;
+    int64_t last = 0;
+    std::vector<uint32_t> matches(BLOCK);
+    for (EvtcSpan<cbtevent> span = reader.next_events(); !span.empty();
+         span = reader.next_events()) {
+        const uint8_t* events = span.bytes();
+        if (summary.events == 0) first = (int64_t)read<uint64_t>(events);
+        last = (int64_t)read<uint64_t>(events + span.size_bytes() - EVENT_SIZE);
+        summary.events += span.size();
+
+        for (size_t begin = 0; begin < span.size(); begin += BLOCK) {
+            const uint8_t* block = events + begin * EVENT_SIZE;
+            size_t n = find(block, 0, (std::min)(BLOCK, span.size() - begin),
+                            matches.data());
+            for (size_t k = 0; k < n; ++k) {
+                const uint8_t* ev = block + (size_t)matches[k] * EVENT_SIZE;
+                uint64_t src =
+                    read<uint64_t>(ev + offsetof(cbtevent, src_agent));
+                switch (ev[STATECHANGE_OFFSET]) {
+                    case CBTS_CHANGEDEAD:
+                        if (is_boss(src)) {
+                            boss_dead = true;
+                        } else if (std::binary_search(players.begin(),
+                                                      players.end(), src)) {
+                            summary.player_deaths++;
+                        }
+                        break;
+                    case CBTS_HEALTHUPDATE:
+                        if (is_boss(src)) {
+                            summary.boss_health = (int32_t)read<uint64_t>(
+                                ev + offsetof(cbtevent, dst_agent));
+                        }
+                        break;
+                    case CBTS_REWARD:
+                        reward = true;
+                        break;
+                }
+            }
+        }
+    }
+
+    // A streamed log that breaks off part way is not summarised
+    summary.valid = reader.error().empty();
+    summary.duration_ms = (std::max)(last - first, (int64_t)0);
+    summary.kill = boss_dead || reward;
+    return summary;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "EvtcReader.h"
+
+// What a log says about its fight, read straight from the event array
+// without building agent or skill tables. Elite Insights stays the
+// authority; this is for deciding things about a log before it is uploaded.
+struct EvtcSummary
+{
+	bool valid = false; // false if it is not a revision 1 EVTC log or breaks off
+	uint16_t boss_id = 0;
+	bool kill = false; // boss died or a reward chest was handed out
+	int64_t duration_ms = 0; // first to last event
+	uint32_t player_deaths = 0;
+	int32_t boss_health = 10000; // last health update of the boss, percent * 100
+	uint64_t events = 0;
+};
+
+// Finds the few state changes that decide the summary by testing only the
+// is_statechange byte of every event, 8 events per step on SSE2/AVX2, and
+// decodes just the events that match.
+class EvtcScanner
+{
+public:
+	enum class Path { SCALAR, SSE2, AVX2 };
+
+	// Fastest path this CPU supports
+	static Path best_path();
+	static bool supported(Path path);
+	static const char* path_name(Path path);
+
+	// Reads the rest of reader's events
+	static EvtcSummary scan(EvtcReader& reader);
+	static EvtcSummary scan(EvtcReader& reader, Path path);
+	// data is a whole uncompressed .evtc
+	static EvtcSummary scan(const uint8_t* data, size_t size);
+	static EvtcSummary scan(const uint8_t* data, size_t size, Path path);
+};
@@ -1,25 +1,154 @@
 #include "Log.h"
 
-std::string PathToString(std::filesystem::path path)
+#include <cstring>
+#include <unordered_map>
+
+#include "loguru.hpp"
+
+int64_t TimepointToMillis(std::chrono::system_clock::time_point tp)
 {
-	return path.string();
+	return std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
 }
 
-std::unique_ptr<std::filesystem::path> PathFromString(const std::string& s)
+std::chrono::system_clock::time_point TimepointFromMillis(int64_t ms)
 {
-	return std::make_unique<std::filesystem::path>(std::filesystem::path(s));
+	return std::chrono::system_clock::time_point(
+		std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(ms))
+	);
 }
 
-std::string TimepointToString(std::chrono::system_clock::time_point tp)
+static bool exec(sqlite3* db, const char* sql)
 {
-	auto t = std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
-	return std::to_string(t);
+	char* err = nullptr;
+	if (sqlite3_exec(db, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+		LOG_F(ERROR, "Log schema migration failed (%s): %s", sql, err ? err : "");
+		sqlite3_free(err);
+		return false;
+	}
+	return true;
 }
 
-std::unique_ptr<std::chrono::system_clock::time_point> TimepointFromString(const std::string& s)
+static int user_version(sqlite3* db)
 {
-	long long t = std::stoll(s);
-	return std::make_unique<std::chrono::system_clock::time_point>(
-		std::chrono::system_clock::time_point(std::chrono::seconds(t))
-	);
+	int version = 0;
+	sqlite3_stmt* stmt;
+	if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, nullptr) == SQLITE_OK) {
+		if (sqlite3_step(stmt) == SQLITE_ROW) {
+			version = sqlite3_column_int(stmt, 0);
+		}
+		sqlite3_finalize(stmt);
+	}
+	return version;
+}
+
+static bool has_column(sqlite3* db, const char* table, const char* column)
+{
+	bool found = false;
+	std::string sql = std::string("PRAGMA table_info(") + table + ")";
+	sqlite3_stmt* stmt;
+	if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+		while (sqlite3_step(stmt) == SQLITE_ROW) {
+			auto name = (const char*)sqlite3_column_text(stmt, 1);
+			if (name && strcmp(name, column) == 0) {
+				found = true;
+				break;
+			}
+		}
+		sqlite3_finalize(stmt);
+	}
+	return found;
+}
+
+// Version 0 -> 1: split path into log_dirs + file, time seconds -> time_ms.
+// The old path/time columns are left for sync_schema to drop.
+static bool migrate_v0(sqlite3* db)
+{
+	if (!exec(db, "CREATE TABLE IF NOT EXISTS log_dirs (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, path TEXT NOT NULL)")
+		|| !exec(db, "ALTER TABLE logs ADD COLUMN dir_id INTEGER NOT NULL DEFAULT 0")
+		|| !exec(db, "ALTER TABLE logs ADD COLUMN file TEXT NOT NULL DEFAULT ''")
+		|| !exec(db, "ALTER TABLE logs ADD COLUMN time_ms INTEGER NOT NULL DEFAULT 0")
+		|| !exec(db, "UPDATE logs SET time_ms = CAST(time AS INTEGER) * 1000")) {
+		return false;
+	}
+
+	sqlite3_stmt* select = nullptr;
+	sqlite3_stmt* insert_dir = nullptr;
+	sqlite3_stmt* update = nullptr;
+	bool ok = sqlite3_prepare_v2(db, "SELECT id, path FROM logs", -1, &select, nullptr) == SQLITE_OK
+		&& sqlite3_prepare_v2(db, "INSERT INTO log_dirs (path) VALUES (?)", -1, &insert_dir, nullptr) == SQLITE_OK
+		&& sqlite3_prepare_v2(db, "UPDATE logs SET dir_id = ?, file = ? WHERE id = ?", -1, &update, nullptr) == SQLITE_OK;
+
+	std::unordered_map<std::string, int> dir_ids;
+	int rc = SQLITE_DONE;
+	while (ok && (rc = sqlite3_step(select)) == SQLITE_ROW) {
+		int id = sqlite3_column_int(select, 0);
+		auto text = (const char*)sqlite3_column_text(select, 1);
+		std::filesystem::path path(text ? text : "");
+		std::string dir = path.parent_path().string();
+		std::string file = path.filename().string();
+
+		auto it = dir_ids.find(dir);
+		if (it == dir_ids.end()) {
+			sqlite3_bind_text(insert_dir, 1, dir.c_str(), -1, SQLITE_TRANSIENT);
+			ok = sqlite3_step(insert_dir) == SQLITE_DONE;
+			sqlite3_reset(insert_dir);
+			it = dir_ids.emplace(dir, (int)sqlite3_last_insert_rowid(db)).first;
+		}
+
+		sqlite3_bind_int(update, 1, it->second);
+		sqlite3_bind_text(update, 2, file.c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int(update, 3, id);
+		ok = ok && sqlite3_step(update) == SQLITE_DONE;
+		sqlite3_reset(update);
+	}
+	// An interrupted or failed select ends the loop early as well
+	ok = ok && rc == SQLITE_DONE;
+	if (!ok) {
+		LOG_F(ERROR, "Log schema migration failed: %s", sqlite3_errmsg(db));
+	}
+
+	sqlite3_finalize(select);
+	sqlite3_finalize(insert_dir);
+	sqlite3_finalize(update);
+	LOG_F(INFO, "Migrated logs to schema v1 (%zu directories)", dir_ids.size());
+	return ok;
+}
+
+bool migrate_log_schema(const std::string& db_path, const std::atomic<bool>* cancel)
+{
+	sqlite3* db = nullptr;
+	if (sqlite3_open(db_path.c_str(), &db) != SQLITE_OK) {
+		LOG_F(ERROR, "Failed to open %s for migration: %s", db_path.c_str(), sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return false;
+	}
+
+	if (cancel) {
+		// Checked every 1000 VM instructions, a statement interrupted by it
+		// fails and the migration rolls back
+		sqlite3_progress_handler(db, 1000, [](void* flag) {
+			return ((const std::atomic<bool>*)flag)->load() ? 1 : 0;
+		}, (void*)cancel);
+	}
+
+	bool ok = true;
+	if (user_version(db) < LOG_SCHEMA_VERSION) {
+		ok = exec(db, "BEGIN");
+		if (ok && has_column(db, "logs", "path")) {
+			ok = migrate_v0(db);
+		}
+		std::string set_version = "PRAGMA user_version = " + std::to_string(LOG_SCHEMA_VERSION);
+		ok = ok && exec(db, set_version.c_str());
+		if (!ok && cancel) {
+			// Otherwise the rollback would be interrupted as well
+			sqlite3_progress_handler(db, 0, nullptr, nullptr);
+		}
+		// An interrupted statement has rolled the transaction back already
+		if (ok || !sqlite3_get_autocommit(db)) {
+			exec(db, ok ? "COMMIT" : "ROLLBACK");
+		}
+	}
+
+	sqlite3_close(db);
+	return ok;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <atomic>
 #include <chrono>
 #include <iomanip>
 #include <filesystem>
@@ -8,10 +9,24 @@
 #include "sqlite_orm.h"
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <cstdlib>
+
+// Bumped whenever the logs schema changes, stored as PRAGMA user_version
+// 0: full path per row, time as TEXT seconds
+// 1: directories interned in log_dirs, time as INTEGER epoch milliseconds
+constexpr int LOG_SCHEMA_VERSION = 1;
+
+// Directory shared by many logs
+struct LogDirectory {
+	int id;
+	std::string path;
+};
 
 struct Log {
 	int id;
-	std::filesystem::path path;
+	std::filesystem::path path; // log_dirs.path / file, not stored
+	int dir_id;
+	std::string file;
 	std::string filename;
 	std::string human_time;
 	std::chrono::system_clock::time_point time;
@@ -21,10 +36,10 @@ struct Log {
 	std::string permalink;
 	int boss_id;
 	std::string boss_name;
-	std::string players_json;
-	std::optional<nlohmann::json> players;
+	std::string players_json; // parsed on demand
 	bool json_available;
 	bool success;
+	int64_t duration_ms; // 0 if unknown
 
 	inline bool operator==(const Log&rhs) {
 		return time == rhs.time && filename == rhs.filename;
@@ -35,64 +50,27 @@ struct Log {
 	}
 };
 
-std::string PathToString(std::filesystem::path path);
-std::unique_ptr<std::filesystem::path> PathFromString(const std::string& s);
-std::string TimepointToString(std::chrono::system_clock::time_point tp);
-std::unique_ptr<std::chrono::system_clock::time_point> TimepointFromString(const std::string& s);
+// Upgrades an existing database to LOG_SCHEMA_VERSION. Runs before the
+// storage syncs its schema, which would otherwise drop the old columns.
+// Setting cancel interrupts it, the database is then left as it was.
+bool migrate_log_schema(const std::string& db_path, const std::atomic<bool>* cancel = nullptr);
+
+int64_t TimepointToMillis(std::chrono::system_clock::time_point tp);
+std::chrono::system_clock::time_point TimepointFromMillis(int64_t ms);
 
 namespace sqlite_orm
 {
-	//std::filesystem::path
-	template<>
-	struct type_printer<std::filesystem::path> : public text_printer {};
-	
-	template<>
-	struct statement_binder<std::filesystem::path>
-	{
-		int bind(sqlite3_stmt* stmt, int index, const std::filesystem::path& path)
-		{
-			return statement_binder<std::string>().bind(stmt, index, PathToString(path));
-		}
-	};
-
-	template<>
-	struct field_printer<std::filesystem::path> {
-		std::string operator()(const std::filesystem::path& t) const
-		{
-			return PathToString(t);
-		}
-	};
-
-	template<>
-	struct row_extractor<std::filesystem::path> {
-		std::filesystem::path extract(const char* row_value) {
-			if (auto path = PathFromString(row_value)) {
-				return *path;
-			}
-			else
-			{
-				throw std::runtime_error("incorrect path string (" + std::string(row_value) + ")");
-			}
-		}
-
-		std::filesystem::path extract(sqlite3_stmt* stmt, int columnIndex)
-		{
-			auto str = sqlite3_column_text(stmt, columnIndex);
-			return this->extract((const char*)str);
-		}
-	};
-
-	//std::chrono::system_clock::time_point
+	//std::chrono::system_clock::time_point, epoch milliseconds
 	using namespace std::chrono;
 	template<>
-	struct type_printer<system_clock::time_point> : public text_printer {};
+	struct type_printer<system_clock::time_point> : public integer_printer {};
 
 	template<>
 	struct statement_binder<system_clock::time_point>
 	{
 		int bind(sqlite3_stmt* stmt, int index, const system_clock::time_point& value)
 		{
-			return statement_binder<std::string>().bind(stmt, index, TimepointToString(value));
+			return sqlite3_bind_int64(stmt, index, TimepointToMillis(value));
 		}
 	};
 
@@ -101,26 +79,19 @@ namespace sqlite_orm
 	{
 		std::string operator()(const system_clock::time_point& t) const
 		{
-			return TimepointToString(t);
+			return std::to_string(TimepointToMillis(t));
 		}
 	};
 
 	template<>
 	struct row_extractor<system_clock::time_point> {
 		system_clock::time_point extract(const char* row_value) {
-			if (auto path = TimepointFromString(row_value)) {
-				return *path;
-			}
-			else
-			{
-				throw std::runtime_error("incorrect path string (" + std::string(row_value) + ")");
-			}
+			return TimepointFromMillis(row_value ? std::strtoll(row_value, nullptr, 10) : 0);
 		}
 
 		system_clock::time_point extract(sqlite3_stmt* stmt, int columnIndex)
 		{
-			auto str = sqlite3_column_text(stmt, columnIndex);
-			return this->extract((const char*)str);
+			return TimepointFromMillis(sqlite3_column_int64(stmt, columnIndex));
 		}
 	};
 }
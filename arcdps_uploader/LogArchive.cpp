@@ -0,0 +1,285 @@
+#include "LogArchive.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <zlib.h>
+
+#include "loguru.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// Bound parameters per statement, IN lists and multi-row inserts are split
+// so none goes past SQLite's variable limit
+constexpr size_t MAX_VARIABLES = 500;
+
+inline auto initArchiveStorage(const std::string& path) {
+    using namespace sqlite_orm;
+    return make_storage(
+        path,
+        make_index("idx_archived_time_ms", &ArchivedLog::time),
+        make_index("idx_archived_boss", &ArchivedLog::boss_id,
+                   &ArchivedLog::time),
+        make_index("idx_archived_filename", &ArchivedLog::filename),
+        make_table(
+            "archived_logs",
+            make_column("id", &ArchivedLog::id, primary_key()),
+            make_column("dir_id", &ArchivedLog::dir_id),
+            make_column("file", &ArchivedLog::file),
+            make_column("filename", &ArchivedLog::filename),
+            make_column("human_time", &ArchivedLog::human_time),
+            make_column("time_ms", &ArchivedLog::time),
+            make_column("uploaded", &ArchivedLog::uploaded),
+            make_column("error", &ArchivedLog::error),
+            make_column("report_id", &ArchivedLog::report_id),
+            make_column("permalink", &ArchivedLog::permalink),
+            make_column("boss_id", &ArchivedLog::boss_id),
+            make_column("boss_name", &ArchivedLog::boss_name),
+            make_column("players", &ArchivedLog::players),
+            make_column("json_available", &ArchivedLog::json_available),
+            make_column("success", &ArchivedLog::success),
+            make_column("duration_ms", &ArchivedLog::duration_ms,
+                        default_value(0))));
+}
+
+std::vector<char> deflate_text(const std::string& text) {
+    std::vector<char> out;
+    if (text.empty()) return out;
+    uLongf size = compressBound((uLong)text.size());
+    out.resize(sizeof(uint32_t) + size);
+    uint32_t inflated = (uint32_t)text.size();
+    memcpy(out.data(), &inflated, sizeof(inflated));
+    if (compress2((Bytef*)out.data() + sizeof(inflated), &size,
+                  (const Bytef*)text.data(), (uLong)text.size(),
+                  Z_BEST_COMPRESSION) != Z_OK) {
+        return {};
+    }
+    out.resize(sizeof(inflated) + size);
+    return out;
+}
+
+std::string inflate_text(const std::vector<char>& data) {
+    uint32_t inflated = 0;
+    if (data.size() <= sizeof(inflated)) return "";
+    memcpy(&inflated, data.data(), sizeof(inflated));
+    std::string text(inflated, '\0');
+    uLongf size = inflated;
+    if (uncompress((Bytef*)&text[0], &size,
+                   (const Bytef*)data.data() + sizeof(inflated),
+                   (uLong)(data.size() - sizeof(inflated))) != Z_OK ||
+        size != inflated) {
+        return "";
+    }
+    return text;
+}
+}  // namespace
+
+struct LogArchive::Connection {
+    decltype(initArchiveStorage("")) storage;
+    explicit Connection(const std::string& path)
+        : storage(initArchiveStorage(path)) {}
+};
+
+LogArchive::LogArchive(fs::path path) : file(std::move(path)) {}
+
+LogArchive::~LogArchive() = default;
+
+LogArchive::Connection& LogArchive::open() {
+    if (!connection) {
+        connection = std::make_unique<Connection>(file.string());
+    }
+    if (!synced) {
+        connection->storage.sync_schema(true);
+        synced = true;
+    }
+    return *connection;
+}
+
+ArchivedLog LogArchive::pack(const Log& log) {
+    return ArchivedLog{log.id,
+                       log.dir_id,
+                       log.file,
+                       log.filename,
+                       log.human_time,
+                       log.time,
+                       log.uploaded,
+                       log.error,
+                       log.report_id,
+                       log.permalink,
+                       log.boss_id,
+                       log.boss_name,
+                       deflate_text(log.players_json),
+                       log.json_available,
+                       log.success,
+                       log.duration_ms};
+}
+
+Log LogArchive::unpack(const ArchivedLog& archived) {
+    Log log = {};
+    log.id = archived.id;
+    log.dir_id = archived.dir_id;
+    log.file = archived.file;
+    log.filename = archived.filename;
+    log.human_time = archived.human_time;
+    log.time = archived.time;
+    log.uploaded = archived.uploaded;
+    log.error = archived.error;
+    log.report_id = archived.report_id;
+    log.permalink = archived.permalink;
+    log.boss_id = archived.boss_id;
+    log.boss_name = archived.boss_name;
+    log.players_json = inflate_text(archived.players);
+    log.json_available = archived.json_available;
+    log.success = archived.success;
+    log.duration_ms = archived.duration_ms;
+    return log;
+}
+
+bool LogArchive::store(const std::vector<Log>& logs) {
+    if (logs.empty()) return true;
+    std::vector<ArchivedLog> rows;
+    rows.reserve(logs.size());
+    for (const Log& log : logs) {
+        rows.push_back(pack(log));
+    }
+
+    std::lock_guard<std::mutex> lk(mutex);
+    try {
+        auto& s = open().storage;
+        // One statement per few rows, each row binds every column
+        constexpr size_t rows_per_statement = MAX_VARIABLES / 16;
+        return s.transaction([&] {
+            for (size_t i = 0; i < rows.size(); i += rows_per_statement) {
+                s.replace_range(rows.begin() + i,
+                                rows.begin() + (std::min)(i + rows_per_statement,
+                                                          rows.size()));
+            }
+            return true;
+        });
+    } catch (std::system_error& e) {
+        LOG_F(ERROR, "Failed to archive logs: %s", e.what());
+        return false;
+    }
+}
+
+std::optional<Log> LogArchive::get(int id) {
+    std::lock_guard<std::mutex> lk(mutex);
+    try {
+        auto row = open().storage.get_pointer<ArchivedLog>(id);
+        if (row) return unpack(*row);
+    } catch (std::system_error& e) {
+        LOG_F(ERROR, "Failed to read archived log: %s", e.what());
+    }
+    return std::nullopt;
+}
+
+std::vector<Log> LogArchive::search(const ArchiveQuery& query) {
+    using namespace sqlite_orm;
+    std::vector<Log> logs;
+    std::lock_guard<std::mutex> lk(mutex);
+    try {
+        // Compared as milliseconds, INT64_MAX doesn't fit a time_point
+        int64_t from = query.from_ms;
+        int64_t to = query.to_ms;
+        // Unused conditions become open ranges, so one statement serves
+        // every query
+        int boss_min = query.boss_id ? query.boss_id : INT_MIN;
+        int boss_max = query.boss_id ? query.boss_id : INT_MAX;
+        auto rows = open().storage.get_all<ArchivedLog>(
+            where(c(&ArchivedLog::time) >= from and
+                  c(&ArchivedLog::time) < to and
+                  c(&ArchivedLog::boss_id) >= boss_min and
+                  c(&ArchivedLog::boss_id) <= boss_max and
+                  c(&ArchivedLog::success) >= query.success_only and
+                  like(&ArchivedLog::filename,
+                       query.filename_prefix + "%")),
+            order_by(&ArchivedLog::time).desc(), limit((int)query.limit));
+        logs.reserve(rows.size());
+        for (const auto& row : rows) {
+            logs.push_back(unpack(row));
+        }
+    } catch (std::system_error& e) {
+        LOG_F(ERROR, "Failed to search archive: %s", e.what());
+    }
+    return logs;
+}
+
+std::vector<Log> LogArchive::read_after(int after_id, size_t limit) {
+    using namespace sqlite_orm;
+    std::vector<Log> logs;
+    std::lock_guard<std::mutex> lk(mutex);
+    try {
+        auto rows = open().storage.get_all<ArchivedLog>(
+            where(c(&ArchivedLog::id) > after_id), order_by(&ArchivedLog::id),
+            sqlite_orm::limit((int)limit));
+        logs.reserve(rows.size());
+        for (const auto& row : rows) {
+            logs.push_back(unpack(row));
+        }
+    } catch (std::system_error& e) {
+        LOG_F(ERROR, "Failed to read archive: %s", e.what());
+    }
+    return logs;
+}
+
+std::unordered_set<std::string> LogArchive::contains(
+    const std::vector<std::string>& filenames) {
+    using namespace sqlite_orm;
+    std::unordered_set<std::string> found;
+    if (filenames.empty()) return found;
+    std::lock_guard<std::mutex> lk(mutex);
+    try {
+        auto& s = open().storage;
+        for (size_t i = 0; i < filenames.size(); i += MAX_VARIABLES) {
+            std::vector<std::string> chunk(
+                filenames.begin() + i,
+                filenames.begin() +
+                    (std::min)(i + MAX_VARIABLES, filenames.size()));
+            for (auto& name : s.select(&ArchivedLog::filename,
+                                       where(in(&ArchivedLog::filename,
+                                                std::move(chunk))))) {
+                found.insert(std::move(name));
+            }
+        }
+    } catch (std::system_error& e) {
+        LOG_F(ERROR, "Failed to look up archived logs: %s", e.what());
+    }
+    return found;
+}
+
+std::optional<std::unordered_set<std::string>> LogArchive::filenames() {
+    std::lock_guard<std::mutex> lk(mutex);
+    try {
+        auto names = open().storage.select(&ArchivedLog::filename);
+        return std::unordered_set<std::string>(
+            std::make_move_iterator(names.begin()),
+            std::make_move_iterator(names.end()));
+    } catch (std::system_error& e) {
+        LOG_F(ERROR, "Failed to read archived file names: %s", e.what());
+        return std::nullopt;
+    }
+}
+
+size_t LogArchive::count() {
+    std::lock_guard<std::mutex> lk(mutex);
+    try {
+        return (size_t)open().storage.count<ArchivedLog>();
+    } catch (std::system_error& e) {
+        LOG_F(ERROR, "Failed to count archived logs: %s", e.what());
+        return 0;
+    }
+}
+
+int64_t LogArchive::newest_ms() {
+    using namespace sqlite_orm;
+    std::lock_guard<std::mutex> lk(mutex);
+    try {
+        auto newest = open().storage.select(
+            &ArchivedLog::time, order_by(&ArchivedLog::time).desc(), limit(1));
+        return newest.empty() ? 0 : TimepointToMillis(newest.front());
+    } catch (std::system_error& e) {
+        LOG_F(ERROR, "Failed to read archive: %s", e.what());
+        return 0;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "Log.h"
+
+// Row of the cold database: a Log whose players are deflated, keeping the
+// id it had in the hot database
+struct ArchivedLog
+{
+	int id;
+	int dir_id;
+	std::string file;
+	std::string filename;
+	std::string human_time;
+	std::chrono::system_clock::time_point time;
+	bool uploaded;
+	bool error;
+	std::string report_id;
+	std::string permalink;
+	int boss_id;
+	std::string boss_name;
+	std::vector<char> players; // zlib, prefixed with the inflated size
+	bool json_available;
+	bool success;
+	int64_t duration_ms;
+};
+
+struct ArchiveQuery
+{
+	int boss_id = 0; // 0 for any
+	int64_t from_ms = 0;
+	int64_t to_ms = INT64_MAX; // exclusive
+	bool success_only = false;
+	std::string filename_prefix;
+	size_t limit = 100;
+};
+
+// Cold tier of the log history. Uploaded rows older than the hot window are
+// moved here in small batches, so the hot database and its queries stay the
+// same size however long the history gets. The file is only opened while a
+// call needs it; nothing keeps it attached in between. Thread safe.
+class LogArchive
+{
+public:
+	explicit LogArchive(std::filesystem::path path);
+	~LogArchive();
+	LogArchive(const LogArchive&) = delete;
+	LogArchive& operator=(const LogArchive&) = delete;
+
+	static ArchivedLog pack(const Log& log);
+	// Log::path is left empty, it depends on the hot log_dirs table
+	static Log unpack(const ArchivedLog& archived);
+
+	// Inserts or replaces by id in one transaction, so a batch that was
+	// stored but not yet removed from the hot database can be stored again
+	bool store(const std::vector<Log>& logs);
+	std::optional<Log> get(int id);
+	// Newest first
+	std::vector<Log> search(const ArchiveQuery& query);
+	// Up to limit logs with an id above after_id, by id. Walks the whole
+	// archive a page at a time.
+	std::vector<Log> read_after(int after_id, size_t limit);
+	// Which of filenames are archived
+	std::unordered_set<std::string> contains(const std::vector<std::string>& filenames);
+	// Every archived filename, nullopt if the archive can't be read
+	std::optional<std::unordered_set<std::string>> filenames();
+
+	size_t count();
+	// Time of the newest archived log, 0 if there is none
+	int64_t newest_ms();
+
+	const std::filesystem::path& path() const { return file; }
+
+private:
+	struct Connection;
+
+	std::filesystem::path file;
+	std::mutex mutex;
+	std::unique_ptr<Connection> connection;
+	bool synced = false;
+
+	Connection& open();
+};
@@ -0,0 +1,260 @@
+#include "LogCompressor.h"
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "loguru.hpp"
+
+namespace fs = std::filesystem;
+
+static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+LogCompressor::LogCompressor(fs::path cache_dir, unsigned thread_count)
+    : cache_dir(std::move(cache_dir)), running(true), cancelled(false) {
+    std::error_code ec;
+    fs::create_directories(this->cache_dir, ec);
+    if (thread_count == 0) thread_count = 1;
+    for (unsigned i = 0; i < thread_count; ++i) {
+        workers.emplace_back(&LogCompressor::worker_loop, this);
+    }
+}
+
+LogCompressor::~LogCompressor() {
+    cancel();
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        running = false;
+        jobs.clear();
+    }
+    cv.notify_all();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+void LogCompressor::worker_loop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [this] { return !jobs.empty() || !running; });
+            if (!running) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+bool LogCompressor::needs_compression(const fs::path& path) {
+    return path.extension() == ".evtc";
+}
+
+std::shared_future<fs::path> LogCompressor::compress(const fs::path& path) {
+    std::lock_guard<std::mutex> lk(mutex);
+    auto it = pending.find(path);
+    if (it != pending.end()) {
+        return it->second;
+    }
+
+    auto task = std::make_shared<std::packaged_task<fs::path()>>(
+        [dir = cache_dir, path, cancel = &cancelled]() -> fs::path {
+            uint64_t hash = hash_file(path);
+            if (hash == 0) return path;
+
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.zevtc",
+                     (unsigned long long)hash);
+            fs::path out = dir / name;
+
+            std::error_code ec;
+            if (fs::exists(out, ec) && fs::file_size(out, ec) > 0) {
+                fs::last_write_time(out, fs::file_time_type::clock::now(), ec);
+                return out;
+            }
+
+            fs::path tmp = out;
+            tmp += ".tmp";
+            if (!write_zevtc(path, tmp, 6, cancel)) {
+                LOG_F(ERROR, "Failed to compress %s", path.string().c_str());
+                fs::remove(tmp, ec);
+                return path;
+            }
+            fs::rename(tmp, out, ec);
+            if (ec) {
+                LOG_F(ERROR, "Failed to store compressed log: %s",
+                      ec.message().c_str());
+                return path;
+            }
+            LOG_F(INFO, "Compressed %s (%llu -> %llu bytes)",
+                  path.filename().string().c_str(),
+                  (unsigned long long)fs::file_size(path, ec),
+                  (unsigned long long)fs::file_size(out, ec));
+            return out;
+        });
+
+    std::shared_future<fs::path> result = task->get_future().share();
+    pending.emplace(path, result);
+    jobs.emplace_back([task]() { (*task)(); });
+    cv.notify_one();
+    return result;
+}
+
+void LogCompressor::release(const fs::path& path) {
+    std::lock_guard<std::mutex> lk(mutex);
+    pending.erase(path);
+}
+
+void LogCompressor::cancel() { cancelled = true; }
+
+void LogCompressor::prune(std::chrono::hours max_age) {
+    std::error_code ec;
+    auto cutoff = fs::file_time_type::clock::now() - max_age;
+    for (const auto& entry : fs::directory_iterator(cache_dir, ec)) {
+        if (entry.path().extension() != ".zevtc") continue;
+        if (entry.last_write_time(ec) < cutoff) {
+            fs::remove(entry.path(), ec);
+        }
+    }
+}
+
+uint64_t LogCompressor::hash_file(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return 0;
+
+    // FNV-1a over 64 bit words, tail bytes folded in individually
+    uint64_t hash = 14695981039346656037ull;
+    std::vector<char> buf(CHUNK_SIZE);
+    while (in) {
+        in.read(buf.data(), buf.size());
+        size_t n = (size_t)in.gcount();
+        size_t words = n / 8;
+        const unsigned char* p = (const unsigned char*)buf.data();
+        for (size_t i = 0; i < words; ++i, p += 8) {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            hash = (hash ^ w) * 1099511628211ull;
+        }
+        for (size_t i = words * 8; i < n; ++i) {
+            hash = (hash ^ (unsigned char)buf[i]) * 1099511628211ull;
+        }
+    }
+    return hash ? hash : 1;
+}
+
+static void put16(std::ostream& out, uint16_t v) {
+    char b[2] = {(char)(v & 0xff), (char)(v >> 8)};
+    out.write(b, 2);
+}
+
+static void put32(std::ostream& out, uint32_t v) {
+    char b[4] = {(char)(v & 0xff), (char)((v >> 8) & 0xff),
+                 (char)((v >> 16) & 0xff), (char)(v >> 24)};
+    out.write(b, 4);
+}
+
+bool LogCompressor::write_zevtc(const fs::path& src, const fs::path& dst,
+                                int level, const std::atomic<bool>* cancel) {
+    std::ifstream in(src, std::ios::binary);
+    std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+    if (!in || !out) return false;
+
+    const std::string entry_name = src.filename().string();
+
+    // Local file header, crc and sizes are patched once deflate is done
+    put32(out, 0x04034b50);
+    put16(out, 20);  // version needed
+    put16(out, 0);   // flags
+    put16(out, 8);   // deflate
+    put16(out, 0);   // mod time
+    put16(out, 0x21);  // mod date (1980-01-01)
+    std::streampos crc_pos = out.tellp();
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, 0);
+    put16(out, (uint16_t)entry_name.size());
+    put16(out, 0);
+    out.write(entry_name.data(), entry_name.size());
+
+    z_stream zs = {};
+    if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    std::vector<char> in_buf(CHUNK_SIZE);
+    std::vector<char> out_buf(CHUNK_SIZE);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint64_t uncompressed = 0;
+    uint64_t compressed = 0;
+    int flush = Z_NO_FLUSH;
+    do {
+        if (cancel && cancel->load()) {
+            deflateEnd(&zs);
+            return false;
+        }
+        in.read(in_buf.data(), in_buf.size());
+        uInt n = (uInt)in.gcount();
+        crc = crc32(crc, (const Bytef*)in_buf.data(), n);
+        uncompressed += n;
+        flush = in.eof() ? Z_FINISH : Z_NO_FLUSH;
+        zs.next_in = (Bytef*)in_buf.data();
+        zs.avail_in = n;
+        do {
+            zs.next_out = (Bytef*)out_buf.data();
+            zs.avail_out = (uInt)out_buf.size();
+            deflate(&zs, flush);
+            size_t have = out_buf.size() - zs.avail_out;
+            out.write(out_buf.data(), have);
+            compressed += have;
+        } while (zs.avail_out == 0);
+    } while (flush != Z_FINISH && in);
+    deflateEnd(&zs);
+
+    if (uncompressed > 0xffffffffull || compressed > 0xffffffffull) {
+        return false;
+    }
+
+    std::streampos cd_pos = out.tellp();
+
+    // Central directory
+    put32(out, 0x02014b50);
+    put16(out, 20);  // version made by
+    put16(out, 20);  // version needed
+    put16(out, 0);
+    put16(out, 8);
+    put16(out, 0);
+    put16(out, 0x21);
+    put32(out, (uint32_t)crc);
+    put32(out, (uint32_t)compressed);
+    put32(out, (uint32_t)uncompressed);
+    put16(out, (uint16_t)entry_name.size());
+    put16(out, 0);  // extra
+    put16(out, 0);  // comment
+    put16(out, 0);  // disk
+    put16(out, 0);  // internal attrs
+    put32(out, 0);  // external attrs
+    put32(out, 0);  // local header offset
+    out.write(entry_name.data(), entry_name.size());
+    std::streampos cd_end = out.tellp();
+
+    // End of central directory
+    put32(out, 0x06054b50);
+    put16(out, 0);
+    put16(out, 0);
+    put16(out, 1);
+    put16(out, 1);
+    put32(out, (uint32_t)(cd_end - cd_pos));
+    put32(out, (uint32_t)cd_pos);
+    put16(out, 0);
+
+    out.seekp(crc_pos);
+    put32(out, (uint32_t)crc);
+    put32(out, (uint32_t)compressed);
+    put32(out, (uint32_t)uncompressed);
+
+    return (bool)out;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Recompresses raw .evtc logs into .zevtc (zip/deflate) on a small worker
+// pool so uploads send 5-10x fewer bytes. Output is cached on disk keyed by
+// content hash, so re-queueing the same log never compresses twice.
+class LogCompressor
+{
+	std::filesystem::path cache_dir;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool running;
+	// Stops compressions in progress, see cancel()
+	std::atomic<bool> cancelled;
+	std::deque<std::function<void()>> jobs;
+	std::map<std::filesystem::path, std::shared_future<std::filesystem::path>> pending;
+
+	void worker_loop();
+public:
+	LogCompressor(std::filesystem::path cache_dir, unsigned thread_count = 2);
+	~LogCompressor();
+
+	static bool needs_compression(const std::filesystem::path& path);
+
+	// Queue path for compression (no-op if already queued) and return the
+	// path to upload: the cached .zevtc, or path itself if compression failed
+	std::shared_future<std::filesystem::path> compress(const std::filesystem::path& path);
+	// Forget about a finished job once its result has been consumed
+	void release(const std::filesystem::path& path);
+	// Stops every compression at its next chunk, their futures resolve to
+	// the uncompressed path. Done by the destructor as well.
+	void cancel();
+
+	// Remove cached archives that have not been touched for max_age
+	void prune(std::chrono::hours max_age);
+
+	static uint64_t hash_file(const std::filesystem::path& path);
+	// Write src into a single entry zip archive at dst. Returns false on
+	// failure or when cancel is set part way through.
+	static bool write_zevtc(const std::filesystem::path& src, const std::filesystem::path& dst, int level = 6,
+		const std::atomic<bool>* cancel = nullptr);
+};
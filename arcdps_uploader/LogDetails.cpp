@@ -0,0 +1,275 @@
+#include "LogDetails.h"
+
+#include <cpr/cpr.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <nlohmann/json.hpp>
+
+#include "Metrics.h"
+#include "loguru.hpp"
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// clang-format off
+static const SpecInfo spec_table[(size_t)Spec::COUNT] = {
+    {"Unknown",      "Unk",  {0.6f, 0.6f, 0.6f}},
+    {"Guardian",     "Gdn",  {114 / 255.f, 193 / 255.f, 217 / 255.f}},
+    {"Dragonhunter", "Dgh",  {52 / 255.f, 152 / 255.f, 219 / 255.f}},
+    {"Firebrand",    "Fbd",  {93 / 255.f, 173 / 255.f, 226 / 255.f}},
+    {"Willbender",   "Wbd",  {114 / 255.f, 193 / 255.f, 217 / 255.f}},
+    {"Warrior",      "War",  {255 / 255.f, 209 / 255.f, 102 / 255.f}},
+    {"Berserker",    "Brs",  {211 / 255.f, 84 / 255.f, 0.f}},
+    {"Spellbreaker", "Spb",  {212 / 255.f, 172 / 255.f, 13 / 255.f}},
+    {"Bladesworn",   "Bds",  {255 / 255.f, 209 / 255.f, 102 / 255.f}},
+    {"Engineer",     "Eng",  {208 / 255.f, 156 / 255.f, 89 / 255.f}},
+    {"Scrapper",     "Scr",  {230 / 255.f, 126 / 255.f, 34 / 255.f}},
+    {"Holosmith",    "Hls",  {243 / 255.f, 156 / 255.f, 18 / 255.f}},
+    {"Mechanist",    "Mec",  {208 / 255.f, 156 / 255.f, 89 / 255.f}},
+    {"Ranger",       "Rgr",  {140 / 255.f, 220 / 255.f, 130 / 255.f}},
+    {"Druid",        "Dru",  {17 / 255.f, 122 / 255.f, 101 / 255.f}},
+    {"Soulbeast",    "Slb",  {39 / 255.f, 174 / 255.f, 96 / 255.f}},
+    {"Untamed",      "Unt",  {140 / 255.f, 220 / 255.f, 130 / 255.f}},
+    {"Thief",        "Thf",  {192 / 255.f, 143 / 255.f, 149 / 255.f}},
+    {"Daredevil",    "Dar",  {133 / 255.f, 146 / 255.f, 158 / 255.f}},
+    {"Deadeye",      "Ded",  {203 / 255.f, 67 / 255.f, 53 / 255.f}},
+    {"Specter",      "Spe",  {192 / 255.f, 143 / 255.f, 149 / 255.f}},
+    {"Elementalist", "Ele",  {246 / 255.f, 138 / 255.f, 135 / 255.f}},
+    {"Tempest",      "Tmp",  {93 / 255.f, 173 / 255.f, 226 / 255.f}},
+    {"Weaver",       "Wea",  {192 / 255.f, 57 / 255.f, 43 / 255.f}},
+    {"Catalyst",     "Cat",  {246 / 255.f, 138 / 255.f, 135 / 255.f}},
+    {"Mesmer",       "Mes",  {182 / 255.f, 121 / 255.f, 213 / 255.f}},
+    {"Chronomancer", "Chr",  {142 / 255.f, 68 / 255.f, 173 / 255.f}},
+    {"Mirage",       "Mir",  {155 / 255.f, 89 / 255.f, 182 / 255.f}},
+    {"Virtuoso",     "Vir",  {182 / 255.f, 121 / 255.f, 213 / 255.f}},
+    {"Necromancer",  "Nec",  {82 / 255.f, 167 / 255.f, 111 / 255.f}},
+    {"Reaper",       "Rea",  {20 / 255.f, 90 / 255.f, 50 / 255.f}},
+    {"Scourge",      "Scg",  {241 / 255.f, 196 / 255.f, 15 / 255.f}},
+    {"Harbinger",    "Har",  {82 / 255.f, 167 / 255.f, 111 / 255.f}},
+    {"Revenant",     "Rev",  {209 / 255.f, 110 / 255.f, 90 / 255.f}},
+    {"Herald",       "Her",  {84 / 255.f, 153 / 255.f, 199 / 255.f}},
+    {"Renegade",     "Ren",  {148 / 255.f, 49 / 255.f, 38 / 255.f}},
+    {"Vindicator",   "Vin",  {209 / 255.f, 110 / 255.f, 90 / 255.f}},
+};
+// clang-format on
+
+const SpecInfo& spec_info(Spec spec) {
+    size_t i = (size_t)spec;
+    return spec_table[i < (size_t)Spec::COUNT ? i : 0];
+}
+
+Spec spec_from_name(const std::string& name) {
+    for (size_t i = 1; i < (size_t)Spec::COUNT; ++i) {
+        if (name == spec_table[i].name) return (Spec)i;
+    }
+    return Spec::UNKNOWN;
+}
+
+size_t LogSummary::memory_usage() const {
+    size_t bytes = sizeof(LogSummary) + fight_name.capacity() +
+                   players.capacity() * sizeof(PlayerSummary);
+    for (const auto& p : players) {
+        bytes += p.name.capacity() + p.account.capacity();
+    }
+    return bytes;
+}
+
+std::optional<LogSummary> LogSummary::from_ei_json(const std::string& text) {
+    try {
+        json parsed = json::parse(text);
+        LogSummary summary;
+        summary.fight_name = parsed.value("fightName", "");
+        summary.success = parsed.value("success", false);
+        if (parsed.contains("durationMS")) {
+            summary.duration_ms = parsed["durationMS"].get<int64_t>();
+        } else {
+            // "05m 12s 345ms"
+            int m = 0, s = 0, ms = 0;
+            std::string duration = parsed.value("duration", "");
+            if (sscanf(duration.c_str(), "%dm %ds %dms", &m, &s, &ms) == 3) {
+                summary.duration_ms = (m * 60 + s) * 1000 + ms;
+            }
+        }
+
+        if (parsed.contains("players")) {
+            for (const auto& p : parsed["players"]) {
+                PlayerSummary player;
+                player.name = p.value("name", "");
+                player.account = p.value("account", "");
+                player.spec = spec_from_name(p.value("profession", ""));
+                player.group = p.value("group", 0);
+                player.dps = 0;
+                player.boss_dps = 0;
+                if (p.contains("dpsAll") && !p["dpsAll"].empty()) {
+                    player.dps = p["dpsAll"][0].value("dps", 0);
+                }
+                if (p.contains("dpsTargets")) {
+                    for (const auto& target : p["dpsTargets"]) {
+                        if (!target.empty()) {
+                            player.boss_dps += target[0].value("dps", 0);
+                        }
+                    }
+                }
+                summary.players.push_back(std::move(player));
+            }
+        }
+        std::stable_sort(summary.players.begin(), summary.players.end(),
+                         [](const PlayerSummary& a, const PlayerSummary& b) {
+                             return a.group < b.group;
+                         });
+        summary.players.shrink_to_fit();
+        return summary;
+    } catch (const json::exception& e) {
+        LOG_F(ERROR, "Failed to decode Elite Insights json: %s", e.what());
+        return std::nullopt;
+    }
+}
+
+LogDetails::LogDetails(fs::path cache_dir, size_t max_bytes)
+    : cache_dir(std::move(cache_dir)), max_bytes(max_bytes), used_bytes(0) {
+    std::error_code ec;
+    fs::create_directories(this->cache_dir, ec);
+}
+
+LogDetails::~LogDetails() {
+    // Fetches abort at libcurl's next progress tick, loads only touch their
+    // own copies
+    cancel.cancel();
+    for (auto& [id, ft] : pending) {
+        wait_unless_cancelled(ft, cancel);
+    }
+}
+
+LogDetails::State LogDetails::get(const LogDetailSource& source,
+                                  std::shared_ptr<const LogSummary>& summary) {
+    auto it = entries.find(source.log_id);
+    if (it != entries.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        summary = it->second->second;
+        return State::READY;
+    }
+    if (failed.count(source.log_id)) {
+        return State::FAILED;
+    }
+
+    auto ft = pending.find(source.log_id);
+    if (ft == pending.end()) {
+        pending.emplace(source.log_id,
+                        std::async(std::launch::async, &LogDetails::load,
+                                   cache_dir, source, cancel));
+        return State::LOADING;
+    }
+    if (ft->second.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready) {
+        return State::LOADING;
+    }
+
+    std::optional<LogSummary> loaded = ft->second.get();
+    pending.erase(ft);
+    if (!loaded) {
+        failed.emplace(source.log_id, "Could not load Elite Insights data");
+        return State::FAILED;
+    }
+    insert(source.log_id, std::move(*loaded));
+    summary = lru.front().second;
+    return State::READY;
+}
+
+std::string LogDetails::error(int log_id) const {
+    auto it = failed.find(log_id);
+    return it == failed.end() ? std::string() : it->second;
+}
+
+void LogDetails::insert(int log_id, LogSummary summary) {
+    auto shared = std::make_shared<const LogSummary>(std::move(summary));
+    used_bytes += shared->memory_usage();
+    lru.emplace_front(log_id, std::move(shared));
+    entries[log_id] = lru.begin();
+
+    // Keep at least the entry that was just added
+    while (used_bytes > max_bytes && lru.size() > 1) {
+        auto& victim = lru.back();
+        used_bytes -= victim.second->memory_usage();
+        entries.erase(victim.first);
+        lru.pop_back();
+    }
+}
+
+std::optional<LogSummary> LogDetails::load(const fs::path& cache_dir,
+                                           const LogDetailSource& source,
+                                           const CancelToken& cancel) {
+    fs::path cached = cache_dir / (std::to_string(source.log_id) + ".json.gz");
+    std::string text;
+    if (read_gz(cached, text)) {
+        return LogSummary::from_ei_json(text);
+    }
+
+    if (source.permalink.rfind("http", 0) == 0) {
+        // getJson lives on the same host as the report
+        size_t host_end = source.permalink.find('/', source.permalink.find("//") + 2);
+        std::string host = source.permalink.substr(0, host_end);
+        Metrics::Timer timer;
+        cpr::Response response =
+            cpr::Get(cpr::Url{host + "/getJson"},
+                     cpr::Parameters{{"permalink", source.permalink}},
+                     cancel.progress());
+        Metrics::observe_http("getJson", (int)response.status_code,
+                              timer.seconds());
+        if (response.status_code != 200) {
+            LOG_F(WARNING, "getJson failed for %s: %d",
+                  source.permalink.c_str(), (int)response.status_code);
+            return std::nullopt;
+        }
+        text = std::move(response.text);
+    } else {
+        // Local Elite Insights writes the json next to the html report
+        fs::path json_path = fs::path(source.permalink).replace_extension(".json");
+        std::ifstream in(json_path, std::ios::binary);
+        if (!in) return std::nullopt;
+        text.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+    }
+
+    auto summary = LogSummary::from_ei_json(text);
+    if (summary) {
+        write_gz(cached, text);
+    }
+    return summary;
+}
+
+bool LogDetails::read_gz(const fs::path& path, std::string& out) {
+    std::error_code ec;
+    if (!fs::exists(path, ec)) return false;
+    gzFile gz = gzopen(path.string().c_str(), "rb");
+    if (!gz) return false;
+    out.clear();
+    char buf[64 * 1024];
+    int n;
+    while ((n = gzread(gz, buf, sizeof(buf))) > 0) {
+        out.append(buf, (size_t)n);
+    }
+    bool ok = n == 0;
+    gzclose(gz);
+    return ok;
+}
+
+bool LogDetails::write_gz(const fs::path& path, const std::string& data) {
+    fs::path tmp = path;
+    tmp += ".tmp";
+    gzFile gz = gzopen(tmp.string().c_str(), "wb6");
+    if (!gz) return false;
+    bool ok = gzwrite(gz, data.data(), (unsigned)data.size()) ==
+              (int)data.size();
+    ok = gzclose(gz) == Z_OK && ok;
+    std::error_code ec;
+    if (ok) {
+        fs::rename(tmp, path, ec);
+    } else {
+        fs::remove(tmp, ec);
+    }
+    return ok && !ec;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CancelToken.h"
+
+// Professions and elite specializations, used to index the lookup tables
+enum class Spec : uint8_t
+{
+	UNKNOWN,
+	GUARDIAN, DRAGONHUNTER, FIREBRAND, WILLBENDER,
+	WARRIOR, BERSERKER, SPELLBREAKER, BLADESWORN,
+	ENGINEER, SCRAPPER, HOLOSMITH, MECHANIST,
+	RANGER, DRUID, SOULBEAST, UNTAMED,
+	THIEF, DAREDEVIL, DEADEYE, SPECTER,
+	ELEMENTALIST, TEMPEST, WEAVER, CATALYST,
+	MESMER, CHRONOMANCER, MIRAGE, VIRTUOSO,
+	NECROMANCER, REAPER, SCOURGE, HARBINGER,
+	REVENANT, HERALD, RENEGADE, VINDICATOR,
+	COUNT
+};
+
+struct SpecInfo
+{
+	const char* name;
+	const char* short_name;
+	float color[3];
+};
+
+const SpecInfo& spec_info(Spec spec);
+Spec spec_from_name(const std::string& name);
+
+struct PlayerSummary
+{
+	std::string name;
+	std::string account;
+	Spec spec;
+	int group;
+	int dps;
+	int boss_dps;
+};
+
+// What the detail view shows, decoded once from the Elite Insights JSON
+struct LogSummary
+{
+	std::string fight_name;
+	int64_t duration_ms = 0;
+	bool success = false;
+	std::vector<PlayerSummary> players; // sorted by group
+
+	size_t memory_usage() const;
+	static std::optional<LogSummary> from_ei_json(const std::string& text);
+};
+
+struct LogDetailSource
+{
+	int log_id;
+	std::string permalink;
+};
+
+// Elite Insights JSON for the detail view. Fetched in the background the
+// first time a log is opened, kept gzipped under cache_dir, and decoded
+// summaries are held in an LRU bounded by max_bytes. Render thread only.
+class LogDetails
+{
+public:
+	enum class State { LOADING, READY, FAILED };
+
+	LogDetails(std::filesystem::path cache_dir, size_t max_bytes = 4 * 1024 * 1024);
+	~LogDetails();
+
+	// Never blocks. Starts loading on a miss; summary is set when READY.
+	State get(const LogDetailSource& source, std::shared_ptr<const LogSummary>& summary);
+	// Why a FAILED log could not be loaded
+	std::string error(int log_id) const;
+
+	static bool read_gz(const std::filesystem::path& path, std::string& out);
+	static bool write_gz(const std::filesystem::path& path, const std::string& data);
+
+private:
+	using Entry = std::pair<int, std::shared_ptr<const LogSummary>>;
+
+	std::filesystem::path cache_dir;
+	size_t max_bytes;
+	size_t used_bytes;
+	std::list<Entry> lru; // most recent first
+	std::unordered_map<int, std::list<Entry>::iterator> entries;
+	std::map<int, std::future<std::optional<LogSummary>>> pending;
+	std::unordered_map<int, std::string> failed;
+	// Aborts fetches still running when the view goes away
+	CancelToken cancel;
+
+	void insert(int log_id, LogSummary summary);
+	static std::optional<LogSummary> load(const std::filesystem::path& cache_dir,
+		const LogDetailSource& source, const CancelToken& cancel);
+};
@@ -0,0 +1,827 @@
+#include "LogExport.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+#include "loguru.hpp"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+namespace {
+// Just enough of a FlatBuffers encoder for Arrow's Schema.fbs and
+// Message.fbs. A table is written before the objects its fields point to,
+// so every offset points forward as the format requires.
+struct Flat
+{
+    enum class Kind { TABLE, STRING, TABLE_VECTOR, STRUCT_VECTOR };
+    struct Scalar {
+        int id;
+        int size;
+        uint64_t bits;
+    };
+
+    Kind kind = Kind::TABLE;
+    std::vector<Scalar> scalars;
+    std::vector<int> child_ids;  // field id of each child of a table
+    std::vector<Flat> children;  // table fields and vector items
+    std::string bytes;           // string, or the structs of a vector
+    uint32_t count = 0;          // structs in the vector
+
+    Flat& add(int id, int size, uint64_t bits) {
+        scalars.push_back({id, size, bits});
+        return *this;
+    }
+    Flat& add(int id, Flat child) {
+        child_ids.push_back(id);
+        children.push_back(std::move(child));
+        return *this;
+    }
+    static Flat string(std::string text) {
+        Flat f;
+        f.kind = Kind::STRING;
+        f.bytes = std::move(text);
+        return f;
+    }
+    static Flat tables(std::vector<Flat> items) {
+        Flat f;
+        f.kind = Kind::TABLE_VECTOR;
+        f.children = std::move(items);
+        return f;
+    }
+    // Arrow's FieldNode and Buffer are both two longs
+    static Flat longs(const std::vector<int64_t>& pairs) {
+        Flat f;
+        f.kind = Kind::STRUCT_VECTOR;
+        f.count = (uint32_t)(pairs.size() / 2);
+        f.bytes.assign((const char*)pairs.data(), pairs.size() * 8);
+        return f;
+    }
+};
+
+// Arrow only has little endian files in practice, and so do the
+// platforms this builds for
+class FlatWriter
+{
+    std::string buf;
+
+    void pad(size_t align) { buf.resize((buf.size() + align - 1) / align * align); }
+    template <typename T>
+    void put(size_t at, T value) {
+        memcpy(&buf[at], &value, sizeof(value));
+    }
+    template <typename T>
+    void append(T value) {
+        buf.append((const char*)&value, sizeof(value));
+    }
+
+    size_t write(const Flat& f) {
+        switch (f.kind) {
+            case Flat::Kind::STRING: {
+                pad(4);
+                size_t at = buf.size();
+                append((uint32_t)f.bytes.size());
+                buf += f.bytes;
+                buf.push_back('\0');
+                return at;
+            }
+            case Flat::Kind::STRUCT_VECTOR: {
+                // The structs after the length need 8 byte alignment
+                pad(4);
+                if ((buf.size() + 4) % 8) buf.append(4, '\0');
+                size_t at = buf.size();
+                append(f.count);
+                buf += f.bytes;
+                return at;
+            }
+            case Flat::Kind::TABLE_VECTOR: {
+                pad(4);
+                size_t at = buf.size();
+                append((uint32_t)f.children.size());
+                size_t slots = buf.size();
+                buf.append(f.children.size() * 4, '\0');
+                for (size_t i = 0; i < f.children.size(); ++i) {
+                    size_t slot = slots + i * 4;
+                    put(slot, (uint32_t)(write(f.children[i]) - slot));
+                }
+                return at;
+            }
+            default:
+                return write_table(f);
+        }
+    }
+
+    size_t write_table(const Flat& f) {
+        // Widest fields first so each is aligned without padding between
+        struct Slot {
+            int id;
+            int size;
+            uint64_t bits;
+            int child;  // -1 for a scalar
+            size_t offset;
+        };
+        std::vector<Slot> slots;
+        int fields = 0;
+        for (const auto& s : f.scalars) {
+            slots.push_back({s.id, s.size, s.bits, -1, 0});
+            fields = (std::max)(fields, s.id + 1);
+        }
+        for (size_t i = 0; i < f.children.size(); ++i) {
+            slots.push_back({f.child_ids[i], 4, 0, (int)i, 0});
+            fields = (std::max)(fields, f.child_ids[i] + 1);
+        }
+        std::stable_sort(slots.begin(), slots.end(),
+                         [](const Slot& a, const Slot& b) {
+                             return a.size > b.size;
+                         });
+        size_t size = 4;  // the vtable offset
+        size_t align = 4;
+        for (Slot& s : slots) {
+            size = (size + s.size - 1) / s.size * s.size;
+            s.offset = size;
+            size += s.size;
+            align = (std::max)(align, (size_t)s.size);
+        }
+
+        pad(2);
+        size_t vtable = buf.size();
+        append((uint16_t)(4 + 2 * fields));
+        append((uint16_t)size);
+        size_t entries = buf.size();
+        buf.append(2 * fields, '\0');
+        for (const Slot& s : slots) {
+            put(entries + 2 * s.id, (uint16_t)s.offset);
+        }
+
+        pad(align);
+        size_t table = buf.size();
+        buf.append(size, '\0');
+        put(table, (int32_t)(table - vtable));
+        for (const Slot& s : slots) {
+            if (s.child < 0) {
+                memcpy(&buf[table + s.offset], &s.bits, s.size);
+            }
+        }
+        for (const Slot& s : slots) {
+            if (s.child >= 0) {
+                size_t child = write(f.children[s.child]);
+                put(table + s.offset,
+                    (uint32_t)(child - (table + s.offset)));
+            }
+        }
+        return table;
+    }
+
+public:
+    // Root offset, then the root table, padded to 8 bytes
+    static std::string finish(const Flat& root) {
+        FlatWriter w;
+        w.buf.assign(4, '\0');
+        w.put(0, (uint32_t)w.write(root));
+        w.pad(8);
+        return std::move(w.buf);
+    }
+};
+
+// Values from Schema.fbs and Message.fbs
+constexpr int METADATA_V5 = 4;
+constexpr int HEADER_SCHEMA = 1;
+constexpr int HEADER_RECORD_BATCH = 3;
+constexpr int TYPE_INT = 2;
+constexpr int TYPE_UTF8 = 5;
+constexpr int TYPE_BOOL = 6;
+constexpr int TYPE_TIMESTAMP = 10;
+constexpr int UNIT_MILLISECOND = 1;
+constexpr uint32_t CONTINUATION = 0xFFFFFFFF;
+
+Flat arrow_field(const ExportColumn& column) {
+    Flat type;
+    int type_id = 0;
+    switch (column.type) {
+        case ExportColumn::Type::INT32:
+            type.add(0, 4, 32).add(1, 1, 1);
+            type_id = TYPE_INT;
+            break;
+        case ExportColumn::Type::INT64:
+            type.add(0, 4, 64).add(1, 1, 1);
+            type_id = TYPE_INT;
+            break;
+        case ExportColumn::Type::TIMESTAMP_MS:
+            type.add(0, 2, UNIT_MILLISECOND).add(1, Flat::string("UTC"));
+            type_id = TYPE_TIMESTAMP;
+            break;
+        case ExportColumn::Type::BOOL:
+            type_id = TYPE_BOOL;
+            break;
+        case ExportColumn::Type::TEXT:
+            type_id = TYPE_UTF8;
+            break;
+    }
+    // Never null, every value is written
+    Flat field;
+    field.add(0, Flat::string(column.name))
+        .add(1, 1, 0)
+        .add(2, 1, type_id)
+        .add(3, std::move(type))
+        .add(5, Flat::tables({}));
+    return field;
+}
+
+Flat arrow_message(int header_type, Flat header, int64_t body_length) {
+    Flat message;
+    message.add(0, 2, METADATA_V5)
+        .add(1, 1, header_type)
+        .add(2, std::move(header))
+        .add(3, 8, (uint64_t)body_length);
+    return message;
+}
+
+size_t padded(size_t size) { return (size + 7) / 8 * 8; }
+
+class ArrowStreamWriter : public TableWriter
+{
+    std::ofstream out;
+    std::vector<char> bitmap;
+    std::vector<int32_t> narrow;
+
+    void message(const Flat& flat) {
+        std::string metadata = FlatWriter::finish(flat);
+        out.write((const char*)&CONTINUATION, 4);
+        int32_t length = (int32_t)metadata.size();
+        out.write((const char*)&length, 4);
+        out.write(metadata.data(), metadata.size());
+    }
+    void body(const void* data, size_t size) {
+        static const char zeros[8] = {};
+        out.write((const char*)data, size);
+        out.write(zeros, padded(size) - size);
+    }
+
+public:
+    bool open(const fs::path& path, const std::vector<ExportColumn>& schema) {
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        std::vector<Flat> fields;
+        for (const ExportColumn& column : schema) {
+            fields.push_back(arrow_field(column));
+        }
+        Flat header;
+        header.add(0, 2, 0).add(1, Flat::tables(std::move(fields)));
+        message(arrow_message(HEADER_SCHEMA, std::move(header), 0));
+        return (bool)out;
+    }
+
+    bool write(const ColumnBatch& batch) override {
+        if (batch.rows() == 0) return (bool)out;
+        int64_t rows = (int64_t)batch.rows();
+
+        // An empty validity buffer, then one or two buffers of values
+        std::vector<int64_t> nodes;
+        std::vector<int64_t> buffers;
+        int64_t offset = 0;
+        auto buffer = [&](size_t size) {
+            buffers.push_back(offset);
+            buffers.push_back((int64_t)size);
+            offset += (int64_t)padded(size);
+        };
+        for (size_t i = 0; i < batch.schema().size(); ++i) {
+            const ColumnBatch::Column& column = batch.column(i);
+            nodes.push_back(rows);
+            nodes.push_back(0);
+            buffer(0);
+            switch (batch.schema()[i].type) {
+                case ExportColumn::Type::INT32:
+                    buffer(rows * 4);
+                    break;
+                case ExportColumn::Type::BOOL:
+                    buffer((rows + 7) / 8);
+                    break;
+                case ExportColumn::Type::TEXT:
+                    buffer((rows + 1) * 4);
+                    buffer(column.text.size());
+                    break;
+                default:
+                    buffer(rows * 8);
+                    break;
+            }
+        }
+        Flat header;
+        header.add(0, 8, (uint64_t)rows)
+            .add(1, Flat::longs(nodes))
+            .add(2, Flat::longs(buffers));
+        message(arrow_message(HEADER_RECORD_BATCH, std::move(header), offset));
+
+        for (size_t i = 0; i < batch.schema().size(); ++i) {
+            const ColumnBatch::Column& column = batch.column(i);
+            switch (batch.schema()[i].type) {
+                case ExportColumn::Type::INT32:
+                    narrow.assign(column.values.begin(), column.values.end());
+                    body(narrow.data(), narrow.size() * 4);
+                    break;
+                case ExportColumn::Type::BOOL:
+                    bitmap.assign((rows + 7) / 8, 0);
+                    for (size_t r = 0; r < column.values.size(); ++r) {
+                        if (column.values[r]) bitmap[r / 8] |= 1 << (r % 8);
+                    }
+                    body(bitmap.data(), bitmap.size());
+                    break;
+                case ExportColumn::Type::TEXT:
+                    body(column.offsets.data(), column.offsets.size() * 4);
+                    body(column.text.data(), column.text.size());
+                    break;
+                default:
+                    body(column.values.data(), column.values.size() * 8);
+                    break;
+            }
+        }
+        return (bool)out;
+    }
+
+    bool close() override {
+        // End of stream marker
+        uint32_t end[2] = {CONTINUATION, 0};
+        out.write((const char*)end, sizeof(end));
+        out.close();
+        return !out.fail();
+    }
+};
+
+// RFC 4180, times as ISO 8601 in UTC
+class CsvWriter : public TableWriter
+{
+    std::ofstream out;
+    std::string line;
+
+    void quote(std::string_view text) {
+        if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+            line.append(text);
+            return;
+        }
+        line.push_back('"');
+        for (char ch : text) {
+            if (ch == '"') line.push_back('"');
+            line.push_back(ch);
+        }
+        line.push_back('"');
+    }
+    void time(int64_t ms) {
+        std::time_t seconds = (std::time_t)(ms >= 0 ? ms / 1000 : (ms - 999) / 1000);
+        std::tm tm = {};
+#ifdef _WIN32
+        gmtime_s(&tm, &seconds);
+#else
+        gmtime_r(&seconds, &tm);
+#endif
+        // Room for any int in each field, not just real dates
+        char text[96];
+        snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+                 tm.tm_min, tm.tm_sec, (int)(ms - (int64_t)seconds * 1000));
+        line += text;
+    }
+
+public:
+    bool open(const fs::path& path, const std::vector<ExportColumn>& schema) {
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        for (size_t i = 0; i < schema.size(); ++i) {
+            if (i) line.push_back(',');
+            line += schema[i].name;
+        }
+        line += "\r\n";
+        out << line;
+        return (bool)out;
+    }
+
+    bool write(const ColumnBatch& batch) override {
+        const auto& schema = batch.schema();
+        line.clear();
+        for (size_t r = 0; r < batch.rows(); ++r) {
+            for (size_t i = 0; i < schema.size(); ++i) {
+                if (i) line.push_back(',');
+                const ColumnBatch::Column& column = batch.column(i);
+                switch (schema[i].type) {
+                    case ExportColumn::Type::TEXT:
+                        quote(std::string_view(column.text).substr(
+                            column.offsets[r],
+                            column.offsets[r + 1] - column.offsets[r]));
+                        break;
+                    case ExportColumn::Type::BOOL:
+                        line += column.values[r] ? "true" : "false";
+                        break;
+                    case ExportColumn::Type::TIMESTAMP_MS:
+                        time(column.values[r]);
+                        break;
+                    default: {
+                        char text[24];
+                        snprintf(text, sizeof(text), "%" PRId64,
+                                 column.values[r]);
+                        line += text;
+                    }
+                }
+            }
+            line += "\r\n";
+            // Written in pieces, a group of text can be large
+            if (line.size() >= 1 << 20) {
+                out.write(line.data(), line.size());
+                line.clear();
+            }
+        }
+        out.write(line.data(), line.size());
+        return (bool)out;
+    }
+
+    bool close() override {
+        out.close();
+        return !out.fail();
+    }
+};
+
+struct RosterRow
+{
+    std::string account;
+    std::string character;
+    int64_t profession = 0;
+    int64_t elite_spec = 0;
+    int64_t group = 0;
+};
+
+// The shape players_to_json writes: an object of flat objects holding
+// strings without escapes and integers. With ten players a log, parsing is
+// most of what an export costs, this is several times quicker than the
+// json parser. False for anything else, RosterSax reads that.
+bool read_roster_fast(std::string_view text, std::vector<RosterRow>& rows) {
+    size_t i = 0;
+    auto skip = [&] {
+        while (i < text.size() && (text[i] == ' ' || text[i] == '\n' ||
+                                   text[i] == '\r' || text[i] == '\t')) {
+            ++i;
+        }
+    };
+    auto expect = [&](char ch) {
+        skip();
+        if (i >= text.size() || text[i] != ch) return false;
+        ++i;
+        return true;
+    };
+    auto string = [&](std::string_view& value) {
+        if (!expect('"')) return false;
+        size_t end = text.find('"', i);
+        if (end == std::string_view::npos) return false;
+        value = text.substr(i, end - i);
+        i = end + 1;
+        return value.find('\\') == std::string_view::npos;
+    };
+    auto integer = [&](int64_t& value) {
+        bool negative = i < text.size() && text[i] == '-';
+        if (negative) ++i;
+        size_t begin = i;
+        value = 0;
+        // 18 digits always fit, longer numbers go the slow way
+        while (i < text.size() && i - begin < 18 && text[i] >= '0' &&
+               text[i] <= '9') {
+            value = value * 10 + (text[i++] - '0');
+        }
+        if (negative) value = -value;
+        return i > begin && i < text.size() &&
+               (text[i] == ',' || text[i] == '}' || text[i] == ' ');
+    };
+
+    if (!expect('{')) return false;
+    if (!expect('}')) {
+        do {
+            RosterRow row;
+            std::string_view character;
+            if (!string(character) || !expect(':') || !expect('{')) {
+                return false;
+            }
+            row.character = character;
+            if (!expect('}')) {
+                do {
+                    std::string_view key;
+                    if (!string(key) || !expect(':')) return false;
+                    skip();
+                    if (i < text.size() && text[i] == '"') {
+                        std::string_view value;
+                        if (!string(value)) return false;
+                        if (key == "display_name") row.account = value;
+                        else if (key == "character_name") row.character = value;
+                    } else {
+                        int64_t value;
+                        if (!integer(value)) return false;
+                        if (key == "profession") row.profession = value;
+                        else if (key == "elite_spec") row.elite_spec = value;
+                        else if (key == "group") row.group = value;
+                    }
+                } while (expect(','));
+                if (!expect('}')) return false;
+            }
+            rows.push_back(std::move(row));
+        } while (expect(','));
+        if (!expect('}')) return false;
+    }
+    skip();
+    return i == text.size();
+}
+
+// Any players object, as events rather than into a json value
+class RosterSax : public nlohmann::json_sax<json> {
+    std::vector<RosterRow>& rows;
+    int depth = 0;
+    std::string current_key;
+    std::string character;
+
+    bool number(int64_t value) {
+        if (depth != 2) return true;
+        if (current_key == "profession") rows.back().profession = value;
+        else if (current_key == "elite_spec") rows.back().elite_spec = value;
+        else if (current_key == "group") rows.back().group = value;
+        return true;
+    }
+
+public:
+    explicit RosterSax(std::vector<RosterRow>& rows) : rows(rows) {}
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t value) override {
+        return number(value);
+    }
+    bool number_unsigned(number_unsigned_t value) override {
+        return number((int64_t)value);
+    }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+    bool string(string_t& value) override {
+        if (depth != 2) return true;
+        if (current_key == "display_name") {
+            rows.back().account = std::move(value);
+        } else if (current_key == "character_name") {
+            rows.back().character = std::move(value);
+        }
+        return true;
+    }
+    bool binary(binary_t&) override { return true; }
+    bool key(string_t& value) override {
+        if (depth == 1) character = value;
+        current_key = std::move(value);
+        return true;
+    }
+    bool start_object(std::size_t) override {
+        if (++depth == 2) {
+            rows.emplace_back();
+            rows.back().character = character;
+        }
+        return true;
+    }
+    bool end_object() override {
+        --depth;
+        return true;
+    }
+    bool start_array(std::size_t) override {
+        ++depth;
+        return true;
+    }
+    bool end_array() override {
+        --depth;
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string&,
+                     const nlohmann::detail::exception&) override {
+        return false;
+    }
+};
+
+// Rows of the roster table for one log
+size_t add_roster(ColumnBatch& players, const Log& log) {
+    if (log.players_json.empty()) return 0;
+    std::vector<RosterRow> rows;
+    if (!read_roster_fast(log.players_json, rows)) {
+        rows.clear();
+        RosterSax sax(rows);
+        if (!json::sax_parse(log.players_json, &sax)) rows.clear();
+    }
+    for (const RosterRow& row : rows) {
+        players.add_int(log.id);
+        players.add_text(row.account);
+        players.add_text(row.character);
+        players.add_int(row.profession);
+        players.add_int(row.elite_spec);
+        players.add_int(row.group);
+        players.end_row();
+    }
+    return rows.size();
+}
+
+std::string file_stamp() {
+    std::time_t now = std::time(nullptr);
+    std::tm tm = {};
+#ifdef _WIN32
+    gmtime_s(&tm, &now);
+#else
+    gmtime_r(&now, &tm);
+#endif
+    char text[32];
+    strftime(text, sizeof(text), "%Y%m%d-%H%M%S", &tm);
+    return text;
+}
+}  // namespace
+
+const char* export_format_name(ExportFormat format) {
+    return format == ExportFormat::CSV ? "csv" : "arrow";
+}
+
+ColumnBatch::ColumnBatch(std::vector<ExportColumn> schema)
+    : fields(std::move(schema)), columns(fields.size()) {
+    clear();
+}
+
+void ColumnBatch::add_int(int64_t value) { columns[next++].values.push_back(value); }
+
+void ColumnBatch::add_bool(bool value) { columns[next++].values.push_back(value); }
+
+void ColumnBatch::add_text(std::string_view value) {
+    Column& column = columns[next++];
+    column.text.append(value);
+    column.offsets.push_back((int32_t)column.text.size());
+}
+
+void ColumnBatch::end_row() {
+    next = 0;
+    ++row_count;
+}
+
+void ColumnBatch::clear() {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i].values.clear();
+        columns[i].text.clear();
+        columns[i].offsets.clear();
+        if (fields[i].type == ExportColumn::Type::TEXT) {
+            columns[i].offsets.push_back(0);
+        }
+    }
+    next = 0;
+    row_count = 0;
+}
+
+std::unique_ptr<TableWriter> TableWriter::open(
+    ExportFormat format, const fs::path& path,
+    const std::vector<ExportColumn>& schema, std::string& error) {
+    bool ok = false;
+    std::unique_ptr<TableWriter> writer;
+    if (format == ExportFormat::CSV) {
+        auto csv = std::make_unique<CsvWriter>();
+        ok = csv->open(path, schema);
+        writer = std::move(csv);
+    } else {
+        auto arrow = std::make_unique<ArrowStreamWriter>();
+        ok = arrow->open(path, schema);
+        writer = std::move(arrow);
+    }
+    if (!ok) {
+        error = "Failed to write " + path.string();
+        return nullptr;
+    }
+    return writer;
+}
+
+const std::vector<ExportColumn>& LogExporter::log_columns() {
+    using Type = ExportColumn::Type;
+    static const std::vector<ExportColumn> columns = {
+        {"id", Type::INT32},           {"time", Type::TIMESTAMP_MS},
+        {"filename", Type::TEXT},      {"boss_id", Type::INT32},
+        {"boss_name", Type::TEXT},     {"success", Type::BOOL},
+        {"duration_ms", Type::INT64},  {"uploaded", Type::BOOL},
+        {"error", Type::BOOL},         {"report_id", Type::TEXT},
+        {"permalink", Type::TEXT},
+    };
+    return columns;
+}
+
+const std::vector<ExportColumn>& LogExporter::player_columns() {
+    using Type = ExportColumn::Type;
+    static const std::vector<ExportColumn> columns = {
+        {"log_id", Type::INT32},     {"account", Type::TEXT},
+        {"character", Type::TEXT},   {"profession", Type::INT32},
+        {"elite_spec", Type::INT32}, {"subgroup", Type::INT32},
+    };
+    return columns;
+}
+
+LogExporter::LogExporter(ExportOptions options)
+    : options(std::move(options)),
+      logs(log_columns()),
+      players(player_columns()) {
+    if (this->options.rows_per_group == 0) this->options.rows_per_group = 1;
+}
+
+LogExporter::~LogExporter() { discard(); }
+
+bool LogExporter::open() {
+    std::error_code ec;
+    fs::create_directories(options.dir, ec);
+    // Two exports within a second get a numbered name
+    std::string stamp = file_stamp();
+    std::string extension = std::string(".") + export_format_name(options.format);
+    for (int n = 1;; ++n) {
+        std::string stem = n == 1 ? stamp : stamp + "-" + std::to_string(n);
+        result.logs_file = options.dir / ("logs-" + stem + extension);
+        result.players_file = options.dir / ("players-" + stem + extension);
+        if (!fs::exists(result.logs_file, ec) &&
+            !fs::exists(result.players_file, ec)) {
+            break;
+        }
+    }
+    logs_part = result.logs_file;
+    logs_part += ".part";
+    players_part = result.players_file;
+    players_part += ".part";
+
+    logs_writer =
+        TableWriter::open(options.format, logs_part, log_columns(), result.error);
+    if (logs_writer) {
+        players_writer = TableWriter::open(options.format, players_part,
+                                           player_columns(), result.error);
+    }
+    if (!players_writer) {
+        LOG_F(ERROR, "%s", result.error.c_str());
+        discard();
+        return false;
+    }
+    return true;
+}
+
+bool LogExporter::flush(ColumnBatch& batch, TableWriter& writer) {
+    if (batch.rows() == 0) return true;
+    bool ok = writer.write(batch);
+    batch.clear();
+    ++result.groups;
+    if (!ok) result.error = "Failed to write the export, is the disk full?";
+    return ok;
+}
+
+bool LogExporter::add(const Log& log) {
+    if (!logs_writer || !players_writer) return false;
+    logs.add_int(log.id);
+    logs.add_int(TimepointToMillis(log.time));
+    logs.add_text(log.filename);
+    logs.add_int(log.boss_id);
+    logs.add_text(log.boss_name);
+    logs.add_bool(log.success);
+    logs.add_int(log.duration_ms);
+    logs.add_bool(log.uploaded);
+    logs.add_bool(log.error);
+    logs.add_text(log.report_id);
+    logs.add_text(log.permalink);
+    logs.end_row();
+    ++result.logs;
+    result.players += add_roster(players, log);
+
+    if (logs.rows() >= options.rows_per_group &&
+        !flush(logs, *logs_writer)) {
+        return false;
+    }
+    if (players.rows() >= options.rows_per_group &&
+        !flush(players, *players_writer)) {
+        return false;
+    }
+    return true;
+}
+
+ExportResult LogExporter::close() {
+    if (!logs_writer || !players_writer) return result;
+    bool ok = flush(logs, *logs_writer) && flush(players, *players_writer);
+    ok = logs_writer->close() && ok;
+    ok = players_writer->close() && ok;
+    logs_writer.reset();
+    players_writer.reset();
+    if (ok) {
+        std::error_code ec;
+        fs::rename(logs_part, result.logs_file, ec);
+        if (!ec) fs::rename(players_part, result.players_file, ec);
+        if (ec) {
+            result.error = "Failed to rename the export: " + ec.message();
+            ok = false;
+        }
+    } else if (result.error.empty()) {
+        result.error = "Failed to write the export, is the disk full?";
+    }
+    if (!ok) {
+        LOG_F(ERROR, "%s", result.error.c_str());
+        discard();
+    }
+    result.ok = ok;
+    return result;
+}
+
+void LogExporter::discard() {
+    logs_writer.reset();
+    players_writer.reset();
+    std::error_code ec;
+    if (!logs_part.empty()) fs::remove(logs_part, ec);
+    if (!players_part.empty()) fs::remove(players_part, ec);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Log.h"
+
+enum class ExportFormat : int
+{
+	ARROW = 0, // Arrow IPC stream, read with pyarrow.ipc.open_stream and the like
+	CSV = 1,
+};
+
+const char* export_format_name(ExportFormat format);
+
+struct ExportColumn
+{
+	enum class Type { INT32, INT64, TIMESTAMP_MS, BOOL, TEXT };
+	const char* name;
+	Type type;
+};
+
+// One row group, kept a column at a time. Values are added row by row in
+// schema order.
+class ColumnBatch
+{
+public:
+	struct Column
+	{
+		std::vector<int64_t> values; // numbers, times and bools
+		std::vector<int32_t> offsets; // text: where each value starts, then the end
+		std::string text;
+	};
+
+	explicit ColumnBatch(std::vector<ExportColumn> schema);
+
+	void add_int(int64_t value);
+	void add_bool(bool value);
+	void add_text(std::string_view value);
+	void end_row();
+	void clear();
+
+	const std::vector<ExportColumn>& schema() const { return fields; }
+	const Column& column(size_t i) const { return columns[i]; }
+	size_t rows() const { return row_count; }
+
+private:
+	std::vector<ExportColumn> fields;
+	std::vector<Column> columns;
+	size_t next = 0;
+	size_t row_count = 0;
+};
+
+// Streams row groups of one table into a file
+class TableWriter
+{
+public:
+	virtual ~TableWriter() = default;
+
+	// Writes the header, or returns nullptr and sets error
+	static std::unique_ptr<TableWriter> open(ExportFormat format,
+		const std::filesystem::path& path, const std::vector<ExportColumn>& schema,
+		std::string& error);
+
+	virtual bool write(const ColumnBatch& batch) = 0;
+	// Ends the stream and flushes it
+	virtual bool close() = 0;
+};
+
+// Where an export into a directory stopped, so the next one can continue
+// from there
+struct ExportCursor
+{
+	std::string destination;
+	int format; // ExportFormat
+	int last_log_id; // every log up to this one has been exported
+	int64_t exported_ms;
+};
+
+struct ExportOptions
+{
+	std::filesystem::path dir;
+	ExportFormat format = ExportFormat::ARROW;
+	// Rows per record batch or CSV flush, memory use is bounded by this
+	// rather than by the history
+	size_t rows_per_group = 65536;
+	// Only logs added after the last export into dir in this format
+	bool since_last = false;
+};
+
+struct ExportResult
+{
+	bool ok = false;
+	std::string error;
+	size_t logs = 0;
+	size_t players = 0;
+	size_t groups = 0;
+	int last_log_id = 0; // where the next export with since_last starts
+	std::filesystem::path logs_file;
+	std::filesystem::path players_file;
+};
+
+// Writes logs into two tables: one row per log, and one row per player of
+// each log keyed by log_id. Both are written a row group at a time and
+// only appear under their final names once complete.
+class LogExporter
+{
+public:
+	explicit LogExporter(ExportOptions options);
+	~LogExporter();
+	LogExporter(const LogExporter&) = delete;
+	LogExporter& operator=(const LogExporter&) = delete;
+
+	static const std::vector<ExportColumn>& log_columns();
+	static const std::vector<ExportColumn>& player_columns();
+
+	// Creates logs-<time>.<ext> and players-<time>.<ext> in the directory
+	bool open();
+	bool add(const Log& log);
+	// Writes what is left and moves the files into place. Without a call the
+	// partial files are removed.
+	ExportResult close();
+
+	const std::string& error() const { return result.error; }
+
+private:
+	ExportOptions options;
+	ExportResult result;
+	ColumnBatch logs;
+	ColumnBatch players;
+	std::unique_ptr<TableWriter> logs_writer;
+	std::unique_ptr<TableWriter> players_writer;
+	std::filesystem::path logs_part;
+	std::filesystem::path players_part;
+
+	bool flush(ColumnBatch& batch, TableWriter& writer);
+	void discard();
+};
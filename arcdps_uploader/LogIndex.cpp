@@ -0,0 +1,86 @@
+#include "LogIndex.h"
+
+#include "LogScanner.h"
+
+uint32_t StringPool::intern(std::string_view s) {
+    auto it = interned.find(std::string(s));
+    if (it != interned.end()) return it->second;
+    uint32_t id = append(s);
+    interned.emplace(std::string(s), id);
+    return id;
+}
+
+uint32_t StringPool::append(std::string_view s) {
+    arena.append(s.data(), s.size());
+    ends.push_back((uint32_t)arena.size());
+    return (uint32_t)ends.size() - 1;
+}
+
+std::string_view StringPool::get(uint32_t id) const {
+    if (id >= ends.size()) return {};
+    uint32_t begin = id == 0 ? 0 : ends[id - 1];
+    return std::string_view(arena).substr(begin, ends[id] - begin);
+}
+
+size_t StringPool::memory_usage() const {
+    size_t bytes = arena.capacity() + ends.capacity() * sizeof(uint32_t);
+    // Rough cost of an unordered_map node holding a short string
+    bytes += interned.size() * (sizeof(std::string) + sizeof(uint32_t) +
+                                2 * sizeof(void*)) +
+             interned.bucket_count() * sizeof(void*);
+    return bytes;
+}
+
+const LogRecord& LogIndex::add(const Log& log) {
+    LogRecord r = {};
+    r.time_ms = TimepointToMillis(log.time);
+    r.id = log.id;
+    r.boss_id = log.boss_id;
+    r.dir = interned.intern(log.path.parent_path().string());
+    r.file = unique.append(log.file.empty() ? log.path.filename().string()
+                                            : log.file);
+    r.boss_name = interned.intern(log.boss_name);
+
+    std::string_view link = log.permalink;
+    size_t slash = link.rfind('/');
+    size_t split = slash == std::string_view::npos ? 0 : slash + 1;
+    r.link_base = interned.intern(link.substr(0, split));
+    r.link_tail = unique.append(link.substr(split));
+
+    r.flags = (log.uploaded ? LogRecord::FLAG_UPLOADED : 0) |
+              (log.error ? LogRecord::FLAG_ERROR : 0) |
+              (log.json_available ? LogRecord::FLAG_JSON_AVAILABLE : 0) |
+              (log.success ? LogRecord::FLAG_SUCCESS : 0);
+    records.push_back(r);
+    return records.back();
+}
+
+std::string_view LogIndex::filename(const LogRecord& r) const {
+    return LogScanner::log_stem(file(r));
+}
+
+std::string LogIndex::permalink(const LogRecord& r) const {
+    std::string link(interned.get(r.link_base));
+    link += unique.get(r.link_tail);
+    return link;
+}
+
+std::filesystem::path LogIndex::path(const LogRecord& r) const {
+    return std::filesystem::path(interned.get(r.dir)) / file(r);
+}
+
+std::string LogIndex::human_time(const LogRecord& r) const {
+    std::string_view name = filename(r);
+    LogTimestamp ts;
+    if (!LogScanner::parse_timestamp(name, ts)) {
+        return std::string(name);
+    }
+    char buf[32];
+    size_t len = LogScanner::format_human_time(ts, buf, sizeof(buf));
+    return std::string(buf, len);
+}
+
+size_t LogIndex::memory_usage() const {
+    return records.capacity() * sizeof(LogRecord) + interned.memory_usage() +
+           unique.memory_usage();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Log.h"
+
+// Strings packed into one buffer and referred to by a 32 bit id. intern()
+// returns the same id for equal strings, append() always adds a new entry.
+class StringPool
+{
+	std::string arena;
+	std::vector<uint32_t> ends;
+	std::unordered_map<std::string, uint32_t> interned;
+public:
+	uint32_t intern(std::string_view s);
+	uint32_t append(std::string_view s);
+	std::string_view get(uint32_t id) const;
+
+	size_t size() const { return ends.size(); }
+	size_t memory_usage() const;
+};
+
+// Fixed size view of a Log for lists that can hold the whole history.
+// Strings live in the owning LogIndex, players are not kept at all.
+struct LogRecord
+{
+	int64_t time_ms;
+	int32_t id;
+	int32_t boss_id;
+	uint32_t dir;
+	uint32_t file;
+	uint32_t boss_name;
+	uint32_t link_base; // permalink up to and including the last '/'
+	uint32_t link_tail;
+	uint8_t flags;
+
+	enum : uint8_t {
+		FLAG_UPLOADED = 1 << 0,
+		FLAG_ERROR = 1 << 1,
+		FLAG_JSON_AVAILABLE = 1 << 2,
+		FLAG_SUCCESS = 1 << 3,
+	};
+
+	bool uploaded() const { return flags & FLAG_UPLOADED; }
+	bool error() const { return flags & FLAG_ERROR; }
+	bool json_available() const { return flags & FLAG_JSON_AVAILABLE; }
+	bool success() const { return flags & FLAG_SUCCESS; }
+	std::chrono::system_clock::time_point time() const { return TimepointFromMillis(time_ms); }
+};
+
+class LogIndex
+{
+	std::vector<LogRecord> records;
+	// Directories, boss names and permalink bases repeat a lot
+	StringPool interned;
+	StringPool unique;
+public:
+	void reserve(size_t count) { records.reserve(count); }
+	const LogRecord& add(const Log& log);
+
+	size_t size() const { return records.size(); }
+	bool empty() const { return records.empty(); }
+	const LogRecord& operator[](size_t i) const { return records[i]; }
+	std::vector<LogRecord>::const_iterator begin() const { return records.begin(); }
+	std::vector<LogRecord>::const_iterator end() const { return records.end(); }
+
+	std::string_view boss_name(const LogRecord& r) const { return interned.get(r.boss_name); }
+	std::string_view file(const LogRecord& r) const { return unique.get(r.file); }
+	// Log::filename, the file name without extensions
+	std::string_view filename(const LogRecord& r) const;
+	std::string permalink(const LogRecord& r) const;
+	std::filesystem::path path(const LogRecord& r) const;
+	// Formatted on demand from the name, "%I:%M%p (%a %b %d)"
+	std::string human_time(const LogRecord& r) const;
+
+	size_t memory_usage() const;
+};
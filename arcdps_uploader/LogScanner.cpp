@@ -0,0 +1,241 @@
+#include "LogScanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <iterator>
+#include <thread>
+
+#include "AsyncLog.h"
+#include "loguru.hpp"
+
+namespace fs = std::filesystem;
+
+int64_t LogScanner::days_from_civil(int year, int month, int day) {
+    // Howard Hinnant's days_from_civil
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yoe = (unsigned)(year - era * 400);
+    const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+std::chrono::system_clock::time_point LocalTimeCache::to_system(
+    const LogTimestamp& ts) {
+    int64_t local = LogScanner::days_from_civil(ts.year, ts.month, ts.day) *
+                        86400 +
+                    ts.hour * 3600 + ts.minute * 60 + ts.second;
+    int64_t hour = local / 3600;
+
+    auto it = offsets.find(hour);
+    if (it == offsets.end()) {
+        std::tm tm = {};
+        tm.tm_year = ts.year - 1900;
+        tm.tm_mon = ts.month - 1;
+        tm.tm_mday = ts.day;
+        tm.tm_hour = ts.hour;
+        tm.tm_isdst = -1;
+        std::time_t utc = std::mktime(&tm);
+        it = offsets.emplace(hour, hour * 3600 - (int64_t)utc).first;
+    }
+    return std::chrono::system_clock::time_point(
+        std::chrono::seconds(local - it->second));
+}
+
+LogScanner::LogScanner(unsigned thread_count)
+    : thread_count(thread_count ? thread_count : 1) {}
+
+std::string_view LogScanner::log_stem(std::string_view file_name) {
+    // Same as path::replace_extension() twice
+    for (int i = 0; i < 2; ++i) {
+        size_t dot = file_name.rfind('.');
+        if (dot == std::string_view::npos || dot == 0) break;
+        file_name = file_name.substr(0, dot);
+    }
+    return file_name;
+}
+
+bool LogScanner::is_log_file(std::string_view file_name) {
+    auto ends_with = [file_name](std::string_view suffix) {
+        return file_name.size() > suffix.size() &&
+               file_name.compare(file_name.size() - suffix.size(),
+                                 suffix.size(), suffix) == 0;
+    };
+    return ends_with(".zevtc") || ends_with(".evtc");
+}
+
+bool LogScanner::parse_timestamp(std::string_view stem, LogTimestamp& ts) {
+    if (stem.size() < 15 || stem[8] != '-') return false;
+
+    auto digits = [stem](size_t pos, size_t count, int& out) {
+        int v = 0;
+        for (size_t i = pos; i < pos + count; ++i) {
+            char c = stem[i];
+            if (c < '0' || c > '9') return false;
+            v = v * 10 + (c - '0');
+        }
+        out = v;
+        return true;
+    };
+
+    if (!digits(0, 4, ts.year) || !digits(4, 2, ts.month) ||
+        !digits(6, 2, ts.day) || !digits(9, 2, ts.hour) ||
+        !digits(11, 2, ts.minute) || !digits(13, 2, ts.second)) {
+        return false;
+    }
+    return ts.month >= 1 && ts.month <= 12 && ts.day >= 1 && ts.day <= 31 &&
+           ts.hour < 24 && ts.minute < 60 && ts.second < 61;
+}
+
+size_t LogScanner::format_human_time(const LogTimestamp& ts, char* buf,
+                                     size_t size) {
+    static const char* weekdays[] = {"Sun", "Mon", "Tue", "Wed",
+                                     "Thu", "Fri", "Sat"};
+    static const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+    // 1970-01-01 was a Thursday
+    int64_t days = days_from_civil(ts.year, ts.month, ts.day);
+    int weekday = (int)(((days % 7) + 11) % 7);
+    int hour12 = ts.hour % 12 == 0 ? 12 : ts.hour % 12;
+
+    int n = snprintf(buf, size, "%02d:%02d%s (%s %s %02d)", hour12, ts.minute,
+                     ts.hour < 12 ? "AM" : "PM", weekdays[weekday],
+                     months[ts.month - 1], ts.day);
+    return n < 0 ? 0 : (std::min)((size_t)n, size - 1);
+}
+
+void LogScanner::scan_directory(Worker& worker, const fs::path& dir,
+                                const std::unordered_set<std::string>& known,
+                                Progress& progress) {
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        const auto& entry = *it;
+        std::error_code type_ec;
+        if (entry.is_directory(type_ec)) {
+            progress.outstanding.fetch_add(1);
+            {
+                std::lock_guard<std::mutex> lk(worker.mutex);
+                worker.dirs.push_back(entry.path());
+            }
+            {
+                std::lock_guard<std::mutex> lk(progress.mutex);
+                progress.queued++;
+            }
+            progress.cv.notify_one();
+            continue;
+        }
+        if (!entry.is_regular_file(type_ec)) continue;
+
+        std::string name = entry.path().filename().string();
+        if (!is_log_file(name)) continue;
+        std::string stem(log_stem(name));
+        if (known.count(stem)) continue;
+
+        ASYNC_LOG_F(INFO, "Found new log: %s", entry.path().string());
+        Log log = {};
+        log.id = -1;
+        log.path = entry.path();
+        log.file = std::move(name);
+        log.filename = std::move(stem);
+
+        LogTimestamp ts;
+        if (parse_timestamp(log.filename, ts)) {
+            log.time = worker.times.to_system(ts);
+            char timestr[32];
+            size_t len = format_human_time(ts, timestr, sizeof(timestr));
+            log.human_time.assign(timestr, len);
+        } else {
+            ASYNC_LOG_F(INFO, "Failed to parse time: %s", log.filename);
+            log.human_time = log.filename;
+        }
+        worker.found.push_back(std::move(log));
+    }
+    if (ec) {
+        LOG_F(WARNING, "Failed to scan %s: %s", dir.string().c_str(),
+              ec.message().c_str());
+    }
+}
+
+std::vector<Log> LogScanner::scan(const fs::path& root,
+                                  const std::unordered_set<std::string>& known,
+                                  const std::atomic<bool>* cancel) {
+    std::vector<Worker> workers(thread_count);
+    workers[0].dirs.push_back(root);
+
+    Progress progress;
+
+    auto take = [&workers](size_t self, fs::path& dir) {
+        {
+            Worker& own = workers[self];
+            std::lock_guard<std::mutex> lk(own.mutex);
+            if (!own.dirs.empty()) {
+                dir = std::move(own.dirs.back());
+                own.dirs.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < workers.size(); ++i) {
+            Worker& victim = workers[(self + i) % workers.size()];
+            std::lock_guard<std::mutex> lk(victim.mutex);
+            if (!victim.dirs.empty()) {
+                dir = std::move(victim.dirs.front());
+                victim.dirs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto run = [&](size_t self) {
+        Worker& worker = workers[self];
+        fs::path dir;
+        while (progress.outstanding.load() > 0) {
+            // Read before looking for work, a directory queued after a
+            // failed take changes it and the wait returns at once
+            uint64_t queued;
+            {
+                std::lock_guard<std::mutex> lk(progress.mutex);
+                queued = progress.queued;
+            }
+            if (!take(self, dir)) {
+                std::unique_lock<std::mutex> lk(progress.mutex);
+                progress.cv.wait(lk, [&] {
+                    return progress.queued != queued ||
+                           progress.outstanding.load() == 0;
+                });
+                continue;
+            }
+            if (!cancel || !cancel->load()) {
+                scan_directory(worker, dir, known, progress);
+            }
+            if (progress.outstanding.fetch_sub(1) == 1) {
+                // Taken so a worker between its check and its wait can't
+                // miss the notification
+                { std::lock_guard<std::mutex> lk(progress.mutex); }
+                progress.cv.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers.size(); ++i) {
+        threads.emplace_back(run, i);
+    }
+    run(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::vector<Log> found;
+    for (auto& worker : workers) {
+        std::move(worker.found.begin(), worker.found.end(),
+                  std::back_inserter(found));
+    }
+    std::sort(found.begin(), found.end(),
+              [](const Log& a, const Log& b) { return a.time < b.time; });
+    return found;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Log.h"
+
+// Local date/time encoded in an arcdps log name (YYYYMMDD-HHMMSS)
+struct LogTimestamp
+{
+	int year;
+	int month;
+	int day;
+	int hour;
+	int minute;
+	int second;
+};
+
+// Converts local times to system time. mktime is slow and serialised by the
+// CRT, so the UTC offset is looked up once per local hour and reused.
+class LocalTimeCache
+{
+	std::unordered_map<int64_t, int64_t> offsets;
+public:
+	std::chrono::system_clock::time_point to_system(const LogTimestamp& ts);
+};
+
+// Finds new logs below a directory. Every directory is a task; workers pop
+// their own tasks LIFO and steal FIFO from the others when they run dry, so
+// a single huge boss folder doesn't leave the other threads idle.
+class LogScanner
+{
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<std::filesystem::path> dirs;
+		std::vector<Log> found;
+		LocalTimeCache times;
+	};
+
+	// Shared by the workers of one scan. Workers with nothing to take or
+	// steal sleep on cv until a directory is queued or the scan is done.
+	struct Progress
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::atomic<size_t> outstanding{1}; // directories queued or being scanned
+		uint64_t queued = 0; // guarded by mutex
+	};
+
+	unsigned thread_count;
+
+	void scan_directory(Worker& worker, const std::filesystem::path& dir,
+		const std::unordered_set<std::string>& known, Progress& progress);
+public:
+	explicit LogScanner(unsigned thread_count = 1);
+
+	// Logs under root whose name is not in known, sorted by time. Once cancel
+	// is set the directories still queued are skipped and the result is
+	// incomplete.
+	std::vector<Log> scan(const std::filesystem::path& root, const std::unordered_set<std::string>& known,
+		const std::atomic<bool>* cancel = nullptr);
+
+	// Log name without its extensions, as stored in Log::filename
+	static std::string_view log_stem(std::string_view file_name);
+	static bool is_log_file(std::string_view file_name);
+
+	// No allocations, returns false if stem is not YYYYMMDD-HHMMSS
+	static bool parse_timestamp(std::string_view stem, LogTimestamp& ts);
+	// Same output as strftime("%I:%M%p (%a %b %d)"), returns the length
+	static size_t format_human_time(const LogTimestamp& ts, char* buf, size_t size);
+	// Days since 1970-01-01 of a civil date
+	static int64_t days_from_civil(int year, int month, int day);
+};
@@ -0,0 +1,153 @@
+#include "LogValidator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "EvtcReader.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr uint32_t ZIP_LOCAL_HEADER = 0x04034b50;
+constexpr uint32_t ZIP_CENTRAL_HEADER = 0x02014b50;
+constexpr uint32_t ZIP_END_OF_DIRECTORY = 0x06054b50;
+constexpr size_t LOCAL_HEADER_SIZE = 30;
+constexpr size_t CENTRAL_HEADER_SIZE = 46;
+constexpr size_t END_OF_DIRECTORY_SIZE = 22;
+// The end record can be followed by a comment of up to 64K
+constexpr size_t END_SEARCH = END_OF_DIRECTORY_SIZE + 0xffff;
+
+template <typename T>
+T read(const uint8_t* p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+struct ZipEntry {
+    uint32_t crc;
+    uint32_t uncompressed;
+};
+
+// Finds the log through the central directory. It is written last, so it
+// is the first thing missing when the game dies while saving.
+bool read_zip_entry(const fs::path& path, uint64_t size, ZipEntry& entry,
+                    std::string& reason) {
+    std::ifstream in(path, std::ios::binary);
+    size_t tail_size = (size_t)(std::min)(size, (uint64_t)END_SEARCH);
+    std::vector<uint8_t> tail(tail_size);
+    in.seekg((std::streamoff)(size - tail_size));
+    in.read((char*)tail.data(), (std::streamsize)tail_size);
+    if ((size_t)in.gcount() != tail_size) {
+        reason = "Failed to read log";
+        return false;
+    }
+
+    const uint8_t* end = nullptr;
+    for (size_t i = tail_size; i-- > 0 && !end;) {
+        if (i + END_OF_DIRECTORY_SIZE <= tail_size &&
+            read<uint32_t>(tail.data() + i) == ZIP_END_OF_DIRECTORY) {
+            end = tail.data() + i;
+        }
+    }
+    if (!end) {
+        reason = "Zip archive is incomplete";
+        return false;
+    }
+    uint16_t entries = read<uint16_t>(end + 10);
+    uint32_t directory_size = read<uint32_t>(end + 12);
+    uint32_t directory_at = read<uint32_t>(end + 16);
+    uint64_t end_at = size - tail_size + (uint64_t)(end - tail.data());
+    if (entries == 0) {
+        reason = "Zip archive is empty";
+        return false;
+    }
+    if (directory_size < CENTRAL_HEADER_SIZE ||
+        (uint64_t)directory_at + directory_size > end_at) {
+        reason = "Zip central directory is corrupt";
+        return false;
+    }
+
+    uint8_t central[CENTRAL_HEADER_SIZE];
+    in.seekg(directory_at);
+    in.read((char*)central, sizeof(central));
+    if ((size_t)in.gcount() != sizeof(central) ||
+        read<uint32_t>(central) != ZIP_CENTRAL_HEADER) {
+        reason = "Zip central directory is corrupt";
+        return false;
+    }
+    entry.crc = read<uint32_t>(central + 16);
+    uint32_t compressed = read<uint32_t>(central + 20);
+    entry.uncompressed = read<uint32_t>(central + 24);
+    uint32_t local_at = read<uint32_t>(central + 42);
+
+    uint8_t local[LOCAL_HEADER_SIZE];
+    in.seekg(local_at);
+    in.read((char*)local, sizeof(local));
+    if ((size_t)in.gcount() != sizeof(local) ||
+        read<uint32_t>(local) != ZIP_LOCAL_HEADER) {
+        reason = "Zip entry header is corrupt";
+        return false;
+    }
+    uint64_t data_end = (uint64_t)local_at + LOCAL_HEADER_SIZE +
+                        read<uint16_t>(local + 26) +
+                        read<uint16_t>(local + 28) + compressed;
+    if (data_end > directory_at) {
+        reason = "Zip entry is truncated";
+        return false;
+    }
+    return true;
+}
+}  // namespace
+
+LogValidation LogValidator::validate(const fs::path& path) {
+    LogValidation result;
+    std::error_code ec;
+    uint64_t size = fs::file_size(path, ec);
+    if (ec) {
+        result.reason = "Log file is missing";
+        return result;
+    }
+    if (size == 0) {
+        result.reason = "Log file is empty";
+        return result;
+    }
+
+    bool zipped = path.extension() == ".zevtc";
+    ZipEntry entry = {};
+    if (zipped && !read_zip_entry(path, size, entry, result.reason)) {
+        return result;
+    }
+
+    EvtcReader reader;
+    if (!reader.open(path)) {
+        result.reason = reader.error();
+        return result;
+    }
+    if (reader.agents().empty()) {
+        result.reason = "Log has no agents";
+        return result;
+    }
+    while (!reader.next_events().empty()) {
+    }
+    result.events = reader.events_read();
+    if (!reader.error().empty()) {
+        result.reason = reader.error();
+        return result;
+    }
+    if (zipped && (reader.crc() != entry.crc ||
+                   reader.inflated_bytes() != entry.uncompressed)) {
+        result.reason = "Log does not match its zip checksum";
+        return result;
+    }
+    if (result.events < MIN_EVENTS) {
+        result.reason =
+            "Log has only " + std::to_string(result.events) + " events";
+        return result;
+    }
+
+    result.ok = true;
+    return result;
+}
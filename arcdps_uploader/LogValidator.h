@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+struct LogValidation
+{
+	bool ok = false;
+	std::string reason; // why the log can't be uploaded, empty if ok
+	uint64_t events = 0;
+};
+
+// Pre-flight checks for logs dps.report would reject as "Invalid File":
+// empty files, archives cut short by a game crash, bad CRCs, and EVTC data
+// that is the wrong revision, has no agents or next to no events. A .zevtc
+// has its central directory checked and is inflated once through
+// EvtcReader's window, a .evtc is mapped.
+class LogValidator
+{
+public:
+	// Fewer events than this is a log arcdps gave up on right after starting
+	static constexpr uint64_t MIN_EVENTS = 16;
+
+	static LogValidation validate(const std::filesystem::path& path);
+};
@@ -0,0 +1,261 @@
+#include "Metrics.h"
+
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <variant>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static size_t this_thread_shard() {
+    static std::atomic<size_t> next_shard{0};
+    thread_local size_t shard =
+        next_shard.fetch_add(1, std::memory_order_relaxed) %
+        Metrics::SHARD_COUNT;
+    return shard;
+}
+
+static int highest_bit(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+void Metrics::Counter::inc(uint64_t n) {
+    shards[this_thread_shard()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Counter::value() const {
+    uint64_t v = 0;
+    for (const auto& s : shards) {
+        v += s.value.load(std::memory_order_relaxed);
+    }
+    return v;
+}
+
+int Metrics::Histogram::bucket_index(uint64_t us) {
+    if (us < SUB_COUNT) return (int)us;
+    int shift = highest_bit(us) - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + (int)((us >> shift) & (SUB_COUNT - 1));
+}
+
+uint64_t Metrics::Histogram::bucket_upper_us(int index) {
+    if (index < SUB_COUNT) return (uint64_t)index;
+    int shift = index / SUB_COUNT - 1;
+    uint64_t sub = (uint64_t)(index % SUB_COUNT);
+    return ((SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+void Metrics::Histogram::observe(double seconds) {
+    observe_us(seconds <= 0.0 ? 0 : (uint64_t)(seconds * 1e6));
+}
+
+void Metrics::Histogram::observe_us(uint64_t us) {
+    shards[this_thread_shard()].buckets[bucket_index(us)].fetch_add(
+        1, std::memory_order_relaxed);
+    total.inc();
+    sum_us.inc(us);
+}
+
+uint64_t Metrics::Histogram::bucket_count(int index) const {
+    uint64_t n = 0;
+    for (const auto& s : shards) {
+        n += s.buckets[index].load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+double Metrics::Histogram::percentile(double q) const {
+    uint64_t n = 0;
+    std::array<uint64_t, BUCKET_COUNT> snapshot;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        snapshot[i] = bucket_count(i);
+        n += snapshot[i];
+    }
+    if (n == 0) return 0.0;
+
+    uint64_t rank = (uint64_t)std::ceil(q * (double)n);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += snapshot[i];
+        if (seen >= rank) return (double)bucket_upper_us(i) / 1e6;
+    }
+    return (double)bucket_upper_us(BUCKET_COUNT - 1) / 1e6;
+}
+
+uint64_t Metrics::Histogram::count_below(double seconds) const {
+    uint64_t limit = (uint64_t)(seconds * 1e6);
+    uint64_t n = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        if (bucket_upper_us(i) > limit) break;
+        n += bucket_count(i);
+    }
+    return n;
+}
+
+namespace {
+    using Metric = std::variant<std::unique_ptr<Metrics::Counter>,
+                                std::unique_ptr<Metrics::Gauge>,
+                                std::unique_ptr<Metrics::Histogram>>;
+
+    struct Family {
+        std::string help;
+        const char* type;
+        std::map<std::string, Metric> series;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::map<std::string, Family> families;
+    };
+
+    Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    template <typename T>
+    T& get_or_create(const std::string& name, const std::string& help,
+                     const std::string& labels, const char* type) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lk(r.mutex);
+        Family& family = r.families[name];
+        if (family.help.empty()) {
+            family.help = help;
+            family.type = type;
+        }
+        auto it = family.series.find(labels);
+        if (it == family.series.end()) {
+            it = family.series.emplace(labels, std::make_unique<T>()).first;
+        }
+        return *std::get<std::unique_ptr<T>>(it->second);
+    }
+
+    // Exported bucket bounds (seconds), internal buckets are finer
+    constexpr double EXPORT_BOUNDS[] = {0.001, 0.005, 0.01, 0.025, 0.05,
+                                        0.1,   0.25,  0.5,  1,     2.5,
+                                        5,     10,    30,   60,    300};
+
+    std::string series_name(const std::string& name, const std::string& labels,
+                            const std::string& extra = "") {
+        std::string all = labels;
+        if (!extra.empty()) {
+            if (!all.empty()) all += ",";
+            all += extra;
+        }
+        return all.empty() ? name : name + "{" + all + "}";
+    }
+}
+
+Metrics::Counter& Metrics::counter(const std::string& name,
+                                   const std::string& help,
+                                   const std::string& labels) {
+    return get_or_create<Counter>(name, help, labels, "counter");
+}
+
+Metrics::Gauge& Metrics::gauge(const std::string& name, const std::string& help,
+                               const std::string& labels) {
+    return get_or_create<Gauge>(name, help, labels, "gauge");
+}
+
+Metrics::Histogram& Metrics::histogram(const std::string& name,
+                                       const std::string& help,
+                                       const std::string& labels) {
+    return get_or_create<Histogram>(name, help, labels, "histogram");
+}
+
+void Metrics::observe_http(const std::string& endpoint, int status_code,
+                           double seconds, uint64_t bytes_sent) {
+    std::string ep = "endpoint=\"" + escape_label(endpoint) + "\"";
+    counter("uploader_http_requests_total", "Outbound HTTP requests",
+            ep + ",code=\"" + std::to_string(status_code) + "\"")
+        .inc();
+    if (status_code < 200 || status_code >= 300) {
+        counter("uploader_http_failures_total",
+                "Outbound HTTP requests without a 2xx response", ep)
+            .inc();
+    }
+    histogram("uploader_http_request_seconds", "Outbound HTTP request latency",
+              ep)
+        .observe(seconds);
+    if (bytes_sent) {
+        counter("uploader_http_sent_bytes_total", "Request bytes sent", ep)
+            .inc(bytes_sent);
+    }
+}
+
+std::string Metrics::escape_label(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+std::string Metrics::render() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.mutex);
+    std::ostringstream out;
+    for (const auto& [name, family] : r.families) {
+        out << "# HELP " << name << " " << family.help << "\n";
+        out << "# TYPE " << name << " " << family.type << "\n";
+        for (const auto& [labels, metric] : family.series) {
+            if (auto c = std::get_if<std::unique_ptr<Counter>>(&metric)) {
+                out << series_name(name, labels) << " " << (*c)->value()
+                    << "\n";
+            } else if (auto g = std::get_if<std::unique_ptr<Gauge>>(&metric)) {
+                out << series_name(name, labels) << " " << (*g)->value()
+                    << "\n";
+            } else if (auto h =
+                           std::get_if<std::unique_ptr<Histogram>>(&metric)) {
+                for (double bound : EXPORT_BOUNDS) {
+                    std::ostringstream le;
+                    le << "le=\"" << bound << "\"";
+                    out << series_name(name + "_bucket", labels, le.str())
+                        << " " << (*h)->count_below(bound) << "\n";
+                }
+                out << series_name(name + "_bucket", labels, "le=\"+Inf\"")
+                    << " " << (*h)->count() << "\n";
+                out << series_name(name + "_sum", labels) << " "
+                    << (*h)->sum_seconds() << "\n";
+                out << series_name(name + "_count", labels) << " "
+                    << (*h)->count() << "\n";
+            }
+        }
+    }
+    return out.str();
+}
+
+bool Metrics::write_text_file(const fs::path& path) {
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) return false;
+        out << render();
+        if (!out) return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
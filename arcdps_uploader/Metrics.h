@@ -0,0 +1,93 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Process wide metrics registry (counters, gauges, latency histograms) with a
+// Prometheus text exposition export. Metric objects are created once and live
+// until exit, so callers can keep references; updates are lock free.
+namespace Metrics {
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    // Monotonic counter, sharded per thread so concurrent increments
+    // don't contend on one cache line
+    class Counter {
+        std::array<Shard, SHARD_COUNT> shards;
+    public:
+        void inc(uint64_t n = 1);
+        uint64_t value() const;
+    };
+
+    class Gauge {
+        std::atomic<int64_t> v{0};
+    public:
+        void set(int64_t value) { v.store(value, std::memory_order_relaxed); }
+        void add(int64_t delta) { v.fetch_add(delta, std::memory_order_relaxed); }
+        int64_t value() const { return v.load(std::memory_order_relaxed); }
+    };
+
+    // Log-linear (HDR style) histogram over microseconds: 8 sub-buckets per
+    // power of two, so any recorded value is within 12.5% of its bucket.
+    // Buckets are sharded per thread like Counter and summed when read.
+    class Histogram {
+    public:
+        static constexpr int SUB_BITS = 3;
+        static constexpr int SUB_COUNT = 1 << SUB_BITS;
+        static constexpr int BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+        void observe(double seconds);
+        void observe_us(uint64_t us);
+
+        uint64_t count() const { return total.value(); }
+        double sum_seconds() const { return (double)sum_us.value() / 1e6; }
+        // Approximate value (seconds) at quantile q in [0, 1]
+        double percentile(double q) const;
+        // Number of observations <= seconds
+        uint64_t count_below(double seconds) const;
+
+        static int bucket_index(uint64_t us);
+        static uint64_t bucket_upper_us(int index);
+    private:
+        uint64_t bucket_count(int index) const;
+
+        struct alignas(64) BucketShard {
+            std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+        };
+        std::array<BucketShard, SHARD_COUNT> shards;
+        Counter total;
+        Counter sum_us;
+    };
+
+    struct Timer {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double seconds() const {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    };
+
+    // labels use Prometheus syntax without braces, e.g. endpoint="dps.report"
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    // Records one outbound request against endpoint: count by status code,
+    // latency and bytes sent
+    void observe_http(const std::string& endpoint, int status_code, double seconds, uint64_t bytes_sent = 0);
+
+    std::string escape_label(const std::string& value);
+
+    std::string render();
+    // Atomically replaces path with the current exposition text
+    bool write_text_file(const std::filesystem::path& path);
+}
+
+#endif // __METRICS_H__
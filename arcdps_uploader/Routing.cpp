@@ -0,0 +1,349 @@
+#include "Routing.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include "Revtc.h"
+
+namespace {
+constexpr int MINUTES_PER_DAY = 24 * 60;
+constexpr int CATEGORY_BITS = 32;
+
+struct CategoryName {
+    const char* name;
+    Revtc::BossCategory category;
+};
+
+const CategoryName CATEGORY_NAMES[] = {
+    {"raids", Revtc::BossCategory::RAIDS},
+    {"fractals", Revtc::BossCategory::FRACTALS},
+    {"strikes", Revtc::BossCategory::STRIKES},
+    {"golems", Revtc::BossCategory::GOLEMS},
+    {"wvw", Revtc::BossCategory::WVW},
+    {"unknown", Revtc::BossCategory::UNKNOWN},
+};
+
+std::string trim(const std::string& s) {
+    size_t begin = 0, end = s.size();
+    while (begin < end && std::isspace((unsigned char)s[begin])) ++begin;
+    while (end > begin && std::isspace((unsigned char)s[end - 1])) --end;
+    return s.substr(begin, end - begin);
+}
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return (char)std::tolower(c); });
+    return s;
+}
+
+// Trimmed, non-empty parts of s
+std::vector<std::string> split(const std::string& s, char separator) {
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (begin <= s.size()) {
+        size_t end = s.find(separator, begin);
+        if (end == std::string::npos) end = s.size();
+        std::string part = trim(s.substr(begin, end - begin));
+        if (!part.empty()) parts.push_back(std::move(part));
+        begin = end + 1;
+    }
+    return parts;
+}
+
+bool parse_number(const std::string& s, long long& value) {
+    if (s.empty() || !std::isdigit((unsigned char)s[0])) return false;
+    char* end = nullptr;
+    value = std::strtoll(s.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+// 19:00 or 19
+bool parse_clock(const std::string& s, int& minute) {
+    size_t colon = s.find(':');
+    long long hours = 0, minutes = 0;
+    if (!parse_number(trim(s.substr(0, colon)), hours)) return false;
+    if (colon != std::string::npos &&
+        !parse_number(trim(s.substr(colon + 1)), minutes)) {
+        return false;
+    }
+    if (hours > 24 || minutes > 59 || hours * 60 + minutes > MINUTES_PER_DAY) {
+        return false;
+    }
+    minute = (int)(hours * 60 + minutes) % MINUTES_PER_DAY;
+    return true;
+}
+
+bool parse_duration(const std::string& s, int64_t& ms) {
+    size_t digits = 0;
+    while (digits < s.size() && std::isdigit((unsigned char)s[digits])) {
+        ++digits;
+    }
+    long long value = 0;
+    if (!parse_number(s.substr(0, digits), value)) return false;
+    std::string unit = lower(trim(s.substr(digits)));
+    if (unit.empty() || unit == "s") {
+        ms = value * 1000;
+    } else if (unit == "m") {
+        ms = value * 60 * 1000;
+    } else if (unit == "ms") {
+        ms = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool in_window(int minute, int start, int end) {
+    if (start == end) return true;
+    if (start < end) return minute >= start && minute < end;
+    return minute >= start || minute < end;
+}
+}  // namespace
+
+uint32_t RouteRule::category_bit(int category) {
+    return category >= 0 && category < CATEGORY_BITS ? 1u << category : 0;
+}
+
+const char* RouteRule::category_name(int category) {
+    for (const auto& entry : CATEGORY_NAMES) {
+        if ((int)entry.category == category) return entry.name;
+    }
+    return "unknown";
+}
+
+std::string RouteRule::normalize_account(std::string account) {
+    return lower(trim(account));
+}
+
+bool RouteRule::parse(const std::string& text, std::string& error) {
+    RouteRule rule = *this;
+    for (const std::string& clause : split(text, ';')) {
+        size_t key_end = 0;
+        while (key_end < clause.size() &&
+               std::isalpha((unsigned char)clause[key_end])) {
+            ++key_end;
+        }
+        std::string key = lower(clause.substr(0, key_end));
+        std::string rest = trim(clause.substr(key_end));
+        std::string op;
+        if (rest.rfind(">=", 0) == 0) {
+            op = ">=";
+        } else if (rest.rfind("=", 0) == 0) {
+            op = "=";
+        }
+        std::string value = trim(rest.substr(op.size()));
+        if (op.empty() && !rest.empty()) {
+            error = "Expected = in \"" + clause + "\"";
+            return false;
+        }
+
+        if ((key == "success" || key == "clears") && op.empty()) {
+            rule.success_only = true;
+        } else if (key == "category" && op == "=") {
+            uint32_t mask = 0;
+            for (const std::string& name : split(value, ',')) {
+                auto it = std::find_if(
+                    std::begin(CATEGORY_NAMES), std::end(CATEGORY_NAMES),
+                    [n = lower(name)](const CategoryName& c) {
+                        return n == c.name;
+                    });
+                if (it == std::end(CATEGORY_NAMES)) {
+                    error = "Unknown category \"" + name + "\"";
+                    return false;
+                }
+                mask |= category_bit((int)it->category);
+            }
+            rule.categories &= mask;
+        } else if (key == "boss" && op == "=") {
+            rule.boss_ids.clear();
+            for (const std::string& id : split(value, ',')) {
+                long long boss_id = 0;
+                if (!parse_number(id, boss_id) || boss_id <= 0 ||
+                    boss_id > 0xffff) {
+                    error = "Invalid boss ID \"" + id + "\"";
+                    return false;
+                }
+                rule.boss_ids.push_back((uint16_t)boss_id);
+            }
+        } else if (key == "duration" && op == ">=") {
+            int64_t ms = 0;
+            if (!parse_duration(value, ms)) {
+                error = "Invalid duration \"" + value + "\"";
+                return false;
+            }
+            rule.min_duration_ms = (std::max)(rule.min_duration_ms, ms);
+        } else if (key == "accounts" && op == "=") {
+            // "2 of a.1234, b.5678"
+            long long required = 1;
+            size_t of = lower(value).find(" of ");
+            if (of != std::string::npos &&
+                parse_number(trim(value.substr(0, of)), required)) {
+                value = value.substr(of + 4);
+            }
+            rule.accounts.clear();
+            for (const std::string& account : split(value, ',')) {
+                rule.accounts.push_back(normalize_account(account));
+            }
+            if (rule.accounts.empty() || required <= 0) {
+                error = "No accounts in \"" + clause + "\"";
+                return false;
+            }
+            rule.min_accounts = (int)required;
+        } else if (key == "time" && op == "=") {
+            size_t dash = value.find('-');
+            int start = 0, end = 0;
+            if (dash == std::string::npos ||
+                !parse_clock(trim(value.substr(0, dash)), start) ||
+                !parse_clock(trim(value.substr(dash + 1)), end)) {
+                error = "Invalid time window \"" + value + "\"";
+                return false;
+            }
+            rule.window_start = start;
+            rule.window_end = end;
+        } else {
+            error = "Unknown clause \"" + clause + "\"";
+            return false;
+        }
+    }
+    *this = std::move(rule);
+    return true;
+}
+
+void RoutingTable::set(Bits& bits, size_t rule) const {
+    bits[rule / 64] |= 1ull << (rule % 64);
+}
+
+RoutingTable::RoutingTable(const std::vector<RouteRule>& rules)
+    : count(rules.size()), words((rules.size() + 63) / 64) {
+    by_category.assign(CATEGORY_BITS, empty_bits());
+    any_boss = empty_bits();
+    without_success = empty_bits();
+    without_accounts = empty_bits();
+
+    std::vector<std::pair<int64_t, size_t>> minimums;
+    std::vector<int> cuts = {0};
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const RouteRule& rule = rules[i];
+        for (int c = 0; c < CATEGORY_BITS; ++c) {
+            if (rule.categories & (1u << c)) set(by_category[c], i);
+        }
+
+        if (rule.boss_ids.empty()) set(any_boss, i);
+        for (uint16_t id : rule.boss_ids) {
+            auto it = by_boss.try_emplace(id, empty_bits()).first;
+            set(it->second, i);
+        }
+
+        if (!rule.success_only) set(without_success, i);
+        minimums.emplace_back((std::max)(rule.min_duration_ms, (int64_t)0), i);
+
+        if (rule.window_start >= 0 && rule.window_end >= 0) {
+            cuts.push_back(rule.window_start % MINUTES_PER_DAY);
+            cuts.push_back(rule.window_end % MINUTES_PER_DAY);
+        }
+
+        std::vector<std::string> accounts = rule.accounts;
+        std::sort(accounts.begin(), accounts.end());
+        accounts.erase(std::unique(accounts.begin(), accounts.end()),
+                       accounts.end());
+        int required = (std::min)(rule.min_accounts, (int)accounts.size());
+        if (required <= 0) {
+            set(without_accounts, i);
+            continue;
+        }
+        account_rules.emplace_back((uint32_t)i, required);
+        for (const std::string& account : accounts) {
+            by_account[account].push_back((uint32_t)i);
+        }
+    }
+
+    for (auto& [id, bits] : by_boss) {
+        for (size_t w = 0; w < words; ++w) bits[w] |= any_boss[w];
+    }
+
+    // Every threshold holds the rules of the ones below it plus its own
+    std::sort(minimums.begin(), minimums.end());
+    Bits allowed = empty_bits();
+    by_duration.emplace_back(0, allowed);
+    for (const auto& [minimum, rule] : minimums) {
+        set(allowed, rule);
+        if (by_duration.back().first == minimum) {
+            by_duration.back().second = allowed;
+        } else {
+            by_duration.emplace_back(minimum, allowed);
+        }
+    }
+
+    // Window edges split the day into segments no window starts or ends in
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+    for (int start : cuts) {
+        Bits open = empty_bits();
+        for (size_t i = 0; i < rules.size(); ++i) {
+            const RouteRule& rule = rules[i];
+            if (rule.window_start < 0 || rule.window_end < 0 ||
+                in_window(start, rule.window_start % MINUTES_PER_DAY,
+                          rule.window_end % MINUTES_PER_DAY)) {
+                set(open, i);
+            }
+        }
+        by_minute.emplace_back(start, std::move(open));
+    }
+}
+
+std::vector<size_t> RoutingTable::match(const RouteInput& input) const {
+    std::vector<size_t> matched;
+    if (count == 0 || input.category < 0 || input.category >= CATEGORY_BITS) {
+        return matched;
+    }
+
+    Bits bits = by_category[input.category];
+    auto narrow = [&bits, this](const Bits& with) {
+        for (size_t w = 0; w < words; ++w) bits[w] &= with[w];
+    };
+
+    auto boss = by_boss.find(input.boss_id);
+    narrow(boss == by_boss.end() ? any_boss : boss->second);
+    if (!input.success) narrow(without_success);
+
+    int64_t duration = (std::max)(input.duration_ms, (int64_t)0);
+    auto threshold = std::upper_bound(
+        by_duration.begin(), by_duration.end(), duration,
+        [](int64_t value, const auto& entry) { return value < entry.first; });
+    narrow(std::prev(threshold)->second);
+
+    int minute = (std::min)((std::max)(input.minute_of_day, 0),
+                            MINUTES_PER_DAY - 1);
+    auto segment = std::upper_bound(
+        by_minute.begin(), by_minute.end(), minute,
+        [](int value, const auto& entry) { return value < entry.first; });
+    narrow(std::prev(segment)->second);
+
+    // Last, so only rules that are still in the running get counted
+    if (!account_rules.empty()) {
+        auto live = [&bits](uint32_t rule) {
+            return bits[rule / 64] >> (rule % 64) & 1;
+        };
+        std::vector<int> found(count, 0);
+        for (const std::string& account : input.accounts) {
+            auto it = by_account.find(account);
+            if (it == by_account.end()) continue;
+            for (uint32_t rule : it->second) found[rule] += (int)live(rule);
+        }
+        Bits present = without_accounts;
+        for (const auto& [rule, required] : account_rules) {
+            if (found[rule] >= required) set(present, rule);
+        }
+        narrow(present);
+    }
+
+    for (size_t w = 0; w < words; ++w) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            size_t bit = 0;
+            while (!(word >> bit & 1)) ++bit;
+            matched.push_back(w * 64 + bit);
+        }
+    }
+    return matched;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What routing decides on, gathered once per log
+struct RouteInput
+{
+	int category = 0; // Revtc::BossCategory
+	uint16_t boss_id = 0;
+	bool success = false;
+	int64_t duration_ms = 0;
+	int minute_of_day = 0; // local time the log was written
+	std::vector<std::string> accounts; // distinct, see RouteRule::normalize_account
+};
+
+// Conditions for posting a log to one destination, all of which must hold.
+// Built from a destination's options and narrowed further by parse(), which
+// reads ';' separated clauses:
+//   category=raids,strikes    any of raids, fractals, strikes, golems, wvw, unknown
+//   boss=15438,21041          trigger/boss IDs
+//   success                   clears only
+//   duration>=90s             also m, ms; a bare number is seconds
+//   accounts=2 of a.1234,b.5678   without "N of" one of them is enough
+//   time=19:00-23:30          local time, may wrap past midnight
+struct RouteRule
+{
+	uint32_t categories = ~0u; // one bit per Revtc::BossCategory
+	std::vector<uint16_t> boss_ids; // empty for any boss
+	bool success_only = false;
+	int64_t min_duration_ms = 0;
+	std::vector<std::string> accounts;
+	int min_accounts = 0; // 0 ignores accounts
+	int window_start = -1; // minutes since midnight, -1 for any time
+	int window_end = -1; // exclusive
+
+	static uint32_t category_bit(int category);
+	// As written in rules, "unknown" for anything else
+	static const char* category_name(int category);
+	// Trimmed and lower case, the form account names are compared in
+	static std::string normalize_account(std::string account);
+
+	// Returns false with error set on the first clause it can't read, the
+	// rule is left as it was
+	bool parse(const std::string& text, std::string& error);
+};
+
+// A set of rules compiled into one bitset per condition value, so a log is
+// matched against every destination with a handful of lookups and word-wide
+// ANDs instead of testing each rule in turn.
+class RoutingTable
+{
+public:
+	RoutingTable() = default;
+	explicit RoutingTable(const std::vector<RouteRule>& rules);
+
+	size_t size() const { return count; }
+	// Whether any rule looks at accounts/duration, callers can skip
+	// gathering them otherwise
+	bool uses_accounts() const { return !account_rules.empty(); }
+	bool uses_duration() const { return by_duration.size() > 1; }
+
+	// Indices of the matching rules, ascending
+	std::vector<size_t> match(const RouteInput& input) const;
+
+private:
+	using Bits = std::vector<uint64_t>;
+
+	size_t count = 0;
+	size_t words = 0;
+	std::vector<Bits> by_category;
+	std::unordered_map<uint16_t, Bits> by_boss; // includes the any-boss rules
+	Bits any_boss;
+	Bits without_success;
+	// Ascending thresholds, each with every rule whose minimum is <= it
+	std::vector<std::pair<int64_t, Bits>> by_duration;
+	// Ascending minute each segment of the day starts at, with the rules open in it
+	std::vector<std::pair<int, Bits>> by_minute;
+	// Rules each account counts towards, and what each of those rules needs
+	std::unordered_map<std::string, std::vector<uint32_t>> by_account;
+	std::vector<std::pair<uint32_t, int>> account_rules;
+	Bits without_accounts;
+
+	Bits empty_bits() const { return Bits(words, 0); }
+	void set(Bits& bits, size_t rule) const;
+};
@@ -1,10 +1,15 @@
 #include "Settings.h"
 
+#include "Coordination.h"
 #include "loguru.hpp"
 
-Settings::Settings(std::filesystem::path& ini_path)
+Settings::Settings(const std::filesystem::path& ini_path)
 : ini_path(ini_path)
 , aleeva{}
+, upload_backend(0)
+, ei_output_path((ini_path.parent_path() / "ei").string())
+, coordination_enabled(false)
+, archive_after_days(90)
 {}
 
 void Settings::load() {
@@ -40,6 +45,22 @@ void Settings::load() {
         aleeva.success_only =
             ini.GetBoolValue(INI_SECTION_SETTINGS, INI_ALEEVA_SUCCESS_ONLY, false);
 
+        upload_backend =
+            ini.GetLongValue(INI_SECTION_SETTINGS, INI_UPLOAD_BACKEND, 0);
+        upload_backend_url =
+            ini.GetValue(INI_SECTION_SETTINGS, INI_UPLOAD_BACKEND_URL, "");
+        ei_path = ini.GetValue(INI_SECTION_SETTINGS, INI_EI_PATH, "");
+        ei_output_path = ini.GetValue(INI_SECTION_SETTINGS, INI_EI_OUTPUT_PATH,
+                                      ei_output_path.c_str());
+        coordination_enabled = ini.GetBoolValue(
+            INI_SECTION_SETTINGS, INI_COORDINATION_ENABLED, false);
+        coordination_url =
+            ini.GetValue(INI_SECTION_SETTINGS, INI_COORDINATION_URL, "");
+        coordination_client_id =
+            ini.GetValue(INI_SECTION_SETTINGS, INI_COORDINATION_CLIENT_ID, "");
+        archive_after_days =
+            ini.GetLongValue(INI_SECTION_SETTINGS, INI_ARCHIVE_AFTER_DAYS, 90);
+
         try {
             aleeva.token_expiration = std::stoll(ini.GetValue(
                 INI_SECTION_SETTINGS, INI_ALEEVA_TOKEN_EXPIRATION, "0"));
@@ -48,6 +69,11 @@ void Settings::load() {
                   e.what());
         }
     }
+    // Identifies this install to the coordination server, kept across runs
+    // so a restarted client still owns the claims it made
+    if (coordination_client_id.empty()) {
+        coordination_client_id = Coordination::new_client_id();
+    }
 }
 
 void Settings::save() {
@@ -70,6 +96,20 @@ void Settings::save() {
                  aleeva.selected_channel_id.c_str());
     ini.SetBoolValue(INI_SECTION_SETTINGS, INI_ALEEVA_SHOULD_POST, aleeva.should_post);
     ini.SetBoolValue(INI_SECTION_SETTINGS, INI_ALEEVA_SUCCESS_ONLY, aleeva.success_only);
+    ini.SetLongValue(INI_SECTION_SETTINGS, INI_UPLOAD_BACKEND, upload_backend);
+    ini.SetValue(INI_SECTION_SETTINGS, INI_UPLOAD_BACKEND_URL,
+                 upload_backend_url.c_str());
+    ini.SetValue(INI_SECTION_SETTINGS, INI_EI_PATH, ei_path.c_str());
+    ini.SetValue(INI_SECTION_SETTINGS, INI_EI_OUTPUT_PATH,
+                 ei_output_path.c_str());
+    ini.SetBoolValue(INI_SECTION_SETTINGS, INI_COORDINATION_ENABLED,
+                     coordination_enabled);
+    ini.SetValue(INI_SECTION_SETTINGS, INI_COORDINATION_URL,
+                 coordination_url.c_str());
+    ini.SetValue(INI_SECTION_SETTINGS, INI_COORDINATION_CLIENT_ID,
+                 coordination_client_id.c_str());
+    ini.SetLongValue(INI_SECTION_SETTINGS, INI_ARCHIVE_AFTER_DAYS,
+                     archive_after_days);
     SI_Error error = ini.SaveFile(ini_path.string().c_str());
     if (error != SI_OK) {
         LOG_F(ERROR, "Failed to save INI file");
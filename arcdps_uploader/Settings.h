@@ -15,6 +15,7 @@ struct AleevaSettings {
 	bool authorised;
 	std::string refresh_token;
 	int64_t token_expiration;
+	int64_t api_key_expiration;
 	std::string api_key;
 	std::vector<Aleeva::DiscordId> server_ids;
 	std::string selected_server_id;
@@ -37,24 +38,46 @@ struct Settings
 	bool gw2bot_success_only;
 	AleevaSettings aleeva;
 
-	Settings(std::filesystem::path& ini_path);
+	int upload_backend;
+	std::string upload_backend_url;
+	std::string ei_path;
+	std::string ei_output_path;
+
+	// Squad upload coordination, see Coordination.h
+	bool coordination_enabled;
+	std::string coordination_url;
+	std::string coordination_client_id;
+
+	// Uploaded logs older than this move to the archive database, 0 keeps
+	// everything in uploader.db
+	int archive_after_days;
+
+	Settings(const std::filesystem::path& ini_path);
 	void load();
 	void save();
 };
 
-inline constexpr char* INI_SECTION_SETTINGS = "Settings";
-inline constexpr char* INI_WVW_DETAILED_SETTING = "WvW_Detailed";
-inline constexpr char* INI_MSG_FORMAT = "Msg_Format";
-inline constexpr char* INI_RECENT_MINUTES = "Recent_Minutes";
-inline constexpr char* INI_GW2BOT_ENABLED = "GW2Bot_Enabled";
-inline constexpr char* INI_GW2BOT_KEY = "GW2Bot_Key";
-inline constexpr char* INI_GW2BOT_SUCCESS_ONLY = "GW2Bot_Success_Only";
-inline constexpr char* INI_ALEEVA_ENABLED = "Aleeva_Enabled";
-inline constexpr char* INI_ALEEVA_REFRESH_TOKEN = "Aleeva_Refresh_Token";
-inline constexpr char* INI_ALEEVA_TOKEN_EXPIRATION = "Aleeva_Token_Expiration";
-inline constexpr char* INI_ALEEVA_SERVER_ID = "Aleeva_Server_Id";
-inline constexpr char* INI_ALEEVA_CHANNEL_ID = "Aleeva_Channel_Id";
-inline constexpr char* INI_ALEEVA_SHOULD_POST = "Aleeva_Should_Post";
-inline constexpr char* INI_ALEEVA_SUCCESS_ONLY = "Aleeva_Success_Only";
+inline constexpr const char* INI_SECTION_SETTINGS = "Settings";
+inline constexpr const char* INI_WVW_DETAILED_SETTING = "WvW_Detailed";
+inline constexpr const char* INI_MSG_FORMAT = "Msg_Format";
+inline constexpr const char* INI_RECENT_MINUTES = "Recent_Minutes";
+inline constexpr const char* INI_GW2BOT_ENABLED = "GW2Bot_Enabled";
+inline constexpr const char* INI_GW2BOT_KEY = "GW2Bot_Key";
+inline constexpr const char* INI_GW2BOT_SUCCESS_ONLY = "GW2Bot_Success_Only";
+inline constexpr const char* INI_ALEEVA_ENABLED = "Aleeva_Enabled";
+inline constexpr const char* INI_ALEEVA_REFRESH_TOKEN = "Aleeva_Refresh_Token";
+inline constexpr const char* INI_ALEEVA_TOKEN_EXPIRATION = "Aleeva_Token_Expiration";
+inline constexpr const char* INI_ALEEVA_SERVER_ID = "Aleeva_Server_Id";
+inline constexpr const char* INI_ALEEVA_CHANNEL_ID = "Aleeva_Channel_Id";
+inline constexpr const char* INI_ALEEVA_SHOULD_POST = "Aleeva_Should_Post";
+inline constexpr const char* INI_ALEEVA_SUCCESS_ONLY = "Aleeva_Success_Only";
+inline constexpr const char* INI_UPLOAD_BACKEND = "Upload_Backend";
+inline constexpr const char* INI_UPLOAD_BACKEND_URL = "Upload_Backend_Url";
+inline constexpr const char* INI_EI_PATH = "EI_Path";
+inline constexpr const char* INI_EI_OUTPUT_PATH = "EI_Output_Path";
+inline constexpr const char* INI_COORDINATION_ENABLED = "Coordination_Enabled";
+inline constexpr const char* INI_COORDINATION_URL = "Coordination_Url";
+inline constexpr const char* INI_COORDINATION_CLIENT_ID = "Coordination_Client_Id";
+inline constexpr const char* INI_ARCHIVE_AFTER_DAYS = "Archive_After_Days";
 
 #endif // __SETTINGS_H__
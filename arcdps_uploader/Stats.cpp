@@ -0,0 +1,135 @@
+#include "Stats.h"
+
+#include <algorithm>
+
+#include "Revtc.h"
+#include "Routing.h"
+
+namespace {
+// 1970-01-05 07:30 UTC, the first weekly reset after the epoch
+constexpr int64_t FIRST_RESET_MS = (4 * 24 * 3600 + 7 * 3600 + 30 * 60) * 1000ll;
+constexpr int64_t WEEK_MS = 7 * 24 * 3600 * 1000ll;
+
+StatsRollup row(Stats::Scope scope, int key, int week, std::string name) {
+    StatsRollup r = {};
+    r.scope = (int)scope;
+    r.key = key;
+    r.week = week;
+    r.name = std::move(name);
+    return r;
+}
+}  // namespace
+
+int Stats::reset_week(std::chrono::system_clock::time_point time) {
+    int64_t since = TimepointToMillis(time) - FIRST_RESET_MS;
+    // Rounded down, logs before the first reset are week -1 and below
+    return (int)(since >= 0 ? since / WEEK_MS : (since - WEEK_MS + 1) / WEEK_MS);
+}
+
+std::chrono::system_clock::time_point Stats::week_start(int week) {
+    return TimepointFromMillis(FIRST_RESET_MS + week * WEEK_MS);
+}
+
+const char* Stats::range_name(Range range) {
+    switch (range) {
+        case Range::WEEK:
+            return "week";
+        case Range::MONTH:
+            return "month";
+        case Range::YEAR:
+            return "year";
+        default:
+            return "all";
+    }
+}
+
+std::pair<int, int> Stats::weeks(Range range,
+                                 std::chrono::system_clock::time_point now) {
+    int current = reset_week(now);
+    switch (range) {
+        case Range::WEEK:
+            return {current, current};
+        case Range::MONTH:
+            return {current - 3, current};
+        case Range::YEAR:
+            return {current - 51, current};
+        default:
+            return {ALL_TIME, ALL_TIME};
+    }
+}
+
+bool Stats::counts(const Log& log) {
+    return log.uploaded && !log.error && log.boss_id != 0;
+}
+
+std::vector<StatsRollup> Stats::contribution(const Log& log) {
+    int category =
+        (int)Revtc::Parser::encounterCategory((Revtc::BossID)log.boss_id);
+    int week = reset_week(log.time);
+    const char* category_name = RouteRule::category_name(category);
+
+    std::vector<StatsRollup> rows = {
+        row(Scope::BOSS, log.boss_id, week, log.boss_name),
+        row(Scope::BOSS, log.boss_id, ALL_TIME, log.boss_name),
+        row(Scope::CATEGORY, category, week, category_name),
+        row(Scope::CATEGORY, category, ALL_TIME, category_name),
+    };
+    for (StatsRollup& r : rows) {
+        r.attempts = 1;
+        if (!log.success) continue;
+        r.kills = 1;
+        if (log.duration_ms > 0) {
+            r.timed_kills = 1;
+            r.kill_ms_total = log.duration_ms;
+            r.kill_ms_best = log.duration_ms;
+        }
+    }
+    return rows;
+}
+
+void Stats::add(StatsRollup& into, const StatsRollup& from) {
+    into.attempts += from.attempts;
+    into.kills += from.kills;
+    into.timed_kills += from.timed_kills;
+    into.kill_ms_total += from.kill_ms_total;
+    if (from.kill_ms_best > 0 &&
+        (into.kill_ms_best == 0 || from.kill_ms_best < into.kill_ms_best)) {
+        into.kill_ms_best = from.kill_ms_best;
+    }
+    // The newest name wins, dps.report renames bosses now and then
+    if (!from.name.empty()) into.name = from.name;
+}
+
+bool Stats::same(const StatsRollup& a, const StatsRollup& b) {
+    return a.attempts == b.attempts && a.kills == b.kills &&
+           a.timed_kills == b.timed_kills &&
+           a.kill_ms_total == b.kill_ms_total &&
+           a.kill_ms_best == b.kill_ms_best;
+}
+
+void Stats::accumulate(std::map<Key, StatsRollup>& rows, const Log& log) {
+    for (const StatsRollup& r : contribution(log)) {
+        auto [it, inserted] = rows.emplace(key_of(r), r);
+        if (!inserted) add(it->second, r);
+    }
+}
+
+std::vector<StatsRollup> Stats::merge_weeks(
+    const std::vector<StatsRollup>& rows) {
+    std::map<std::pair<int, int>, StatsRollup> merged;
+    for (const StatsRollup& r : rows) {
+        auto [it, inserted] = merged.emplace(std::make_pair(r.scope, r.key), r);
+        if (!inserted) add(it->second, r);
+        it->second.week = ALL_TIME;
+    }
+    std::vector<StatsRollup> out;
+    out.reserve(merged.size());
+    for (auto& [key, r] : merged) {
+        out.push_back(std::move(r));
+    }
+    std::stable_sort(out.begin(), out.end(),
+                     [](const StatsRollup& a, const StatsRollup& b) {
+                         return a.attempts > b.attempts;
+                     });
+    return out;
+}
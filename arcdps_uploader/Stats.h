@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "Log.h"
+
+// Running totals of uploaded logs for one boss or category over one reset
+// week, or over all time. Every upload adds to four of them, so any
+// statistic is read back from a few rows however long the history is.
+struct StatsRollup
+{
+	int scope; // Stats::Scope
+	int key; // boss id or Revtc::BossCategory
+	int week; // Stats::reset_week, Stats::ALL_TIME for the total
+	std::string name;
+	int attempts;
+	int kills;
+	int timed_kills; // kills with a known duration
+	int64_t kill_ms_total;
+	int64_t kill_ms_best; // 0 until a timed kill
+
+	double success_rate() const { return attempts ? (double)kills / attempts : 0.0; }
+	int64_t average_kill_ms() const { return timed_kills ? kill_ms_total / timed_kills : 0; }
+};
+
+// Outcome of rebuilding the rollups from every log
+struct StatsRebuild
+{
+	size_t logs = 0; // hot and archived logs read
+	size_t rows = 0; // rollups written
+	size_t mismatched = 0; // rollups that were wrong, missing or extra
+	bool ok = true; // false if it was rolled back
+};
+
+namespace Stats
+{
+	enum class Scope { BOSS = 0, CATEGORY = 1 };
+	// Below any week a log can be in, even one without a time
+	constexpr int ALL_TIME = std::numeric_limits<int>::min();
+
+	// Weeks since the first weekly reset after the epoch. Resets are on
+	// Monday 07:30 UTC, so a week matches a raid lockout.
+	int reset_week(std::chrono::system_clock::time_point time);
+	std::chrono::system_clock::time_point week_start(int week);
+
+	// The current reset week, the last 4, the last 52, or the all-time rows
+	enum class Range { WEEK, MONTH, YEAR, ALL };
+	const char* range_name(Range range);
+	// First and last week of range, both inclusive
+	std::pair<int, int> weeks(Range range, std::chrono::system_clock::time_point now);
+
+	// Uploaded without error and of a known boss
+	bool counts(const Log& log);
+	// The four rows a counted log adds to: boss and category, for its week
+	// and for all time
+	std::vector<StatsRollup> contribution(const Log& log);
+	void add(StatsRollup& into, const StatsRollup& from);
+	// Same totals, the name is not compared
+	bool same(const StatsRollup& a, const StatsRollup& b);
+
+	using Key = std::tuple<int, int, int>; // scope, key, week
+	inline Key key_of(const StatsRollup& row) { return {row.scope, row.key, row.week}; }
+	// Adds every contribution of log to rows
+	void accumulate(std::map<Key, StatsRollup>& rows, const Log& log);
+
+	// Sums the weekly rows of each key into one, week is set to ALL_TIME.
+	// Sorted by attempts, most first.
+	std::vector<StatsRollup> merge_weeks(const std::vector<StatsRollup>& rows);
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sqlite3.h>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "loguru.hpp"
+
+// Owns a sqlite_orm storage on a dedicated thread. Other threads submit
+// commands (callables taking the storage) and get their results through a
+// future, so results are plain values, never pointers into the connection.
+// Writes queued close together are executed in one transaction, each in its
+// own savepoint: a command that throws has its writes rolled back and the
+// exception handed to its caller, the rest of the batch still commits.
+template <typename S>
+class StorageActor
+{
+	struct Command
+	{
+		// Runs the callable and fulfils its future, false if it threw
+		std::function<bool(S&)> run;
+		bool write;
+	};
+
+	// sqlite_orm keeps its connection protected, savepoints need it
+	struct ConnectionAccess : S
+	{
+		using S::get_connection;
+	};
+
+	std::unique_ptr<S> storage;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<Command> commands;
+	bool running;
+
+	// Extra time to wait for more writes before committing a batch
+	static constexpr std::chrono::milliseconds GROUP_COMMIT_WINDOW{2};
+	static constexpr size_t MAX_BATCH = 512;
+
+	template <typename F>
+	auto enqueue(F fn, bool write) -> std::future<std::invoke_result_t<F, S&>>
+	{
+		using R = std::invoke_result_t<F, S&>;
+		auto call = std::make_shared<F>(std::move(fn));
+		auto promise = std::make_shared<std::promise<R>>();
+		std::future<R> result = promise->get_future();
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+			commands.push_back({ [call, promise](S& s) {
+				try {
+					if constexpr (std::is_void_v<R>) {
+						(*call)(s);
+						promise->set_value();
+					}
+					else {
+						promise->set_value((*call)(s));
+					}
+					return true;
+				}
+				catch (...) {
+					promise->set_exception(std::current_exception());
+					return false;
+				}
+			}, write });
+		}
+		cv.notify_one();
+		return result;
+	}
+
+	bool execute(const char* sql)
+	{
+		auto connection = (storage.get()->*(&ConnectionAccess::get_connection))();
+		char* error = nullptr;
+		if (sqlite3_exec(connection.get(), sql, nullptr, nullptr, &error) != SQLITE_OK) {
+			LOG_F(ERROR, "Sqlite %s failed: %s", sql, error ? error : "");
+			sqlite3_free(error);
+			return false;
+		}
+		return true;
+	}
+
+	void run()
+	{
+		std::vector<Command> batch;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lk(mutex);
+				cv.wait(lk, [this] { return !commands.empty() || !running; });
+				if (commands.empty() && !running) return;
+
+				if (commands.front().write && running) {
+					cv.wait_for(lk, GROUP_COMMIT_WINDOW, [this] {
+						return commands.size() >= MAX_BATCH || !running;
+					});
+				}
+
+				while (!commands.empty() && batch.size() < MAX_BATCH) {
+					batch.push_back(std::move(commands.front()));
+					commands.pop_front();
+				}
+			}
+
+			bool any_write = false;
+			for (const auto& c : batch) {
+				any_write |= c.write;
+			}
+
+			bool in_transaction = false;
+			if (any_write) {
+				try {
+					storage->begin_transaction();
+					in_transaction = true;
+				}
+				catch (std::system_error& e) {
+					LOG_F(ERROR, "Sqlite begin transaction failed: %s", e.what());
+				}
+			}
+
+			for (auto& c : batch) {
+				bool savepoint = in_transaction && c.write && execute("SAVEPOINT command");
+				bool ok = c.run(*storage);
+				if (savepoint) {
+					if (!ok) execute("ROLLBACK TO command");
+					execute("RELEASE command");
+				}
+			}
+
+			if (in_transaction) {
+				try {
+					storage->commit();
+				}
+				catch (std::system_error& e) {
+					LOG_F(ERROR, "Sqlite commit failed: %s", e.what());
+				}
+			}
+			batch.clear();
+		}
+	}
+
+public:
+	explicit StorageActor(std::unique_ptr<S> storage)
+		: storage(std::move(storage)), running(true)
+	{
+		thread = std::thread(&StorageActor::run, this);
+	}
+
+	// Finishes every queued command before closing
+	~StorageActor()
+	{
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+			running = false;
+		}
+		cv.notify_all();
+		thread.join();
+	}
+
+	StorageActor(const StorageActor&) = delete;
+	StorageActor& operator=(const StorageActor&) = delete;
+
+	template <typename F>
+	auto read(F fn) { return enqueue(std::move(fn), false); }
+
+	template <typename F>
+	auto write(F fn) { return enqueue(std::move(fn), true); }
+
+	// Blocks until everything queued so far has been executed
+	void flush()
+	{
+		read([](S&) {}).wait();
+	}
+};
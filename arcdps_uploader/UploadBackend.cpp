@@ -0,0 +1,398 @@
+#include "UploadBackend.h"
+
+#include <cpr/cpr.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+#include "Metrics.h"
+#include "Settings.h"
+#include "loguru.hpp"
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+DpsReportBackend::DpsReportBackend(std::string base_url,
+                                   std::string display_name)
+    : base_url(std::move(base_url)), display_name(std::move(display_name)) {
+    while (!this->base_url.empty() && this->base_url.back() == '/') {
+        this->base_url.pop_back();
+    }
+}
+
+std::future<UploadResult> DpsReportBackend::submit(
+    const UploadRequest& request) {
+    return std::async(
+        std::launch::async, [url = base_url + "/uploadContent",
+                             endpoint = display_name, request]() {
+            cpr::Parameters params = cpr::Parameters{};
+            cpr::Multipart multi = cpr::Multipart{
+                {"file", cpr::File{request.path.string()}}, {"json", "1"}};
+
+            if (!request.user_token.empty()) {
+                params.Add({"userToken", request.user_token});
+            }
+
+            if (request.detailed_wvw) {
+                params.Add({"detailedwvw", "true"});
+            }
+
+            std::error_code ec;
+            uint64_t bytes = (uint64_t)fs::file_size(request.path, ec);
+            Metrics::Timer timer;
+            cpr::Response response = cpr::Post(cpr::Url{url}, params, multi,
+                                               request.cancel.progress());
+            Metrics::observe_http(endpoint, (int)response.status_code,
+                                  timer.seconds(), ec ? 0 : bytes);
+            if (request.cancel.cancelled()) {
+                UploadResult result;
+                result.cancelled = true;
+                result.error = "Cancelled";
+                return result;
+            }
+            UploadResult result =
+                parse_response((int)response.status_code, response.text);
+            if (!result.ok && result.error.empty()) {
+                result.error = response.error.message;
+            }
+            return result;
+        });
+}
+
+namespace {
+// Fills an UploadResult straight from the token stream. Anything outside
+// id/permalink/userToken/error, encounter.* and the player roster is skipped
+// without being stored.
+class DpsReportSax : public nlohmann::json_sax<json> {
+    enum class Scope { ROOT, ENCOUNTER, PLAYERS, PLAYER, OTHER };
+
+    UploadResult& result;
+    std::vector<Scope> scopes;
+    std::string current_key;
+
+    Scope scope() const { return scopes.empty() ? Scope::OTHER : scopes.back(); }
+
+    template <typename T>
+    bool number(T value) {
+        switch (scope()) {
+            case Scope::ENCOUNTER:
+                if (current_key == "bossId") result.boss_id = (int)value;
+                // seconds
+                else if (current_key == "duration")
+                    result.duration_ms = (int64_t)(value * 1000);
+                break;
+            case Scope::PLAYER: {
+                UploadPlayer& p = result.players.back();
+                if (current_key == "profession") p.profession = (int)value;
+                else if (current_key == "elite_spec") p.elite_spec = (int)value;
+                else if (current_key == "group") p.group = (int)value;
+                break;
+            }
+            default:
+                break;
+        }
+        return true;
+    }
+
+   public:
+    std::string error;
+    bool has_id = false;
+    bool has_permalink = false;
+    bool has_encounter = false;
+
+    explicit DpsReportSax(UploadResult& result) : result(result) {}
+
+    bool null() override { return true; }
+    bool boolean(bool val) override {
+        if (scope() == Scope::ENCOUNTER) {
+            if (current_key == "success") result.success = val;
+            else if (current_key == "jsonAvailable") result.json_available = val;
+        }
+        return true;
+    }
+    bool number_integer(number_integer_t val) override { return number(val); }
+    bool number_unsigned(number_unsigned_t val) override { return number(val); }
+    bool number_float(number_float_t val, const string_t&) override {
+        return number(val);
+    }
+    bool string(string_t& val) override {
+        switch (scope()) {
+            case Scope::ROOT:
+                if (current_key == "id") {
+                    result.report_id = std::move(val);
+                    has_id = true;
+                } else if (current_key == "permalink") {
+                    result.permalink = std::move(val);
+                    has_permalink = true;
+                } else if (current_key == "userToken") {
+                    result.user_token = std::move(val);
+                } else if (current_key == "error") {
+                    error = std::move(val);
+                }
+                break;
+            case Scope::ENCOUNTER:
+                if (current_key == "boss") result.boss_name = std::move(val);
+                break;
+            case Scope::PLAYER:
+                if (current_key == "display_name") {
+                    result.players.back().display_name = std::move(val);
+                } else if (current_key == "character_name") {
+                    result.players.back().character_name = std::move(val);
+                }
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+    bool binary(binary_t&) override { return true; }
+
+    bool start_object(std::size_t) override {
+        Scope next = Scope::OTHER;
+        if (scopes.empty()) {
+            next = Scope::ROOT;
+        } else if (scope() == Scope::ROOT && current_key == "encounter") {
+            next = Scope::ENCOUNTER;
+            has_encounter = true;
+        } else if (scope() == Scope::ROOT && current_key == "players") {
+            next = Scope::PLAYERS;
+        } else if (scope() == Scope::PLAYERS) {
+            next = Scope::PLAYER;
+            result.players.emplace_back();
+            result.players.back().character_name = current_key;
+        }
+        scopes.push_back(next);
+        return true;
+    }
+    bool end_object() override {
+        scopes.pop_back();
+        return true;
+    }
+    bool start_array(std::size_t) override {
+        scopes.push_back(Scope::OTHER);
+        return true;
+    }
+    bool end_array() override {
+        scopes.pop_back();
+        return true;
+    }
+    bool key(string_t& val) override {
+        current_key.swap(val);
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string&,
+                     const nlohmann::detail::exception& ex) override {
+        error = ex.what();
+        return false;
+    }
+};
+}  // namespace
+
+UploadResult DpsReportBackend::parse_response(int status_code,
+                                              const std::string& text) {
+    UploadResult result;
+    result.status_code = status_code;
+    if (status_code != 200) {
+        result.error = text;
+        return result;
+    }
+
+    DpsReportSax sax(result);
+    bool parsed = json::sax_parse(text, &sax);
+    if (!parsed || !sax.has_id || !sax.has_permalink || !sax.has_encounter) {
+        std::string reason = !sax.error.empty() ? sax.error
+                             : parsed ? "missing id/permalink/encounter"
+                                      : "malformed json";
+        LOG_F(ERROR, "Failed to parse upload response: %s", reason.c_str());
+        UploadResult failed;
+        failed.status_code = status_code;
+        failed.error = "Invalid response: " + reason;
+        return failed;
+    }
+
+    result.players_json = players_to_json(result.players);
+    result.ok = true;
+    return result;
+}
+
+LocalEliteInsightsBackend::LocalEliteInsightsBackend(fs::path ei_path,
+                                                     fs::path output_path)
+    : ei_path(std::move(ei_path)), output_path(std::move(output_path)) {}
+
+std::future<UploadResult> LocalEliteInsightsBackend::submit(
+    const UploadRequest& request) {
+    return std::async(
+        std::launch::async,
+        [ei_path = ei_path, output_path = output_path, request]() {
+            UploadResult result;
+            if (!fs::exists(ei_path)) {
+                result.error = "Elite Insights not found at " + ei_path.string();
+                return result;
+            }
+
+            std::error_code ec;
+            fs::create_directories(output_path, ec);
+
+            fs::path conf_path = output_path / "uploader.conf";
+            {
+                std::ofstream conf(conf_path, std::ios::trunc);
+                conf << "SaveAtOut=false\n"
+                     << "OutLocation=" << output_path.string() << "\n"
+                     << "SaveOutHTML=true\n"
+                     << "SaveOutJSON=true\n"
+                     << "IndentJSON=false\n"
+                     << "UploadToDPSReports=false\n"
+                     << "ParseMultipleLogs=false\n";
+            }
+
+            std::string stem = request.path.filename()
+                                   .replace_extension()
+                                   .replace_extension()
+                                   .string();
+            auto started = fs::file_time_type::clock::now();
+
+            std::string cmd = "\"" + ei_path.string() + "\" -c \"" +
+                              conf_path.string() + "\" \"" +
+                              request.path.string() + "\"";
+#ifdef _WIN32
+            // cmd.exe strips the outer quotes when the command starts with one
+            cmd = "\"" + cmd + "\"";
+#endif
+            // The EI process itself can't be interrupted, only not started
+            if (request.cancel.cancelled()) {
+                result.cancelled = true;
+                result.error = "Cancelled";
+                return result;
+            }
+            int rc = std::system(cmd.c_str());
+            if (rc != 0) {
+                result.status_code = rc;
+                result.error = "Elite Insights exited with code " +
+                               std::to_string(rc);
+                return result;
+            }
+
+            // EI names its output <log>_<boss>_<kill|fail>.json
+            fs::path json_path;
+            fs::path html_path;
+            for (const auto& entry : fs::directory_iterator(output_path)) {
+                const auto& p = entry.path();
+                if (p.filename().string().rfind(stem, 0) != 0) continue;
+                if (entry.last_write_time() < started) continue;
+                if (p.extension() == ".json") json_path = p;
+                if (p.extension() == ".html") html_path = p;
+            }
+            if (json_path.empty()) {
+                result.error = "Elite Insights produced no JSON for " + stem;
+                return result;
+            }
+
+            std::ifstream in(json_path, std::ios::binary);
+            std::stringstream ss;
+            ss << in.rdbuf();
+            result = parse_ei_json(ss.str());
+            result.report_id = stem;
+            result.permalink =
+                (html_path.empty() ? json_path : html_path).string();
+            return result;
+        });
+}
+
+UploadResult LocalEliteInsightsBackend::parse_ei_json(const std::string& text) {
+    UploadResult result;
+    try {
+        json parsed = json::parse(text);
+        result.boss_id = parsed.value("triggerID", 0);
+        result.boss_name = parsed.value("fightName", "");
+        result.success = parsed.value("success", false);
+        result.duration_ms = parsed.value("durationMS", (int64_t)0);
+        result.json_available = true;
+
+        if (parsed.contains("players")) {
+            for (const auto& p : parsed["players"]) {
+                UploadPlayer player;
+                player.character_name = p.value("name", "");
+                player.display_name = p.value("account", "");
+                player.group = p.value("group", 0);
+                result.players.push_back(std::move(player));
+            }
+        }
+        result.players_json = players_to_json(result.players);
+        result.status_code = 200;
+        result.ok = true;
+    } catch (const json::exception& e) {
+        LOG_F(ERROR, "Failed to parse Elite Insights json: %s", e.what());
+        result.error = std::string("Invalid Elite Insights json: ") + e.what();
+    }
+    return result;
+}
+
+std::shared_ptr<UploadBackend> make_upload_backend(const Settings& settings) {
+    switch ((UploadBackendType)settings.upload_backend) {
+        case UploadBackendType::SELF_HOSTED:
+            if (!settings.upload_backend_url.empty()) {
+                return std::make_shared<DpsReportBackend>(
+                    settings.upload_backend_url, "Self-hosted");
+            }
+            LOG_F(WARNING, "Self-hosted backend has no URL, using dps.report");
+            break;
+        case UploadBackendType::LOCAL_EI:
+            return std::make_shared<LocalEliteInsightsBackend>(
+                settings.ei_path, settings.ei_output_path);
+        default:
+            break;
+    }
+    return std::make_shared<DpsReportBackend>();
+}
+
+namespace {
+// Escapes the way json::dump does, other bytes are copied as they are
+void append_json_string(std::string& out, const std::string& value) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char ch : value) {
+        switch (ch) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)ch < 0x20) {
+                    out += "\\u00";
+                    out.push_back(hex[(unsigned char)ch >> 4]);
+                    out.push_back(hex[ch & 0xf]);
+                } else {
+                    out.push_back(ch);
+                }
+        }
+    }
+    out.push_back('"');
+}
+}  // namespace
+
+// Written directly rather than through a json DOM, it runs for every parsed
+// response. Members are in the order json::dump sorts them into.
+std::string players_to_json(const std::vector<UploadPlayer>& players) {
+    std::string out;
+    out.reserve(players.size() * 128 + 2);
+    out.push_back('{');
+    for (const auto& p : players) {
+        if (out.size() > 1) out.push_back(',');
+        append_json_string(out, p.character_name);
+        out += ":{\"character_name\":";
+        append_json_string(out, p.character_name);
+        out += ",\"display_name\":";
+        append_json_string(out, p.display_name);
+        out += ",\"elite_spec\":" + std::to_string(p.elite_spec);
+        out += ",\"group\":" + std::to_string(p.group);
+        out += ",\"profession\":" + std::to_string(p.profession);
+        out.push_back('}');
+    }
+    out.push_back('}');
+    return out;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CancelToken.h"
+
+struct Settings;
+
+struct UploadRequest
+{
+	int log_id;
+	std::filesystem::path path;
+	std::string user_token;
+	bool detailed_wvw;
+	// Aborts the transfer, the result then has ok == false and cancelled set
+	CancelToken cancel;
+};
+
+struct UploadPlayer
+{
+	std::string character_name;
+	std::string display_name;
+	int profession = 0;
+	int elite_spec = 0;
+	int group = 0;
+};
+
+// Normalized result, independent of the service that produced it
+struct UploadResult
+{
+	bool ok = false;
+	bool cancelled = false;
+	int status_code = 0;
+	std::string error;
+
+	std::string report_id;
+	std::string permalink;
+	int boss_id = 0;
+	std::string boss_name;
+	bool success = false;
+	int64_t duration_ms = 0; // 0 if the service didn't say
+	bool json_available = false;
+	std::vector<UploadPlayer> players;
+	// players keyed by character name, same shape as dps.report's "players"
+	// object ({"display_name", "character_name", "profession", ...})
+	std::string players_json;
+	std::string user_token;
+};
+
+class UploadBackend
+{
+public:
+	virtual ~UploadBackend() = default;
+
+	virtual const char* name() const = 0;
+
+	// Starts an upload/parse. Poll with wait_for(0) or block with get().
+	virtual std::future<UploadResult> submit(const UploadRequest& request) = 0;
+};
+
+// dps.report or any server exposing the same /uploadContent API
+class DpsReportBackend : public UploadBackend
+{
+	std::string base_url;
+	std::string display_name;
+public:
+	DpsReportBackend(std::string base_url = "https://dps.report",
+		std::string display_name = "dps.report");
+
+	const char* name() const override { return display_name.c_str(); }
+	std::future<UploadResult> submit(const UploadRequest& request) override;
+
+	// Streams the response, only the fields UploadResult needs are kept
+	static UploadResult parse_response(int status_code, const std::string& text);
+};
+
+// Parses logs locally with the Elite Insights CLI, nothing leaves the machine
+class LocalEliteInsightsBackend : public UploadBackend
+{
+	std::filesystem::path ei_path;
+	std::filesystem::path output_path;
+public:
+	LocalEliteInsightsBackend(std::filesystem::path ei_path,
+		std::filesystem::path output_path);
+
+	const char* name() const override { return "Local Elite Insights"; }
+	std::future<UploadResult> submit(const UploadRequest& request) override;
+
+	static UploadResult parse_ei_json(const std::string& text);
+};
+
+enum class UploadBackendType : int
+{
+	DPS_REPORT = 0,
+	SELF_HOSTED = 1,
+	LOCAL_EI = 2,
+};
+
+std::shared_ptr<UploadBackend> make_upload_backend(const Settings& settings);
+
+std::string players_to_json(const std::vector<UploadPlayer>& players);
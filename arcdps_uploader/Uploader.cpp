@@ -1,13 +1,29 @@
 #include "Uploader.h"
 
+#ifdef _WIN32
 #include <ShlObj.h>
+#endif
 
+#include <algorithm>
+#include <climits>
 #include <nlohmann/json.hpp>
+#include <regex>
+#include <sstream>
 #include <thread>
+#include <unordered_set>
 
 #include "Aleeva.h"
+#include "AsyncLog.h"
+#include "EvtcScanner.h"
+#include "Metrics.h"
+#include "LogIndex.h"
+#include "LogScanner.h"
+#include "LogValidator.h"
+#include "StorageActor.h"
+#ifndef HEADLESS
 #include "imgui/imgui.h"
 #include "imgui/imgui_stdlib.h"
+#endif
 #include "loguru.hpp"
 
 using json = nlohmann::json;
@@ -16,12 +32,14 @@ inline auto initStorage(const std::string& path) {
     using namespace sqlite_orm;
     return make_storage(
         path,
+        make_index("idx_logs_time_ms", &Log::time),
         make_table("logs",
                    make_column("id", &Log::id, autoincrement(), primary_key()),
-                   make_column("path", &Log::path),
+                   make_column("dir_id", &Log::dir_id, default_value(0)),
+                   make_column("file", &Log::file, default_value("")),
                    make_column("filename", &Log::filename),
                    make_column("human_time", &Log::human_time),
-                   make_column("time", &Log::time),
+                   make_column("time_ms", &Log::time, default_value(0)),
                    make_column("uploaded", &Log::uploaded),
                    make_column("error", &Log::error),
                    make_column("report_id", &Log::report_id),
@@ -30,7 +48,14 @@ inline auto initStorage(const std::string& path) {
                    make_column("boss_name", &Log::boss_name),
                    make_column("players_json", &Log::players_json),
                    make_column("json_available", &Log::json_available),
-                   make_column("success", &Log::success)),
+                   make_column("success", &Log::success),
+                   make_column("duration_ms", &Log::duration_ms,
+                               default_value(0))),
+        make_table(
+            "log_dirs",
+            make_column("id", &LogDirectory::id, autoincrement(),
+                        primary_key()),
+            make_column("path", &LogDirectory::path)),
         make_table(
             "webhooks",
             make_column("id", &Webhook::id, autoincrement(), primary_key()),
@@ -43,63 +68,302 @@ inline auto initStorage(const std::string& path) {
             make_column("wvw", &Webhook::wvw),
             make_column("filter", &Webhook::filter),
             make_column("filter_min", &Webhook::filter_min),
-            make_column("success", &Webhook::success)),
+            make_column("success", &Webhook::success),
+            make_column("rule", &Webhook::rule, default_value(""))),
         make_table(
             "usertokens",
             make_column("id", &UserToken::id, autoincrement(), primary_key()),
             make_column("value", &UserToken::value),
-            make_column("disabled", &UserToken::disabled)));
+            make_column("disabled", &UserToken::disabled)),
+        make_table(
+            "aleeva_discord",
+            make_column("id", &AleevaDiscordId::id, autoincrement(),
+                        primary_key()),
+            make_column("server_id", &AleevaDiscordId::server_id),
+            make_column("channel_id", &AleevaDiscordId::channel_id),
+            make_column("name", &AleevaDiscordId::name),
+            make_column("fetched_at", &AleevaDiscordId::fetched_at)),
+        make_table("pending_uploads",
+                   make_column("log_id", &PendingUpload::log_id,
+                               primary_key())),
+        make_table("quarantined_logs",
+                   make_column("log_id", &QuarantinedLog::log_id,
+                               primary_key()),
+                   make_column("reason", &QuarantinedLog::reason),
+                   make_column("time_ms", &QuarantinedLog::time_ms)),
+        make_index("idx_stats_week", &StatsRollup::scope, &StatsRollup::week),
+        make_table(
+            "stats_rollups", make_column("scope", &StatsRollup::scope),
+            make_column("key", &StatsRollup::key),
+            make_column("week", &StatsRollup::week),
+            make_column("name", &StatsRollup::name),
+            make_column("attempts", &StatsRollup::attempts),
+            make_column("kills", &StatsRollup::kills),
+            make_column("timed_kills", &StatsRollup::timed_kills),
+            make_column("kill_ms_total", &StatsRollup::kill_ms_total),
+            make_column("kill_ms_best", &StatsRollup::kill_ms_best),
+            primary_key(&StatsRollup::scope, &StatsRollup::key,
+                        &StatsRollup::week)),
+        make_table(
+            "export_cursors",
+            make_column("destination", &ExportCursor::destination),
+            make_column("format", &ExportCursor::format),
+            make_column("last_log_id", &ExportCursor::last_log_id),
+            make_column("exported_ms", &ExportCursor::exported_ms),
+            primary_key(&ExportCursor::destination, &ExportCursor::format)));
 }
 using Storage = decltype(initStorage(""));
-static std::unique_ptr<Storage> storage;
+// Every database access goes through the actor's thread
+static std::unique_ptr<StorageActor<Storage>> db;
+
+// Interned log directories, only touched on the storage thread
+static std::unordered_map<std::string, int> log_dir_ids;
+static std::unordered_map<int, fs::path> log_dir_paths;
+
+static int intern_log_dir(Storage& s, const fs::path& dir) {
+    std::string key = dir.string();
+    auto it = log_dir_ids.find(key);
+    if (it != log_dir_ids.end()) return it->second;
+
+    using namespace sqlite_orm;
+    auto ids = s.select(&LogDirectory::id,
+                        where(c(&LogDirectory::path) == key));
+    int id = ids.empty() ? s.insert(LogDirectory{-1, key}) : ids.front();
+    log_dir_ids.emplace(key, id);
+    log_dir_paths.emplace(id, dir);
+    return id;
+}
+
+// Rebuilds Log::path from the interned directory
+static void resolve_log_path(Storage& s, Log& log) {
+    auto it = log_dir_paths.find(log.dir_id);
+    if (it == log_dir_paths.end()) {
+        for (auto& dir : s.get_all<LogDirectory>()) {
+            log_dir_ids.emplace(dir.path, dir.id);
+            log_dir_paths.emplace(dir.id, fs::path(dir.path));
+        }
+        it = log_dir_paths.find(log.dir_id);
+        if (it == log_dir_paths.end()) {
+            log.path = log.file;
+            return;
+        }
+    }
+    log.path = it->second / log.file;
+}
+
+// Adds a newly counted log to its rollups, in the caller's transaction
+static void add_stats(Storage& s, const Log& log) {
+    for (const StatsRollup& r : Stats::contribution(log)) {
+        auto stored = s.get_pointer<StatsRollup>(r.scope, r.key, r.week);
+        if (stored) {
+            Stats::add(*stored, r);
+            s.replace(*stored);
+        } else {
+            s.replace(r);
+        }
+    }
+}
+
+// Fight length read from the log itself, for rules on duration when the
+// backend didn't report one
+static int64_t local_duration_ms(const Log& log) {
+    EvtcReader reader;
+    if (!reader.open(log.path)) return 0;
+    EvtcSummary summary = EvtcScanner::scan(reader);
+    return summary.valid ? summary.duration_ms : 0;
+}
+
+// How often a log another member is uploading is asked about, and when to
+// stop waiting for them
+constexpr auto COORDINATION_RETRY = std::chrono::seconds(10);
+constexpr auto COORDINATION_MAX_WAIT = std::chrono::minutes(15);
+
+// Logs moved to the archive per refresh. Small steps keep each transaction
+// short, a long history drains over a few refreshes.
+constexpr size_t ARCHIVE_BATCH = 500;
+constexpr int ARCHIVE_STEPS = 4;
+
+// Logs read at a time when the rollups are rebuilt
+constexpr size_t STATS_REBUILD_PAGE = 2000;
+
+// Logs read at a time by an export, the row groups are filled from these
+constexpr size_t EXPORT_PAGE = 2000;
+
+// Boss, outcome and length read from the log itself, for results that lack
+// them
+static void classify_locally(Log& log) {
+    EvtcReader reader;
+    if (!reader.open(log.path)) {
+        LOG_F(WARNING, "Failed to read %s: %s", log.path.string().c_str(),
+              reader.error().c_str());
+        return;
+    }
+    EvtcSummary summary = EvtcScanner::scan(reader);
+    if (!summary.valid) return;
+    log.boss_id = summary.boss_id;
+    log.success = summary.kill;
+    log.duration_ms = summary.duration_ms;
+}
 
 Uploader::Uploader(fs::path data_path, std::optional<fs::path> custom_log_path)
-    : is_open(false), in_combat(false), settings(data_path / "uploader.ini") {
-    // Load settings from INI
-    settings.load();
+    : settings(data_path / "uploader.ini"),
+      data_path(data_path),
+      custom_log_path(custom_log_path),
+      stats_stale(true),
+      upload_in_progress(false),
+      ready(false),
+      init_failed(false),
+      is_open(false),
+      in_combat(false) {}
+
+void Uploader::start_async_init() {
+    ft_init = std::async(std::launch::async, [this] {
+        try {
+            initialize();
+        } catch (const std::exception& e) {
+            LOG_F(ERROR, "Initialization failed: %s", e.what());
+            init_error = e.what();
+            init_failed = true;
+            return;
+        }
+        // The destructor is already waiting, don't start anything
+        if (shutdown_token.cancelled()) return;
+        start_async_refresh_log_list();
+        start_upload_thread();
+        add_pending_upload_logs(resumed_uploads);
+        ready = true;
+    });
+}
 
-    // Sqlite Database
+bool Uploader::is_ready() const { return ready; }
+
+bool Uploader::wait_for_init() {
+    if (ft_init.valid()) {
+        ft_init.wait();
+    }
+    return ready;
+}
+
+void Uploader::open_database() {
     fs::path db_path = data_path / "uploader.db";
     LOG_F(INFO, "DB Path: %s", db_path.string().c_str());
-    storage = std::make_unique<Storage>(initStorage(db_path.string()));
+    // sync_schema drops columns it no longer knows, so it must not run on a
+    // database that is still in the old layout. The migration rolled back,
+    // uploader.db is left as it was for the next start.
+    if (!migrate_log_schema(db_path.string(), shutdown_token.get())) {
+        if (shutdown_token.cancelled()) {
+            throw std::runtime_error("Upgrade of " + db_path.string() +
+                                     " interrupted by shutdown");
+        }
+        throw std::runtime_error("Failed to upgrade " + db_path.string() +
+                                 ", see uploader.log");
+    }
+    auto storage = std::make_unique<Storage>(initStorage(db_path.string()));
 
     storage->sync_schema(true);
     storage->open_forever();
+    db = std::make_unique<StorageActor<Storage>>(std::move(storage));
 
-    // dps.report User Token
-    userTokens = storage->get_all<UserToken>();
-    if (userTokens.size() == 0) {
-        userToken.id = -1;
-        userToken.value = "";
-        userToken.disabled = true;
-        storage->insert(userToken);
-        userTokens = storage->get_all<UserToken>();
-    }
-    userToken.id = userTokens.front().id;
-    userToken.value = userTokens.front().value;
-    userToken.disabled = userTokens.front().disabled;
-    memset(userToken.value_buf, 0, sizeof(userToken.value_buf));
-    if (userToken.disabled) {
-        memcpy(userToken.value_buf, "--DISABLED--", sizeof("--DISABLED--"));
-    } else {
-        memcpy(userToken.value_buf, userToken.value.c_str(),
-               userToken.value.size());
-    }
+    // Opened by the calls that need it, startup doesn't touch the file
+    archive = std::make_unique<LogArchive>(data_path / "uploader_archive.db");
+}
 
-    // Webhooks
-    webhooks = storage->get_all<Webhook>();
-    for (auto& wh : webhooks) {
-        memset(wh.name_buf, 0, 64);
-        memcpy(wh.name_buf, wh.name.c_str(), wh.name.size());
-        memset(wh.url_buf, 0, 192);
-        memcpy(wh.url_buf, wh.url.c_str(), wh.url.size());
-        memset(wh.filter_buf, 0, 256);
-        memcpy(wh.filter_buf, wh.filter.c_str(), wh.filter.size());
+bool Uploader::open_offline() {
+    try {
+        settings.load();
+        open_database();
+    } catch (const std::exception& e) {
+        LOG_F(ERROR, "Failed to open the database: %s", e.what());
+        return false;
     }
+    return true;
+}
+
+void Uploader::initialize() {
+    // Timed per stage so a slow startup can be pinned on one of them
+    auto stage = [](const char* name, auto&& fn) {
+        Metrics::Timer timer;
+        fn();
+        double seconds = timer.seconds();
+        Metrics::gauge("uploader_init_stage_microseconds",
+                       "Time spent in each startup stage",
+                       std::string("stage=\"") + name + "\"")
+            .set((int64_t)(seconds * 1e6));
+        LOG_F(INFO, "Init stage %s took %.1f ms", name, seconds * 1000.0);
+    };
+
+    stage("settings", [this] {
+        settings.load();
+        upload_backend = make_upload_backend(settings);
+    });
+
+    stage("database", [this] { open_database(); });
+
+    stage("workers", [this] {
+        // Raw .evtc logs are recompressed before upload
+        unsigned compress_threads =
+            std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+        compressor = std::make_unique<LogCompressor>(data_path / "cache",
+                                                     compress_threads);
+        compressor->prune(std::chrono::hours(24 * 7));
+
+        // Coalesces webhook posts per channel and honours Discord rate limits
+        webhook_dispatcher = std::make_unique<WebhookDispatcher>(
+            std::chrono::seconds(3), std::chrono::seconds(15),
+            WebhookDispatcher::post_multipart, shutdown_deadline / 2);
+
+        // Elite Insights json for the detail view, fetched on first open
+        details = std::make_unique<LogDetails>(data_path / "details");
+    });
+
+    stage("user_data", [this] {
+        // dps.report User Token
+        userTokens = db->write([](Storage& s) {
+                           if (s.count<UserToken>() == 0) {
+                               UserToken token{};
+                               token.id = -1;
+                               token.disabled = true;
+                               s.insert(token);
+                           }
+                           return s.get_all<UserToken>();
+                       }).get();
+        userToken.id = userTokens.front().id;
+        userToken.value = userTokens.front().value;
+        userToken.disabled = userTokens.front().disabled;
+        memset(userToken.value_buf, 0, sizeof(userToken.value_buf));
+        if (userToken.disabled) {
+            memcpy(userToken.value_buf, "--DISABLED--", sizeof("--DISABLED--"));
+        } else {
+            memcpy(userToken.value_buf, userToken.value.c_str(),
+                   userToken.value.size());
+        }
+
+        // Aleeva servers/channels from the last login
+        aleeva_cache = load_aleeva_cache();
+        if (aleeva_cache) {
+            settings.aleeva.server_ids = aleeva_cache->server_ids;
+            settings.aleeva.channel_ids = aleeva_cache->channel_ids;
+        }
+
+        // Webhooks
+        set_webhooks(db->read([](Storage& s) { return s.get_all<Webhook>(); }).get());
+
+        // Uploads interrupted by the last shutdown
+        resumed_uploads = db->write([](Storage& s) {
+                              auto ids = s.select(&PendingUpload::log_id);
+                              s.remove_all<PendingUpload>();
+                              return ids;
+                          }).get();
+        if (!resumed_uploads.empty()) {
+            LOG_F(INFO, "Resuming %zu interrupted uploads",
+                  resumed_uploads.size());
+        }
+    });
 
     if (custom_log_path) {
         log_path = *custom_log_path;
     } else {
+#ifdef _WIN32
         /* my documents */
         WCHAR my_documents[MAX_PATH];
         HRESULT result = SHGetFolderPath(NULL, CSIDL_MYDOCUMENTS, NULL,
@@ -117,6 +381,9 @@ Uploader::Uploader(fs::path data_path, std::optional<fs::path> custom_log_path)
         } else {
             LOG_F(ERROR, "Failed to find Documents paths. Fatal.");
         }
+#else
+        LOG_F(ERROR, "No log path given and no Documents folder on this platform.");
+#endif
     }
 
     LOG_F(INFO, "Logs Path: %s", log_path.string().c_str());
@@ -134,22 +401,110 @@ Uploader::Uploader(fs::path data_path, std::optional<fs::path> custom_log_path)
 
 Uploader::~Uploader() {
     LOG_F(INFO, "Uploader destructor begin...");
-    // Save our settings if we previously loaded/created an ini file
-    settings.save();
-
-    // Stop the thread from looping and wait for it to finish executing
-    // Otherwise, GW2 will not exit
-    upload_thread_run = false;
-    ut_cv.notify_all();
-    upload_thread.join();
+    Metrics::Timer shutdown_timer;
+    // Every task below checks the token: jobs stop at their next page or
+    // directory, transfers abort at libcurl's next progress tick. They are
+    // all still waited for, nothing may run once the module is unloaded.
+    shutdown_token.cancel();
+
+    // The threads and the upload queue only exist once initialization has
+    // finished. A schema migration in progress is interrupted and rolled
+    // back.
+    if (ft_init.valid()) {
+        ft_init.wait();
+    }
+    std::vector<int> unfinished;
+    if (ready) {
+        // The upload thread may be waiting on a compression
+        compressor->cancel();
+        // Save our settings if we previously loaded/created an ini file
+        settings.save();
+
+        // Stop the thread from looping and wait for it to finish executing
+        // Otherwise, GW2 will not exit
+        upload_thread_run = false;
+        ut_cv.notify_all();
+        if (upload_thread.joinable()) {
+            upload_thread.join();
+        }
+
+        // The aborted upload was put back in the queue, pick it up next start
+        unfinished.assign(upload_queue.begin(), upload_queue.end());
+        for (const auto& [log_id, deferred] : deferred_uploads) {
+            unfinished.push_back(log_id);
+        }
+        db->write([unfinished](Storage& s) {
+            s.remove_all<PendingUpload>();
+            for (int log_id : unfinished) {
+                s.replace(PendingUpload{log_id});
+            }
+        });
+    } else if (db && !resumed_uploads.empty()) {
+        // Initialization stopped after taking them out of the table
+        unfinished = resumed_uploads;
+        db->write([unfinished](Storage& s) {
+            for (int log_id : unfinished) {
+                s.replace(PendingUpload{log_id});
+            }
+        });
+    }
+
+    // The refresh task uses the compressor, let it finish first
+    if (ft_file_list.valid()) {
+        ft_file_list.wait();
+    }
+    if (ft_aleeva_login.valid()) {
+        ft_aleeva_login.wait();
+    }
+    if (ft_webhooks.valid()) {
+        ft_webhooks.wait();
+    }
+    if (ft_stats.valid()) {
+        ft_stats.wait();
+    }
+    if (ft_stats_rebuild.valid()) {
+        ft_stats_rebuild.wait();
+    }
+    if (ft_export.valid()) {
+        ft_export.wait();
+    }
+    // Whatever initialize or open_offline created, even if it failed part
+    // way: their threads must not outlive the module. The webhook dispatcher
+    // sends queued messages for up to half the deadline.
+    webhook_dispatcher.reset();
+    details.reset();
+    compressor.reset();
+    // Commits whatever is still queued, the jobs above stopped adding to it
+    db.reset();
+
+    double ms = shutdown_timer.seconds() * 1000.0;
+    if (ms > shutdown_deadline.count()) {
+        LOG_F(WARNING,
+              "Shutdown took %.1f ms, over the %lld ms deadline (%zu uploads "
+              "left for next start)",
+              ms, (long long)shutdown_deadline.count(), unfinished.size());
+    } else {
+        LOG_F(INFO, "Shutdown took %.1f ms (%zu uploads left for next start)",
+              ms, unfinished.size());
+    }
 }
 
+void Uploader::set_shutdown_deadline(std::chrono::milliseconds deadline) {
+    shutdown_deadline = deadline;
+}
+
+#ifndef HEADLESS
 uintptr_t Uploader::imgui_tick() {
 #ifdef STANDALONE
     if (1) {
 #else
     if (is_open) {
 #endif
+        if (!ready) {
+            imgui_draw_initializing();
+            return uintptr_t();
+        }
+
         ImGui::PushStyleVar(ImGuiStyleVar_ChildRounding, 5.0f);
 
         if (!ImGui::Begin("Uploader", &is_open,
@@ -176,6 +531,7 @@ uintptr_t Uploader::imgui_tick() {
         ImGui::Separator();
 
         imgui_draw_status();
+        imgui_draw_stats();
         imgui_draw_options();
 
         if (in_combat) {
@@ -203,7 +559,8 @@ uintptr_t Uploader::imgui_tick() {
         }
     }
 
-    if (!in_combat) {
+    // The init thread owns the refresh and the Aleeva login until then
+    if (!in_combat && is_ready()) {
         poll_async_refresh_log_list();
     }
 
@@ -242,46 +599,43 @@ void Uploader::imgui_draw_logs() {
     ImGui::Separator();
     static bool selected[75]{false};
     for (int i = 0; i < logs.size(); ++i) {
-        Log& s = logs.at(i);
-        std::string display;
-        if (s.uploaded) {
-            display = s.boss_name;
-        } else {
-            display = s.filename;
-        }
+        const LogRecord& s = logs[i];
+        std::string display(s.uploaded() ? logs.boss_name(s)
+                                         : logs.filename(s));
 
         ImVec4 col = ImVec4(1.f, 0.f, 0.f, 1.f);
-        if (s.success) {
+        if (s.success()) {
             col = ImVec4(0.f, 1.f, 0.f, 1.f);
         } else if (success_only) {
             continue;
         }
 
         ImGui::PushStyleColor(ImGuiCol_Text, col);
-        ImGui::PushID(s.human_time.c_str());
-        ImGui::Selectable(display.c_str(), &selected[i],
-                          ImGuiSelectableFlags_SpanAllColumns);
-        ImGui::PopID();
-        ImGui::PopStyleColor();
+        ImGui::PushID(s.id);
+        if (ImGui::Selectable(display.c_str(), &selected[i],
+                              ImGuiSelectableFlags_SpanAllColumns)) {
+            detail_log_id = s.id;
+        }
         ImGui::SetItemAllowOverlap();
+        ImGui::PopStyleColor();
         ImGui::NextColumn();
-        ImGui::Text(s.human_time.c_str());
+        ImGui::TextUnformatted(logs.human_time(s).c_str());
         ImGui::NextColumn();
-        if (s.uploaded) {
-            ImGui::PushID(s.filename.c_str());
+        if (s.uploaded()) {
             if (ImGui::SmallButton("View")) {
-                if (!s.permalink.empty()) {
+                std::string permalink = logs.permalink(s);
+                if (!permalink.empty()) {
                     int sz =
-                        MultiByteToWideChar(CP_UTF8, 0, s.permalink.c_str(),
-                                            (int)s.permalink.size(), 0, 0);
+                        MultiByteToWideChar(CP_UTF8, 0, permalink.c_str(),
+                                            (int)permalink.size(), 0, 0);
                     std::wstring wstr(sz, 0);
-                    MultiByteToWideChar(CP_UTF8, 0, s.permalink.c_str(),
-                                        (int)s.permalink.size(), &wstr[0], sz);
+                    MultiByteToWideChar(CP_UTF8, 0, permalink.c_str(),
+                                        (int)permalink.size(), &wstr[0], sz);
                     ShellExecute(0, 0, wstr.c_str(), 0, 0, SW_SHOW);
                 }
             }
-            ImGui::PopID();
         }
+        ImGui::PopID();
 
         ImGui::NextColumn();
 
@@ -298,8 +652,7 @@ void Uploader::imgui_draw_logs() {
         std::string msg;
         for (int i = 0; i < logs.size(); ++i) {
             if (selected[i]) {
-                const Log& s = logs.at(i);
-                msg += s.permalink + "\n";
+                msg += logs.permalink(logs[i]) + "\n";
             }
         }
         ImGui::SetClipboardText(msg.c_str());
@@ -317,8 +670,7 @@ void Uploader::imgui_draw_logs() {
 
         for (int i = 0; i < logs.size(); ++i) {
             if (selected[i]) {
-                const Log& s = logs.at(i);
-                msg += format_msg(s);
+                msg += format_msg(logs, logs[i]);
             }
         }
         ImGui::SetClipboardText(msg.c_str());
@@ -339,10 +691,10 @@ void Uploader::imgui_draw_logs() {
         std::chrono::system_clock::time_point past =
             current - std::chrono::minutes(settings.recent_minutes);
         for (int i = 0; i < logs.size(); ++i) {
-            const Log& s = logs.at(i);
-            if (s.uploaded && s.success) {
-                if (s.time > past) {
-                    msg += format_msg(s);
+            const LogRecord& s = logs[i];
+            if (s.uploaded() && s.success()) {
+                if (s.time() > past) {
+                    msg += format_msg(logs, s);
                 }
             }
         }
@@ -355,13 +707,14 @@ void Uploader::imgui_draw_logs() {
         std::vector<int> queue;
         for (int i = 0; i < logs.size(); ++i) {
             if (selected[i]) {
-                Log& s = logs.at(i);
-                queue.push_back(s.id);
+                queue.push_back(logs[i].id);
             }
         }
         add_pending_upload_logs(queue);
     }
 #endif
+
+    imgui_draw_details();
 }
 
 void Uploader::imgui_draw_status() {
@@ -371,22 +724,18 @@ void Uploader::imgui_draw_status() {
     for (const auto& status : status_messages) {
         ImGui::Text(status.msg.c_str());
         if (status.log_id > 0) {
-            auto log = storage->get_pointer<Log>(status.log_id);
-            if (log) {
-                if (log->permalink.size() > 8) {
-                    ImGui::Text("%s",
-                                log->permalink.substr(8, log->permalink.size())
-                                    .c_str());
-                } else {
-                    ImGui::Text("%s", log->permalink.c_str());
-                }
-                ImGui::SameLine();
-                ImGui::PushID(std::string("Url" + log->permalink).c_str());
-                if (ImGui::SmallButton("Copy")) {
-                    ImGui::SetClipboardText(log->permalink.c_str());
-                }
-                ImGui::PopID();
+            const std::string& permalink = status.permalink;
+            if (permalink.size() > 8) {
+                ImGui::Text("%s", permalink.substr(8, permalink.size()).c_str());
+            } else {
+                ImGui::Text("%s", permalink.c_str());
+            }
+            ImGui::SameLine();
+            ImGui::PushID(std::string("Url" + permalink).c_str());
+            if (ImGui::SmallButton("Copy")) {
+                ImGui::SetClipboardText(permalink.c_str());
             }
+            ImGui::PopID();
         }
     }
     static uint8_t status_message_count = 0;
@@ -398,6 +747,140 @@ void Uploader::imgui_draw_status() {
     ImGui::EndChild();
 }
 
+void Uploader::imgui_draw_stats() {
+    if (ft_stats.valid() && ft_stats.wait_for(std::chrono::seconds(0)) ==
+                                std::future_status::ready) {
+        stats_rows = ft_stats.get();
+    }
+    if (ft_stats_rebuild.valid() &&
+        ft_stats_rebuild.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready) {
+        StatsRebuild rebuild = ft_stats_rebuild.get();
+        status_messages.push_back(StatusMessage{
+            rebuild.ok
+                ? "Statistics rebuilt from " + std::to_string(rebuild.logs) +
+                      " logs, " + std::to_string(rebuild.mismatched) +
+                      " of " + std::to_string(rebuild.rows) +
+                      " totals were off."
+                : std::string("Statistics rebuild failed, see the log."),
+            -1, {}});
+        stats_stale = true;
+    }
+#ifdef STANDALONE
+    if (ft_export.valid() && ft_export.wait_for(std::chrono::seconds(0)) ==
+                                 std::future_status::ready) {
+        ExportResult result = ft_export.get();
+        status_messages.push_back(StatusMessage{
+            result.ok ? "Exported " + std::to_string(result.logs) +
+                            " logs to " + result.logs_file.string()
+                      : "Export failed: " + result.error,
+            -1, {}});
+    }
+#endif
+
+    if (!ImGui::CollapsingHeader("Statistics")) return;
+
+    static const char* range_names[] = {"This week", "Last 4 weeks",
+                                        "Last 52 weeks", "All time"};
+    static const char* scope_names[] = {"Bosses", "Categories"};
+    ImGui::PushItemWidth(120);
+    if (ImGui::Combo("##Range", &stats_range, range_names,
+                     IM_ARRAYSIZE(range_names))) {
+        stats_stale = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Combo("##Scope", &stats_scope, scope_names,
+                     IM_ARRAYSIZE(scope_names))) {
+        stats_stale = true;
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Rebuild") && !ft_stats_rebuild.valid()) {
+        ft_stats_rebuild = std::async(std::launch::async,
+                                      [this] { return rebuild_stats(); });
+    }
+    if (ImGui::IsItemHovered()) {
+        ImGui::BeginTooltip();
+        ImGui::Text("Recount every log, including archived ones");
+        ImGui::EndTooltip();
+    }
+#ifdef STANDALONE
+    static const char* format_names[] = {"Arrow", "CSV"};
+    ImGui::SameLine();
+    ImGui::PushItemWidth(70);
+    ImGui::Combo("##ExportFormat", &export_format, format_names,
+                 IM_ARRAYSIZE(format_names));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Export") && !ft_export.valid()) {
+        ExportOptions options;
+        options.dir = data_path / "export";
+        options.format = (ExportFormat)export_format;
+        options.since_last = true;
+        ft_export = std::async(std::launch::async, [this, options] {
+            return export_logs(options);
+        });
+    }
+    if (ImGui::IsItemHovered()) {
+        ImGui::BeginTooltip();
+        ImGui::Text("Write the logs added since the last export, with their "
+                    "players, to the export folder");
+        ImGui::EndTooltip();
+    }
+#endif
+
+    if (stats_stale && !ft_stats.valid()) {
+        stats_stale = false;
+        auto [from, to] = Stats::weeks((Stats::Range)stats_range,
+                                       std::chrono::system_clock::now());
+        ft_stats = std::async(
+            std::launch::async,
+            [this, scope = (Stats::Scope)stats_scope, from = from, to = to] {
+                return query_stats(scope, from, to);
+            });
+    }
+
+    auto mm_ss = [](int64_t ms) {
+        char text[16];
+        if (ms <= 0) return std::string("-");
+        snprintf(text, sizeof(text), "%d:%02d", (int)(ms / 60000),
+                 (int)(ms / 1000 % 60));
+        return std::string(text);
+    };
+
+    ImGui::BeginChild("Statistics", ImVec2(450, 150), true);
+    ImGui::Columns(5);
+    ImGui::SetColumnOffset(1, 170);
+    ImGui::SetColumnOffset(2, 240);
+    ImGui::SetColumnOffset(3, 310);
+    ImGui::SetColumnOffset(4, 380);
+    ImGui::TextUnformatted(stats_scope ? "Category" : "Boss");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("Kills");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("Success");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("Avg kill");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("Best");
+    ImGui::NextColumn();
+    ImGui::Separator();
+    for (const StatsRollup& row : stats_rows) {
+        ImGui::TextUnformatted(row.name.c_str());
+        ImGui::NextColumn();
+        ImGui::Text("%d/%d", row.kills, row.attempts);
+        ImGui::NextColumn();
+        ImGui::Text("%.0f%%", row.success_rate() * 100.0);
+        ImGui::NextColumn();
+        ImGui::TextUnformatted(mm_ss(row.average_kill_ms()).c_str());
+        ImGui::NextColumn();
+        ImGui::TextUnformatted(mm_ss(row.kill_ms_best).c_str());
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::EndChild();
+}
+
 void Uploader::imgui_draw_options() {
     if (ImGui::CollapsingHeader("Options")) {
         if (ImGui::TreeNode("dps.report User Token")) {
@@ -416,7 +899,7 @@ void Uploader::imgui_draw_options() {
             }
             if (ImGui::Button("Save") && !userToken.disabled) {
                 userToken.value = userToken.value_buf;
-                storage->update(userToken);
+                save_user_token();
             }
             if (ImGui::IsItemHovered()) {
                 ImGui::BeginTooltip();
@@ -434,7 +917,7 @@ void Uploader::imgui_draw_options() {
                     memset(userToken.value_buf, 0, sizeof(userToken.value_buf));
                     userToken.value = userToken.value_buf;
                     userToken.disabled = false;
-                    storage->update(userToken);
+                    save_user_token();
                 }
                 ImGui::EndPopup();
             }
@@ -454,7 +937,7 @@ void Uploader::imgui_draw_options() {
                     memcpy(userToken.value_buf, userToken.value.c_str(),
                            userToken.value.size());
                     userToken.disabled = false;
-                    storage->update(userToken);
+                    save_user_token();
                 }
             } else {
                 if (ImGui::Button("Disable")) {
@@ -462,7 +945,7 @@ void Uploader::imgui_draw_options() {
                     memcpy(userToken.value_buf, "--DISABLED--",
                            sizeof("--DISABLED--"));
                     userToken.disabled = true;
-                    storage->update(userToken);
+                    save_user_token();
                 }
             }
             if (ImGui::IsItemHovered()) {
@@ -478,10 +961,18 @@ void Uploader::imgui_draw_options() {
             ImGui::TreePop();
         }
         if (ImGui::TreeNode("Webhooks (Discord)")) {
+            if (ft_webhooks.valid() &&
+                ft_webhooks.wait_for(std::chrono::seconds(0)) ==
+                    std::future_status::ready) {
+                set_webhooks(ft_webhooks.get());
+            }
+
             for (auto& wh : webhooks) {
                 ImGui::BeginChild(
                     wh.name.c_str(),
-                    ImVec2(ImGui::GetContentRegionAvailWidth(), 148), true);
+                    ImVec2(ImGui::GetContentRegionAvailWidth(),
+                           wh.rule_error.empty() ? 172 : 190),
+                    true);
 
                 ImGui::PushItemWidth(ImGui::GetContentRegionAvailWidth() -
                                      ImGui::CalcTextSize("Filter").x - 1);
@@ -504,7 +995,7 @@ void Uploader::imgui_draw_options() {
                     ImGui::EndTooltip();
                 }
 
-                ImGui::Checkbox("Raids", &wh.raids);
+                routes_dirty |= ImGui::Checkbox("Raids", &wh.raids);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
                     ImGui::Text("Use this webhook for raid logs");
@@ -512,7 +1003,7 @@ void Uploader::imgui_draw_options() {
                 }
                 ImGui::SameLine();
 
-                ImGui::Checkbox("Fractals", &wh.fractals);
+                routes_dirty |= ImGui::Checkbox("Fractals", &wh.fractals);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
                     ImGui::Text("Use this webhook for fractal logs");
@@ -520,7 +1011,7 @@ void Uploader::imgui_draw_options() {
                 }
                 ImGui::SameLine();
 
-                ImGui::Checkbox("Strikes", &wh.strikes);
+                routes_dirty |= ImGui::Checkbox("Strikes", &wh.strikes);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
                     ImGui::Text("Use this webhook for strike logs");
@@ -528,7 +1019,7 @@ void Uploader::imgui_draw_options() {
                 }
                 ImGui::SameLine();
 
-                ImGui::Checkbox("Golems", &wh.golems);
+                routes_dirty |= ImGui::Checkbox("Golems", &wh.golems);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
                     ImGui::Text("Use this webhook for golem logs");
@@ -536,7 +1027,7 @@ void Uploader::imgui_draw_options() {
                 }
                 ImGui::SameLine();
 
-                ImGui::Checkbox("WvW", &wh.wvw);
+                routes_dirty |= ImGui::Checkbox("WvW", &wh.wvw);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
                     ImGui::Text("Use this webhook for WvW logs");
@@ -560,7 +1051,7 @@ void Uploader::imgui_draw_options() {
 
                 ImGui::PushItemWidth(ImGui::GetContentRegionAvailWidth() *
                                      0.25f);
-                ImGui::InputInt("Min", &wh.filter_min, 1, 2);
+                routes_dirty |= ImGui::InputInt("Min", &wh.filter_min, 1, 2);
                 ImGui::PopItemWidth();
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
@@ -572,18 +1063,45 @@ void Uploader::imgui_draw_options() {
                 }
                 ImGui::SameLine();
 
-                ImGui::Checkbox("Clears Only", &wh.success);
+                routes_dirty |= ImGui::Checkbox("Clears Only", &wh.success);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
                     ImGui::Text("Use this webhook for clears/success only");
                     ImGui::EndTooltip();
                 }
 
+                ImGui::PushItemWidth(ImGui::GetContentRegionAvailWidth() -
+                                     ImGui::CalcTextSize("Filter").x - 1);
+                ImGui::InputText("Rule", wh.rule_buf, 256);
+                ImGui::PopItemWidth();
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::Text(
+                        "Extra conditions, separated by ';' (optional)\n"
+                        "category=raids,strikes; boss=15438,21041; success;\n"
+                        "duration>=90s; accounts=2 of a.1234,b.5678; "
+                        "time=19:00-23:30");
+                    ImGui::EndTooltip();
+                }
+                if (!wh.rule_error.empty()) {
+                    ImGui::TextColored(ImVec4(1.f, 0.4f, 0.4f, 1.f), "%s",
+                                       wh.rule_error.c_str());
+                }
+
                 if (ImGui::Button("Save")) {
-                    wh.name = wh.name_buf;
-                    wh.url = wh.url_buf;
-                    wh.filter = wh.filter_buf;
-                    storage->update(wh);
+                    RouteRule check;
+                    wh.rule_error.clear();
+                    if (!check.parse(wh.rule_buf, wh.rule_error)) {
+                        wh.rule_error = "Not saved, " + wh.rule_error;
+                    } else {
+                        std::lock_guard<std::mutex> lk(wh_mutex);
+                        wh.name = wh.name_buf;
+                        wh.url = wh.url_buf;
+                        wh.filter = wh.filter_buf;
+                        wh.rule = wh.rule_buf;
+                        db->write([wh](Storage& s) { s.update(wh); });
+                        routes_dirty = true;
+                    }
                 }
                 ImGui::SameLine();
 
@@ -591,19 +1109,11 @@ void Uploader::imgui_draw_options() {
                     ImGui::OpenPopup("Delete_Confirm");
                 }
                 if (ImGui::BeginPopup("Delete_Confirm")) {
-                    if (ImGui::Button("Confirm")) {
-                        storage->remove<Webhook>(wh.id);
-                        webhooks = storage->get_all<Webhook>();
-                        for (auto& wh : webhooks) {
-                            memset(wh.name_buf, 0, 64);
-                            memcpy(wh.name_buf, wh.name.c_str(),
-                                   wh.name.size());
-                            memset(wh.url_buf, 0, 192);
-                            memcpy(wh.url_buf, wh.url.c_str(), wh.url.size());
-                            memset(wh.filter_buf, 0, 256);
-                            memcpy(wh.filter_buf, wh.filter.c_str(),
-                                   wh.filter.size());
-                        }
+                    if (ImGui::Button("Confirm") && !ft_webhooks.valid()) {
+                        ft_webhooks = db->write([id = wh.id](Storage& s) {
+                            s.remove<Webhook>(id);
+                            return s.get_all<Webhook>();
+                        });
                     }
                     ImGui::EndPopup();
                 }
@@ -612,7 +1122,7 @@ void Uploader::imgui_draw_options() {
             }
 
             ImGui::Separator();
-            if (ImGui::Button("Add Webhook")) {
+            if (ImGui::Button("Add Webhook") && !ft_webhooks.valid()) {
                 Webhook nwh = {};
                 nwh.id = -1;
                 nwh.raids = true;
@@ -622,16 +1132,10 @@ void Uploader::imgui_draw_options() {
                 nwh.wvw = true;
                 nwh.success = true;
                 nwh.filter_min = 10;
-                storage->insert(nwh);
-                webhooks = storage->get_all<Webhook>();
-                for (auto& wh : webhooks) {
-                    memset(wh.name_buf, 0, 64);
-                    memcpy(wh.name_buf, wh.name.c_str(), wh.name.size());
-                    memset(wh.url_buf, 0, 192);
-                    memcpy(wh.url_buf, wh.url.c_str(), wh.url.size());
-                    memset(wh.filter_buf, 0, 256);
-                    memcpy(wh.filter_buf, wh.filter.c_str(), wh.filter.size());
-                }
+                ft_webhooks = db->write([nwh](Storage& s) {
+                    s.insert(nwh);
+                    return s.get_all<Webhook>();
+                });
             }
 
             ImGui::TreePop();
@@ -680,7 +1184,8 @@ void Uploader::imgui_draw_options() {
                     ImGui::EndTooltip();
                 }
 
-                ImGui::Checkbox("Clears only", &settings.gw2bot_success_only);
+                routes_dirty |= ImGui::Checkbox("Clears only",
+                                                &settings.gw2bot_success_only);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
                     ImGui::Text("Only post clears/successful logs to GW2Bot.");
@@ -691,6 +1196,38 @@ void Uploader::imgui_draw_options() {
             ImGui::TreePop();
         }
 
+        if (ImGui::TreeNode("Squad Coordination")) {
+            std::lock_guard<std::mutex> lk(coordination_mutex);
+            ImGui::Checkbox("Coordinate uploads with my squad",
+                            &settings.coordination_enabled);
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::PushTextWrapPos(ImGui::GetFontSize() * 35.0f);
+                ImGui::TextUnformatted(
+                    "Only one squad member uploads each fight, everyone else "
+                    "gets its link. Every member needs this enabled with the "
+                    "same server. Webhooks are posted by the member who "
+                    "uploads.");
+                ImGui::PopTextWrapPos();
+                ImGui::EndTooltip();
+            }
+
+            if (settings.coordination_enabled) {
+                ImGui::PushItemWidth(ImGui::GetContentRegionAvailWidth() -
+                                     ImGui::CalcTextSize("Server URL").x - 5);
+                ImGui::InputText("Server URL", &settings.coordination_url);
+                ImGui::PopItemWidth();
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::Text("e.g. http://192.168.1.10:8787, see "
+                                "coordination_server.");
+                    ImGui::EndTooltip();
+                }
+            }
+
+            ImGui::TreePop();
+        }
+
         if (ImGui::TreeNode("Other")) {
             ImGui::Checkbox("Enable detailed WvW reports",
                             &settings.wvw_detailed_enabled);
@@ -717,14 +1254,59 @@ void Uploader::imgui_draw_options() {
 
             ImGui::PushItemWidth(ImGui::GetContentRegionAvailWidth() * 0.25f);
             ImGui::InputInt("# of minutes back for recent clears", &settings.recent_minutes);
+            ImGui::InputInt("Archive logs after # days", &settings.archive_after_days);
             ImGui::PopItemWidth();
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::Text(
+                    "Uploaded logs older than this move to uploader_archive.db"
+                    "\n0 keeps every log in uploader.db");
+                ImGui::EndTooltip();
+            }
+            settings.archive_after_days = (std::max)(settings.archive_after_days, 0);
+
+            static const char* backend_names[] = {
+                "dps.report", "Self-hosted (dps.report API)",
+                "Local Elite Insights"};
+            ImGui::PushItemWidth(ImGui::GetContentRegionAvailWidth() * 0.5f);
+            ImGui::Combo("Upload target", &settings.upload_backend,
+                         backend_names, IM_ARRAYSIZE(backend_names));
+            ImGui::PopItemWidth();
+            if (settings.upload_backend ==
+                (int)UploadBackendType::SELF_HOSTED) {
+                ImGui::InputText("Server URL", &settings.upload_backend_url);
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::Text(
+                        "Base URL of a server implementing dps.report's "
+                        "/uploadContent");
+                    ImGui::EndTooltip();
+                }
+            } else if (settings.upload_backend ==
+                       (int)UploadBackendType::LOCAL_EI) {
+                ImGui::InputText("GuildWars2EliteInsights.exe",
+                                 &settings.ei_path);
+                ImGui::InputText("Output folder", &settings.ei_output_path);
+            }
+            if (ImGui::Button("Apply upload target")) {
+                auto backend = make_upload_backend(settings);
+                std::lock_guard<std::mutex> lk(backend_mutex);
+                upload_backend = backend;
+            }
 
             ImGui::TreePop();
         }
     }
+
+    // After the Aleeva section has released aleeva_mutex
+    if (routes_dirty) {
+        routes_dirty = false;
+        update_routes();
+    }
 }
 
 void Uploader::imgui_draw_options_aleeva() {
+    std::lock_guard<std::mutex> lk(aleeva_mutex);
     if (ImGui::TreeNode("Aleeva")) {
         ImGui::Checkbox("Aleeva Integration Enabled", &settings.aleeva.enabled);
         if (ImGui::IsItemHovered()) {
@@ -748,16 +1330,10 @@ void Uploader::imgui_draw_options_aleeva() {
                     ImGui::EndTooltip();
                 }
 
-                if (ImGui::Button("Login")) {
-                    auto future = std::async(
-                        std::launch::async, [&]() { 
-							StatusMessage sm;
-							sm.msg = "Aleeva login failed. Please check your access code and try to login again.";
-                            if (Aleeva::login(settings)) {
-                                sm.msg = "Aleeva login successful.";
-                            }
-                            status_messages.push_back(sm);
-                        });
+                if (ft_aleeva_login.valid()) {
+                    ImGui::TextDisabled("Logging in...");
+                } else if (ImGui::Button("Login")) {
+                    start_aleeva_login();
                 }
             } else {
                 ImGui::SameLine();
@@ -828,7 +1404,8 @@ void Uploader::imgui_draw_options_aleeva() {
                     ImGui::Unindent();
                 }
 
-                ImGui::Checkbox("Clears only", &settings.gw2bot_success_only);
+                routes_dirty |= ImGui::Checkbox("Clears only",
+                                                &settings.aleeva.success_only);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
                     ImGui::Text("Only post clears/successful logs to Aleeva.");
@@ -842,251 +1419,501 @@ void Uploader::imgui_draw_options_aleeva() {
     }
 }
 
+void Uploader::imgui_draw_initializing() {
+    if (!ImGui::Begin("Uploader", &is_open,
+                      ImGuiWindowFlags_AlwaysAutoResize |
+                          ImGuiWindowFlags_NoCollapse)) {
+        ImGui::End();
+        return;
+    }
+    if (init_failed) {
+        ImGui::TextColored(ImVec4(1.f, 0.f, 0.f, 1.f),
+                           "Failed to initialize: %s", init_error.c_str());
+    } else {
+        ImGui::TextUnformatted("Initializing...");
+    }
+    ImGui::End();
+}
+
 void Uploader::imgui_window_checkbox() {
     ImGui::Checkbox("Uploader", &is_open);
 }
 
-void Uploader::create_log_table(Log& l) {
-    auto seconds_to_string = [](uint64_t seconds) -> std::string {
-        uint32_t minutes = (uint32_t)seconds / 60;
-        float secondsf = fmodf((float)seconds, 60.f);
+void Uploader::imgui_draw_details() {
+    if (detail_log_id < 0) return;
 
-        char buf[32];
-        sprintf(buf, "%02u:%02.0f", minutes, secondsf);
-        return std::string(buf);
-    };
+    LogDetailSource source{detail_log_id, ""};
+    for (const LogRecord& r : logs) {
+        if (r.id == detail_log_id) {
+            if (!r.uploaded()) return;
+            source.permalink = logs.permalink(r);
+            break;
+        }
+    }
+    if (source.permalink.empty()) return;
 
-    static std::map<std::string, ImVec4> colors = {
-        {"Druid", ImVec4(17.f / 255.f, 122.f / 255.f, 101.f / 255.f, 1.f)},
-        {"Daredevil", ImVec4(133.f / 255.f, 146.f / 255.f, 158.f / 255.f, 1.f)},
-        {"Berserker", ImVec4(211.f / 255.f, 84.f / 255.f, 0.f, 1.f)},
-        {"Dragonhunter",
-         ImVec4(52.f / 255.f, 152.f / 255.f, 219.f / 255.f, 1.f)},
-        {"Reaper", ImVec4(20.f / 255.f, 90.f / 255.f, 50.f / 255.f, 1.f)},
-        {"Chronomancer",
-         ImVec4(142.f / 255.f, 68.f / 255.f, 173.f / 255.f, 1.f)},
-        {"Scrapper", ImVec4(230.f / 255.f, 126.f / 255.f, 34.f / 255.f, 1.f)},
-        {"Tempest", ImVec4(93.f / 255.f, 173.f / 255.f, 226.f / 255.f, 1.f)},
-        {"Herald", ImVec4(84.f / 255.f, 153.f / 255.f, 199.f / 255.f, 1.f)},
-        {"Soulbeast", ImVec4(39.f / 255.f, 174.f / 255.f, 96.f / 255.f, 1.f)},
-        {"Weaver", ImVec4(192.f / 255.f, 57.f / 255.f, 43.f / 255.f, 1.f)},
-        {"Holosmith", ImVec4(243.f / 255.f, 156.f / 255.f, 18.f / 255.f, 1.f)},
-        {"Deadye", ImVec4(203.f / 255.f, 67.f / 255.f, 53.f / 255.f, 1.f)},
-        {"Mirage", ImVec4(155.f / 255.f, 89.f / 255.f, 182.f, 1.f)},
-        {"Scourge", ImVec4(241.f / 255.f, 196.f / 255.f, 15.f / 255.f, 1.f)},
-        {"Spellbreaker",
-         ImVec4(212.f / 255.f, 172.f / 255.f, 13.f / 255.f, 1.f)},
-        {"Firebrand", ImVec4(93.f / 255.f, 173.f / 255.f, 226.f / 255.f, 1.f)},
-        {"Renegade", ImVec4(148.f / 255.f, 49.f / 255.f, 38.f / 255.f, 1.f)}};
-
-    if (l.players) {
-        /*
-        static ImVec2 size = ImVec2(800, 250);
-        ImGui::Text("%s (%s)", l.encounter_name.c_str(),
-        seconds_to_string(l.parsed.encounter_duration).c_str());
-        ImGui::Separator(); ImGui::Spacing(); ImGui::BeginChild("DPS Table",
-        size, false, ImGuiWindowFlags_NoScrollbar);
-
-        ImGui::Columns(10);
-        ImGui::SetColumnOffset(0, 0); //Sub
-        ImGui::SetColumnOffset(1, 15); //Class
-        ImGui::SetColumnOffset(2, 15 + 55); //Name
-        ImGui::SetColumnOffset(3, 15 + 55 + 180); //Account
-        ImGui::SetColumnOffset(4, 15 + 55 + 180 + 180); //Boss DPS
-        ImGui::SetColumnOffset(5, 15 + 55 + 180 + 180 + 85); //DPS
-        ImGui::SetColumnOffset(6, 15 + 55 + 180 + 180 + 85 + 70); //Might
-        ImGui::SetColumnOffset(7, 15 + 55 + 180 + 180 + 85 + 70 + 55); //Fury
-        ImGui::SetColumnOffset(8, 15 + 55 + 180 + 180 + 85 + 70 + 55 + 55);
-        //Quickness ImGui::SetColumnOffset(9, 15 + 55 + 180 + 180 + 85 + 70 + 55
-        + 55 + 55); //Alacrity ImGui::TextUnformatted(""); ImGui::NextColumn();
-        ImGui::TextUnformatted("Class"); ImGui::NextColumn();
-        ImGui::TextUnformatted("Name"); ImGui::NextColumn();
-        ImGui::TextUnformatted("Account"); ImGui::NextColumn();
-        ImGui::TextUnformatted("Boss DPS"); ImGui::NextColumn();
-        ImGui::TextUnformatted("DPS"); ImGui::NextColumn();
-        ImGui::TextUnformatted("Might"); ImGui::NextColumn();
-        ImGui::TextUnformatted("Fury"); ImGui::NextColumn();
-        ImGui::TextUnformatted("Quick"); ImGui::NextColumn();
-        ImGui::TextUnformatted("Alac"); ImGui::NextColumn();
-        ImGui::Separator();
+    std::shared_ptr<const LogSummary> summary;
+    LogDetails::State state = details->get(source, summary);
+    ImGui::Separator();
+    if (state == LogDetails::State::LOADING) {
+        ImGui::TextUnformatted("Loading details...");
+        return;
+    }
+    if (state == LogDetails::State::FAILED) {
+        ImGui::TextUnformatted(details->error(detail_log_id).c_str());
+        return;
+    }
 
-        int16_t sub = -1;
-        for (const auto& p : l.parsed.players) {
-                if (p.subgroup != sub) {
-                        ImGui::Separator();
-                        sub = p.subgroup;
-                }
-                ImGui::Text("%u", p.subgroup); ImGui::NextColumn();
-                if (colors.count(p.elite_spec_name)) {
-                        ImGui::TextColored(colors.at(p.elite_spec_name), "%s",
-        p.elite_spec_name == "Unknown" ? p.profession_name_short.c_str() :
-        p.elite_spec_name_short.c_str()); } else { ImGui::Text("%s",
-        p.elite_spec_name == "Unknown" ? p.profession_name_short.c_str() :
-        p.elite_spec_name_short.c_str());
-                }
-                ImGui::NextColumn();
-                ImGui::Text("%s", p.name.c_str()); ImGui::NextColumn();
-                ImGui::Text("%s", p.account.c_str()); ImGui::NextColumn();
-                ImGui::Text("%.2fk", (float)p.boss_dps / 1000.f);
-        ImGui::NextColumn(); ImGui::Text("%.2fk", (float)p.dps / 1000.f);
-        ImGui::NextColumn(); ImGui::Text("%.1f", p.might_avg);
-        ImGui::NextColumn(); ImGui::Text("%.1f%%", p.fury_avg * 100.f);
-        ImGui::NextColumn(); ImGui::Text("%.1f%%", p.quickness_avg * 100.f);
-        ImGui::NextColumn(); ImGui::Text("%.1f%%", p.alacrity_avg * 100.f);
+    int64_t seconds = summary->duration_ms / 1000;
+    ImGui::Text("%s (%02d:%02d)", summary->fight_name.c_str(),
+                (int)(seconds / 60), (int)(seconds % 60));
+    ImGui::Spacing();
+    ImGui::BeginChild("DPS Table", ImVec2(0, 250), false);
+
+    ImGui::Columns(6);
+    ImGui::SetColumnOffset(0, 0);                         // Sub
+    ImGui::SetColumnOffset(1, 30);                        // Class
+    ImGui::SetColumnOffset(2, 30 + 45);                   // Name
+    ImGui::SetColumnOffset(3, 30 + 45 + 180);             // Account
+    ImGui::SetColumnOffset(4, 30 + 45 + 180 + 180);       // Boss DPS
+    ImGui::SetColumnOffset(5, 30 + 45 + 180 + 180 + 85);  // DPS
+    ImGui::TextUnformatted("Sub");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("Class");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("Name");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("Account");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("Boss DPS");
+    ImGui::NextColumn();
+    ImGui::TextUnformatted("DPS");
+    ImGui::NextColumn();
+
+    int sub = -1;
+    for (const auto& p : summary->players) {
+        if (p.group != sub) {
+            ImGui::Separator();
+            sub = p.group;
+        }
+        const SpecInfo& spec = spec_info(p.spec);
+        ImGui::Text("%d", p.group);
+        ImGui::NextColumn();
+        ImGui::TextColored(
+            ImVec4(spec.color[0], spec.color[1], spec.color[2], 1.f), "%s",
+            spec.short_name);
+        ImGui::NextColumn();
+        ImGui::TextUnformatted(p.name.c_str());
+        ImGui::NextColumn();
+        ImGui::TextUnformatted(p.account.c_str());
+        ImGui::NextColumn();
+        ImGui::Text("%.2fk", (float)p.boss_dps / 1000.f);
         ImGui::NextColumn();
+        ImGui::Text("%.2fk", (float)p.dps / 1000.f);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns();
+    ImGui::EndChild();
+}
+#endif // HEADLESS
+
+void Uploader::update_routes() {
+    std::vector<Webhook> hooks;
+    {
+        std::lock_guard<std::mutex> lk(wh_mutex);
+        hooks = webhooks;
+    }
+
+    auto next = std::make_shared<Routes>();
+    std::vector<RouteRule> rules;
+    for (const auto& wh : hooks) {
+        RouteRule rule;
+        auto exclude = [&rule](Revtc::BossCategory category, bool used) {
+            if (!used) rule.categories &= ~RouteRule::category_bit((int)category);
+        };
+        exclude(Revtc::BossCategory::RAIDS, wh.raids);
+        exclude(Revtc::BossCategory::FRACTALS, wh.fractals);
+        exclude(Revtc::BossCategory::STRIKES, wh.strikes);
+        exclude(Revtc::BossCategory::GOLEMS, wh.golems);
+        exclude(Revtc::BossCategory::WVW, wh.wvw);
+        exclude(Revtc::BossCategory::UNKNOWN, false);
+        rule.success_only = wh.success;
+
+        if (wh.filter.size() > 5) {
+            std::string account;
+            std::istringstream accountStream(wh.filter);
+            while (std::getline(accountStream, account, ',')) {
+                rule.accounts.push_back(RouteRule::normalize_account(account));
+            }
+            rule.min_accounts = wh.filter_min;
         }
 
-        size.y = ImGui::GetCursorPosY();
+        std::string error;
+        if (!rule.parse(wh.rule, error)) {
+            LOG_F(WARNING, "Webhook \"%s\" disabled, bad rule: %s",
+                  wh.name.c_str(), error.c_str());
+            continue;
+        }
+        rules.push_back(std::move(rule));
+        next->targets.push_back({RouteTarget::Kind::WEBHOOK, wh.name, wh.url});
+    }
+    next->webhooks = next->targets.size();
 
-        ImGui::EndChild();
-        */
+    // Whether they are enabled is checked when posting
+    RouteRule gw2bot;
+    gw2bot.success_only = settings.gw2bot_success_only;
+    rules.push_back(gw2bot);
+    next->targets.push_back({RouteTarget::Kind::GW2BOT, "GW2Bot", ""});
+
+    RouteRule aleeva;
+    {
+        std::lock_guard<std::mutex> lk(aleeva_mutex);
+        aleeva.success_only = settings.aleeva.success_only;
     }
+    rules.push_back(aleeva);
+    next->targets.push_back({RouteTarget::Kind::ALEEVA, "Aleeva", ""});
+
+    next->table = RoutingTable(rules);
+    std::lock_guard<std::mutex> lk(wh_mutex);
+    routes = std::move(next);
 }
 
-void Uploader::check_webhooks(int log_id) {
-    auto log = storage->get_pointer<Log>(log_id);
-    if (log) {
-        if (!log->players) {
-            try {
-                json players = json::parse(log->players_json);
-                log->players = std::make_optional<json>(players);
-            } catch (json::parse_error& e) {
-                LOG_F(ERROR, "Failed to parse player json for %s: %s",
-                      log->filename.c_str(), e.what());
-            }
+void Uploader::route_log(const Log& log, const UploadResult& result) {
+    std::shared_ptr<const Routes> current;
+    {
+        std::lock_guard<std::mutex> lk(wh_mutex);
+        current = routes;
+    }
+    if (!current) return;
+
+    static Metrics::Counter& evaluated = Metrics::counter(
+        "uploader_webhook_evaluations_total",
+        "Webhook filter evaluations");
+    static Metrics::Counter& matched = Metrics::counter(
+        "uploader_webhook_matches_total",
+        "Webhook evaluations that resulted in a post");
+    static Metrics::Histogram& routing_time = Metrics::histogram(
+        "uploader_routing_seconds",
+        "Time to match a log against every destination");
+
+    Metrics::Timer timer;
+    RouteInput input;
+    input.category = (int)Revtc::Parser::encounterCategory(
+        (Revtc::BossID)log.boss_id);
+    input.boss_id = (uint16_t)log.boss_id;
+    input.success = log.success;
+    input.duration_ms =
+        log.duration_ms > 0 ? log.duration_ms : result.duration_ms;
+    if (input.duration_ms <= 0 && current->table.uses_duration()) {
+        input.duration_ms = local_duration_ms(log);
+    }
+    std::time_t written = std::chrono::system_clock::to_time_t(log.time);
+    if (std::tm* local = std::localtime(&written)) {
+        input.minute_of_day = local->tm_hour * 60 + local->tm_min;
+    }
+    if (current->table.uses_accounts()) {
+        for (const auto& player : result.players) {
+            input.accounts.push_back(
+                RouteRule::normalize_account(player.display_name));
         }
+        std::sort(input.accounts.begin(), input.accounts.end());
+        input.accounts.erase(
+            std::unique(input.accounts.begin(), input.accounts.end()),
+            input.accounts.end());
+    }
+    std::vector<size_t> destinations = current->table.match(input);
+    routing_time.observe(timer.seconds());
+    evaluated.inc(current->webhooks);
+
+    for (size_t i : destinations) {
+        const RouteTarget& target = current->targets[i];
+        switch (target.kind) {
+            case RouteTarget::Kind::WEBHOOK:
+                matched.inc();
+                ASYNC_LOG_F(INFO, "Queueing webhook \"%s\" for %s (%s)",
+                            target.name, log.filename, log.boss_name);
+                webhook_dispatcher->enqueue(target.url,
+                                            log.boss_name + " - *" +
+                                                log.human_time + "*\n" +
+                                                log.permalink);
+                break;
+            case RouteTarget::Kind::GW2BOT:
+                post_gw2bot(log);
+                break;
+            case RouteTarget::Kind::ALEEVA:
+                post_aleeva(log);
+                break;
+        }
+    }
+}
 
-        Revtc::BossCategory category =
-            Revtc::Parser::encounterCategory((Revtc::BossID)log->boss_id);
-        for (const auto& wh : webhooks) {
-            bool process = true;
-            if (!log->success && wh.success) process = false;
-            if (category == Revtc::BossCategory::RAIDS && !wh.raids)
-                process = false;
-            if (category == Revtc::BossCategory::FRACTALS && !wh.fractals)
-                process = false;
-            if (category == Revtc::BossCategory::STRIKES && !wh.strikes)
-                process = false;
-            if (category == Revtc::BossCategory::GOLEMS && !wh.golems)
-                process = false;
-            if (category == Revtc::BossCategory::WVW && !wh.wvw)
-                process = false;
-            if (category == Revtc::BossCategory::UNKNOWN)
-                process = false;
-
-            if (wh.filter.size() > 5) {
-                std::vector<std::string> accounts;
-                std::string account;
-                std::istringstream accountStream(wh.filter);
-                while (std::getline(accountStream, account, ',')) {
-                    if (std::isspace(account.front())) {
-                        account = account.substr(1);
-                    }
-                    if (account.size() > 0 && std::isspace(account.back())) {
-                        account.pop_back();
-                    }
-                    std::transform(account.begin(), account.end(),
-                                   account.begin(), (int (*)(int))std::tolower);
-                    accounts.push_back(account);
-                }
+void Uploader::post_gw2bot(const Log& log) {
+    if (!settings.gw2bot_enabled) return;
 
-                if (log->players && log->players->is_object()) {
-                    const auto& players = *log->players;
-                    int found = 0;
-                    for (auto it = players.begin(); it != players.end(); ++it) {
-                        auto& display_name =
-                            it.value().value("display_name", "");
-                        std::transform(display_name.begin(), display_name.end(),
-                                       display_name.begin(),
-                                       (int (*)(int))std::tolower);
-                        if (std::find(accounts.begin(), accounts.end(),
-                                      display_name) != accounts.end()) {
-                            found++;
-                        }
-                    }
-                    int required = (int)min(wh.filter_min, accounts.size());
-                    LOG_F(INFO, "Webhook (%s) - %s - Found/Required: %d/%d",
-                          wh.name.c_str(), log->boss_name.c_str(), found,
-                          required);
-                    if (found < required) {
-                        process = false;
-                    }
-                } else {
-                    LOG_F(ERROR, "Players json was not an object.");
-                }
+    LOG_F(INFO, "Posting to GW2Bot: %s", log.permalink.c_str());
+    auto gw2bot_future = std::async(
+        std::launch::async,
+        [](const std::string& key, const std::string& permalink,
+           CancelToken cancel) {
+            Metrics::Timer timer;
+            cpr::Response response;
+            response = cpr::Post(
+                cpr::Url{
+                    "https://api.gw2bot.info/v1/evtc/notification"},
+                cpr::Header{
+                    {"accept", "application/json"},
+                    {"Authorization", "Bearer " + std::string(key)},
+                    {"Content-Type", "application/json"},
+                },
+                cpr::Body{"{\"dpsreport_url\": \"" + permalink + "\"}"},
+                cancel.progress());
+            Metrics::observe_http("gw2bot", (int)response.status_code,
+                                  timer.seconds());
+            return response;
+        },
+        settings.gw2bot_key, log.permalink, shutdown_token);
+    auto response = wait_unless_cancelled(gw2bot_future, shutdown_token);
+    if (!response) return;
+    if (response->status_code != 201) {
+        queue_status_message("GW2Bot Error: " + response->text);
+    }
+    LOG_F(INFO, "GW2Bot response: %s", response->text.c_str());
+}
 
-                if (process) {
-                    LOG_F(INFO, "Executing webhook \"%s\" for %s (%s)",
-                          wh.name.c_str(), log->filename.c_str(),
-                          log->boss_name.c_str());
-                    auto webhook_future = std::async(
-                        std::launch::async,
-                        [](const Webhook& wh, Log log) {
-                            cpr::Response response;
-                            response = cpr::Post(
-                                cpr::Url{wh.url},
-                                cpr::Multipart{
-                                    {"content", log.boss_name + " - *" +
-                                                    log.human_time + "*" +
-                                                    "\n" + log.permalink}});
-                        },
-                        wh, *log);
-                }
+void Uploader::post_aleeva(const Log& log) {
+    AleevaSettings aleeva;
+    {
+        std::lock_guard<std::mutex> lk(aleeva_mutex);
+        aleeva = settings.aleeva;
+    }
+    if (!aleeva.enabled || !aleeva.authorised) return;
+
+    LOG_F(INFO, "Posting to Aleeva: %s", log.permalink.c_str());
+    auto aleeva_future =
+        std::async(std::launch::async, Aleeva::post_log, aleeva,
+                   log.permalink, shutdown_token);
+    wait_unless_cancelled(aleeva_future, shutdown_token);
+}
+
+bool Uploader::claim_upload(
+    Log& log,
+    std::optional<std::chrono::steady_clock::time_point> waiting_since,
+    std::optional<CoordinatedUpload>& claimed) {
+    CoordinatedUpload coordinated;
+    {
+        std::lock_guard<std::mutex> lk(coordination_mutex);
+        if (!settings.coordination_enabled ||
+            settings.coordination_url.empty()) {
+            return true;
+        }
+        coordinated.url = settings.coordination_url;
+        coordinated.client = settings.coordination_client_id;
+    }
+    // Without a fingerprint nobody else could match it, upload as usual
+    auto fingerprint = FightFingerprint::read(log.path);
+    if (!fingerprint) return true;
+
+    Coordination::Claim claim = Coordination::claim(
+        coordinated.url, coordinated.client, *fingerprint, shutdown_token);
+    Metrics::counter("uploader_coordination_claims_total",
+                     "Answers from the coordination server",
+                     std::string("result=\"") +
+                         Coordination::status_name(claim.status) + "\"")
+        .inc();
+    std::string display = log.filename + " - " + log.human_time;
+
+    if (claim.status == Coordination::Status::DONE) {
+        LOG_F(INFO, "%s was uploaded by %s: %s", log.filename.c_str(),
+              claim.owner.c_str(), claim.permalink.c_str());
+        bool counted = Stats::counts(log);
+        classify_locally(log);
+        log.uploaded = true;
+        log.permalink = claim.permalink;
+        log.report_id = claim.permalink.substr(claim.permalink.rfind('/') + 1);
+        log.boss_name = claim.boss_name;
+        log.success = claim.success;
+        bool count = !counted && Stats::counts(log);
+        db->write([updated = log, count](Storage& s) {
+            try {
+                // Same transaction as the update, see StorageActor
+                s.update(updated);
+                if (count) add_stats(s, updated);
+            } catch (std::system_error& e) {
+                LOG_F(ERROR, "Failed to update log: %s", e.what());
+                // Rolls back the update along with the totals
+                throw;
             }
+        });
+        if (count) stats_stale = true;
+        // The member who uploaded it posted it to webhooks as well
+        queue_status_message(StatusMessage{
+            "Uploaded " + display + " (by a squad member).", log.id,
+            log.permalink});
+        return false;
+    }
+
+    if (claim.status == Coordination::Status::TAKEN) {
+        auto now = std::chrono::steady_clock::now();
+        if (!waiting_since) {
+            waiting_since = now;
+            queue_status_message("Waiting for a squad member to upload " +
+                                 display + ".");
+        }
+        // The server hands out an abandoned claim again once its lease is
+        // up, this only guards against a server that never does
+        if (now - *waiting_since >= COORDINATION_MAX_WAIT) {
+            LOG_F(WARNING, "Gave up waiting for %s to upload %s",
+                  claim.owner.c_str(), log.filename.c_str());
+            return true;
         }
+        std::lock_guard<std::mutex> lk(ut_mutex);
+        deferred_uploads[log.id] = {now + COORDINATION_RETRY, *waiting_since};
+        return false;
+    }
+
+    if (claim.status == Coordination::Status::CLAIMED) {
+        coordinated.fight = claim.fight;
+        claimed = coordinated;
+    } else {
+        LOG_F(WARNING, "Coordination failed for %s: %s", log.filename.c_str(),
+              claim.error.c_str());
     }
+    return true;
 }
 
-void Uploader::check_gw2bot(int log_id) {
-    if (!settings.gw2bot_enabled) return;
+void Uploader::finish_claim(const CoordinatedUpload& claimed, const Log& log,
+                            bool uploaded) {
+    Coordination::Claim answer =
+        uploaded ? Coordination::complete(claimed.url, claimed.client,
+                                          claimed.fight, log.permalink,
+                                          log.boss_name, log.success,
+                                          shutdown_token)
+                 // Let the next member take it rather than wait out the lease
+                 : Coordination::release(claimed.url, claimed.client,
+                                         claimed.fight, shutdown_token);
+    if (answer.status == Coordination::Status::FAILED) {
+        LOG_F(WARNING, "Failed to report %s to the coordination server: %s",
+              log.filename.c_str(), answer.error.c_str());
+    }
+}
 
-    auto log = storage->get_pointer<Log>(log_id);
-    if (log) {
-        bool process = true;
-        if (!log->success && settings.gw2bot_success_only) process = false;
-
-        if (process) {
-            LOG_F(INFO, "Posting to GW2Bot: %s", log->permalink.c_str());
-            auto gw2bot_future = std::async(
-                std::launch::async,
-                [this](const std::string& key, Log log) {
-                    cpr::Response response;
-                    response = cpr::Post(
-                        cpr::Url{
-                            "https://api.gw2bot.info/v1/evtc/notification"},
-                        cpr::Header{
-                            {"accept", "application/json"},
-                            {"Authorization", "Bearer " + std::string(key)},
-                            {"Content-Type", "application/json"},
-                        },
-                        cpr::Body{"{\"dpsreport_url\": \"" + log.permalink +
-                                  "\"}"});
-                    if (response.status_code != 201) {
-                        queue_status_message("GW2Bot Error: " + response.text);
-                    }
-                    LOG_F(INFO, "GW2Bot response: %s", response.text.c_str());
-                },
-                settings.gw2bot_key, *log);
+void Uploader::start_aleeva_login() {
+    if (ft_aleeva_login.valid()) return;
+
+    AleevaSettings credentials;
+    {
+        std::lock_guard<std::mutex> lk(aleeva_mutex);
+        credentials = settings.aleeva;
+    }
+    aleeva_retry_time =
+        std::chrono::steady_clock::now() + std::chrono::minutes(1);
+    ft_aleeva_login =
+        Aleeva::login_async(credentials, aleeva_cache, shutdown_token);
+}
+
+void Uploader::poll_aleeva_login() {
+    if (ft_aleeva_login.valid()) {
+        if (ft_aleeva_login.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+            return;
+        }
+
+        Aleeva::Session session = ft_aleeva_login.get();
+        bool was_authorised;
+        bool expired = false;
+        {
+            std::lock_guard<std::mutex> lk(aleeva_mutex);
+            was_authorised = settings.aleeva.authorised;
+            Aleeva::apply_session(settings.aleeva, session);
+            // A refresh that failed with a token that is still good is
+            // retried in a minute, once the token is gone it is up to the
+            // user to log in again
+            if (!session.authorised && settings.aleeva.authorised &&
+                !Aleeva::is_refresh_token_valid(settings.aleeva)) {
+                Aleeva::deauthorize(settings);
+                expired = true;
+            }
+        }
+        if (session.lists) {
+            aleeva_cache = session.lists;
+        }
+        // Stored from here rather than the login thread, which must not
+        // touch the uploader once it has been cancelled
+        if (session.lists_fetched) {
+            store_aleeva_cache(*session.lists);
+        }
+
+        if (session.authorised) {
+            settings.save();
+            if (!was_authorised) {
+                queue_status_message("Aleeva login successful.");
+            }
+        } else if (expired) {
+            settings.save();
+            queue_status_message(
+                "Aleeva session expired. Please login again.");
+        } else if (!was_authorised || session.unauthorized) {
+            queue_status_message(
+                "Aleeva login failed. Please check your access code and try "
+                "to login again.");
+        } else {
+            LOG_F(WARNING, "Aleeva token refresh failed, retrying in a minute");
+        }
+        return;
+    }
+
+    // Refresh tokens before they run out so posting never has to wait
+    if (std::chrono::steady_clock::now() > aleeva_retry_time) {
+        bool refresh;
+        {
+            std::lock_guard<std::mutex> lk(aleeva_mutex);
+            refresh = Aleeva::needs_refresh(settings.aleeva);
+        }
+        if (refresh) {
+            LOG_F(INFO, "Refreshing Aleeva token");
+            start_aleeva_login();
         }
     }
 }
 
-void Uploader::check_aleeva(int log_id) {
-    if (!settings.aleeva.enabled) return;
+std::optional<Aleeva::DiscordLists> Uploader::load_aleeva_cache() {
+    auto rows =
+        db->read([](Storage& s) { return s.get_all<AleevaDiscordId>(); }).get();
+    if (rows.empty()) return std::nullopt;
 
-    auto log = storage->get_pointer<Log>(log_id);
-    if (log) {
-        bool process = true;
-        if (!log->success && settings.gw2bot_success_only) process = false;
-
-        if (process) {
-            LOG_F(INFO, "Posting to Aleeva: %s", log->permalink.c_str());
-            auto aleeva_future = std::async(
-                std::launch::async,
-                Aleeva::post_log,
-                settings.aleeva, log->permalink);
+    Aleeva::DiscordLists lists;
+    lists.fetched_at = rows.front().fetched_at;
+    for (const auto& row : rows) {
+        if (row.channel_id.empty()) {
+            lists.server_ids.push_back({row.server_id, row.name});
+        } else {
+            lists.channel_ids[row.server_id].push_back(
+                {row.channel_id, row.name});
         }
+        lists.fetched_at = (std::min)(lists.fetched_at, row.fetched_at);
     }
+    return lists;
+}
+
+void Uploader::store_aleeva_cache(const Aleeva::DiscordLists& lists) {
+    // The actor commits the whole batch in one transaction
+    db->write([lists](Storage& s) {
+        try {
+            s.remove_all<AleevaDiscordId>();
+            for (const auto& server : lists.server_ids) {
+                s.insert(AleevaDiscordId{-1, server.id, "", server.name,
+                                         lists.fetched_at});
+            }
+            for (const auto& [server_id, channels] : lists.channel_ids) {
+                for (const auto& channel : channels) {
+                    s.insert(AleevaDiscordId{-1, server_id, channel.id,
+                                             channel.name, lists.fetched_at});
+                }
+            }
+        } catch (std::system_error& e) {
+            LOG_F(ERROR, "Failed to cache Aleeva servers: %s", e.what());
+        }
+    });
 }
 
 void Uploader::start_async_refresh_log_list() {
@@ -1096,88 +1923,212 @@ void Uploader::start_async_refresh_log_list() {
     if (ft_file_list.valid()) return;
     if (!std::filesystem::exists(log_path)) return;
 
+    int archive_after_days = settings.archive_after_days;
     ft_file_list = std::async(
         std::launch::async,
-        [&](fs::path path) {
-            std::vector<Log> file_list;
-            auto filenames = storage->select(&Log::filename);
-            std::set<std::string> filename_set(filenames.begin(),
-                                               filenames.end());
-
-            storage->begin_transaction();
-            for (const auto& p : fs::recursive_directory_iterator(path)) {
-                if (fs::is_regular_file(p.status())) {
-                    const auto& extension = p.path().extension();
-                    auto& fn = p.path()
-                                   .filename()
-                                   .replace_extension()
-                                   .replace_extension()
-                                   .string();
-                    if (extension != ".zevtc" && extension != ".evtc") continue;
-                    if (filename_set.count(fn) == 0) {
-                        LOG_F(INFO, "Found new log: %s",
-                              p.path().string().c_str());
-                        Log log;
-                        log.id = -1;
-                        log.path = p;
-                        log.filename = fn;
-                        // get_time needs separators to parse
-                        auto temp = log.filename;
-                        temp.insert(4, "-");
-                        temp.insert(7, "-");
-                        temp.insert(13, "-");
-                        temp.insert(16, "-");
-                        std::tm tm = {};
-                        std::stringstream ss(temp);
-                        ss >> std::get_time(&tm, "%Y-%m-%d-%H-%M-%S");
-                        if (ss.fail()) {
-                            LOG_F(INFO, "Failed to parse time.");
-                        }
-                        tm.tm_isdst = -1;
-                        log.time = std::chrono::system_clock::from_time_t(
-                            std::mktime(&tm));
-
-                        char timestr[64];
-                        std::strftime(timestr, sizeof timestr,
-                                      "%I:%M%p (%a %b %d)", &tm);
-                        log.human_time = std::string(timestr);
-
-                        log.uploaded = false;
-                        log.error = false;
-                        log.report_id = "";
-                        log.permalink = "";
-                        log.boss_id = 0;
-                        log.json_available = false;
-                        log.success = false;
+        [&, archive_after_days](fs::path path) {
+            static Metrics::Counter& discovered = Metrics::counter(
+                "uploader_logs_discovered_total", "New log files found");
+            static Metrics::Histogram& scan_time = Metrics::histogram(
+                "uploader_discovery_seconds", "Log directory scan duration");
+            Metrics::Timer timer;
+
+            auto filenames =
+                db->read([](Storage& s) { return s.select(&Log::filename); })
+                    .get();
+            std::unordered_set<std::string> filename_set(
+                std::make_move_iterator(filenames.begin()),
+                std::make_move_iterator(filenames.end()));
+
+            // Archived logs are still on disk, skip them like the hot ones.
+            // Their names are read once, archive_old_logs adds to them.
+            if (archive && !archived_names) {
+                archived_names = archive->filenames();
+            }
+            if (archived_names) {
+                filename_set.insert(archived_names->begin(),
+                                    archived_names->end());
+            }
 
+            unsigned scan_threads =
+                std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+            std::vector<Log> new_logs = LogScanner(scan_threads)
+                                            .scan(path, filename_set,
+                                                  shutdown_token.get());
+            // Whatever was not inserted is found again on the next start
+            if (shutdown_token.cancelled()) return LogIndex();
+
+            // The archive could not be read up front, look the names up.
+            // Only logs no newer than the archive can be in it.
+            if (archive && !archived_names && !new_logs.empty()) {
+                int64_t newest = archive->newest_ms();
+                std::vector<std::string> old_names;
+                for (const auto& log : new_logs) {
+                    if (TimepointToMillis(log.time) <= newest) {
+                        old_names.push_back(log.filename);
+                    }
+                }
+                auto archived = archive->contains(old_names);
+                if (!archived.empty()) {
+                    new_logs.erase(
+                        std::remove_if(new_logs.begin(), new_logs.end(),
+                                       [&](const Log& log) {
+                                           return archived.count(log.filename);
+                                       }),
+                        new_logs.end());
+                }
+            }
+            discovered.inc(new_logs.size());
+
+            // Large imports are split so other writes can interleave, each
+            // batch is still committed as a single transaction
+            constexpr size_t INSERT_BATCH = 5000;
+            for (size_t i = 0; i + INSERT_BATCH < new_logs.size() &&
+                               !shutdown_token.cancelled();
+                 i += INSERT_BATCH) {
+                std::vector<Log> batch(
+                    std::make_move_iterator(new_logs.begin() + i),
+                    std::make_move_iterator(new_logs.begin() + i +
+                                            INSERT_BATCH));
+                db->write([batch = std::move(batch)](Storage& s) mutable {
+                    for (auto& log : batch) {
                         try {
-                            log.id = storage->insert(log);
-                        } catch (std::system_error e) {
+                            log.dir_id =
+                                intern_log_dir(s, log.path.parent_path());
+                            s.insert(log);
+                        } catch (std::system_error& e) {
                             LOG_F(ERROR, "Sqlite insert error: %s", e.what());
-                        } catch (...) {
-                            LOG_F(ERROR, "Unknown Sqlite insert error.");
                         }
                     }
-                }
+                });
+            }
+            if (shutdown_token.cancelled()) return LogIndex();
+            if (new_logs.size() > INSERT_BATCH) {
+                size_t tail = new_logs.size() % INSERT_BATCH;
+                if (tail == 0) tail = INSERT_BATCH;
+                new_logs.erase(new_logs.begin(), new_logs.end() - tail);
             }
-            storage->commit();
 
-            file_list =
-                storage->get_all<Log>(order_by(&Log::time).desc(), limit(75));
+            // The last batch is inserted together with the recent list query
+            std::vector<Log> file_list =
+                db->write([new_logs = std::move(new_logs)](Storage& s) mutable {
+                      for (auto& log : new_logs) {
+                          try {
+                              log.dir_id =
+                                  intern_log_dir(s, log.path.parent_path());
+                              s.insert(log);
+                          } catch (std::system_error& e) {
+                              LOG_F(ERROR, "Sqlite insert error: %s",
+                                    e.what());
+                          }
+                      }
+                      auto recent = s.get_all<Log>(
+                          order_by(&Log::time).desc(), limit(75));
+                      for (auto& log : recent) {
+                          resolve_log_path(s, log);
+                      }
+                      return recent;
+                  }).get();
+            scan_time.observe(timer.seconds());
+            // Logs not uploaded yet are queued again by the next refresh
+            if (shutdown_token.cancelled()) return LogIndex();
 
             std::vector<int> queue;
             for (auto& log : file_list) {
-                if (!log.uploaded) queue.push_back(log.id);
+                // Quarantined logs keep uploaded unset, they are not retried
+                if (!log.uploaded && !log.error) {
+                    queue.push_back(log.id);
+                    // Start compressing now so it is ready by upload time
+                    if (LogCompressor::needs_compression(log.path)) {
+                        compressor->compress(log.path);
+                    }
+                }
             }
             add_pending_upload_logs(queue);
 
-            return file_list;
+            archive_old_logs(archive_after_days);
+
+            LogIndex index;
+            index.reserve(file_list.size());
+            for (const auto& log : file_list) {
+                index.add(log);
+            }
+            return index;
         },
         log_path);
     refresh_time = std::chrono::system_clock::now();
 }
 
+bool Uploader::is_refreshing() const { return ft_file_list.valid(); }
+
+// Moves finished logs older than the hot window from uploader.db to the
+// archive, so the hot table only ever holds the last after_days of logs.
+// Logs still waiting for an upload stay where they are.
+void Uploader::archive_old_logs(int after_days) {
+    if (!archive || after_days <= 0) return;
+    static Metrics::Counter& archived = Metrics::counter(
+        "uploader_logs_archived_total", "Logs moved to the archive database");
+    static Metrics::Histogram& step_time =
+        Metrics::histogram("uploader_archive_step_seconds",
+                           "Duration of one archive batch");
+    using namespace sqlite_orm;
+
+    auto cutoff = std::chrono::system_clock::now() -
+                  std::chrono::hours(24) * after_days;
+    for (int step = 0; step < ARCHIVE_STEPS && !shutdown_token.cancelled();
+         ++step) {
+        Metrics::Timer timer;
+        std::vector<Log> batch =
+            db->read([cutoff](Storage& s) {
+                  try {
+                      return s.get_all<Log>(
+                          where(c(&Log::time) < cutoff and
+                                (c(&Log::uploaded) == true or
+                                 c(&Log::error) == true) and
+                                not_in(&Log::id,
+                                       select(&PendingUpload::log_id))),
+                          order_by(&Log::time), limit((int)ARCHIVE_BATCH));
+                  } catch (std::system_error& e) {
+                      LOG_F(ERROR, "Failed to read logs to archive: %s",
+                            e.what());
+                      return std::vector<Log>();
+                  }
+              }).get();
+        if (batch.empty()) break;
+
+        // Stored before it is removed: if the removal fails the rows are in
+        // both, and the next step stores them again
+        if (!archive->store(batch)) break;
+        if (archived_names) {
+            for (const auto& log : batch) {
+                archived_names->insert(log.filename);
+            }
+        }
+        std::vector<int> ids;
+        ids.reserve(batch.size());
+        for (const auto& log : batch) {
+            ids.push_back(log.id);
+        }
+        bool removed = db->write([ids = std::move(ids)](Storage& s) {
+                             try {
+                                 s.remove_all<Log>(where(in(&Log::id, ids)));
+                                 return true;
+                             } catch (std::system_error& e) {
+                                 LOG_F(ERROR, "Failed to remove archived logs: %s",
+                                       e.what());
+                                 return false;
+                             }
+                         }).get();
+        if (!removed) break;
+        archived.inc(batch.size());
+        step_time.observe(timer.seconds());
+        if (batch.size() < ARCHIVE_BATCH) break;
+    }
+}
+
 void Uploader::poll_async_refresh_log_list() {
+    poll_aleeva_login();
+
     if (ft_file_list.valid()) {
         if (ft_file_list.wait_for(std::chrono::milliseconds(1)) ==
             std::future_status::ready) {
@@ -1190,6 +2141,9 @@ void Uploader::poll_async_refresh_log_list() {
     if (diff > std::chrono::minutes(1)) {
         start_async_refresh_log_list();
         refresh_time = now;
+#ifdef STANDALONE
+        Metrics::write_text_file(data_path / "uploader.prom");
+#endif
     }
 
     // Upload Thread
@@ -1203,17 +2157,9 @@ void Uploader::start_upload_thread() {
     // Create a thread that spins, waiting for uploads to process
     upload_thread_run = true;
     upload_thread = std::thread(&Uploader::upload_thread_loop, this);
-    // Aleeva Authorise
+    // Aleeva Authorise, the result is picked up by poll_aleeva_login
     if (settings.aleeva.enabled) {
-        auto future =
-            std::async(std::launch::async, [&]() {
-				StatusMessage sm;
-                sm.msg = "Aleeva login failed. Please check your access code and try to login again.";
-                if (Aleeva::login(settings)) {
-                    sm.msg = "Aleeva login successful.";
-				}
-				status_messages.push_back(sm);
-			});
+        start_aleeva_login();
     }
 }
 
@@ -1225,74 +2171,247 @@ void Uploader::add_pending_upload_logs(std::vector<int>& queue) {
             if (std::find(upload_queue.begin(), upload_queue.end(), log_id) ==
                 upload_queue.end()) {
                 upload_queue.push_back(log_id);
+                upload_queued_at[log_id] = std::chrono::steady_clock::now();
             }
         }
+        Metrics::gauge("uploader_upload_queue_depth", "Logs waiting to upload")
+            .set((int64_t)upload_queue.size());
     }
     ut_cv.notify_one();
 }
 
+void Uploader::add_all_pending_upload_logs() {
+    using namespace sqlite_orm;
+    auto ids = db->read([](Storage& s) {
+                      return s.select(&Log::id,
+                                      where(c(&Log::uploaded) == false and
+                                            c(&Log::error) == false),
+                                      order_by(&Log::time));
+                  }).get();
+    add_pending_upload_logs(ids);
+}
+
+size_t Uploader::pending_upload_count() {
+    std::lock_guard<std::mutex> lk(ut_mutex);
+    return upload_queue.size() + deferred_uploads.size() +
+           (upload_in_progress ? 1 : 0);
+}
+
 void Uploader::upload_thread_loop() {
     while (upload_thread_run) {
         std::unique_lock<std::mutex> lk(ut_mutex);
-        ut_cv.wait(lk);
+        auto can_upload = [this] {
+            return (!upload_queue.empty() && !in_combat) || !upload_thread_run;
+        };
+        if (deferred_uploads.empty()) {
+            ut_cv.wait(lk, can_upload);
+        } else {
+            auto next = std::min_element(
+                deferred_uploads.begin(), deferred_uploads.end(),
+                [](const auto& a, const auto& b) {
+                    return a.second.retry_at < b.second.retry_at;
+                });
+            auto retry_at = next->second.retry_at;
+            // Nothing signals the end of combat, look again in a while
+            if (in_combat) {
+                retry_at = (std::max)(retry_at, std::chrono::steady_clock::now() +
+                                                    std::chrono::seconds(1));
+            }
+            ut_cv.wait_until(lk, retry_at, can_upload);
+            // Due ones go behind whatever was queued meanwhile, claim_upload
+            // reschedules or drops them
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = deferred_uploads.begin();
+                 it != deferred_uploads.end() && !in_combat; ++it) {
+                if (it->second.retry_at > now) continue;
+                it->second.retry_at = std::chrono::steady_clock::time_point::max();
+                if (std::find(upload_queue.begin(), upload_queue.end(),
+                              it->first) == upload_queue.end()) {
+                    upload_queue.push_back(it->first);
+                    upload_queued_at[it->first] = now;
+                }
+            }
+        }
+
+        static Metrics::Histogram& queue_wait = Metrics::histogram(
+            "uploader_queue_wait_seconds",
+            "Time between a log being queued and its upload starting");
+        static Metrics::Gauge& queue_depth = Metrics::gauge(
+            "uploader_upload_queue_depth", "Logs waiting to upload");
+        static Metrics::Histogram& validate_seconds = Metrics::histogram(
+            "uploader_validation_seconds", "Pre-upload check duration per log");
 
         bool process_log = false;
         int log_id;
-        if (!upload_queue.empty()) {
+        std::optional<std::chrono::steady_clock::time_point> waiting_since;
+        if (!upload_queue.empty() && upload_thread_run && !in_combat) {
             log_id = upload_queue.front();
             upload_queue.pop_front();
             process_log = true;
+            upload_in_progress = true;
+
+            // claim_upload defers it again if it is still being uploaded
+            auto deferred = deferred_uploads.find(log_id);
+            if (deferred != deferred_uploads.end()) {
+                waiting_since = deferred->second.since;
+                deferred_uploads.erase(deferred);
+            }
+
+            auto queued = upload_queued_at.find(log_id);
+            if (queued != upload_queued_at.end()) {
+                queue_wait.observe(std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() -
+                                       queued->second)
+                                       .count());
+                upload_queued_at.erase(queued);
+            }
+            queue_depth.set((int64_t)upload_queue.size());
         }
 
         lk.unlock();
 
         if (process_log) {
             std::string display;
-            auto log = storage->get_pointer<Log>(log_id);
-            if (!log) continue;
+            auto log = get_log(log_id);
+            if (!log) {
+                upload_in_progress = false;
+                continue;
+            }
 
             display = log->filename;
+            // Whether the rollups already have it, from an earlier upload
+            bool counted = Stats::counts(*log);
 
-            queue_status_message("Uploading " + display + " - " +
-                                 log->human_time + ".");
+            std::shared_ptr<UploadBackend> backend;
+            {
+                std::lock_guard<std::mutex> backend_lk(backend_mutex);
+                backend = upload_backend;
+            }
 
-            cpr::Response response;
-            cpr::Url url = cpr::Url{"https://dps.report/uploadContent"};
-            cpr::Parameters params = cpr::Parameters{};
-            cpr::Multipart multi = cpr::Multipart{
-                {"file", cpr::File{log->path.string()}}, {"json", "1"}};
+            // dps.report only rejects a broken log once all of it has been
+            // sent, catch those here and keep them off the network
+            Metrics::Timer validate_timer;
+            LogValidation validation = LogValidator::validate(log->path);
+            validate_seconds.observe(validate_timer.seconds());
+            if (!validation.ok) {
+                std::error_code ec;
+                auto modified = fs::last_write_time(log->path, ec);
+                if (!ec && fs::file_time_type::clock::now() - modified <
+                               std::chrono::seconds(30)) {
+                    // Possibly still being written, the next refresh
+                    // queues it again
+                    queue_status_message("Skipped " + display +
+                                         ", it is still being written.");
+                    upload_in_progress = false;
+                    continue;
+                }
 
-            if (!userToken.disabled) {
-                params.Add({"userToken", userToken.value});
+                LOG_F(WARNING, "Quarantined %s: %s",
+                      log->path.string().c_str(), validation.reason.c_str());
+                Metrics::counter("uploader_validations_total",
+                                 "Logs checked before upload",
+                                 "result=\"quarantined\"")
+                    .inc();
+                log->error = true;
+                QuarantinedLog quarantined{
+                    log->id, validation.reason,
+                    TimepointToMillis(std::chrono::system_clock::now())};
+                db->write([updated = *log, quarantined](Storage& s) {
+                    try {
+                        s.update(updated);
+                        s.replace(quarantined);
+                    } catch (std::system_error& e) {
+                        LOG_F(ERROR, "Failed to quarantine log: %s", e.what());
+                    }
+                });
+                queue_status_message("Skipped " + display + ": " +
+                                     validation.reason + ".");
+                upload_in_progress = false;
+                continue;
             }
+            Metrics::counter("uploader_validations_total",
+                             "Logs checked before upload", "result=\"ok\"")
+                .inc();
 
-            if (settings.wvw_detailed_enabled) {
-                params.Add({"detailedwvw", "true"});
+            queue_status_message("Uploading " + display + " - " +
+                                 log->human_time + " (" + backend->name() +
+                                 ").");
+
+            std::optional<CoordinatedUpload> claimed;
+            if (!claim_upload(*log, waiting_since, claimed)) {
+                upload_in_progress = false;
+                continue;
             }
 
-            response = cpr::Post(url, params, multi);
+            UploadRequest request;
+            request.log_id = log->id;
+            request.path = log->path;
+            if (LogCompressor::needs_compression(log->path)) {
+                auto compressed = compressor->compress(log->path);
+                auto path = wait_unless_cancelled(compressed, shutdown_token);
+                compressor->release(log->path);
+                if (!path) {
+                    std::lock_guard<std::mutex> requeue_lk(ut_mutex);
+                    upload_queue.push_front(log_id);
+                    upload_in_progress = false;
+                    break;
+                }
+                request.path = *path;
+            }
+            request.user_token = userToken.disabled ? "" : userToken.value;
+            request.detailed_wvw = settings.wvw_detailed_enabled;
+
+            request.cancel = shutdown_token;
+
+            Metrics::Timer upload_timer;
+            auto ft_result = backend->submit(request);
+            auto submitted = wait_unless_cancelled(ft_result, shutdown_token);
+            if (!submitted || submitted->cancelled) {
+                // Shutting down, the destructor persists it for next start
+                std::lock_guard<std::mutex> requeue_lk(ut_mutex);
+                upload_queue.push_front(log_id);
+                upload_in_progress = false;
+                break;
+            }
+            UploadResult& result = *submitted;
+            std::string backend_label =
+                "backend=\"" + Metrics::escape_label(backend->name()) + "\"";
+            Metrics::histogram("uploader_upload_seconds",
+                               "Upload/parse duration per log", backend_label)
+                .observe(upload_timer.seconds());
+            Metrics::counter("uploader_uploads_total", "Logs processed",
+                             backend_label + ",result=\"" +
+                                 (result.ok ? "ok" : "error") + "\"")
+                .inc();
 
             StatusMessage status;
             status.log_id = -1;
-            if (response.status_code == 200) {
-                json parsed = json::parse(response.text);
-
+            if (result.ok) {
                 log->uploaded = true;
-                log->report_id = parsed["id"].get<std::string>();
-                log->permalink = parsed["permalink"].get<std::string>();
-                json encounter = parsed["encounter"];
-                log->boss_id = encounter["bossId"].get<int>();
-                log->boss_name = encounter["boss"].get<std::string>();
-                log->players_json = parsed["players"].dump();
-                log->json_available = encounter["jsonAvailable"].get<bool>();
-                log->success = encounter["success"].get<bool>();
-                auto token = parsed["userToken"].get<std::string>();
+                log->report_id = result.report_id;
+                log->permalink = result.permalink;
+                log->boss_id = result.boss_id;
+                log->boss_name = result.boss_name;
+                log->players_json = result.players_json;
+                log->json_available = result.json_available;
+                log->success = result.success;
+                log->duration_ms = result.duration_ms;
+                // dps.report leaves bossId at 0 when its parse failed, the
+                // webhook filters still need to know the boss
+                if (log->boss_id == 0) classify_locally(*log);
+                // Kill times feed the statistics
+                if (log->success && log->duration_ms <= 0) {
+                    log->duration_ms = local_duration_ms(*log);
+                }
+                const auto& token = result.user_token;
 
                 status.msg =
                     "Uploaded " + display + " - " + log->human_time + ".";
                 status.log_id = log->id;
+                status.permalink = log->permalink;
 
-                if (!userToken.disabled) {
+                // Only dps.report style backends hand out user tokens
+                if (!userToken.disabled && !token.empty()) {
                     if (userToken.value.empty() &&
                         token.size() <= sizeof(userToken.value_buf)) {
                         memset(userToken.value_buf, 0,
@@ -1300,7 +2419,7 @@ void Uploader::upload_thread_loop() {
                         memcpy(userToken.value_buf, token.c_str(),
                                token.size());
                         userToken.value = userToken.value_buf;
-                        storage->update(userToken);
+                        save_user_token();
                     } else if (token != userToken.value) {
                         status.msg =
                             "ERROR: Configured userToken did not work. Maybe a "
@@ -1308,41 +2427,54 @@ void Uploader::upload_thread_loop() {
                             "was used?";
                     }
                 }
-            } else if (response.status_code == 401) {
+            } else if (result.status_code == 401) {
                 status.msg =
                     "Upload failed. Invalid Username/Password. Please login "
                     "again.";
-            } else if (response.status_code == 400) {
+            } else if (result.status_code == 400) {
                 status.msg =
                     "Upload failed. Invalid File/File Error or Connection "
                     "Error.";
             } else {
-                status.msg = "Unknown response.\n" + response.text;
-                LOG_F(INFO, "Upload failed: %s - %d, %s, %s", log->filename,
-                      response.status_code, response.error.message,
-                      response.text);
+                status.msg = "Unknown response.\n" + result.error;
+                LOG_F(INFO, "Upload failed: %s - %d, %s",
+                      log->filename.c_str(), result.status_code,
+                      result.error.c_str());
                 log->uploaded = true;
                 log->error = true;
             }
 
-            try {
-                storage->update(*log);
-                if (log->uploaded && !log->error) {
-                    check_webhooks(log->id);
-                    check_gw2bot(log->id);
-                    check_aleeva(log->id);
-                };
-            } catch (std::system_error e) {
-                LOG_F(ERROR, "Failed to update log: %s", e.what());
+            bool count = !counted && Stats::counts(*log);
+            db->write([updated = *log, count](Storage& s) {
+                try {
+                    // Same transaction as the update, see StorageActor
+                    s.update(updated);
+                    if (count) add_stats(s, updated);
+                } catch (std::system_error& e) {
+                    LOG_F(ERROR, "Failed to update log: %s", e.what());
+                    // Rolls back the update along with the totals
+                    throw;
+                }
+            });
+            if (count) stats_stale = true;
+            // Local parses have no public link to share
+            bool shareable = log->permalink.rfind("http", 0) == 0;
+            if (claimed) {
+                finish_claim(*claimed, *log,
+                             log->uploaded && !log->error && shareable);
+            }
+            if (log->uploaded && !log->error && shareable) {
+                route_log(*log, result);
             }
 
             queue_status_message(status);
+            upload_in_progress = false;
         }
     }
 }
 
 void Uploader::queue_status_message(const std::string& msg, int log_id) {
-    StatusMessage status{msg, log_id};
+    StatusMessage status{msg, log_id, {}};
     queue_status_message(status);
 }
 
@@ -1351,7 +2483,284 @@ void Uploader::queue_status_message(const StatusMessage& msg) {
     thread_status_messages.push_back(msg);
 }
 
-std::string Uploader::format_msg(Log log) {
+std::vector<StatusMessage> Uploader::take_status_messages() {
+    std::vector<StatusMessage> messages;
+    std::lock_guard<std::mutex> lk(ts_msg_mutex);
+    messages.swap(thread_status_messages);
+    return messages;
+}
+
+std::optional<Log> Uploader::get_log(int log_id) {
+    auto log = db->read([log_id](Storage& s) -> std::optional<Log> {
+                     auto log = s.get_pointer<Log>(log_id);
+                     if (log) {
+                         resolve_log_path(s, *log);
+                         return *log;
+                     }
+                     return std::nullopt;
+                 }).get();
+    if (log || !archive) return log;
+
+    // Ids are never reused, so an id missing here can only be archived
+    log = archive->get(log_id);
+    if (log) {
+        db->read([&log](Storage& s) { resolve_log_path(s, *log); }).get();
+    }
+    return log;
+}
+
+std::vector<Log> Uploader::search_archive(const ArchiveQuery& query) {
+    if (!archive) return {};
+    std::vector<Log> found = archive->search(query);
+    // Directories stay interned in uploader.db
+    db->read([&found](Storage& s) {
+          for (auto& log : found) {
+              resolve_log_path(s, log);
+          }
+      }).get();
+    return found;
+}
+
+std::vector<StatsRollup> Uploader::query_stats(Stats::Scope scope,
+                                               int from_week, int to_week) {
+    using namespace sqlite_orm;
+    auto rows = db->read([scope, from_week, to_week](Storage& s) {
+                      try {
+                          return s.get_all<StatsRollup>(
+                              where(c(&StatsRollup::scope) == (int)scope and
+                                    c(&StatsRollup::week) >= from_week and
+                                    c(&StatsRollup::week) <= to_week));
+                      } catch (std::system_error& e) {
+                          LOG_F(ERROR, "Failed to read statistics: %s",
+                                e.what());
+                          return std::vector<StatsRollup>();
+                      }
+                  }).get();
+    return Stats::merge_weeks(rows);
+}
+
+StatsRebuild Uploader::rebuild_stats() {
+    using namespace sqlite_orm;
+    // All of it runs on the storage thread, so no upload or archive step
+    // changes the logs halfway through
+    auto result = db->write([this](Storage& s) {
+                 StatsRebuild rebuild;
+                 std::map<Stats::Key, StatsRollup> rows;
+                 try {
+                     std::unordered_set<int> hot_ids;
+                     int last = 0;
+                     for (;;) {
+                         // Nothing is written before both passes are done,
+                         // leaving early keeps the stored rollups
+                         if (shutdown_token.cancelled()) return StatsRebuild{};
+                         auto page = s.get_all<Log>(
+                             where(c(&Log::id) > last), order_by(&Log::id),
+                             limit((int)STATS_REBUILD_PAGE));
+                         if (page.empty()) break;
+                         for (const Log& log : page) {
+                             hot_ids.insert(log.id);
+                             if (Stats::counts(log)) {
+                                 Stats::accumulate(rows, log);
+                             }
+                         }
+                         rebuild.logs += page.size();
+                         last = page.back().id;
+                     }
+                     // A batch is stored in the archive before it leaves
+                     // uploader.db, skip logs that are in both
+                     last = 0;
+                     for (;;) {
+                         if (shutdown_token.cancelled()) return StatsRebuild{};
+                         auto page =
+                             archive->read_after(last, STATS_REBUILD_PAGE);
+                         if (page.empty()) break;
+                         for (const Log& log : page) {
+                             if (hot_ids.count(log.id)) continue;
+                             ++rebuild.logs;
+                             if (Stats::counts(log)) {
+                                 Stats::accumulate(rows, log);
+                             }
+                         }
+                         last = page.back().id;
+                     }
+
+                     // Stored rows that are wrong or extra, then the ones
+                     // that were missing
+                     size_t found = 0;
+                     for (const StatsRollup& stored :
+                          s.get_all<StatsRollup>()) {
+                         auto it = rows.find(Stats::key_of(stored));
+                         if (it == rows.end()) {
+                             ++rebuild.mismatched;
+                             continue;
+                         }
+                         ++found;
+                         if (!Stats::same(it->second, stored)) {
+                             ++rebuild.mismatched;
+                         }
+                     }
+                     rebuild.mismatched += rows.size() - found;
+
+                     s.remove_all<StatsRollup>();
+                     for (const auto& [key, row] : rows) {
+                         s.replace(row);
+                     }
+                     rebuild.rows = rows.size();
+                 } catch (std::system_error& e) {
+                     LOG_F(ERROR, "Failed to rebuild statistics: %s",
+                           e.what());
+                     // The old totals stay, not a half written set
+                     throw;
+                 }
+                 return rebuild;
+             });
+    try {
+        return result.get();
+    } catch (std::system_error&) {
+        StatsRebuild failed;
+        failed.ok = false;
+        return failed;
+    }
+}
+
+ExportResult Uploader::export_logs(const ExportOptions& options) {
+    static Metrics::Counter& exported = Metrics::counter(
+        "uploader_logs_exported_total", "Logs written by exports");
+    using namespace sqlite_orm;
+
+    std::error_code ec;
+    std::string destination =
+        fs::absolute(options.dir, ec).lexically_normal().string();
+    int format = (int)options.format;
+    int after = 0;
+    if (options.since_last) {
+        after = db->read([&destination, format](Storage& s) {
+                      auto cursor =
+                          s.get_pointer<ExportCursor>(destination, format);
+                      return cursor ? cursor->last_log_id : 0;
+                  }).get();
+    }
+    // A log that is still to be uploaded will change, the next export starts
+    // again from the first one. Rows after it are written both times, the
+    // later row of an id is the current one. Logs picked by hand are only
+    // in the upload queue, PendingUpload is cleared once it has been read.
+    int first_pending = INT_MAX;
+    {
+        std::lock_guard<std::mutex> lk(ut_mutex);
+        for (int log_id : upload_queue) {
+            if (log_id > after) {
+                first_pending = (std::min)(first_pending, log_id);
+            }
+        }
+        for (const auto& [log_id, deferred] : deferred_uploads) {
+            if (log_id > after) {
+                first_pending = (std::min)(first_pending, log_id);
+            }
+        }
+    }
+    int settled = db->read([after, first_pending](Storage& s) {
+                      auto pending =
+                          s.min(&Log::id, where(c(&Log::id) > after and
+                                                c(&Log::uploaded) == false and
+                                                c(&Log::error) == false));
+                      int first = pending ? (std::min)(*pending, first_pending)
+                                          : first_pending;
+                      return first == INT_MAX ? INT_MAX : first - 1;
+                  }).get();
+
+    LogExporter exporter(options);
+    if (!exporter.open()) {
+        ExportResult result;
+        result.error = exporter.error();
+        return result;
+    }
+
+    bool ok = true;
+    int newest = after;
+    int last = after;
+    while (ok && !shutdown_token.cancelled()) {
+        auto page = db->read([last](Storage& s) {
+                          try {
+                              return s.get_all<Log>(
+                                  where(c(&Log::id) > last),
+                                  order_by(&Log::id),
+                                  limit((int)EXPORT_PAGE));
+                          } catch (std::system_error& e) {
+                              LOG_F(ERROR, "Failed to read logs to export: %s",
+                                    e.what());
+                              return std::vector<Log>();
+                          }
+                      }).get();
+        if (page.empty()) break;
+        for (const Log& log : page) {
+            ok = ok && exporter.add(log);
+        }
+        last = newest = page.back().id;
+    }
+
+    // A batch is stored in the archive before it leaves uploader.db, skip
+    // the logs the hot pass has already written
+    last = after;
+    while (ok && archive && !shutdown_token.cancelled()) {
+        auto page = archive->read_after(last, EXPORT_PAGE);
+        if (page.empty()) break;
+        int first = page.front().id;
+        last = page.back().id;
+        auto hot = db->read([first, last](Storage& s) {
+                         return s.select(&Log::id,
+                                         where(c(&Log::id) >= first and
+                                               c(&Log::id) <= last));
+                     }).get();
+        std::unordered_set<int> written(hot.begin(), hot.end());
+        for (const Log& log : page) {
+            if (!written.count(log.id)) ok = ok && exporter.add(log);
+        }
+        newest = (std::max)(newest, last);
+    }
+
+    if (!ok || shutdown_token.cancelled()) {
+        ExportResult result;
+        result.error = ok ? "Export cancelled" : exporter.error();
+        return result;
+    }
+    ExportResult result = exporter.close();
+    if (!result.ok) return result;
+    exported.inc(result.logs);
+
+    result.last_log_id = (std::min)(newest, settled);
+    ExportCursor cursor{destination, format, result.last_log_id,
+                        TimepointToMillis(std::chrono::system_clock::now())};
+    db->write([cursor](Storage& s) { s.replace(cursor); }).get();
+    LOG_F(INFO, "Exported %zu logs and %zu players to %s", result.logs,
+          result.players, result.logs_file.string().c_str());
+    return result;
+}
+
+void Uploader::save_user_token() {
+    db->write([token = userToken](Storage& s) { s.update(token); });
+}
+
+void Uploader::set_webhooks(std::vector<Webhook> hooks) {
+    for (auto& wh : hooks) {
+        memset(wh.name_buf, 0, 64);
+        memcpy(wh.name_buf, wh.name.c_str(), wh.name.size());
+        memset(wh.url_buf, 0, 192);
+        memcpy(wh.url_buf, wh.url.c_str(), wh.url.size());
+        memset(wh.filter_buf, 0, 256);
+        memcpy(wh.filter_buf, wh.filter.c_str(), wh.filter.size());
+        memset(wh.rule_buf, 0, 256);
+        memcpy(wh.rule_buf, wh.rule.c_str(),
+               (std::min)(wh.rule.size(), (size_t)255));
+        wh.rule_error.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lk(wh_mutex);
+        webhooks = std::move(hooks);
+    }
+    update_routes();
+}
+
+std::string Uploader::format_msg(const LogIndex& index, const LogRecord& log) {
     std::string f = settings.msg_format; // get format string
     std::string msg = "";
     std::string::const_iterator it = f.begin();
@@ -1363,7 +2772,8 @@ std::string Uploader::format_msg(Log log) {
         msg += c;
     }
 
-    msg = std::regex_replace(msg, std::regex("@1"), log.boss_name);
-    msg = std::regex_replace(msg, std::regex("@2"), log.permalink);
+    msg = std::regex_replace(msg, std::regex("@1"),
+                             std::string(index.boss_name(log)));
+    msg = std::regex_replace(msg, std::regex("@2"), index.permalink(log));
     return msg;
 }
\ No newline at end of file
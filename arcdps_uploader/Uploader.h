@@ -6,10 +6,24 @@
 #include <filesystem>
 #include <future>
 #include <deque>
+#include <map>
+#include <unordered_map>
 #include "Revtc.h"
 #include "sqlite_orm.h"
 #include "Log.h"
+#include "LogIndex.h"
+#include "LogArchive.h"
+#include "LogExport.h"
+#include "Stats.h"
 #include "Settings.h"
+#include "Aleeva.h"
+#include "UploadBackend.h"
+#include "LogCompressor.h"
+#include "LogDetails.h"
+#include "WebhookDispatcher.h"
+#include "CancelToken.h"
+#include "Routing.h"
+#include "Coordination.h"
 
 namespace fs = std::filesystem;
 
@@ -17,6 +31,7 @@ struct StatusMessage
 {
 	std::string msg;
 	int log_id;
+	std::string permalink;
 };
 
 struct UserToken
@@ -40,68 +55,243 @@ struct Webhook
 	std::string filter;
 	int filter_min;
 	bool success;
+	std::string rule; // extra RouteRule clauses, may be empty
 
 	char name_buf[64];
 	char url_buf[192];
 	char filter_buf[256];
+	char rule_buf[256];
+	std::string rule_error;
+};
+
+// Destination a log can be routed to, one per RoutingTable rule
+struct RouteTarget
+{
+	enum class Kind { WEBHOOK, GW2BOT, ALEEVA };
+	Kind kind;
+	std::string name;
+	std::string url; // webhooks only
+};
+
+// Fight this client claimed on the coordination server, finished once its
+// upload is done
+struct CoordinatedUpload
+{
+	std::string url;
+	std::string client;
+	std::string fight;
+};
+
+// Upload that was queued or in flight at shutdown, resumed on the next start
+struct PendingUpload
+{
+	int log_id;
+};
+
+// Log that failed local validation, kept off the network for good
+struct QuarantinedLog
+{
+	int log_id;
+	std::string reason;
+	int64_t time_ms;
+};
+
+// Cached Aleeva server (channel_id empty) or channel entry
+struct AleevaDiscordId
+{
+	int id;
+	std::string server_id;
+	std::string channel_id;
+	std::string name;
+	int64_t fetched_at;
 };
 
 class Uploader
 {
 	Settings settings;
 
+	fs::path data_path;
+	std::optional<fs::path> custom_log_path;
 	fs::path log_path;
-	std::vector<Log> logs;
-	std::future<decltype(logs)> ft_file_list;
+	LogIndex logs;
+	std::future<LogIndex> ft_file_list;
 	std::chrono::system_clock::time_point refresh_time;
 
 	std::deque<int> upload_queue;
+	std::unordered_map<int, std::chrono::steady_clock::time_point> upload_queued_at;
 	std::vector<std::future<cpr::Response>> ft_uploads;
 	std::vector<UserToken> userTokens;
 	UserToken userToken;
 	std::vector<Webhook> webhooks;
+	std::future<std::vector<Webhook>> ft_webhooks;
+	std::unique_ptr<WebhookDispatcher> webhook_dispatcher;
+	std::shared_ptr<UploadBackend> upload_backend;
+	std::mutex backend_mutex;
+	std::unique_ptr<LogCompressor> compressor;
+	std::unique_ptr<LogDetails> details;
+	// Cold tier of the logs table, see archive_old_logs
+	std::unique_ptr<LogArchive> archive;
+	// Log::filename of every archived log, so the refresh doesn't find them
+	// again. Loaded and updated by the refresh task only.
+	std::optional<std::unordered_set<std::string>> archived_names;
+
+	// Statistics panel, queried again off the render thread once an upload
+	// changed the rollups
+	std::atomic<bool> stats_stale;
+	std::future<std::vector<StatsRollup>> ft_stats;
+	std::future<StatsRebuild> ft_stats_rebuild;
+	std::vector<StatsRollup> stats_rows;
+	int stats_range = (int)Stats::Range::MONTH;
+	int stats_scope = (int)Stats::Scope::BOSS;
+	std::future<ExportResult> ft_export;
+	int export_format = (int)ExportFormat::ARROW;
+	int detail_log_id = -1;
 	std::mutex wh_mutex;
 	std::deque<int> wh_queue;
 
+	// Every destination's rule compiled into one table, replaced as a whole
+	// by update_routes. Guarded by wh_mutex.
+	struct Routes
+	{
+		RoutingTable table;
+		std::vector<RouteTarget> targets;
+		size_t webhooks = 0; // targets before the GW2Bot/Aleeva ones
+	};
+	std::shared_ptr<const Routes> routes;
+	// Set by the options UI, update_routes runs once it is done drawing
+	bool routes_dirty = false;
+
 	std::vector<StatusMessage> status_messages;
 	std::mutex ts_msg_mutex;
 	std::vector<StatusMessage> thread_status_messages;
 
+	std::future<Aleeva::Session> ft_aleeva_login;
+	std::optional<Aleeva::DiscordLists> aleeva_cache;
+	std::chrono::steady_clock::time_point aleeva_retry_time;
+	// Guards settings.aleeva between the render thread and the upload thread
+	std::mutex aleeva_mutex;
+
 	std::thread upload_thread;
 	std::atomic<bool> upload_thread_run;
 	std::mutex ut_mutex;
 	std::condition_variable ut_cv;
 
+	std::atomic<bool> upload_in_progress;
+	// Logs another squad member is uploading, asked about again at retry_at.
+	// Guarded by ut_mutex.
+	struct DeferredUpload
+	{
+		std::chrono::steady_clock::time_point retry_at;
+		std::chrono::steady_clock::time_point since;
+	};
+	std::map<int, DeferredUpload> deferred_uploads;
+	// Guards settings.coordination_* between the render thread and the upload thread
+	std::mutex coordination_mutex;
+	std::vector<int> resumed_uploads;
+
+	// Cancelled first thing in the destructor, every outbound transfer and
+	// background job checks it
+	CancelToken shutdown_token;
+	std::chrono::milliseconds shutdown_deadline = std::chrono::milliseconds(250);
+
+	// Set once start_async_init has loaded everything and started the threads
+	std::future<void> ft_init;
+	std::atomic<bool> ready;
+	std::atomic<bool> init_failed;
+	std::string init_error;
+
+#ifndef HEADLESS
 	void imgui_draw_logs();
 	void imgui_draw_status();
+	void imgui_draw_stats();
 	void imgui_draw_options();
 	void imgui_draw_options_aleeva();
-	void create_log_table(Log& l);
+	void imgui_draw_details();
+	void imgui_draw_initializing();
+#endif
 
-	void check_webhooks(int log_id);
-	void check_gw2bot(int log_id);
-	void check_aleeva(int log_id);
+	void update_routes();
+	void route_log(const Log& log, const UploadResult& result);
+	void post_gw2bot(const Log& log);
+	void post_aleeva(const Log& log);
 
+	// False if another squad member uploads log: it was then deferred, or
+	// filled in from their upload. claimed is set when this client has to
+	// report back with finish_claim. waiting_since is when the log was first
+	// deferred, if it was.
+	bool claim_upload(Log& log,
+		std::optional<std::chrono::steady_clock::time_point> waiting_since,
+		std::optional<CoordinatedUpload>& claimed);
+	void finish_claim(const CoordinatedUpload& claimed, const Log& log, bool uploaded);
+
+	void save_user_token();
+	void set_webhooks(std::vector<Webhook> hooks);
+
+	void start_aleeva_login();
+	void poll_aleeva_login();
+	std::optional<Aleeva::DiscordLists> load_aleeva_cache();
+	void store_aleeva_cache(const Aleeva::DiscordLists& lists);
+
+	void initialize();
+	void open_database();
+	void archive_old_logs(int after_days);
 	void upload_thread_loop();
 	void add_pending_upload_logs(std::vector<int>& queue);
-	void poll_async_refresh_log_list();
 
 	void queue_status_message(const std::string& msg, int log_id = -1);
 	void queue_status_message(const StatusMessage& status);
 
-	std::string format_msg(Log log);
+	std::string format_msg(const LogIndex& index, const LogRecord& log);
 public:
 	bool is_open;
-	bool in_combat;
+	std::atomic<bool> in_combat;
 
+	// Cheap, everything else happens in start_async_init
 	Uploader(fs::path data_path, std::optional<fs::path> custom_log_path);
 	~Uploader();
 
+	// Loads settings, opens/migrates the database, reads tokens and webhooks,
+	// then starts the first refresh and the upload thread, off the caller's thread
+	void start_async_init();
+	bool is_ready() const;
+	// Settings and databases only, no threads and nothing sent anywhere.
+	// Enough for get_log, search_archive and the statistics.
+	bool open_offline();
+	// Blocks until start_async_init has finished, returns is_ready()
+	bool wait_for_init();
+	// Time the destructor should take. Jobs stop early and uploads in flight
+	// are aborted and persisted for the next start; a stalled transfer can
+	// add up to CURL_PROGRESS_INTERVAL. Set before start_async_init.
+	void set_shutdown_deadline(std::chrono::milliseconds deadline);
+
+#ifndef HEADLESS
 	uintptr_t imgui_tick();
 	void imgui_window_checkbox();
+#endif
 	
 	void start_async_refresh_log_list();
+	void poll_async_refresh_log_list();
+	bool is_refreshing() const;
 
 	void start_upload_thread();
+	void add_all_pending_upload_logs();
+	size_t pending_upload_count();
+
+	std::vector<StatusMessage> take_status_messages();
+	// Looks in the archive when the log is no longer in uploader.db
+	std::optional<Log> get_log(int log_id);
+	std::vector<Log> search_archive(const ArchiveQuery& query);
+
+	// One merged row per boss or category over the reset weeks from_week to
+	// to_week, Stats::ALL_TIME for both reads the all-time rows
+	std::vector<StatsRollup> query_stats(Stats::Scope scope, int from_week, int to_week);
+	// Recomputes every rollup from the hot and archived logs and replaces
+	// them, reporting how many were off. Holds the storage thread meanwhile.
+	StatsRebuild rebuild_stats();
+
+	// Streams the hot and archived logs with their rosters into
+	// options.dir, a page at a time. Remembers where it stopped for the
+	// next export with since_last.
+	ExportResult export_logs(const ExportOptions& options);
 };
 
@@ -0,0 +1,268 @@
+#include "WebhookDispatcher.h"
+
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+#include "Metrics.h"
+#include "loguru.hpp"
+
+using json = nlohmann::json;
+
+static const std::string* find_header(const cpr::Response& response,
+                                      const char* name) {
+    auto it = response.header.find(name);
+    return it == response.header.end() ? nullptr : &it->second;
+}
+
+static std::chrono::milliseconds seconds_to_ms(double seconds) {
+    return std::chrono::milliseconds((int64_t)(seconds * 1000.0 + 0.5));
+}
+
+WebhookDispatcher::WebhookDispatcher(std::chrono::milliseconds idle,
+                                     std::chrono::milliseconds max_delay,
+                                     Transport transport,
+                                     std::chrono::milliseconds drain_timeout)
+    : idle(idle),
+      max_delay(max_delay),
+      transport(std::move(transport)),
+      drain_timeout(drain_timeout),
+      running(true),
+      flushing(false),
+      stopped(false) {
+    thread = std::thread(&WebhookDispatcher::thread_loop, this);
+}
+
+WebhookDispatcher::~WebhookDispatcher() {
+    {
+        std::unique_lock<std::mutex> lk(mutex);
+        running = false;
+        drain_deadline = clock::now() + drain_timeout;
+        cv.notify_all();
+        cv.wait_until(lk, drain_deadline, [this] { return stopped; });
+    }
+    // Messages left past the deadline are dropped, a post in flight aborts
+    cancel.cancel();
+    cv.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+cpr::Response WebhookDispatcher::post_multipart(const std::string& url,
+                                                const std::string& content,
+                                                const CancelToken& cancel) {
+    return cpr::Post(cpr::Url{url}, cpr::Multipart{{"content", content}},
+                     cancel.progress());
+}
+
+void WebhookDispatcher::enqueue(const std::string& url, std::string line) {
+    if (line.size() > MAX_CONTENT) {
+        line.resize(MAX_CONTENT);
+    }
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        Queue& queue = queues[url];
+        clock::time_point now = clock::now();
+        if (queue.lines.empty()) {
+            queue.first = now;
+        }
+        queue.last = now;
+        queue.bytes += line.size() + 1;
+        queue.lines.push_back(std::move(line));
+    }
+    cv.notify_all();
+}
+
+void WebhookDispatcher::flush() {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        flushing = true;
+    }
+    cv.notify_all();
+}
+
+WebhookDispatcher::clock::time_point WebhookDispatcher::blocked_until(
+    const std::string& url) const {
+    clock::time_point until = global_reset;
+    auto route = routes.find(url);
+    if (route != routes.end()) {
+        auto bucket = buckets.find(route->second);
+        if (bucket != buckets.end() && bucket->second.remaining <= 0) {
+            until = (std::max)(until, bucket->second.reset);
+        }
+    }
+    return until;
+}
+
+std::vector<std::string> WebhookDispatcher::take_batch(Queue& queue) {
+    std::vector<std::string> batch;
+    size_t size = 0;
+    while (!queue.lines.empty()) {
+        size_t next = queue.lines.front().size() + (batch.empty() ? 0 : 1);
+        if (!batch.empty() && size + next > MAX_CONTENT) break;
+        size += next;
+        queue.bytes -= queue.lines.front().size() + 1;
+        batch.push_back(std::move(queue.lines.front()));
+        queue.lines.pop_front();
+    }
+    return batch;
+}
+
+void WebhookDispatcher::update_limits(const std::string& url,
+                                      const cpr::Response& response,
+                                      clock::time_point now) {
+    const std::string* bucket_id = find_header(response, "x-ratelimit-bucket");
+    const std::string* remaining =
+        find_header(response, "x-ratelimit-remaining");
+    const std::string* reset_after =
+        find_header(response, "x-ratelimit-reset-after");
+    if (bucket_id && remaining && reset_after) {
+        routes[url] = *bucket_id;
+        Bucket& bucket = buckets[*bucket_id];
+        bucket.remaining = atoi(remaining->c_str());
+        bucket.reset = now + seconds_to_ms(atof(reset_after->c_str()));
+    }
+
+    if (response.status_code != 429) return;
+
+    double retry_after = 1.0;
+    bool global = false;
+    if (const std::string* header = find_header(response, "retry-after")) {
+        retry_after = atof(header->c_str());
+    }
+    try {
+        json body = json::parse(response.text);
+        retry_after = body.value("retry_after", retry_after);
+        global = body.value("global", false);
+    } catch (const json::exception&) {
+    }
+    if (find_header(response, "x-ratelimit-global")) {
+        global = true;
+    }
+
+    clock::time_point reset = now + seconds_to_ms(retry_after);
+    if (global) {
+        global_reset = (std::max)(global_reset, reset);
+    } else {
+        auto route = routes.find(url);
+        std::string id = route != routes.end() ? route->second : url;
+        routes[url] = id;
+        Bucket& bucket = buckets[id];
+        bucket.remaining = 0;
+        bucket.reset = (std::max)(bucket.reset, reset);
+    }
+    LOG_F(WARNING, "Discord rate limited webhook for %.2fs%s", retry_after,
+          global ? " (global)" : "");
+}
+
+void WebhookDispatcher::thread_loop() {
+    static Metrics::Counter& sent = Metrics::counter(
+        "uploader_webhook_messages_total", "Discord webhook messages sent");
+    static Metrics::Counter& coalesced = Metrics::counter(
+        "uploader_webhook_coalesced_total",
+        "Logs that shared a Discord message with an earlier log");
+    static Metrics::Counter& limited = Metrics::counter(
+        "uploader_webhook_rate_limited_total",
+        "Discord webhook posts answered with 429");
+
+    std::unique_lock<std::mutex> lk(mutex);
+    while (true) {
+        if (cancel.cancelled()) {
+            size_t dropped = 0;
+            for (const auto& [url, queue] : queues) {
+                dropped += queue.lines.size();
+            }
+            if (dropped) {
+                LOG_F(WARNING, "Dropping %zu webhook lines at shutdown", dropped);
+            }
+            break;
+        }
+        clock::time_point now = clock::now();
+        clock::time_point wake = clock::time_point::max();
+        std::string url;
+
+        for (auto it = queues.begin(); it != queues.end();) {
+            Queue& queue = it->second;
+            if (queue.lines.empty()) {
+                it = queues.erase(it);
+                continue;
+            }
+
+            clock::time_point ready =
+                (std::min)(queue.last + idle, queue.first + max_delay);
+            if (!running || flushing || queue.bytes > MAX_CONTENT) {
+                ready = now;
+            }
+            clock::time_point blocked = blocked_until(it->first);
+            if (!running && blocked > drain_deadline) {
+                LOG_F(WARNING, "Dropping %zu webhook lines, rate limited",
+                      queue.lines.size());
+                it = queues.erase(it);
+                continue;
+            }
+            ready = (std::max)(ready, blocked);
+            if (ready <= now) {
+                url = it->first;
+                break;
+            }
+            wake = (std::min)(wake, ready);
+            ++it;
+        }
+
+        if (url.empty()) {
+            flushing = false;
+            if (!running && queues.empty()) break;
+            if (wake == clock::time_point::max()) {
+                cv.wait(lk);
+            } else {
+                cv.wait_until(lk, wake);
+            }
+            continue;
+        }
+
+        std::vector<std::string> batch = take_batch(queues[url]);
+        std::string content;
+        for (const auto& line : batch) {
+            if (!content.empty()) content += '\n';
+            content += line;
+        }
+        // Assume the request uses up the bucket slot until we hear otherwise
+        auto route = routes.find(url);
+        if (route != routes.end()) {
+            buckets[route->second].remaining--;
+        }
+
+        lk.unlock();
+        Metrics::Timer timer;
+        auto ft = std::async(std::launch::async, transport, url, content,
+                             cancel);
+        auto sent_response = wait_unless_cancelled(ft, cancel);
+        lk.lock();
+        if (!sent_response) continue;
+        cpr::Response& response = *sent_response;
+        Metrics::observe_http("discord", (int)response.status_code,
+                              timer.seconds(), content.size());
+
+        update_limits(url, response, clock::now());
+        if (response.status_code == 429) {
+            limited.inc();
+            // Put the batch back in front, it goes out once the bucket resets
+            Queue& queue = queues[url];
+            if (queue.lines.empty()) {
+                queue.first = queue.last = clock::now();
+            }
+            for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+                queue.bytes += it->size() + 1;
+                queue.lines.push_front(std::move(*it));
+            }
+        } else if (response.status_code < 200 || response.status_code >= 300) {
+            LOG_F(ERROR, "Webhook post failed: %d %s",
+                  (int)response.status_code, response.text.c_str());
+        } else {
+            sent.inc();
+            coalesced.inc(batch.size() - 1);
+        }
+    }
+    stopped = true;
+    cv.notify_all();
+}
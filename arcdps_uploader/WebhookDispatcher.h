@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cpr/cpr.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "CancelToken.h"
+
+// Posts Discord webhook messages from one background thread. Lines queued
+// for the same webhook are coalesced into one message (up to Discord's
+// content limit) and sent once the webhook has been idle for a moment, and
+// the per-route rate limit buckets reported in the response headers are
+// respected instead of running into 429s during a fast clear.
+class WebhookDispatcher
+{
+public:
+	// Sends content to url and returns the response. Replaceable so the
+	// dispatcher can be pointed at a local stub.
+	using Transport = std::function<cpr::Response(const std::string& url, const std::string& content,
+		const CancelToken& cancel)>;
+
+	static constexpr size_t MAX_CONTENT = 2000;
+
+	WebhookDispatcher(std::chrono::milliseconds idle = std::chrono::seconds(3),
+		std::chrono::milliseconds max_delay = std::chrono::seconds(15),
+		Transport transport = post_multipart,
+		std::chrono::milliseconds drain_timeout = std::chrono::seconds(5));
+	// Sends whatever is still queued for up to drain_timeout, then aborts
+	// the post in flight and drops the rest
+	~WebhookDispatcher();
+
+	void enqueue(const std::string& url, std::string line);
+	// Send everything queued now instead of waiting for the idle window
+	void flush();
+
+	static cpr::Response post_multipart(const std::string& url, const std::string& content,
+		const CancelToken& cancel);
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct Queue
+	{
+		std::deque<std::string> lines;
+		size_t bytes = 0;
+		clock::time_point first;
+		clock::time_point last;
+	};
+
+	struct Bucket
+	{
+		int remaining = 1;
+		clock::time_point reset;
+	};
+
+	std::chrono::milliseconds idle;
+	std::chrono::milliseconds max_delay;
+	Transport transport;
+	std::chrono::milliseconds drain_timeout;
+	CancelToken cancel;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool running;
+	bool flushing;
+	bool stopped;
+	clock::time_point drain_deadline;
+
+	std::unordered_map<std::string, Queue> queues;
+	// Webhook url -> X-RateLimit-Bucket, several routes can share a bucket
+	std::unordered_map<std::string, std::string> routes;
+	std::unordered_map<std::string, Bucket> buckets;
+	clock::time_point global_reset;
+
+	void thread_loop();
+	clock::time_point blocked_until(const std::string& url) const;
+	std::vector<std::string> take_batch(Queue& queue);
+	void update_limits(const std::string& url, const cpr::Response& response, clock::time_point now);
+};
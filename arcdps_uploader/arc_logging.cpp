@@ -1,4 +1,6 @@
 #include "arc_logging.h"
+#include <cinttypes>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <ShlObj.h>
@@ -29,7 +31,7 @@ arc_logging::arc_logging(char* arcvers)
 		formatted_time = std::string(timestr);
 	}
 
-	combat_log.open(doc_path + "\\arc_raw_log " + formatted_time + ".txt");
+	combat_log.open(std::filesystem::u8path(doc_path) / ("arc_raw_log " + formatted_time + ".txt"));
 	if (!combat_log) {
 		std::cout << "Opening file failed" << std::endl;
 	}
@@ -51,9 +53,10 @@ arc_logging::~arc_logging()
 
 void arc_logging::on_combat(cbtevent * ev, ag * src, ag * dst, char * skillname)
 {
-	/* big buffer */
+	/* big buffer, empty if the event isn't one we print */
 	char buff[4096];
 	char* p = &buff[0];
+	*p = 0;
 
 	/* ev is null. dst will only be valid on tracking add. skillname will also be null */
 	if (!ev) {
@@ -65,29 +68,30 @@ void arc_logging::on_combat(cbtevent * ev, ag * src, ag * dst, char * skillname)
 			if (src->prof) {
 				p += _snprintf(p, 400, "==== cbtnotify ====\n");
 				// self flag disabled - always 1
-				p += _snprintf(p, 400, "agent added: %s (%llx), prof: %u, elite: %u, self: %u\n", src->name, src->id, dst->prof, dst->elite, dst->self);
+				p += _snprintf(p, 400, "agent added: %s (%" PRIxPTR "), prof: %u, elite: %u, self: %u\n", src->name, src->id, dst->prof, dst->elite, dst->self);
 			}
 
 			/* remove */
 			else {
 				p += _snprintf(p, 400, "==== cbtnotify ====\n");
-				p += _snprintf(p, 400, "agent removed: %s (%llx)\n", src->name, src->id);
+				p += _snprintf(p, 400, "agent removed: %s (%" PRIxPTR ")\n", src->name, src->id);
 			}
 		}
 
 		/* notify target change */
 		else if (src->elite == 1) {
 			p += _snprintf(p, 400, "==== cbtnotify ====\n");
-			p += _snprintf(p, 400, "new target: %llx\n", src->id);
+			p += _snprintf(p, 400, "new target: %" PRIxPTR "\n", src->id);
 		}
 	}
 
 	/* combat event. skillname may be null. non-null skillname will remain static until module is unloaded. refer to evtc notes for complete detail */
 	else {
 		/* common */
-		p += _snprintf(p, 400, "==== cbtevent %u at %llu ====\n", cbtcount, ev->time);
-		p += _snprintf(p, 400, "source agent: %s (%llx:%u, %lx:%lx), master: %u\n", src->name, ev->src_agent, ev->src_instid, src->prof, src->elite, ev->src_master_instid);
-		if (ev->dst_agent) p += _snprintf(p, 400, "target agent: %s (%llx:%u, %lx:%lx)\n", dst->name, ev->dst_agent, ev->dst_instid, dst->prof, dst->elite);
+		uint32_t count = cbtcount++;
+		p += _snprintf(p, 400, "==== cbtevent %u at %" PRIu64 " ====\n", count, ev->time);
+		p += _snprintf(p, 400, "source agent: %s (%" PRIxPTR ":%u, %" PRIx32 ":%" PRIx32 "), master: %u\n", src->name, ev->src_agent, ev->src_instid, src->prof, src->elite, ev->src_master_instid);
+		if (ev->dst_agent) p += _snprintf(p, 400, "target agent: %s (%" PRIxPTR ":%u, %" PRIx32 ":%" PRIx32 ")\n", dst->name, ev->dst_agent, ev->dst_instid, dst->prof, dst->elite);
 		else p += _snprintf(p, 400, "target agent: n/a\n");
 
 		/* statechange */
@@ -142,13 +146,13 @@ void arc_logging::on_combat(cbtevent * ev, ag * src, ag * dst, char * skillname)
 				p += _snprintf(p, 400, "LANG\n");
 				break;
 			case CBTS_GWBUILD: // src_agent will be game build
-				p += _snprintf(p, 400, "GWBUILD - %llu\n", ev->src_agent);
+				p += _snprintf(p, 400, "GWBUILD - %" PRIuPTR "\n", ev->src_agent);
 				break;
 			case CBTS_SHARDID: // src_agent will be sever shard id
-				p += _snprintf(p, 400, "SHARD ID - %llu\n", ev->src_agent);
+				p += _snprintf(p, 400, "SHARD ID - %" PRIuPTR "\n", ev->src_agent);
 				break;
 			case CBTS_REWARD: // src_agent is self, dst_agent is reward id, value is reward type. these are the wiggly boxes that you get
-				p += _snprintf(p, 400, "REWARD - ID: %llu, Type: %u\n", ev->dst_agent, ev->value);
+				p += _snprintf(p, 400, "REWARD - ID: %" PRIuPTR ", Type: %u\n", ev->dst_agent, ev->value);
 				break;
 			default:
 				p += _snprintf(p, 400, "\n");
@@ -205,9 +209,9 @@ void arc_logging::on_combat(cbtevent * ev, ag * src, ag * dst, char * skillname)
 		/* common */
 		p += _snprintf(p, 400, "iff: %u\n", ev->iff);
 		p += _snprintf(p, 400, "result: %u\n", ev->result);
-		cbtcount += 1;
 	}
 
 	/* print */
+	std::lock_guard<std::mutex> lk(log_mutex);
 	combat_log << buff;
 }
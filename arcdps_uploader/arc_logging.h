@@ -1,14 +1,18 @@
 #pragma once
 
 #include "arcdps_defs.h"
+#include <atomic>
 #include <string>
 #include <fstream>
+#include <mutex>
 
 class arc_logging
 {
 	std::string doc_path;
 	std::ofstream combat_log;
-	uint32_t cbtcount;
+	// on_combat may be called from several threads at once
+	std::mutex log_mutex;
+	std::atomic<uint32_t> cbtcount;
 public:
 	arc_logging(char* arcvers);
 	~arc_logging();
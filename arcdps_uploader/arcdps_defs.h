@@ -1,7 +1,20 @@
 #pragma once
 
 #include <stdint.h>
+#ifdef _WIN32
 #include <Windows.h>
+#else
+/* minimal win32 stand-ins so the headless build can share these definitions */
+typedef void* HANDLE;
+typedef void* HWND;
+typedef int BOOL;
+typedef unsigned int UINT;
+typedef uint32_t DWORD;
+typedef uint32_t UINT32;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+typedef unsigned char byte;
+#endif
 
 /* arcdps export table */
 typedef struct arcdps_exports {
@@ -8,10 +8,12 @@
 #include <fstream>
 #include <iomanip>
 
+#include "AsyncLog.h"
 #include "SimpleIni.h"
 #include "Uploader.h"
 #include "imgui/imgui.h"
 #include "loguru.hpp"
+#include "mod_combat.h"
 
 static char* arcvers;
 static arcdps_exports exports;
@@ -109,15 +111,16 @@ arcdps_exports* mod_init() {
         fs::create_directory(uploader_data_path);
     }
 
-    // Loguru Log
+    // Loguru Log, written from a background thread so logging never
+    // waits on the disk while the game is running
     fs::path uploader_log_path = uploader_data_path / "uploader.log";
-    loguru::add_file(uploader_log_path.string().c_str(), loguru::Truncate,
-                     loguru::Verbosity_MAX);
+    AsyncLog::start(uploader_log_path);
 
-    // Uploader
+    // Uploader, the database and first scan load in the background so
+    // arcdps gets its exports table right away
     up = new Uploader(uploader_data_path, log_path);
-    up->start_async_refresh_log_list();
-    up->start_upload_thread();
+    up->start_async_init();
+    mod_combat_attach(up);
 
     /* for arcdps */
     exports.size = sizeof(arcdps_exports);
@@ -134,7 +137,10 @@ arcdps_exports* mod_init() {
 
 /* release mod -- return ignored */
 uintptr_t mod_release() {
+    mod_combat_attach(nullptr);
     delete up;
+    // Before the DLL unloads, its writer thread can't be joined after that
+    AsyncLog::stop();
     return 0;
 }
 
@@ -178,23 +184,6 @@ uintptr_t mod_wnd(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
     return uMsg;
 }
 
-/* combat callback -- may be called asynchronously. return ignored */
-/* one participant will be party/squad, or minijpon of. no spawn statechange
- * events. despawn statechange only on marked boss npcs */
-uintptr_t mod_combat(cbtevent* ev, ag* src, ag* dst, char* skillname,
-                     uint64_t id, uint64_t revision) {
-    if (ev) {
-        if (src && src->self) {
-            if (ev->is_statechange == CBTS_ENTERCOMBAT) {
-                up->in_combat = true;
-            } else if (ev->is_statechange == CBTS_EXITCOMBAT) {
-                up->in_combat = false;
-            }
-        }
-    }
-    return uintptr_t();
-}
-
 uintptr_t mod_imgui() { return up->imgui_tick(); }
 
 void mod_options_windows(char* windowname) {
@@ -2,6 +2,7 @@
 
 #include "arcdps_defs.h"
 #include "imgui/imgui.h"
+#include "mod_combat.h"
 
 /* proto/globals */
 extern char* arcvers;
@@ -13,6 +14,5 @@ extern "C" __declspec(dllexport) void* get_release_addr();
 arcdps_exports* mod_init();
 uintptr_t mod_release();
 uintptr_t mod_wnd(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
-uintptr_t mod_combat(cbtevent* ev, ag* src, ag* dst, char* skillname, uint64_t id, uint64_t revision);
 uintptr_t mod_imgui();
 void mod_options_windows(char* windowname);
@@ -0,0 +1,316 @@
+// headless.cpp : Command line entry point that runs the upload pipeline
+// without a window, e.g. on a server that collects logs from a squad.
+//
+// Every event is written to stdout as a single line of JSON so the output can
+// be piped into other tools. Diagnostics go through loguru (stderr + file).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+#include "AsyncLog.h"
+#include "LogArchive.h"
+#include "Metrics.h"
+#include "Uploader.h"
+#include "loguru.hpp"
+
+using json = nlohmann::json;
+
+static std::atomic<bool> running(true);
+
+static void on_signal(int) { running = false; }
+
+static void print_usage(const char* exe) {
+    std::cerr
+        << "Usage: " << exe << " --logs <dir> [options]\n"
+        << "  --logs <dir>   arcdps.cbtlogs directory to scan (required)\n"
+        << "  --data <dir>   directory for uploader.ini/uploader.db/uploader.log"
+           " (default ./uploader)\n"
+        << "  --once         scan, upload everything pending, then exit"
+           " (default)\n"
+        << "  --daemon       keep running, rescanning for new logs every"
+           " minute\n"
+        << "  --metrics <file>  write Prometheus text metrics to file every"
+           " 10 seconds\n"
+        << "  --search <prefix>  list archived logs whose name starts with"
+           " prefix (\"\" for all) and exit, --logs not needed\n"
+        << "  --boss <id>    only archived logs of this boss, with --search\n"
+        << "  --limit <n>    at most n results, with --search (default 100)\n"
+        << "  --stats <week|month|year|all>  print kill statistics per boss"
+           " and category and exit\n"
+        << "  --rebuild-stats  recount the statistics from every log and"
+           " exit\n"
+        << "  --export <dir>  write the logs and their players to dir and"
+           " exit\n"
+        << "  --format <arrow|csv>  file format of --export (default arrow)\n"
+        << "  --since-last   only logs added since the last --export to the"
+           " same dir and format\n";
+}
+
+static void emit(const json& j) {
+    std::cout << j.dump() << std::endl;
+}
+
+static void emit_status(Uploader& up, const StatusMessage& status) {
+    json j;
+    j["event"] = "status";
+    j["message"] = status.msg;
+    if (status.log_id > 0) {
+        j["log_id"] = status.log_id;
+        if (auto log = up.get_log(status.log_id)) {
+            j["file"] = log->filename;
+            j["uploaded"] = log->uploaded;
+            j["error"] = log->error;
+            if (log->uploaded && !log->error) {
+                j["boss"] = log->boss_name;
+                j["boss_id"] = log->boss_id;
+                j["success"] = log->success;
+                j["permalink"] = log->permalink;
+            }
+        }
+    }
+    emit(j);
+}
+
+// Reads uploader_archive.db directly, the hot database is never opened
+static int search_archive(const fs::path& data_path,
+                          const ArchiveQuery& query) {
+    fs::path archive_path = data_path / "uploader_archive.db";
+    if (!fs::exists(archive_path)) {
+        emit({{"event", "error"}, {"message", "no archive"}});
+        return 1;
+    }
+    LogArchive archive(archive_path);
+    for (const Log& log : archive.search(query)) {
+        emit({{"event", "archived"},
+              {"log_id", log.id},
+              {"file", log.filename},
+              {"time_ms", TimepointToMillis(log.time)},
+              {"boss", log.boss_name},
+              {"boss_id", log.boss_id},
+              {"success", log.success},
+              {"permalink", log.permalink}});
+    }
+    return 0;
+}
+
+static void emit_stats(const StatsRollup& row) {
+    emit({{"event", "stats"},
+          {"scope", row.scope == (int)Stats::Scope::BOSS ? "boss" : "category"},
+          {"key", row.key},
+          {"name", row.name},
+          {"attempts", row.attempts},
+          {"kills", row.kills},
+          {"success_rate", row.success_rate()},
+          {"average_kill_ms", row.average_kill_ms()},
+          {"best_kill_ms", row.kill_ms_best}});
+}
+
+int main(int argc, char** argv) {
+    std::optional<fs::path> log_path;
+    fs::path data_path = "./uploader/";
+    bool daemon = false;
+    std::optional<fs::path> metrics_path;
+    bool search = false;
+    ArchiveQuery query;
+    std::optional<Stats::Range> stats_range;
+    bool rebuild_stats = false;
+    std::optional<ExportOptions> export_options;
+    ExportFormat export_format = ExportFormat::ARROW;
+    bool since_last = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--logs") && i + 1 < argc) {
+            log_path = fs::path(argv[++i]);
+        } else if (!strcmp(argv[i], "--data") && i + 1 < argc) {
+            data_path = fs::path(argv[++i]);
+        } else if (!strcmp(argv[i], "--once")) {
+            daemon = false;
+        } else if (!strcmp(argv[i], "--daemon")) {
+            daemon = true;
+        } else if (!strcmp(argv[i], "--metrics") && i + 1 < argc) {
+            metrics_path = fs::path(argv[++i]);
+        } else if (!strcmp(argv[i], "--search") && i + 1 < argc) {
+            query.filename_prefix = argv[++i];
+            search = true;
+        } else if (!strcmp(argv[i], "--boss") && i + 1 < argc) {
+            query.boss_id = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--limit") && i + 1 < argc) {
+            query.limit = (size_t)std::max(atoi(argv[++i]), 1);
+        } else if (!strcmp(argv[i], "--stats") && i + 1 < argc) {
+            ++i;
+            for (auto range : {Stats::Range::WEEK, Stats::Range::MONTH,
+                               Stats::Range::YEAR, Stats::Range::ALL}) {
+                if (!strcmp(argv[i], Stats::range_name(range))) {
+                    stats_range = range;
+                }
+            }
+            if (!stats_range) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--rebuild-stats")) {
+            rebuild_stats = true;
+        } else if (!strcmp(argv[i], "--export") && i + 1 < argc) {
+            export_options.emplace();
+            export_options->dir = fs::path(argv[++i]);
+        } else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+            ++i;
+            if (!strcmp(argv[i], export_format_name(ExportFormat::CSV))) {
+                export_format = ExportFormat::CSV;
+            } else if (strcmp(argv[i], export_format_name(ExportFormat::ARROW))) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--since-last")) {
+            since_last = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (search) {
+        return search_archive(data_path, query);
+    }
+
+    if (export_options) {
+        export_options->format = export_format;
+        export_options->since_last = since_last;
+    }
+    bool offline = stats_range || rebuild_stats || export_options;
+    if (!log_path && !offline) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (!fs::exists(data_path)) {
+        fs::create_directories(data_path);
+    }
+
+    // Keep stderr quiet, stdout is reserved for JSON progress
+    int log_argc = 1;
+    char* log_argv[] = {argv[0], nullptr};
+    loguru::init(log_argc, log_argv);
+    loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+    fs::path uploader_log_path = data_path / "uploader.log";
+    // Stops at exit, after the Uploader below has logged its shutdown
+    AsyncLog::Options log_options;
+    log_options.append = true;
+    AsyncLog::start(uploader_log_path, log_options);
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    if (offline) {
+        Uploader up(data_path, log_path);
+        if (!up.open_offline()) {
+            emit({{"event", "error"}, {"message", "failed to open database"}});
+            return 1;
+        }
+        if (rebuild_stats) {
+            StatsRebuild rebuild = up.rebuild_stats();
+            if (!rebuild.ok) {
+                emit({{"event", "error"},
+                      {"message", "failed to rebuild statistics"}});
+                return 1;
+            }
+            emit({{"event", "stats_rebuilt"},
+                  {"logs", rebuild.logs},
+                  {"rows", rebuild.rows},
+                  {"mismatched", rebuild.mismatched}});
+        }
+        if (export_options) {
+            ExportResult result = up.export_logs(*export_options);
+            if (!result.ok) {
+                emit({{"event", "error"}, {"message", result.error}});
+                return 1;
+            }
+            emit({{"event", "exported"},
+                  {"logs", result.logs},
+                  {"players", result.players},
+                  {"row_groups", result.groups},
+                  {"logs_file", result.logs_file.string()},
+                  {"players_file", result.players_file.string()},
+                  {"last_log_id", result.last_log_id}});
+        }
+        if (stats_range) {
+            auto [from, to] =
+                Stats::weeks(*stats_range, std::chrono::system_clock::now());
+            for (auto scope : {Stats::Scope::BOSS, Stats::Scope::CATEGORY}) {
+                for (const StatsRollup& row : up.query_stats(scope, from, to)) {
+                    emit_stats(row);
+                }
+            }
+        }
+        return 0;
+    }
+
+    Uploader up(data_path, log_path);
+    // No game waiting on us, give queued webhook posts time to go out
+    up.set_shutdown_deadline(std::chrono::seconds(30));
+    up.start_async_init();
+    if (!up.wait_for_init()) {
+        emit({{"event", "error"}, {"message", "initialization failed"}});
+        return 1;
+    }
+
+    emit({{"event", "start"},
+          {"mode", daemon ? "daemon" : "once"},
+          {"logs", log_path->string()}});
+
+    bool was_refreshing = true;
+    size_t last_pending = 0;
+    auto metrics_time = std::chrono::steady_clock::now();
+    while (running) {
+        up.poll_async_refresh_log_list();
+
+        // The refresh only queues the most recent logs for the UI, pick up
+        // the full backlog once a scan has been committed
+        bool refreshing = up.is_refreshing();
+        if (was_refreshing && !refreshing) {
+            up.add_all_pending_upload_logs();
+        }
+
+        for (const auto& status : up.take_status_messages()) {
+            emit_status(up, status);
+        }
+
+        size_t pending = up.pending_upload_count();
+        if (pending != last_pending) {
+            emit({{"event", "progress"}, {"pending", pending}});
+            last_pending = pending;
+        }
+
+        if (!daemon && !refreshing && !was_refreshing && pending == 0) {
+            break;
+        }
+        was_refreshing = refreshing;
+
+        if (metrics_path &&
+            std::chrono::steady_clock::now() - metrics_time >
+                std::chrono::seconds(10)) {
+            Metrics::write_text_file(*metrics_path);
+            metrics_time = std::chrono::steady_clock::now();
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    for (const auto& status : up.take_status_messages()) {
+        emit_status(up, status);
+    }
+    emit({{"event", "done"}, {"pending", up.pending_upload_count()}});
+    if (metrics_path) {
+        Metrics::write_text_file(*metrics_path);
+    }
+
+    return 0;
+}
@@ -2849,6 +2849,12 @@ public:
 #define SI_NoCase   SI_GenericNoCase
 
 #include <wchar.h>
+
+#ifdef SI_NO_CONVERTUTF
+// Without the ConvertUTF reference library only the char interfaces
+// (CSimpleIniA, CSimpleIniCaseA) are usable.
+template<class SI_CHAR> class SI_ConvertW;
+#else
 #include "ConvertUTF.h"
 
 /**
@@ -3044,6 +3050,7 @@ public:
         }
     }
 };
+#endif // SI_NO_CONVERTUTF
 
 #endif // SI_CONVERT_GENERIC
 
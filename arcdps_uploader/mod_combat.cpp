@@ -0,0 +1,31 @@
+// mod_combat.cpp : The arcdps combat callback. Kept apart from the DLL entry
+// points so the replay harness can call it on Linux.
+
+#include "mod_combat.h"
+
+#include <atomic>
+
+#include "Uploader.h"
+
+static std::atomic<Uploader*> combat_uploader(nullptr);
+
+void mod_combat_attach(Uploader* uploader) { combat_uploader = uploader; }
+
+/* combat callback -- may be called asynchronously. return ignored */
+/* one participant will be party/squad, or minijpon of. no spawn statechange
+ * events. despawn statechange only on marked boss npcs */
+uintptr_t mod_combat(cbtevent* ev, ag* src, ag* /*dst*/, char* /*skillname*/,
+                     uint64_t /*id*/, uint64_t /*revision*/) {
+    if (ev) {
+        if (src && src->self) {
+            Uploader* up = combat_uploader.load(std::memory_order_acquire);
+            if (!up) return uintptr_t();
+            if (ev->is_statechange == CBTS_ENTERCOMBAT) {
+                up->in_combat = true;
+            } else if (ev->is_statechange == CBTS_EXITCOMBAT) {
+                up->in_combat = false;
+            }
+        }
+    }
+    return uintptr_t();
+}
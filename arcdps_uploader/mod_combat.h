@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+#include "arcdps_defs.h"
+
+class Uploader;
+
+// Uploader the combat callback reports to. Set once the uploader exists and
+// back to nullptr before it is destroyed, arcdps may still be delivering
+// events on another thread.
+void mod_combat_attach(Uploader* uploader);
+
+/* combat callback -- may be called asynchronously. return ignored */
+uintptr_t mod_combat(cbtevent* ev, ag* src, ag* dst, char* skillname, uint64_t id, uint64_t revision);
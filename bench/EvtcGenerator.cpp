@@ -0,0 +1,204 @@
+#include "EvtcGenerator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "EvtcFormat.h"
+#include "LogCompressor.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+// splitmix64, std:: distributions differ between standard libraries
+struct Rng {
+    uint64_t state;
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+    uint32_t below(uint32_t n) { return (uint32_t)(next() % n); }
+};
+
+template <typename T>
+void append(std::vector<char>& out, const T& value) {
+    const char* p = (const char*)&value;
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+constexpr uint64_t PLAYER_ADDR = 0x1000;
+constexpr uint64_t BOSS_ADDR = 0x2000;
+constexpr uint64_t NPC_ADDR = 0x3000;
+}  // namespace
+
+EvtcSpec EvtcSpec::with_size(uint64_t bytes) const {
+    EvtcSpec spec = *this;
+    uint64_t fixed = sizeof(EvtcHeader) + 8 +
+                     (uint64_t)(players + npcs + 1) * sizeof(EvtcAgent) +
+                     (uint64_t)skills * sizeof(EvtcSkill);
+    uint64_t body = bytes > fixed ? bytes - fixed : 0;
+    spec.events = (std::max)(body / sizeof(cbtevent), (uint64_t)1000);
+    return spec;
+}
+
+std::vector<char> generate_evtc(const EvtcSpec& spec) {
+    Rng rng{spec.seed};
+    std::vector<char> out;
+    out.reserve(sizeof(EvtcHeader) + 8 +
+                (spec.players + spec.npcs + 1) * sizeof(EvtcAgent) +
+                spec.skills * sizeof(EvtcSkill) +
+                (spec.events + spec.players + 16) * sizeof(cbtevent));
+
+    EvtcHeader header = {};
+    memcpy(header.magic, "EVTC", 4);
+    memcpy(header.build, "20240101", 8);
+    header.revision = 1;
+    header.boss_id = spec.boss_id;
+    append(out, header);
+
+    append(out, (uint32_t)(spec.players + spec.npcs + 1));
+    for (uint32_t i = 0; i < spec.players; ++i) {
+        EvtcAgent agent = {};
+        agent.addr = PLAYER_ADDR + i;
+        agent.prof = 1 + i % 9;
+        agent.is_elite = rng.below(2) ? 0 : 27 + i % 9;
+        agent.toughness = 10;
+        agent.hitbox_width = 48;
+        agent.hitbox_height = 192;
+        // "character\0:account\0subgroup\0"
+        int n = snprintf(agent.name, sizeof(agent.name), "Player %u", i);
+        n += 1 + snprintf(agent.name + n + 1, sizeof(agent.name) - n - 1,
+                          ":account.%04u", i);
+        snprintf(agent.name + n + 1, sizeof(agent.name) - n - 1, "%u",
+                 1 + i / 5);
+        append(out, agent);
+    }
+    {
+        EvtcAgent boss = {};
+        boss.addr = BOSS_ADDR;
+        boss.prof = spec.boss_id;
+        boss.is_elite = EVTC_NPC_ELITE;
+        snprintf(boss.name, sizeof(boss.name), "Boss %u", spec.boss_id);
+        append(out, boss);
+    }
+    for (uint32_t i = 0; i < spec.npcs; ++i) {
+        EvtcAgent npc = {};
+        npc.addr = NPC_ADDR + i;
+        npc.prof = 10000 + i;
+        npc.is_elite = EVTC_NPC_ELITE;
+        snprintf(npc.name, sizeof(npc.name), "Add %u", i);
+        append(out, npc);
+    }
+
+    append(out, spec.skills);
+    for (uint32_t i = 0; i < spec.skills; ++i) {
+        EvtcSkill skill = {};
+        skill.id = (int32_t)(1000 + i);
+        snprintf(skill.name, sizeof(skill.name), "Skill %u", i);
+        append(out, skill);
+    }
+
+    const uint64_t t0 = 1000;
+    const uint64_t log_start = 1704067200;  // 2024-01-01
+    auto statechange = [&](uint64_t time, uint8_t kind, uint64_t src,
+                           uint64_t dst, int32_t value = 0) {
+        cbtevent ev = {};
+        ev.time = time;
+        ev.src_agent = (uintptr_t)src;
+        ev.dst_agent = (uintptr_t)dst;
+        ev.value = value;
+        ev.is_statechange = kind;
+        append(out, ev);
+    };
+
+    statechange(t0, CBTS_LOGSTART, EVTC_ARCDPS_ID, 0, (int32_t)log_start);
+    statechange(t0, CBTS_POINTOFVIEW, PLAYER_ADDR, 0);
+    for (uint32_t i = 0; i < spec.players; ++i) {
+        statechange(t0, CBTS_ENTERCOMBAT, PLAYER_ADDR + i, 1 + i / 5);
+    }
+    statechange(t0, CBTS_MAXHEALTHUPDATE, BOSS_ADDR, 22021440);
+
+    // Health updates every 1% of the fight, deaths spread across it
+    uint64_t health_every = (std::max)(spec.events / 100, (uint64_t)1);
+    uint64_t death_every =
+        spec.player_deaths ? spec.events / (spec.player_deaths + 1) : 0;
+    uint32_t deaths = 0;
+    uint32_t end_health = spec.kill ? 0 : 3500;
+    for (uint64_t i = 0; i < spec.events; ++i) {
+        uint64_t time = t0 + i * spec.duration_ms / spec.events;
+        // Deaths first, their slots often coincide with health updates
+        if (death_every && i && i % death_every == 0 &&
+            deaths < spec.player_deaths) {
+            statechange(time, CBTS_CHANGEDEAD,
+                        PLAYER_ADDR + deaths % spec.players, 0);
+            deaths++;
+            continue;
+        }
+        if (i % health_every == 0) {
+            uint64_t pct = 10000 - (10000 - end_health) * i / spec.events;
+            statechange(time, CBTS_HEALTHUPDATE, BOSS_ADDR, pct);
+            continue;
+        }
+
+        cbtevent ev = {};
+        ev.time = time;
+        uint32_t src = rng.below(spec.players);
+        ev.src_agent = (uintptr_t)(PLAYER_ADDR + src);
+        ev.src_instid = (uint16_t)(1 + src);
+        ev.skillid = 1000 + rng.below(spec.skills);
+        uint32_t kind = rng.below(100);
+        if (kind < 15) {
+            // buff application on a squad member
+            uint32_t dst = rng.below(spec.players);
+            ev.dst_agent = (uintptr_t)(PLAYER_ADDR + dst);
+            ev.dst_instid = (uint16_t)(1 + dst);
+            ev.buff = 1;
+            ev.value = (int32_t)(1000 + rng.below(10000));
+        } else if (kind < 16) {
+            ev.is_activation = 1 + rng.below(3);
+            ev.value = (int32_t)rng.below(2000);
+        } else {
+            bool add = spec.npcs && kind < 25;
+            ev.dst_agent = (uintptr_t)(add ? NPC_ADDR + rng.below(spec.npcs)
+                                           : BOSS_ADDR);
+            ev.dst_instid = (uint16_t)(add ? 200 : 100);
+            ev.value = (int32_t)(100 + rng.below(20000));
+            ev.iff = 1;
+            ev.is_flanking = (uint8_t)rng.below(2);
+            ev.is_fifty = (uint8_t)rng.below(2);
+        }
+        append(out, ev);
+    }
+
+    uint64_t end = t0 + spec.duration_ms;
+    if (spec.kill) {
+        statechange(end, CBTS_CHANGEDEAD, BOSS_ADDR, 0);
+        statechange(end, CBTS_REWARD, PLAYER_ADDR, 55821, 13);
+    }
+    for (uint32_t i = 0; i < spec.players; ++i) {
+        statechange(end, CBTS_EXITCOMBAT, PLAYER_ADDR + i, 0);
+    }
+    statechange(end, CBTS_LOGEND, EVTC_ARCDPS_ID, 0,
+                (int32_t)(log_start + spec.duration_ms / 1000));
+    return out;
+}
+
+bool write_evtc(const fs::path& path, const EvtcSpec& spec) {
+    std::vector<char> data = generate_evtc(spec);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), (std::streamsize)data.size());
+    return (bool)out;
+}
+
+bool write_zevtc(const fs::path& path, const EvtcSpec& spec) {
+    fs::path raw = path;
+    raw.replace_extension(".evtc");
+    if (!write_evtc(raw, spec)) return false;
+    bool ok = LogCompressor::write_zevtc(raw, path);
+    std::error_code ec;
+    fs::remove(raw, ec);
+    return ok;
+}
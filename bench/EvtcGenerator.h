@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Parameters of a synthetic arcdps log. The same spec always produces the
+// same bytes, on every platform.
+struct EvtcSpec
+{
+	uint16_t boss_id = 15438; // Vale Guardian
+	uint32_t players = 10;
+	uint32_t npcs = 4; // besides the boss
+	uint32_t skills = 300;
+	uint64_t events = 200000;
+	uint32_t duration_ms = 300000;
+	uint32_t player_deaths = 1;
+	bool kill = true;
+	uint64_t seed = 1;
+
+	// Same spec with events chosen so the .evtc is about bytes long
+	EvtcSpec with_size(uint64_t bytes) const;
+};
+
+std::vector<char> generate_evtc(const EvtcSpec& spec);
+bool write_evtc(const std::filesystem::path& path, const EvtcSpec& spec);
+// Writes the .evtc next to path, zips it into path and removes it
+bool write_zevtc(const std::filesystem::path& path, const EvtcSpec& spec);
@@ -0,0 +1,282 @@
+#include "MockServer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define close_socket close
+#define INVALID_SOCKET (-1)
+#endif
+
+static bool send_all(socket_t s, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = send(s, data.data() + sent, (int)(data.size() - sent), 0);
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+static std::string header_value(const std::string& head, const char* name) {
+    // Case-insensitive search for "\r\nName:"
+    std::string needle = std::string("\r\n") + name + ":";
+    auto it = std::search(head.begin(), head.end(), needle.begin(),
+                          needle.end(), [](char a, char b) {
+                              return tolower((unsigned char)a) ==
+                                     tolower((unsigned char)b);
+                          });
+    if (it == head.end()) return "";
+    size_t start = (it - head.begin()) + needle.size();
+    size_t end = head.find("\r\n", start);
+    std::string value = head.substr(start, end - start);
+    while (!value.empty() && value.front() == ' ') value.erase(0, 1);
+    return value;
+}
+
+static std::string response(int code, const char* reason,
+                            const std::string& body,
+                            const std::string& extra_headers = "") {
+    char head[256];
+    snprintf(head, sizeof(head),
+             "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+             "Content-Length: %zu\r\nConnection: close\r\n",
+             code, reason, body.size());
+    return head + extra_headers + "\r\n" + body;
+}
+
+MockServer::MockServer(MockServerConfig config)
+    : config(config),
+      running(true),
+      bucket_remaining(config.webhook_limit),
+      bucket_reset(std::chrono::steady_clock::now() + config.webhook_window) {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(listener, (sockaddr*)&addr, sizeof(addr));
+    listen(listener, 64);
+    socklen_t len = sizeof(addr);
+    getsockname(listener, (sockaddr*)&addr, &len);
+    bound_port = ntohs(addr.sin_port);
+    accept_thread = std::thread(&MockServer::accept_loop, this);
+}
+
+MockServer::~MockServer() {
+    running = false;
+#ifdef _WIN32
+    shutdown(listener, SD_BOTH);
+#else
+    shutdown(listener, SHUT_RDWR);
+#endif
+    close_socket(listener);
+    accept_thread.join();
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        for (socket_t s : open_sockets) {
+#ifdef _WIN32
+            shutdown(s, SD_BOTH);
+#else
+            shutdown(s, SHUT_RDWR);
+#endif
+        }
+        threads.swap(connections);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+std::string MockServer::url() const {
+    return "http://127.0.0.1:" + std::to_string(bound_port);
+}
+
+uint64_t MockServer::requests(const std::string& route) const {
+    std::lock_guard<std::mutex> lk(mutex);
+    auto it = counts.find(route);
+    return it == counts.end() ? 0 : it->second;
+}
+
+std::string MockServer::upload_response(uint32_t players, uint64_t n,
+                                        bool detailed) {
+    char id[64];
+    snprintf(id, sizeof(id), "mock-%08llu_vg", (unsigned long long)n);
+    std::string body = "{\"id\":\"" + std::string(id) +
+                       "\",\"permalink\":\"https://dps.report/" + id +
+                       "\",\"userToken\":\"mocktoken\",\"uploadTime\":" +
+                       std::to_string(1704067200 + n) +
+                       ",\"encounter\":{\"bossId\":15438,\"boss\":\"Vale "
+                       "Guardian\",\"success\":true,\"jsonAvailable\":true,"
+                       "\"duration\":300,\"compDps\":123456,\"isCm\":false},"
+                       "\"players\":{";
+    for (uint32_t i = 0; i < players; ++i) {
+        char player[256];
+        snprintf(player, sizeof(player),
+                 "%s\"Player %u\":{\"display_name\":\"account.%04u\","
+                 "\"character_name\":\"Player %u\",\"profession\":%u,"
+                 "\"elite_spec\":%u,\"group\":%u",
+                 i ? "," : "", i, i, i, 1 + i % 9, i % 2 ? 0 : 27 + i % 9,
+                 1 + i / 5);
+        body += player;
+        if (detailed) {
+            snprintf(player, sizeof(player),
+                     ",\"dpsAll\":[{\"dps\":%u,\"damage\":%u,"
+                     "\"condiDamage\":%u,\"powerDamage\":%u}],"
+                     "\"defenses\":[{\"damageTaken\":%u,\"dodgeCount\":%u,"
+                     "\"downCount\":%u,\"deadCount\":%u}]",
+                     1000 + i, 300000 + i, 100000 + i, 200000 + i, 50000 + i,
+                     i % 7, i % 3, i % 2);
+            body += player;
+            body += ",\"buffUptimes\":[";
+            for (uint32_t buff = 0; buff < 16; ++buff) {
+                snprintf(player, sizeof(player),
+                         "%s{\"id\":%u,\"buffData\":[{\"uptime\":%u.%02u,"
+                         "\"presence\":0.0}]}",
+                         buff ? "," : "", 700 + buff * 13, (i + buff) % 100,
+                         (i * buff) % 100);
+                body += player;
+            }
+            body += "]";
+        }
+        body += "}";
+    }
+    body += "}}";
+    return body;
+}
+
+void MockServer::accept_loop() {
+    while (running) {
+        socket_t client = accept(listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            if (!running) return;
+            continue;
+        }
+        std::lock_guard<std::mutex> lk(mutex);
+        open_sockets.insert(client);
+        connections.emplace_back(&MockServer::serve, this, client);
+    }
+}
+
+void MockServer::serve(socket_t client) {
+    std::string data;
+    char buf[64 * 1024];
+    size_t head_end = std::string::npos;
+    bool continued = false;
+    size_t content_length = 0;
+    std::string head;
+
+    while (!config.stall) {
+        int n = recv(client, buf, sizeof(buf), 0);
+        if (n <= 0) break;
+        if (head_end == std::string::npos) {
+            data.append(buf, (size_t)n);
+            head_end = data.find("\r\n\r\n");
+            if (head_end == std::string::npos) continue;
+            head = data.substr(0, head_end + 2);
+            content_length = (size_t)atoll(
+                header_value(head, "Content-Length").c_str());
+            // Otherwise curl holds the body back for a second
+            if (!continued && !header_value(head, "Expect").empty()) {
+                send_all(client, "HTTP/1.1 100 Continue\r\n\r\n");
+                continued = true;
+            }
+            data.erase(0, head_end + 4);
+        } else {
+            data.append(buf, (size_t)n);
+        }
+        if (data.size() < content_length) {
+            // Only the size matters, don't keep multi-megabyte bodies
+            content_length -= data.size();
+            data.clear();
+            continue;
+        }
+
+        std::string target;
+        {
+            size_t sp = head.find(' ');
+            size_t sp2 = head.find(' ', sp + 1);
+            target = head.substr(sp + 1, sp2 - sp - 1);
+        }
+        std::string route = target.substr(0, target.find('?'));
+        if (route.rfind("/webhook", 0) == 0) route = "/webhook";
+
+        uint64_t n_upload = 0;
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            counts[route]++;
+            if (route == "/uploadContent") n_upload = ++uploads;
+        }
+
+        std::string reply;
+        if (route == "/uploadContent") {
+            std::this_thread::sleep_for(config.upload_latency);
+            if (config.fail_every && n_upload % config.fail_every == 0) {
+                reply = response(500, "Internal Server Error",
+                                 "{\"error\":\"mock failure\"}");
+            } else {
+                reply = response(200, "OK",
+                                 upload_response(config.players, n_upload));
+            }
+        } else if (route == "/webhook") {
+            std::lock_guard<std::mutex> lk(mutex);
+            auto now = std::chrono::steady_clock::now();
+            if (now >= bucket_reset) {
+                bucket_remaining = config.webhook_limit;
+                bucket_reset = now + config.webhook_window;
+            }
+            double after =
+                std::chrono::duration<double>(bucket_reset - now).count();
+            bool allowed = bucket_remaining > 0;
+            if (allowed) bucket_remaining--;
+
+            char headers[256];
+            snprintf(headers, sizeof(headers),
+                     "X-RateLimit-Bucket: mock\r\nX-RateLimit-Limit: %d\r\n"
+                     "X-RateLimit-Remaining: %d\r\n"
+                     "X-RateLimit-Reset-After: %.3f\r\n",
+                     config.webhook_limit, bucket_remaining, after);
+            if (allowed) {
+                reply = response(204, "No Content", "", headers);
+            } else {
+                limited++;
+                char body[96];
+                snprintf(body, sizeof(body),
+                         "{\"retry_after\": %.3f, \"global\": false}", after);
+                reply = response(429, "Too Many Requests", body, headers);
+            }
+        } else {
+            reply = response(404, "Not Found", "{}");
+        }
+        send_all(client, reply);
+        break;
+    }
+
+    if (config.stall) {
+        // Hold the connection until the server shuts down
+        while (running && recv(client, buf, sizeof(buf), 0) > 0) {
+        }
+    }
+
+    std::lock_guard<std::mutex> lk(mutex);
+    open_sockets.erase(client);
+    close_socket(client);
+}
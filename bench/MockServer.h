@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+using socket_t = SOCKET;
+#else
+using socket_t = int;
+#endif
+
+struct MockServerConfig
+{
+	// Added before every /uploadContent answer
+	std::chrono::milliseconds upload_latency{20};
+	// Every n-th upload is answered 500 (0 = never)
+	uint32_t fail_every = 0;
+	// Players in the /uploadContent response
+	uint32_t players = 10;
+	// Accept connections but never answer, for shutdown tests
+	bool stall = false;
+
+	// Discord style bucket shared by every /webhook/<id> route
+	int webhook_limit = 5;
+	std::chrono::milliseconds webhook_window{2000};
+};
+
+// Minimal HTTP/1.1 server on 127.0.0.1 imitating dps.report's /uploadContent
+// and Discord webhooks. One thread per connection, every response closes
+// the connection.
+class MockServer
+{
+public:
+	explicit MockServer(MockServerConfig config = {});
+	~MockServer();
+
+	uint16_t port() const { return bound_port; }
+	std::string url() const;
+	uint64_t requests(const std::string& route) const;
+	uint64_t rate_limited() const { return limited; }
+
+	// The JSON /uploadContent answers with. Detailed WvW responses also carry
+	// per player stats, about 1 KB each.
+	static std::string upload_response(uint32_t players, uint64_t n, bool detailed = false);
+
+private:
+	MockServerConfig config;
+	socket_t listener;
+	uint16_t bound_port = 0;
+	std::atomic<bool> running;
+	std::thread accept_thread;
+
+	mutable std::mutex mutex;
+	std::vector<std::thread> connections;
+	std::set<socket_t> open_sockets;
+	std::map<std::string, uint64_t> counts;
+	uint64_t uploads = 0;
+	std::atomic<uint64_t> limited{0};
+
+	int bucket_remaining;
+	std::chrono::steady_clock::time_point bucket_reset;
+
+	void accept_loop();
+	void serve(socket_t client);
+};
@@ -0,0 +1,1555 @@
+// uploader_bench: repeatable throughput/latency numbers for the upload
+// pipeline, run against a synthetic log corpus and an in-process mock
+// dps.report/Discord server. Nothing leaves the machine.
+//
+//   uploader_bench [--quick] [--only a,b] [--work <dir>]
+//                  [--baseline <file>] [--save-baseline <file>]
+//                  [--tolerance 0.15]
+//
+// With --baseline every result is compared against the stored value and the
+// exit code is 1 if any of them got worse by more than the tolerance.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "AsyncLog.h"
+#include "Coordination.h"
+#include "CoordinationServer.h"
+#include "EvtcGenerator.h"
+#include "EvtcReader.h"
+#include "EvtcScanner.h"
+#include "LogArchive.h"
+#include "LogCompressor.h"
+#include "LogExport.h"
+#include "LogIndex.h"
+#include "LogScanner.h"
+#include "LogValidator.h"
+#include "Metrics.h"
+#include "MockServer.h"
+#include "Routing.h"
+#include "StorageActor.h"
+#include "UploadBackend.h"
+#include "Uploader.h"
+#include "WebhookDispatcher.h"
+#include "loguru.hpp"
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+using namespace std::chrono;
+
+namespace {
+struct Result {
+    std::string name;
+    double value;
+    std::string unit;
+    bool higher_is_better;
+};
+
+class Samples {
+    std::vector<double> values;
+public:
+    void add(double v) { values.push_back(v); }
+    size_t size() const { return values.size(); }
+    double percentile(double q) {
+        if (values.empty()) return 0;
+        std::sort(values.begin(), values.end());
+        size_t i = (size_t)(q * (values.size() - 1) + 0.5);
+        return values[(std::min)(i, values.size() - 1)];
+    }
+};
+
+struct Bench {
+    fs::path work_dir;
+    bool quick = false;
+    std::vector<Result> results;
+    // Checks that did not hold, the run exits non-zero
+    int failures = 0;
+
+    void report(const std::string& name, double value, const char* unit,
+                bool higher_is_better) {
+        results.push_back({name, value, unit, higher_is_better});
+        printf("  %-34s %12.3f %s\n", name.c_str(), value, unit);
+        fflush(stdout);
+    }
+    void fail(const std::string& what) {
+        printf("  FAILED: %s\n", what.c_str());
+        fflush(stdout);
+        ++failures;
+    }
+    fs::path dir(const char* name) {
+        fs::path p = work_dir / name;
+        std::error_code ec;
+        fs::remove_all(p, ec);
+        fs::create_directories(p);
+        return p;
+    }
+};
+
+double mb(uint64_t bytes) { return (double)bytes / (1024.0 * 1024.0); }
+
+void bench_compress(Bench& b) {
+    EvtcSpec spec = EvtcSpec{}.with_size((b.quick ? 8 : 32) << 20);
+    fs::path dir = b.dir("compress");
+    fs::path raw = dir / "20240101-120000.evtc";
+
+    Metrics::Timer gen;
+    write_evtc(raw, spec);
+    double gen_s = gen.seconds();
+    uint64_t size = fs::file_size(raw);
+    b.report("corpus.generate", mb(size) / gen_s, "MB/s", true);
+
+    Metrics::Timer timer;
+    LogCompressor::write_zevtc(raw, dir / "20240101-120000.zevtc");
+    double s = timer.seconds();
+    b.report("compress.throughput", mb(size) / s, "MB/s", true);
+    b.report("compress.ratio",
+             (double)size / fs::file_size(dir / "20240101-120000.zevtc"), "x",
+             true);
+}
+
+void bench_scan(Bench& b) {
+    EvtcSpec spec = EvtcSpec{}.with_size((uint64_t)(b.quick ? 32 : 256) << 20);
+    std::vector<char> data = generate_evtc(spec);
+    const uint8_t* p = (const uint8_t*)data.data();
+
+    EvtcSummary expected =
+        EvtcScanner::scan(p, data.size(), EvtcScanner::Path::SCALAR);
+    if (!expected.valid || expected.kill != spec.kill ||
+        expected.player_deaths != spec.player_deaths) {
+        LOG_F(ERROR, "Scalar scan disagrees with the generated log");
+    }
+
+    for (auto path : {EvtcScanner::Path::SCALAR, EvtcScanner::Path::SSE2,
+                      EvtcScanner::Path::AVX2}) {
+        if (!EvtcScanner::supported(path)) continue;
+        // Best of a few runs, the first one also pages the buffer in
+        double best = 0;
+        for (int run = 0; run < 5; ++run) {
+            Metrics::Timer timer;
+            EvtcSummary s = EvtcScanner::scan(p, data.size(), path);
+            best = (std::max)(best, data.size() / 1e9 / timer.seconds());
+            if (s.kill != expected.kill || s.events != expected.events ||
+                s.player_deaths != expected.player_deaths ||
+                s.boss_health != expected.boss_health ||
+                s.duration_ms != expected.duration_ms) {
+                LOG_F(ERROR, "%s scan disagrees with scalar",
+                      EvtcScanner::path_name(path));
+            }
+        }
+        b.report(std::string("scan.") + EvtcScanner::path_name(path), best,
+                 "GB/s", true);
+    }
+}
+
+// What local inspection cost before EvtcReader: the whole file on the heap,
+// and for a .zevtc the whole inflated log next to it
+std::vector<uint8_t> read_whole(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> data((size_t)fs::file_size(path));
+    in.read((char*)data.data(), (std::streamsize)data.size());
+    if (path.extension() != ".zevtc" || data.size() < 30) return data;
+
+    uint32_t size;
+    uint16_t name_length, extra_length;
+    memcpy(&size, data.data() + 22, 4);
+    memcpy(&name_length, data.data() + 26, 2);
+    memcpy(&extra_length, data.data() + 28, 2);
+    std::vector<uint8_t> out(size);
+    z_stream zs = {};
+    inflateInit2(&zs, -MAX_WBITS);
+    zs.next_in = data.data() + 30 + name_length + extra_length;
+    zs.avail_in = (uInt)(data.size() - 30 - name_length - extra_length);
+    zs.next_out = out.data();
+    zs.avail_out = (uInt)out.size();
+    inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    return out;
+}
+
+void bench_reader(Bench& b) {
+    EvtcSpec spec = EvtcSpec{}.with_size((uint64_t)(b.quick ? 16 : 64) << 20);
+    fs::path dir = b.dir("reader");
+    fs::path evtc = dir / "20240101-120000.evtc";
+    fs::path zevtc = dir / "20240101-120001.zevtc";
+    write_evtc(evtc, spec);
+    write_zevtc(zevtc, spec);
+    double size = mb(fs::file_size(evtc));
+
+    // Best of a few runs, all of them from the page cache
+    auto best_of = [](const std::function<void()>& run) {
+        double best = 1e9;
+        for (int i = 0; i < 3; ++i) {
+            Metrics::Timer timer;
+            run();
+            best = (std::min)(best, timer.seconds());
+        }
+        return best;
+    };
+
+    for (const fs::path& path : {evtc, zevtc}) {
+        std::string name =
+            "reader." + path.extension().string().substr(1) + ".";
+        size_t whole_bytes = 0;
+        size_t reader_bytes = 0;
+        EvtcSummary whole, streamed;
+        double whole_s = best_of([&] {
+            std::vector<uint8_t> data = read_whole(path);
+            whole_bytes = data.size();
+            if (path.extension() == ".zevtc") {
+                whole_bytes += (size_t)fs::file_size(path);
+            }
+            whole = EvtcScanner::scan(data.data(), data.size());
+        });
+        double reader_s = best_of([&] {
+            EvtcReader reader;
+            reader.open(path);
+            streamed = EvtcScanner::scan(reader);
+            reader_bytes = reader.memory_usage();
+        });
+        if (!streamed.valid || streamed.events != whole.events ||
+            streamed.kill != whole.kill) {
+            LOG_F(ERROR, "EvtcReader disagrees with the whole file read of %s",
+                  path.filename().string().c_str());
+        }
+        b.report(name + "whole_file", size / whole_s, "MB/s", true);
+        b.report(name + "reader", size / reader_s, "MB/s", true);
+        b.report(name + "whole_file_memory", whole_bytes / 1024.0, "KB",
+                 false);
+        b.report(name + "reader_memory", reader_bytes / 1024.0, "KB", false);
+    }
+}
+
+void bench_validate(Bench& b) {
+    fs::path dir = b.dir("validate");
+    const int count = b.quick ? 8 : 40;
+    EvtcSpec spec = EvtcSpec{}.with_size(4 << 20);
+    std::vector<fs::path> good;
+    for (int i = 0; i < count; ++i) {
+        spec.seed = i + 1;
+        char name[64];
+        snprintf(name, sizeof(name), "20240101-12%02d00.%s", i,
+                 i % 4 ? "zevtc" : "evtc");
+        fs::path path = dir / name;
+        (i % 4 ? write_zevtc(path, spec) : write_evtc(path, spec));
+        good.push_back(path);
+    }
+
+    // Damaged copies of the first .zevtc, each must be rejected
+    fs::path source = good[1];
+    uint64_t size = fs::file_size(source);
+    auto damaged = [&](const char* name, auto&& damage) {
+        fs::path path = dir / name;
+        fs::copy_file(source, path, fs::copy_options::overwrite_existing);
+        damage(path);
+        return path;
+    };
+    std::vector<fs::path> bad = {
+        damaged("empty.zevtc", [](const fs::path& p) { fs::resize_file(p, 0); }),
+        damaged("half.zevtc",
+                [&](const fs::path& p) { fs::resize_file(p, size / 2); }),
+        damaged("no_directory.zevtc",
+                [&](const fs::path& p) { fs::resize_file(p, size - 22); }),
+        damaged("flipped.zevtc",
+                [&](const fs::path& p) {
+                    std::fstream f(p, std::ios::binary | std::ios::in |
+                                          std::ios::out);
+                    f.seekp((std::streamoff)(size / 2));
+                    f.put('\x5a');
+                }),
+    };
+
+    Samples samples;
+    uint64_t bytes = 0;
+    Metrics::Timer total;
+    for (const auto& path : good) {
+        Metrics::Timer timer;
+        LogValidation result = LogValidator::validate(path);
+        samples.add(timer.seconds() * 1000.0);
+        bytes += result.events * sizeof(cbtevent);
+        if (!result.ok) {
+            LOG_F(ERROR, "Rejected good log %s: %s",
+                  path.filename().string().c_str(), result.reason.c_str());
+        }
+    }
+    double s = total.seconds();
+    for (const auto& path : bad) {
+        LogValidation result = LogValidator::validate(path);
+        if (result.ok) {
+            LOG_F(ERROR, "Accepted damaged log %s",
+                  path.filename().string().c_str());
+        }
+    }
+    b.report("validate.p50", samples.percentile(0.5), "ms", false);
+    b.report("validate.p99", samples.percentile(0.99), "ms", false);
+    b.report("validate.throughput", mb(bytes) / s, "MB/s", true);
+}
+
+#ifndef _WIN32
+// CPU time of the process so far, all threads
+double cpu_seconds() {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+#endif
+
+void bench_discovery(Bench& b) {
+    const int dirs = 50;
+    const int files = b.quick ? 10000 : 100000;
+    fs::path root = b.dir("discovery");
+    for (int i = 0; i < files; ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "%04d%02d%02d-%02d%02d%02d.zevtc",
+                 2020 + i % 4, 1 + i % 12, 1 + i % 28, i % 24, i / 24 % 60,
+                 i / 1440 % 60);
+        fs::path dir = root / ("Boss " + std::to_string(i % dirs));
+        fs::create_directories(dir);
+        std::ofstream(dir / name);
+    }
+
+    // The same cold scan on 1 to 8 threads. Files/s should grow with the
+    // cores there are, and CPU use should stay at the cores that have work:
+    // idle workers sleep rather than spin.
+    unsigned threads = std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+    std::vector<Log> found;
+    double single = 0, rate = 0;
+    for (unsigned n : {1u, 2u, 4u, 8u}) {
+#ifndef _WIN32
+        double cpu = cpu_seconds();
+#endif
+        Metrics::Timer timer;
+        found = LogScanner(n).scan(root, {});
+        double s = timer.seconds();
+        rate = found.size() / s;
+        if (n == 1) single = rate;
+        std::string name = "discovery.cold_scan." + std::to_string(n) + "_threads";
+        b.report(name, rate, "files/s", true);
+#ifndef _WIN32
+        b.report(name + ".cpu", (cpu_seconds() - cpu) / s, "cores", false);
+#endif
+        if (found.size() != (size_t)files) {
+            LOG_F(ERROR, "discovery: found %zu of %d logs", found.size(), files);
+        }
+    }
+    b.report("discovery.speedup_8_threads", rate / single, "x", true);
+
+    Metrics::Timer timer;
+    found = LogScanner(threads).scan(root, {});
+    b.report("discovery.cold_scan", found.size() / timer.seconds(), "files/s",
+             true);
+
+    std::unordered_set<std::string> known;
+    for (const auto& log : found) known.insert(log.filename);
+    Metrics::Timer rescan;
+    LogScanner(threads).scan(root, known);
+    b.report("discovery.rescan", rescan.seconds() * 1000.0, "ms", false);
+}
+
+void bench_parse(Bench& b) {
+    struct Case {
+        uint32_t players;
+        bool detailed;
+    };
+    for (Case c : {Case{10, false}, Case{500, false}, Case{500, true}}) {
+        std::string text = MockServer::upload_response(c.players, 1, c.detailed);
+        int iterations = c.players > 100 ? 200 : 5000;
+        if (b.quick) iterations /= 10;
+        Samples samples;
+        Metrics::Timer total;
+        for (int i = 0; i < iterations; ++i) {
+            Metrics::Timer timer;
+            UploadResult result = DpsReportBackend::parse_response(200, text);
+            samples.add(timer.seconds() * 1e6);
+            if (!result.ok) {
+                LOG_F(ERROR, "parse_response failed: %s", result.error.c_str());
+                return;
+            }
+        }
+        double s = total.seconds();
+
+        // What upload_thread_loop did before parse_response: a full DOM,
+        // a copy of encounter and players dumped back to a string
+        Samples dom;
+        for (int i = 0; i < iterations; ++i) {
+            Metrics::Timer timer;
+            json parsed = json::parse(text);
+            json encounter = parsed["encounter"];
+            std::string players_json = parsed["players"].dump();
+            dom.add(timer.seconds() * 1e6);
+            if (players_json.empty() || encounter.is_null()) return;
+        }
+
+        std::string name = "parse." + std::to_string(c.players) + "_players" +
+                           (c.detailed ? "_detailed" : "");
+        b.report(name + ".p50", samples.percentile(0.5), "us", false);
+        b.report(name + ".p99", samples.percentile(0.99), "us", false);
+        b.report(name + ".throughput",
+                 mb(text.size() * (uint64_t)iterations) / s, "MB/s", true);
+        b.report(name + ".dom.p50", dom.percentile(0.5), "us", false);
+    }
+}
+
+void bench_upload(Bench& b) {
+    MockServerConfig config;
+    config.upload_latency = milliseconds(20);
+    config.fail_every = 10;
+    MockServer server(config);
+
+    fs::path dir = b.dir("upload");
+    fs::path log = dir / "20240101-120000.zevtc";
+    write_zevtc(log, EvtcSpec{}.with_size(16 << 20));
+    uint64_t size = fs::file_size(log);
+
+    DpsReportBackend backend(server.url(), "mock");
+    int uploads = b.quick ? 10 : 40;
+    int failures = 0;
+    Samples samples;
+    Metrics::Timer total;
+    for (int i = 0; i < uploads; ++i) {
+        UploadRequest request;
+        request.log_id = i;
+        request.path = log;
+        request.detailed_wvw = false;
+        Metrics::Timer timer;
+        UploadResult result = backend.submit(request).get();
+        samples.add(timer.seconds() * 1000.0);
+        if (!result.ok) failures++;
+    }
+    double s = total.seconds();
+    b.report("upload.p50", samples.percentile(0.5), "ms", false);
+    b.report("upload.p90", samples.percentile(0.9), "ms", false);
+    b.report("upload.p99", samples.percentile(0.99), "ms", false);
+    b.report("upload.throughput", mb(size * uploads) / s, "MB/s", true);
+    b.report("upload.failures", failures, "logs", false);
+}
+
+void bench_pipeline(Bench& b) {
+    MockServerConfig config;
+    config.upload_latency = milliseconds(10);
+    MockServer server(config);
+
+    fs::path data = b.dir("pipeline_data");
+    fs::path logs = b.dir("pipeline_logs");
+    std::ofstream(data / "uploader.ini")
+        << "[Settings]\nUpload_Backend = 1\nUpload_Backend_Url = "
+        << server.url() << "\n";
+
+    const int count = b.quick ? 8 : 25;
+    for (int i = 0; i < count; ++i) {
+        EvtcSpec spec = EvtcSpec{}.with_size(1 << 20);
+        spec.seed = i + 1;
+        char name[64];
+        snprintf(name, sizeof(name), "20240101-12%02d00.zevtc", i);
+        fs::create_directories(logs / "Vale Guardian");
+        write_zevtc(logs / "Vale Guardian" / name, spec);
+    }
+
+    Metrics::Timer total;
+    int uploaded = 0;
+    {
+        Uploader up(data, logs);
+        up.set_shutdown_deadline(seconds(10));
+        up.start_async_init();
+        if (!up.wait_for_init()) {
+            LOG_F(ERROR, "Uploader failed to initialize");
+            return;
+        }
+        b.report("pipeline.init", total.seconds() * 1000.0, "ms", false);
+
+        bool queued = false;
+        auto deadline = steady_clock::now() + seconds(120);
+        while (uploaded < count && steady_clock::now() < deadline) {
+            up.poll_async_refresh_log_list();
+            if (!queued && !up.is_refreshing()) {
+                up.add_all_pending_upload_logs();
+                queued = true;
+            }
+            for (const auto& status : up.take_status_messages()) {
+                if (status.log_id > 0) uploaded++;
+            }
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+        // The rollups kept up during the uploads must match a recount
+        StatsRebuild rebuild = up.rebuild_stats();
+        if (rebuild.mismatched > 0 || rebuild.rows == 0) {
+            LOG_F(ERROR, "Statistics: %zu of %zu rollups were off",
+                  rebuild.mismatched, rebuild.rows);
+        }
+    }
+    double s = total.seconds();
+    if (uploaded < count) {
+        LOG_F(ERROR, "Pipeline uploaded %d of %d logs", uploaded, count);
+    }
+    b.report("pipeline.logs_per_second", uploaded / s, "logs/s", true);
+    b.report("pipeline.total", s * 1000.0, "ms", false);
+}
+
+void bench_webhooks(Bench& b) {
+    MockServerConfig config;
+    config.webhook_limit = 5;
+    config.webhook_window = milliseconds(1000);
+    MockServer server(config);
+
+    const int hooks = 10;
+    const int logs = b.quick ? 40 : 200;
+    Metrics::Timer total;
+    {
+        WebhookDispatcher dispatcher(milliseconds(50), milliseconds(250),
+                                     WebhookDispatcher::post_multipart,
+                                     seconds(30));
+        for (int i = 0; i < logs; ++i) {
+            dispatcher.enqueue(
+                server.url() + "/webhook/" + std::to_string(i % hooks),
+                "Vale Guardian - *12:00PM (Mon Jan 01)*\n"
+                "https://dps.report/mock-" +
+                    std::to_string(i));
+            std::this_thread::sleep_for(milliseconds(2));
+        }
+    }
+    b.report("webhooks.drain", total.seconds() * 1000.0, "ms", false);
+    b.report("webhooks.messages", (double)server.requests("/webhook"),
+             "posts", false);
+    b.report("webhooks.rate_limited", (double)server.rate_limited(), "posts",
+             false);
+}
+
+// Per call cost of a typical hot path line, timed in bursts that fit the
+// ring so the writer keeps up
+template <typename Log>
+double burst_ns(int bursts, Log&& log) {
+    const int burst = 1000;
+    Samples samples;
+    for (int b = 0; b < bursts; ++b) {
+        Metrics::Timer timer;
+        for (int i = 0; i < burst; ++i) log(i);
+        samples.add(timer.seconds() * 1e9 / burst);
+        AsyncLog::flush();
+    }
+    return samples.percentile(0.5);
+}
+
+void bench_logging(Bench& b) {
+    fs::path dir = b.dir("logging");
+    const std::string path =
+        "C:/logs/arcdps.cbtlogs/Vale Guardian/20240101-120000.zevtc";
+    const int bursts = b.quick ? 20 : 100;
+
+    fs::path sync_path = dir / "sync.log";
+    loguru::add_file(sync_path.string().c_str(), loguru::Truncate,
+                     loguru::Verbosity_MAX);
+    b.report("logging.sync_file", burst_ns(bursts, [&](int) {
+                 LOG_F(INFO, "Found new log: %s", path.c_str());
+             }), "ns/call", false);
+    loguru::remove_callback(sync_path.string().c_str());
+
+    AsyncLog::start(dir / "async.log");
+    b.report("logging.loguru_async", burst_ns(bursts, [&](int) {
+                 LOG_F(INFO, "Found new log: %s", path.c_str());
+             }), "ns/call", false);
+    b.report("logging.deferred", burst_ns(bursts, [&](int i) {
+                 ASYNC_LOG_F(INFO, "Found new log: %s (%d)", path, i);
+             }), "ns/call", false);
+
+    // Four threads flooding it, what doesn't fit is dropped
+    const int flood = b.quick ? 50000 : 250000;
+    Metrics::Timer timer;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < flood; ++i) {
+                ASYNC_LOG_F(INFO, "Found new log: %s (%d)", path, i);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    double flood_ns = timer.seconds() * 1e9 / flood;
+    AsyncLog::flush();
+    double written = 4.0 * flood - (double)AsyncLog::dropped();
+    b.report("logging.flood_4_threads", flood_ns, "ns/call", false);
+    b.report("logging.flood_written", written / timer.seconds(), "lines/s",
+             true);
+    AsyncLog::stop();
+}
+
+// Destinations as users set them up: a category or two, every few an
+// account filter, boss list, duration or evening window
+std::vector<RouteRule> make_rules(size_t count) {
+    static const char* clauses[] = {
+        "category=raids",
+        "category=raids,strikes; success",
+        "category=fractals; duration>=90s",
+        "boss=15438,21041,16246; accounts=2 of a.1001,b.1002,c.1003",
+        "category=strikes; time=19:00-23:30",
+        "success; accounts=p.1,p.2,p.3,p.4,p.5",
+    };
+    std::vector<RouteRule> rules(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string error;
+        rules[i].parse(clauses[i % 6], error);
+    }
+    return rules;
+}
+
+void bench_routing(Bench& b) {
+    RouteInput input;
+    input.category = (int)Revtc::BossCategory::RAIDS;
+    input.boss_id = 15438;
+    input.success = true;
+    input.duration_ms = 250000;
+    input.minute_of_day = 20 * 60;
+    for (int i = 0; i < 10; ++i) {
+        input.accounts.push_back("player." + std::to_string(1000 + i));
+    }
+    input.accounts.push_back("a.1001");
+    input.accounts.push_back("p.3");
+
+    const int rounds = b.quick ? 2000 : 20000;
+    for (size_t destinations : {10, 100, 1000}) {
+        std::vector<RouteRule> rules = make_rules(destinations);
+        Metrics::Timer compile;
+        RoutingTable table(rules);
+        double compile_ms = compile.seconds() * 1000.0;
+
+        size_t matched = 0;
+        Metrics::Timer timer;
+        for (int i = 0; i < rounds; ++i) matched += table.match(input).size();
+        std::string name = "routing.match_" + std::to_string(destinations);
+        b.report(name, timer.seconds() * 1e6 / rounds, "us/log", false);
+        if (destinations == 1000) {
+            b.report("routing.compile_1000", compile_ms, "ms", false);
+        }
+        if (matched == 0) fprintf(stderr, "routing: nothing matched\n");
+    }
+}
+
+// A squad uploading the same fights through the reference coordination
+// server. Every member claims at once with its own log start time; one in
+// five fights loses its first claimer mid upload, so the lease has to run
+// out before someone else takes it.
+void bench_coordination(Bench& b) {
+    fs::path dir = b.dir("coordination");
+    fs::path log = dir / "20240101-120000.zevtc";
+    write_zevtc(log, EvtcSpec{}.with_size(4 << 20));
+    const int reads = b.quick ? 20 : 100;
+    std::optional<FightFingerprint> fingerprint;
+    Metrics::Timer read_timer;
+    for (int i = 0; i < reads; ++i) fingerprint = FightFingerprint::read(log);
+    b.report("coordination.fingerprint", read_timer.seconds() * 1e6 / reads,
+             "us/log", false);
+    if (!fingerprint) {
+        fprintf(stderr, "coordination: no fingerprint\n");
+        return;
+    }
+
+    CoordinationServerConfig config;
+    config.workers = 8;
+    config.registry.lease = seconds(1);
+    CoordinationServer server(config);
+    if (!server.listening()) {
+        fprintf(stderr, "coordination: server did not start\n");
+        return;
+    }
+
+    const int fights = b.quick ? 5 : 20;
+    const int members = 10;
+    const auto upload_time = milliseconds(50);
+    CancelToken cancel;
+    std::mutex mutex;
+    Samples claim_ms, permalink_ms;
+    int uploads = 0, failures = 0;
+    std::vector<std::vector<std::string>> permalinks(fights);
+
+    auto member = [&](int fight, int index) {
+        FightFingerprint mine = *fingerprint;
+        mine.server_start += (uint32_t)(fight * 3600 + index % 4);
+        std::string client = "member-" + std::to_string(index);
+        bool crashes = fight % 5 == 0 && index == 0;
+        Metrics::Timer waited;
+        for (;;) {
+            Metrics::Timer timer;
+            Coordination::Claim claim =
+                Coordination::claim(server.url(), client, mine, cancel);
+            std::unique_lock<std::mutex> lk(mutex);
+            claim_ms.add(timer.seconds() * 1000.0);
+            if (claim.status == Coordination::Status::CLAIMED) {
+                uploads++;
+                if (crashes) return;
+                lk.unlock();
+                std::this_thread::sleep_for(upload_time);
+                Coordination::Claim done = Coordination::complete(
+                    server.url(), client, claim.fight,
+                    "https://dps.report/" + claim.fight, "Vale Guardian", true,
+                    cancel);
+                lk.lock();
+                permalinks[fight].push_back(done.permalink);
+                return;
+            }
+            if (claim.status == Coordination::Status::DONE) {
+                permalink_ms.add(waited.seconds() * 1000.0);
+                permalinks[fight].push_back(claim.permalink);
+                return;
+            }
+            if (claim.status != Coordination::Status::TAKEN) {
+                failures++;
+                return;
+            }
+            lk.unlock();
+            std::this_thread::sleep_for(milliseconds(20));
+        }
+    };
+
+    Metrics::Timer total;
+    std::vector<std::thread> threads;
+    for (int fight = 0; fight < fights; ++fight) {
+        for (int i = 0; i < members; ++i) threads.emplace_back(member, fight, i);
+    }
+    for (auto& t : threads) t.join();
+
+    // Everyone who finished must have ended up with the one permalink
+    int mismatched = 0;
+    for (const auto& links : permalinks) {
+        for (const auto& link : links) mismatched += link != links.front();
+    }
+    b.report("coordination.uploads_per_fight", (double)uploads / fights,
+             "uploads", false);
+    b.report("coordination.claim_p50", claim_ms.percentile(0.5), "ms", false);
+    b.report("coordination.claim_p99", claim_ms.percentile(0.99), "ms", false);
+    b.report("coordination.permalink_p50", permalink_ms.percentile(0.5), "ms",
+             false);
+    b.report("coordination.permalink_p99", permalink_ms.percentile(0.99), "ms",
+             false);
+    b.report("coordination.mismatched", mismatched, "members", false);
+    b.report("coordination.failures", failures, "members", false);
+    b.report("coordination.total", total.seconds() * 1000.0, "ms", false);
+
+    // The registry alone, without HTTP
+    Coordination::Registry registry;
+    const int rounds = b.quick ? 20000 : 200000;
+    Metrics::Timer registry_timer;
+    for (int i = 0; i < rounds; ++i) {
+        FightFingerprint f = *fingerprint;
+        f.server_start += (uint32_t)(i / members * 60);
+        registry.claim(f, "member-" + std::to_string(i % members));
+    }
+    b.report("coordination.registry_claim",
+             registry_timer.seconds() * 1e9 / rounds, "ns", false);
+}
+
+// Hot tables as Uploader.cpp declares them, without the ones the archive
+// doesn't touch
+inline auto bench_log_storage(const std::string& path) {
+    using namespace sqlite_orm;
+    return make_storage(
+        path, make_index("idx_logs_time_ms", &Log::time),
+        make_table("logs",
+                   make_column("id", &Log::id, autoincrement(), primary_key()),
+                   make_column("dir_id", &Log::dir_id, default_value(0)),
+                   make_column("file", &Log::file, default_value("")),
+                   make_column("filename", &Log::filename),
+                   make_column("human_time", &Log::human_time),
+                   make_column("time_ms", &Log::time, default_value(0)),
+                   make_column("uploaded", &Log::uploaded),
+                   make_column("error", &Log::error),
+                   make_column("report_id", &Log::report_id),
+                   make_column("permalink", &Log::permalink),
+                   make_column("boss_id", &Log::boss_id),
+                   make_column("boss_name", &Log::boss_name),
+                   make_column("players_json", &Log::players_json),
+                   make_column("json_available", &Log::json_available),
+                   make_column("success", &Log::success),
+                   make_column("duration_ms", &Log::duration_ms,
+                               default_value(0))),
+        make_table("pending_uploads",
+                   make_column("log_id", &PendingUpload::log_id,
+                               primary_key())));
+}
+
+// Reading the whole logs table back, which the statistics rebuild and the
+// export do, and the recent list every refresh reads
+void bench_log_table(Bench& b) {
+    using namespace sqlite_orm;
+    using Storage = decltype(bench_log_storage(""));
+    fs::path dir = b.dir("log_table");
+    const int count = b.quick ? 10000 : 100000;
+    Storage s = bench_log_storage((dir / "uploader.db").string());
+    s.sync_schema(true);
+    s.open_forever();
+    s.transaction([&] {
+        for (int i = 0; i < count; ++i) {
+            Log log = {};
+            log.dir_id = 1 + i % 40;
+            log.filename = "s" + std::to_string(1000000 + i);
+            log.file = log.filename + ".zevtc";
+            log.human_time = log.filename;
+            log.time = TimepointFromMillis(1704067200000ll + i * 60000ll);
+            log.uploaded = true;
+            log.boss_id = 15438;
+            log.boss_name = "Vale Guardian";
+            log.report_id = "abcd-" + log.filename;
+            log.permalink = "https://dps.report/" + log.report_id;
+            s.insert(log);
+        }
+        return true;
+    });
+
+    const int runs = b.quick ? 3 : 5;
+    Metrics::Timer all;
+    size_t rows = 0;
+    for (int i = 0; i < runs; ++i) {
+        rows = s.get_all<Log>().size();
+    }
+    double all_ms = all.seconds() * 1000.0 / runs;
+    if (rows != (size_t)count) {
+        LOG_F(ERROR, "log_table: read %zu of %d rows", rows, count);
+    }
+    Metrics::Timer recent;
+    for (int i = 0; i < runs * 20; ++i) {
+        s.get_all<Log>(order_by(&Log::time).desc(), limit(75));
+    }
+    b.report("log_table.get_all", all_ms, "ms", false);
+    b.report("log_table.rows_per_second", count / (all_ms / 1000.0), "rows/s",
+             true);
+    b.report("log_table.recent_75", recent.seconds() * 1000.0 / (runs * 20),
+             "ms", false);
+}
+
+// Destroys a busy Uploader and times the destructor against the default
+// shutdown deadline (250 ms). Uploads go to a server that accepts and never
+// answers.
+void bench_shutdown(Bench& b) {
+    MockServerConfig config;
+    config.stall = true;
+    MockServer server(config);
+    const milliseconds shutdown_deadline(250);
+
+    auto setup = [&](const char* name) {
+        fs::path data = b.dir(name);
+        fs::create_directories(data / "logs");
+        std::ofstream(data / "uploader.ini")
+            << "[Settings]\nUpload_Backend = 1\nUpload_Backend_Url = "
+            << server.url() << "\n";
+        return data;
+    };
+    auto start = [&](const fs::path& data) {
+        auto up = std::make_unique<Uploader>(data, data / "logs");
+        up->set_shutdown_deadline(shutdown_deadline);
+        up->start_async_init();
+        up->wait_for_init();
+        return up;
+    };
+    // bound is what the destructor promises for that case
+    auto destroy = [&](std::unique_ptr<Uploader>& up, const char* metric,
+                       milliseconds bound) {
+        Metrics::Timer timer;
+        up.reset();
+        double ms = timer.seconds() * 1000.0;
+        b.report(metric, ms, "ms", false);
+        if (ms > bound.count()) {
+            b.fail(std::string(metric) + " over its " +
+                   std::to_string(bound.count()) + " ms bound");
+        }
+    };
+
+    // Nothing running
+    {
+        fs::path data = setup("shutdown_idle");
+        auto up = start(data);
+        while (up->is_refreshing()) {
+            up->poll_async_refresh_log_list();
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+        destroy(up, "shutdown.idle", shutdown_deadline);
+    }
+
+    // The startup refresh still scanning a large history
+    {
+        fs::path data = setup("shutdown_refresh");
+        const int files = b.quick ? 20000 : 100000;
+        for (int i = 0; i < files; ++i) {
+            char name[64];
+            snprintf(name, sizeof(name), "%04d%02d%02d-%02d%02d%02d.zevtc",
+                     2020 + i % 4, 1 + i % 12, 1 + i % 28, i % 24,
+                     i / 24 % 60, i / 1440 % 60);
+            fs::path dir = data / "logs" / ("Boss " + std::to_string(i % 50));
+            fs::create_directories(dir);
+            std::ofstream(dir / name);
+        }
+        auto up = start(data);
+        bool refreshing = up->is_refreshing();
+        destroy(up, "shutdown.refresh", shutdown_deadline);
+        if (!refreshing) b.fail("shutdown: refresh finished too early");
+    }
+
+    // An upload waiting on the stalled server, it must be kept for the next
+    // start
+    {
+        fs::path data = setup("shutdown_upload");
+        fs::create_directories(data / "logs" / "Vale Guardian");
+        write_zevtc(data / "logs" / "Vale Guardian" / "20240101-120000.zevtc",
+                    EvtcSpec{}.with_size(1 << 20));
+        auto up = start(data);
+        bool uploading = false;
+        auto deadline = steady_clock::now() + seconds(30);
+        while (!uploading && steady_clock::now() < deadline) {
+            up->poll_async_refresh_log_list();
+            for (const auto& status : up->take_status_messages()) {
+                uploading |= status.msg.rfind("Uploading", 0) == 0;
+            }
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+        if (!uploading) {
+            b.fail("shutdown: the upload never started");
+            return;
+        }
+        // Past the send, waiting for an answer. libcurl only sees the cancel
+        // at its next progress tick.
+        std::this_thread::sleep_for(milliseconds(100));
+        destroy(up, "shutdown.stalled_upload",
+                shutdown_deadline + CURL_PROGRESS_INTERVAL);
+
+        auto s = bench_log_storage((data / "uploader.db").string());
+        int persisted = s.count<PendingUpload>();
+        b.report("shutdown.stalled_upload.persisted", (double)persisted,
+                 "uploads", true);
+        if (persisted != 1) b.fail("shutdown: the upload was not persisted");
+    }
+}
+
+// Writes and reads from many threads at once through one StorageActor, the
+// way the refresh task, the upload thread and the render thread share
+// uploader.db. Every tenth write throws after its insert: those rows must
+// be rolled back and every other one committed.
+void bench_storage(Bench& b) {
+    using Storage = decltype(bench_log_storage(""));
+    fs::path dir = b.dir("storage");
+    auto storage = std::make_unique<Storage>(
+        bench_log_storage((dir / "uploader.db").string()));
+    storage->sync_schema(true);
+    storage->open_forever();
+    StorageActor<Storage> actor(std::move(storage));
+
+    const int threads = 8;
+    const int writes = b.quick ? 1000 : 5000;
+    std::vector<std::vector<double>> waits(threads);
+    Metrics::Timer timer;
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            for (int i = 0; i < writes; ++i) {
+                Log log = {};
+                log.filename = std::to_string(t) + "-" + std::to_string(i);
+                log.time = TimepointFromMillis(1704067200000ll + i * 1000ll);
+                log.boss_name = "Vale Guardian";
+                bool fail = i % 10 == 9;
+                Metrics::Timer wait;
+                auto done = actor.write([log, fail](Storage& s) {
+                    s.insert(log);
+                    if (fail) throw std::runtime_error("rolled back");
+                });
+                // Most callers fire and forget, some wait for their write
+                // and read something back like the render thread does
+                if (i % 50 == 0) {
+                    try {
+                        done.get();
+                    } catch (const std::runtime_error&) {
+                    }
+                    waits[t].push_back(wait.seconds() * 1000.0);
+                    actor.read([](Storage& s) { return s.count<Log>(); }).get();
+                }
+            }
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    int rows = actor.read([](Storage& s) { return s.count<Log>(); }).get();
+    double s = timer.seconds();
+
+    const int expected = threads * (writes - writes / 10);
+    if (rows != expected) {
+        LOG_F(ERROR, "storage: %d rows committed, expected %d", rows, expected);
+    }
+    Samples samples;
+    for (const auto& thread : waits) {
+        for (double w : thread) samples.add(w);
+    }
+    b.report("storage.write_throughput", threads * writes / s, "writes/s", true);
+    b.report("storage.write_wait.p50", samples.percentile(0.5), "ms", false);
+    b.report("storage.write_wait.p99", samples.percentile(0.99), "ms", false);
+    b.report("storage.rows_off", std::abs(rows - expected), "rows", false);
+}
+
+// Years of raiding written a month at a time into two databases, one that
+// keeps everything and one that archives after 90 days the way
+// Uploader::archive_old_logs does. The hot queries are timed after every
+// simulated year: they should stay flat for the tiered database and grow
+// with the history for the other one.
+void bench_archive(Bench& b) {
+    using namespace sqlite_orm;
+    using Storage = decltype(bench_log_storage(""));
+    fs::path dir = b.dir("archive");
+    const int years = b.quick ? 2 : 5;
+    const int logs_per_day = 30;
+    const auto hot_window = hours(24 * 90);
+    const size_t batch_size = 500;
+
+    Storage flat = bench_log_storage((dir / "flat.db").string());
+    Storage hot = bench_log_storage((dir / "hot.db").string());
+    for (Storage* s : {&flat, &hot}) {
+        s->sync_schema(true);
+        s->open_forever();
+    }
+    LogArchive archive(dir / "archive.db");
+
+    std::vector<UploadPlayer> roster;
+    for (int i = 0; i < 10; ++i) {
+        roster.push_back({"Character " + std::to_string(i),
+                          "Account." + std::to_string(1000 + i), 1 + i % 9,
+                          40 + i % 30, 1 + i / 5});
+    }
+    const int boss_ids[] = {15438, 15429, 15375, 16123, 16115,
+                            16235, 16246, 17194, 17154, 19767};
+
+    // Time spent in the two hot queries of a refresh: the known filename set
+    // for the scanner and the recent list for the UI
+    auto time_queries = [&](Storage& s) {
+        Metrics::Timer timer;
+        const int runs = 5;
+        for (int i = 0; i < runs; ++i) {
+            auto names = s.select(&Log::filename);
+            auto recent = s.get_all<Log>(order_by(&Log::time).desc(), limit(75));
+            if (names.empty() || recent.empty()) break;
+        }
+        return timer.seconds() * 1000.0 / runs;
+    };
+
+    auto start = system_clock::now() - hours(24 * 365 * years);
+    int64_t archived_rows = 0;
+    double archive_seconds = 0;
+    double first_hot_mb = 0, first_hot_ms = 0, first_flat_ms = 0;
+    double hot_mb = 0, hot_ms = 0, flat_ms = 0;
+    int serial = 0;
+    for (int month = 0; month < years * 12; ++month) {
+        std::vector<Log> logs;
+        for (int day = 0; day < 30; ++day) {
+            for (int i = 0; i < logs_per_day; ++i, ++serial) {
+                Log log = {};
+                log.time = start + hours(24 * (month * 30 + day)) +
+                           minutes(i * 4);
+                log.filename = "s" + std::to_string(1000000 + serial);
+                log.file = log.filename + ".zevtc";
+                log.human_time = log.filename;
+                log.uploaded = true;
+                log.boss_id = boss_ids[serial % 10];
+                log.boss_name = "Boss " + std::to_string(log.boss_id);
+                log.report_id = "abcd-" + log.filename;
+                log.permalink = "https://dps.report/" + log.report_id;
+                log.success = serial % 4 != 0;
+                roster[serial % 10].group = 1 + serial % 3;
+                log.players_json = players_to_json(roster);
+                logs.push_back(std::move(log));
+            }
+        }
+        for (Storage* s : {&flat, &hot}) {
+            s->transaction([&] {
+                for (const Log& log : logs) s->insert(log);
+                return true;
+            });
+        }
+
+        // Same selection and order as Uploader::archive_old_logs, run to
+        // completion instead of a few steps per refresh
+        auto cutoff = logs.back().time - hot_window;
+        Metrics::Timer timer;
+        for (;;) {
+            auto batch = hot.get_all<Log>(
+                where(c(&Log::time) < cutoff and
+                      (c(&Log::uploaded) == true or
+                       c(&Log::error) == true) and
+                      not_in(&Log::id, select(&PendingUpload::log_id))),
+                order_by(&Log::time), limit((int)batch_size));
+            if (batch.empty() || !archive.store(batch)) break;
+            std::vector<int> ids;
+            for (const auto& log : batch) ids.push_back(log.id);
+            hot.remove_all<Log>(where(in(&Log::id, ids)));
+            archived_rows += batch.size();
+            if (batch.size() < batch_size) break;
+        }
+        archive_seconds += timer.seconds();
+
+        if ((month + 1) % 12 == 0) {
+            hot_mb = mb(fs::file_size(dir / "hot.db"));
+            hot_ms = time_queries(hot);
+            flat_ms = time_queries(flat);
+            if (month == 11) {
+                first_hot_mb = hot_mb;
+                first_hot_ms = hot_ms;
+                first_flat_ms = flat_ms;
+            }
+            printf("  year %d: hot %.1f MB %.2f ms, flat %.1f MB %.2f ms\n",
+                   (month + 1) / 12, hot_mb, hot_ms,
+                   mb(fs::file_size(dir / "flat.db")), flat_ms);
+        }
+    }
+
+    b.report("archive.hot_db", hot_mb, "MB", false);
+    b.report("archive.flat_db", mb(fs::file_size(dir / "flat.db")), "MB",
+             false);
+    b.report("archive.hot_db_growth", hot_mb / first_hot_mb, "x", false);
+    b.report("archive.hot_refresh_query", hot_ms, "ms", false);
+    b.report("archive.flat_refresh_query", flat_ms, "ms", false);
+    b.report("archive.hot_query_growth", hot_ms / first_hot_ms, "x", false);
+    b.report("archive.flat_query_growth", flat_ms / first_flat_ms, "x", false);
+    b.report("archive.migrate", archived_rows / archive_seconds, "logs/s",
+             true);
+    b.report("archive.archive_db", mb(fs::file_size(dir / "archive.db")), "MB",
+             false);
+
+    // Players are the bulk of a row and compress well
+    uint64_t raw = 0, packed = 0;
+    for (int i = 0; i < 100; ++i) {
+        Log log = {};
+        roster[i % 10].group = 1 + i % 3;
+        log.players_json = players_to_json(roster);
+        raw += log.players_json.size();
+        packed += LogArchive::pack(log).players.size();
+    }
+    b.report("archive.players_ratio", (double)raw / packed, "x", true);
+
+    // Searches open the archive on demand, so each one pays for that too
+    const int searches = 20;
+    Samples search_ms;
+    for (int i = 0; i < searches; ++i) {
+        ArchiveQuery query;
+        query.boss_id = boss_ids[i % 10];
+        query.success_only = true;
+        query.to_ms = TimepointToMillis(start + hours(24 * 30 * (i + 1)));
+        query.limit = 50;
+        Metrics::Timer timer;
+        auto found = archive.search(query);
+        search_ms.add(timer.seconds() * 1000.0);
+        if (found.empty()) fprintf(stderr, "archive: search found nothing\n");
+    }
+    b.report("archive.search_p50", search_ms.percentile(0.5), "ms", false);
+    b.report("archive.search_p99", search_ms.percentile(0.99), "ms", false);
+
+    Metrics::Timer lookup;
+    std::vector<std::string> names;
+    for (int i = 0; i < 1000; ++i) {
+        names.push_back("s" + std::to_string(1000000 + i * 7));
+    }
+    size_t found = archive.contains(names).size();
+    b.report("archive.contains_1000", lookup.seconds() * 1000.0, "ms", false);
+    if (found != names.size()) fprintf(stderr, "archive: lookup missed logs\n");
+}
+
+// Years of uploaded logs, a third of them archived. Statistics come from
+// the rollups in a handful of rows per boss and week; the same numbers
+// straight from the logs table are timed for comparison.
+void bench_stats(Bench& b) {
+    using namespace sqlite_orm;
+    fs::path data = b.dir("stats");
+    const int years = b.quick ? 2 : 5;
+    const int logs = years * 365 * 30;
+    const int boss_ids[] = {15438, 15429, 15375, 16123, 16115,
+                            16235, 16246, 17194, 17154, 19767};
+    auto start = system_clock::now() - hours(24 * 365 * years);
+
+    std::vector<Log> archived;
+    {
+        auto hot = bench_log_storage((data / "uploader.db").string());
+        hot.sync_schema(true);
+        hot.open_forever();
+        std::vector<Log> rows;
+        for (int i = 0; i < logs; ++i) {
+            Log log = {};
+            log.time = start + minutes(i * 48);
+            log.filename = "s" + std::to_string(1000000 + i);
+            log.file = log.filename + ".zevtc";
+            log.uploaded = true;
+            log.boss_id = boss_ids[i % 10];
+            log.boss_name = "Boss " + std::to_string(log.boss_id);
+            log.success = i % 4 != 0;
+            log.duration_ms = log.success ? 240000 + (i * 7919) % 120000 : 0;
+            rows.push_back(log);
+        }
+        hot.transaction([&] {
+            for (const Log& log : rows) hot.insert(log);
+            return true;
+        });
+        // The oldest third as an archive step would leave them
+        archived = hot.get_all<Log>(where(c(&Log::id) <= logs / 3));
+        hot.remove_all<Log>(where(c(&Log::id) <= logs / 3));
+    }
+    LogArchive(data / "uploader_archive.db").store(archived);
+
+    // What a query costs without rollups: every log of the period read and
+    // grouped, here for all time on the hot table alone
+    auto flat = bench_log_storage((data / "uploader.db").string());
+    Metrics::Timer flat_timer;
+    auto grouped = flat.select(
+        columns(&Log::boss_id, count(&Log::id), sum(&Log::success),
+                sum(&Log::duration_ms)),
+        group_by(&Log::boss_id));
+    b.report("stats.logs_table_query", flat_timer.seconds() * 1000.0, "ms",
+             false);
+    if (grouped.empty()) fprintf(stderr, "stats: nothing grouped\n");
+
+    Uploader up(data, std::nullopt);
+    if (!up.open_offline()) {
+        fprintf(stderr, "stats: database did not open\n");
+        return;
+    }
+    Metrics::Timer rebuild_timer;
+    StatsRebuild first = up.rebuild_stats();
+    b.report("stats.rebuild", logs / rebuild_timer.seconds(), "logs/s", true);
+    StatsRebuild second = up.rebuild_stats();
+    if (first.logs != (size_t)logs || second.mismatched != 0) {
+        fprintf(stderr, "stats: rebuild read %zu logs, %zu rollups off\n",
+                first.logs, second.mismatched);
+    }
+    b.report("stats.rollup_rows", (double)first.rows, "rows", false);
+
+    for (auto range : {Stats::Range::WEEK, Stats::Range::MONTH,
+                       Stats::Range::YEAR, Stats::Range::ALL}) {
+        auto [from, to] = Stats::weeks(range, system_clock::now());
+        Samples ms;
+        size_t attempts = 0;
+        for (int i = 0; i < 50; ++i) {
+            Metrics::Timer timer;
+            auto rows = up.query_stats(Stats::Scope::BOSS, from, to);
+            ms.add(timer.seconds() * 1000.0);
+            attempts = 0;
+            for (const auto& row : rows) attempts += row.attempts;
+        }
+        if (range == Stats::Range::ALL && attempts != (size_t)logs) {
+            fprintf(stderr, "stats: %zu attempts, expected %d\n", attempts,
+                    logs);
+        }
+        b.report(std::string("stats.query_") + Stats::range_name(range),
+                 ms.percentile(0.5), "ms", false);
+    }
+}
+
+#ifndef _WIN32
+// Peak resident memory of the process so far
+double peak_rss_mb() {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+#endif
+
+// A long history, the oldest part of it archived, exported in both formats
+// and then once more with --since-last after a week of new logs. Memory is
+// bounded by the row groups, the peak should not move with the history.
+void bench_export(Bench& b) {
+    using namespace sqlite_orm;
+    fs::path data = b.dir("export");
+    const int logs = b.quick ? 100000 : 1000000;
+    const int archived = logs / 20;
+    const int boss_ids[] = {15438, 15429, 15375, 16123, 16115,
+                            16235, 16246, 17194, 17154, 19767};
+    std::vector<UploadPlayer> roster;
+    for (int i = 0; i < 10; ++i) {
+        roster.push_back({"Character " + std::to_string(i),
+                          "Account." + std::to_string(1000 + i), 1 + i % 9,
+                          40 + i % 30, 1 + i / 5});
+    }
+    auto start = system_clock::now() - minutes(logs * 2);
+    auto make_log = [&](int i) {
+        Log log = {};
+        log.time = start + minutes(i * 2);
+        log.filename = "s" + std::to_string(1000000 + i);
+        log.file = log.filename + ".zevtc";
+        log.uploaded = true;
+        log.boss_id = boss_ids[i % 10];
+        log.boss_name = "Boss " + std::to_string(log.boss_id);
+        log.report_id = "abcd-" + log.filename;
+        log.permalink = "https://dps.report/" + log.report_id;
+        log.success = i % 4 != 0;
+        log.duration_ms = log.success ? 240000 + (i * 7919) % 120000 : 0;
+        roster[i % 10].group = 1 + i % 3;
+        log.players_json = players_to_json(roster);
+        return log;
+    };
+
+    // Written in chunks so generating the history doesn't set the peak
+    auto hot = bench_log_storage((data / "uploader.db").string());
+    hot.sync_schema(true);
+    hot.open_forever();
+    for (int i = 0; i < logs;) {
+        int end = (std::min)(i + 10000, logs);
+        hot.transaction([&] {
+            for (; i < end; ++i) hot.insert(make_log(i));
+            return true;
+        });
+    }
+    {
+        LogArchive archive(data / "uploader_archive.db");
+        for (int id = 0; id < archived; id += 500) {
+            auto batch = hot.get_all<Log>(
+                where(c(&Log::id) > id and c(&Log::id) <= id + 500));
+            archive.store(batch);
+        }
+        hot.remove_all<Log>(where(c(&Log::id) <= archived));
+    }
+
+    Uploader up(data, std::nullopt);
+    if (!up.open_offline()) {
+        fprintf(stderr, "export: database did not open\n");
+        return;
+    }
+    for (ExportFormat format : {ExportFormat::ARROW, ExportFormat::CSV}) {
+        std::string name = std::string("export.") + export_format_name(format);
+        ExportOptions options;
+        options.dir = data / "out";
+        options.format = format;
+#ifndef _WIN32
+        double rss_before = peak_rss_mb();
+#endif
+        Metrics::Timer timer;
+        ExportResult result = up.export_logs(options);
+        double seconds = timer.seconds();
+        if (!result.ok || result.logs != (size_t)logs ||
+            result.players != (size_t)logs * roster.size()) {
+            fprintf(stderr, "export: %s wrote %zu logs, %zu players: %s\n",
+                    name.c_str(), result.logs, result.players,
+                    result.error.c_str());
+            continue;
+        }
+        b.report(name, logs / seconds, "logs/s", true);
+        b.report(name + "_players", result.players / seconds, "rows/s", true);
+        b.report(name + "_file",
+                 mb(fs::file_size(result.logs_file) +
+                    fs::file_size(result.players_file)),
+                 "MB", false);
+#ifndef _WIN32
+        b.report(name + "_peak_growth", peak_rss_mb() - rss_before, "MB",
+                 false);
+#endif
+    }
+
+    // The first export set the cursor, a later one only writes what is new
+    ExportOptions options;
+    options.dir = data / "out";
+    options.since_last = true;
+    const int added = 7 * 30;
+    // Queued behind the cursor, returns once that is committed, so the
+    // second connection doesn't write over the uploader's
+    up.get_log(1);
+    hot.transaction([&] {
+        for (int i = logs; i < logs + added; ++i) hot.insert(make_log(i));
+        return true;
+    });
+    Metrics::Timer timer;
+    ExportResult result = up.export_logs(options);
+    if (!result.ok || result.logs != (size_t)added) {
+        fprintf(stderr, "export: since last wrote %zu logs, expected %d\n",
+                result.logs, added);
+    }
+    b.report("export.since_last", timer.seconds() * 1000.0, "ms", false);
+    up.get_log(1);
+}
+
+#ifdef __GLIBC__
+// Large blocks are mmapped and only counted in hblkhd
+size_t heap_in_use() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+#endif
+
+Log index_log(int i) {
+    Log log = {};
+    log.id = i + 1;
+    log.path = fs::path("C:/logs/arcdps.cbtlogs/Boss " + std::to_string(i % 50)) /
+               ("20240101-" + std::to_string(100000 + i % 900000) + ".zevtc");
+    log.file = log.path.filename().string();
+    log.filename = log.path.stem().string();
+    log.human_time = "12:00PM (Mon Jan 01)";
+    log.boss_name = "Boss " + std::to_string(i % 50);
+    log.permalink = "https://dps.report/abcd-" + log.filename;
+    log.uploaded = true;
+    log.time = TimepointFromMillis(1704067200000ll + i * 1000ll);
+    return log;
+}
+
+void bench_index(Bench& b) {
+    const int count = b.quick ? 10000 : 100000;
+#ifdef __GLIBC__
+    size_t heap = heap_in_use();
+#endif
+    Metrics::Timer timer;
+    LogIndex index;
+    index.reserve(count);
+    for (int i = 0; i < count; ++i) index.add(index_log(i));
+    b.report("index.build", timer.seconds() * 1000.0, "ms", false);
+    b.report("index.bytes_per_log", (double)index.memory_usage() / count,
+             "bytes", false);
+
+    // The same history as the vector<Log> the list used to hold, measured
+    // as heap in use so both sides count their allocator overhead
+#ifdef __GLIBC__
+    b.report("index.heap_bytes_per_log",
+             (double)(heap_in_use() - heap) / count, "bytes", false);
+    heap = heap_in_use();
+#endif
+    std::vector<Log> logs;
+    logs.reserve(count);
+    for (int i = 0; i < count; ++i) logs.push_back(index_log(i));
+#ifdef __GLIBC__
+    b.report("index.vector_log.heap_bytes_per_log",
+             (double)(heap_in_use() - heap) / count, "bytes", false);
+#endif
+
+    Metrics::Timer copy;
+    LogIndex index_copy = index;
+    b.report("index.copy", copy.seconds() * 1000.0, "ms", false);
+    Metrics::Timer copy_logs;
+    std::vector<Log> logs_copy = logs;
+    b.report("index.vector_log.copy", copy_logs.seconds() * 1000.0, "ms",
+             false);
+    if (index_copy.size() != logs_copy.size()) {
+        LOG_F(ERROR, "index: copied %zu records and %zu logs",
+              index_copy.size(), logs_copy.size());
+    }
+}
+
+const std::vector<std::pair<const char*, std::function<void(Bench&)>>>
+    scenarios = {
+        {"compress", bench_compress}, {"scan", bench_scan},
+        {"reader", bench_reader},     {"validate", bench_validate},
+        {"discovery", bench_discovery},
+        {"parse", bench_parse},       {"upload", bench_upload},
+        {"pipeline", bench_pipeline}, {"webhooks", bench_webhooks},
+        {"index", bench_index},       {"routing", bench_routing},
+        {"logging", bench_logging},   {"coordination", bench_coordination},
+        {"archive", bench_archive},   {"stats", bench_stats},
+        {"export", bench_export},     {"storage", bench_storage},
+        {"log_table", bench_log_table}, {"shutdown", bench_shutdown},
+};
+
+bool compare(const std::vector<Result>& results, const fs::path& path,
+             double tolerance) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "No baseline at %s\n", path.string().c_str());
+        return true;
+    }
+    json baseline = json::parse(in, nullptr, false);
+    if (baseline.is_discarded() || !baseline.contains("results")) {
+        fprintf(stderr, "Unreadable baseline %s\n", path.string().c_str());
+        return false;
+    }
+
+    bool ok = true;
+    printf("\nAgainst %s (tolerance %.0f%%)\n", path.string().c_str(),
+           tolerance * 100.0);
+    for (const auto& r : results) {
+        if (!baseline["results"].contains(r.name)) continue;
+        double base = baseline["results"][r.name].get<double>();
+        if (base == 0) continue;
+        double change = (r.value - base) / base;
+        double worse = r.higher_is_better ? -change : change;
+        bool regressed = worse > tolerance;
+        ok = ok && !regressed;
+        printf("  %-34s %+8.1f%%%s\n", r.name.c_str(), change * 100.0,
+               regressed ? "  REGRESSION" : "");
+    }
+    return ok;
+}
+
+void save(const std::vector<Result>& results, const fs::path& path) {
+    json out;
+    for (const auto& r : results) {
+        out["results"][r.name] = r.value;
+        out["units"][r.name] = r.unit;
+    }
+    std::ofstream(path) << out.dump(2) << "\n";
+    printf("\nBaseline written to %s\n", path.string().c_str());
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Bench bench;
+    bench.work_dir = fs::temp_directory_path() / "uploader_bench";
+    std::unordered_set<std::string> only;
+    fs::path baseline;
+    fs::path save_path;
+    double tolerance = 0.15;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            return i + 1 < argc ? argv[++i] : "";
+        };
+        if (arg == "--quick") {
+            bench.quick = true;
+        } else if (arg == "--only") {
+            std::string list = next();
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos) comma = list.size();
+                only.insert(list.substr(start, comma - start));
+                start = comma + 1;
+            }
+        } else if (arg == "--work") {
+            bench.work_dir = next();
+        } else if (arg == "--baseline") {
+            baseline = next();
+        } else if (arg == "--save-baseline") {
+            save_path = next();
+        } else if (arg == "--tolerance") {
+            tolerance = atof(next().c_str());
+        } else {
+            fprintf(stderr, "Unknown argument %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    int log_argc = 1;
+    char* log_argv[] = {argv[0], nullptr};
+    loguru::g_stderr_verbosity = loguru::Verbosity_ERROR;
+    loguru::init(log_argc, log_argv);
+
+    fs::create_directories(bench.work_dir);
+    for (const auto& [name, run] : scenarios) {
+        if (!only.empty() && !only.count(name)) continue;
+        printf("%s\n", name);
+        run(bench);
+    }
+
+    std::error_code ec;
+    fs::remove_all(bench.work_dir, ec);
+
+    bool ok = bench.failures == 0;
+    if (!ok) {
+        fprintf(stderr, "%d check(s) failed\n", bench.failures);
+    }
+    if (!baseline.empty()) {
+        ok = compare(bench.results, baseline, tolerance) && ok;
+    }
+    if (!save_path.empty()) {
+        save(bench.results, save_path);
+    }
+    return ok ? 0 : 1;
+}
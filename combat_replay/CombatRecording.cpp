@@ -0,0 +1,343 @@
+#include "CombatRecording.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <zlib.h>
+
+#include "EvtcReader.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char MAGIC[4] = {'C', 'B', 'T', 'R'};
+constexpr uint32_t VERSION = 1;
+// Header: magic, version, inflated size
+constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint32_t) + sizeof(uint64_t);
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append((const char*)&value, sizeof(value));
+}
+
+void put_text(std::string& out, const std::string& text) {
+    put<uint16_t>(out, (uint16_t)text.size());
+    out.append(text);
+}
+
+class Input {
+   public:
+    explicit Input(const std::string& data) : data(data) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (data.size() - pos < sizeof(value)) return false;
+        memcpy(&value, data.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    bool get_text(std::string& text) {
+        uint16_t size;
+        if (!get(size) || data.size() - pos < size) return false;
+        text.assign(data.data() + pos, size);
+        pos += size;
+        return true;
+    }
+
+    bool done() const { return pos == data.size(); }
+
+   private:
+    const std::string& data;
+    size_t pos = 0;
+};
+
+// Names in an EVTC record aren't necessarily terminated
+std::string fixed_text(const char* text, size_t size) {
+    return std::string(text, strnlen(text, size));
+}
+}  // namespace
+
+bool CombatRecording::read_evtc(EvtcReader& reader, std::string& error) {
+    agents.clear();
+    skills.clear();
+    calls.clear();
+
+    // Players are named "character\0:account\0subgroup" in the log
+    struct Player
+    {
+        uint32_t agent;
+        std::string account;
+        uint16_t subgroup;
+    };
+    std::unordered_map<uint64_t, uint32_t> agent_index;
+    std::vector<Player> players;
+    for (size_t i = 0; i < reader.agents().size(); ++i) {
+        EvtcAgent a = reader.agents()[i];
+        std::string name = fixed_text(a.name, sizeof(a.name));
+        if (a.is_elite != EVTC_NPC_ELITE) {
+            const char* rest = a.name + name.size() + 1;
+            const char* end = a.name + sizeof(a.name);
+            Player p = {(uint32_t)agents.size(), "", 0};
+            if (rest < end) {
+                p.account = fixed_text(rest, end - rest);
+                rest += p.account.size() + 1;
+                if (rest < end) {
+                    p.subgroup = (uint16_t)atoi(fixed_text(rest, end - rest).c_str());
+                }
+            }
+            players.push_back(std::move(p));
+        }
+        agent_index.emplace(a.addr, (uint32_t)agents.size());
+        agents.push_back({a.addr, a.prof, a.is_elite, 0, 0, std::move(name)});
+    }
+
+    std::unordered_map<int32_t, uint32_t> skill_index;
+    for (size_t i = 0; i < reader.skills().size(); ++i) {
+        EvtcSkill s = reader.skills()[i];
+        skill_index.emplace(s.id, (uint32_t)skills.size());
+        skills.push_back(fixed_text(s.name, sizeof(s.name)));
+    }
+
+    // Tracking notifications carry their own agents: src has the character
+    // name and elite 0, prof 1 for added and 0 for removed; dst has the
+    // account, profession, elite spec and subgroup
+    struct Notify
+    {
+        uint32_t added, removed, account;
+    };
+    std::vector<Notify> notify;
+    for (const Player& p : players) {
+        CombatAgent agent = agents[p.agent];
+        Notify n;
+        n.added = (uint32_t)agents.size();
+        agents.push_back({agent.id, 1, 0, 0, 0, agent.name});
+        n.removed = (uint32_t)agents.size();
+        agents.push_back({agent.id, 0, 0, 0, 0, agent.name});
+        n.account = (uint32_t)agents.size();
+        agents.push_back(
+            {agent.id, agent.prof, agent.elite, 0, p.subgroup, p.account});
+        notify.push_back(n);
+    }
+
+    uint64_t next_id = 1;
+    auto add_notify = [&](uint32_t src, uint32_t dst, uint32_t at_ms) {
+        CombatCall call = {};
+        call.at_ms = at_ms;
+        call.src = src;
+        call.dst = dst;
+        call.skill = CombatCall::NONE;
+        call.has_event = false;
+        call.id = next_id++;
+        call.revision = 1;
+        calls.push_back(call);
+    };
+    for (const Notify& n : notify) {
+        add_notify(n.added, n.account, 0);
+    }
+
+    // Addresses that aren't in the agent table, e.g. arcdps' own on log
+    // start, get an unnamed agent like they do in game
+    auto agent_of = [&](uint64_t addr) -> uint32_t {
+        if (!addr) return CombatCall::NONE;
+        auto [it, inserted] = agent_index.emplace(addr, (uint32_t)agents.size());
+        if (inserted) agents.push_back({addr, 0, 0, 0, 0, ""});
+        return it->second;
+    };
+
+    uint64_t first_time = 0;
+    uint32_t last_ms = 0;
+    uint64_t pov = 0;
+    for (EvtcSpan<cbtevent> events = reader.next_events(); !events.empty();
+         events = reader.next_events()) {
+        for (size_t i = 0; i < events.size(); ++i) {
+            cbtevent ev = events[i];
+            if (calls.size() == notify.size()) first_time = ev.time;
+            if (ev.is_statechange == CBTS_POINTOFVIEW) pov = ev.src_agent;
+
+            CombatCall call = {};
+            // Events can be a little out of order, the calls aren't
+            if (ev.time > first_time + last_ms) {
+                last_ms = (uint32_t)(ev.time - first_time);
+            }
+            call.at_ms = last_ms;
+            // Values of these statechanges are not agents
+            bool agents_apply = ev.is_statechange != CBTS_LOGSTART &&
+                                ev.is_statechange != CBTS_LOGEND &&
+                                ev.is_statechange != CBTS_GWBUILD &&
+                                ev.is_statechange != CBTS_SHARDID &&
+                                ev.is_statechange != CBTS_LANGUAGE;
+            call.src = agents_apply ? agent_of(ev.src_agent) : CombatCall::NONE;
+            call.dst = agents_apply && ev.is_statechange == CBTS_NONE
+                           ? agent_of(ev.dst_agent)
+                           : CombatCall::NONE;
+            auto skill = skill_index.find((int32_t)ev.skillid);
+            call.skill = skill == skill_index.end() ? CombatCall::NONE
+                                                    : skill->second;
+            call.has_event = true;
+            call.ev = ev;
+            call.id = next_id++;
+            call.revision = 1;
+            calls.push_back(call);
+        }
+    }
+    if (!reader.error().empty()) {
+        error = reader.error();
+        return false;
+    }
+
+    for (const Notify& n : notify) {
+        add_notify(n.removed, CombatCall::NONE, last_ms);
+    }
+
+    // The recording player is self in every event and in its notification
+    if (pov) {
+        auto it = agent_index.find(pov);
+        if (it != agent_index.end()) agents[it->second].self = 1;
+        for (const Notify& n : notify) {
+            if (agents[n.account].id == pov) agents[n.account].self = 1;
+        }
+    }
+    return true;
+}
+
+bool CombatRecording::save(const fs::path& path, std::string& error) const {
+    std::string body;
+    body.reserve(calls.size() * (sizeof(CombatCall) + 8));
+    put<uint32_t>(body, (uint32_t)agents.size());
+    for (const CombatAgent& a : agents) {
+        put(body, a.id);
+        put(body, a.prof);
+        put(body, a.elite);
+        put(body, a.self);
+        put(body, a.team);
+        put_text(body, a.name);
+    }
+    put<uint32_t>(body, (uint32_t)skills.size());
+    for (const std::string& s : skills) {
+        put_text(body, s);
+    }
+    put<uint64_t>(body, (uint64_t)calls.size());
+    for (const CombatCall& c : calls) {
+        put(body, c.at_ms);
+        put(body, c.src);
+        put(body, c.dst);
+        put(body, c.skill);
+        put<uint8_t>(body, c.has_event);
+        if (c.has_event) put(body, c.ev);
+        put(body, c.id);
+        put(body, c.revision);
+    }
+
+    std::string out(HEADER_SIZE, '\0');
+    uint64_t inflated = body.size();
+    memcpy(&out[0], MAGIC, sizeof(MAGIC));
+    memcpy(&out[4], &VERSION, sizeof(VERSION));
+    memcpy(&out[8], &inflated, sizeof(inflated));
+    uLongf size = compressBound((uLong)body.size());
+    out.resize(HEADER_SIZE + size);
+    if (compress2((Bytef*)&out[HEADER_SIZE], &size, (const Bytef*)body.data(),
+                  (uLong)body.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+        error = "Failed to compress the recording";
+        return false;
+    }
+    out.resize(HEADER_SIZE + size);
+
+    // Written next to path and renamed, a failed save leaves no half file
+    fs::path part = path;
+    part += ".part";
+    {
+        std::ofstream file(part, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.data(), (std::streamsize)out.size())) {
+            error = "Failed to write " + part.string();
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(part, path, ec);
+    if (ec) {
+        fs::remove(part, ec);
+        error = "Failed to write " + path.string();
+        return false;
+    }
+    return true;
+}
+
+bool CombatRecording::load(const fs::path& path, std::string& error) {
+    agents.clear();
+    skills.clear();
+    calls.clear();
+
+    std::ifstream file(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    uint32_t version = 0;
+    uint64_t inflated = 0;
+    if (!file.good() && !file.eof()) {
+        error = "Failed to read " + path.string();
+        return false;
+    }
+    if (data.size() < HEADER_SIZE || memcmp(data.data(), MAGIC, sizeof(MAGIC))) {
+        error = path.string() + " is not a combat recording";
+        return false;
+    }
+    memcpy(&version, &data[4], sizeof(version));
+    memcpy(&inflated, &data[8], sizeof(inflated));
+    if (version != VERSION) {
+        error = "Unsupported recording version " + std::to_string(version);
+        return false;
+    }
+
+    std::string body(inflated, '\0');
+    uLongf size = (uLongf)inflated;
+    if (uncompress((Bytef*)&body[0], &size, (const Bytef*)&data[HEADER_SIZE],
+                   (uLong)(data.size() - HEADER_SIZE)) != Z_OK ||
+        size != inflated) {
+        error = path.string() + " is damaged";
+        return false;
+    }
+    data.clear();
+    data.shrink_to_fit();
+
+    Input in(body);
+    bool ok = true;
+    uint32_t count = 0;
+    ok = in.get(count);
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        CombatAgent a;
+        ok = in.get(a.id) && in.get(a.prof) && in.get(a.elite) &&
+             in.get(a.self) && in.get(a.team) && in.get_text(a.name);
+        agents.push_back(std::move(a));
+    }
+    ok = ok && in.get(count);
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        std::string s;
+        ok = in.get_text(s);
+        skills.push_back(std::move(s));
+    }
+    uint64_t call_count = 0;
+    ok = ok && in.get(call_count);
+    if (ok) calls.reserve((size_t)call_count);
+    for (uint64_t i = 0; ok && i < call_count; ++i) {
+        CombatCall c = {};
+        uint8_t has_event = 0;
+        ok = in.get(c.at_ms) && in.get(c.src) && in.get(c.dst) &&
+             in.get(c.skill) && in.get(has_event) &&
+             (!has_event || in.get(c.ev)) && in.get(c.id) && in.get(c.revision);
+        c.has_event = has_event != 0;
+        // Indexes are checked once here so replaying needs no checks
+        ok = ok && (c.src == CombatCall::NONE || c.src < agents.size()) &&
+             (c.dst == CombatCall::NONE || c.dst < agents.size()) &&
+             (c.skill == CombatCall::NONE || c.skill < skills.size());
+        calls.push_back(c);
+    }
+    if (!ok || !in.done()) {
+        agents.clear();
+        skills.clear();
+        calls.clear();
+        error = path.string() + " is damaged";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "arcdps_defs.h"
+
+class EvtcReader;
+
+// An agent the way the combat callback sees it
+struct CombatAgent
+{
+	uint64_t id;
+	uint32_t prof;
+	uint32_t elite;
+	uint32_t self;
+	uint16_t team;
+	std::string name; // empty is passed as a null name
+};
+
+// One call of the combat callback
+struct CombatCall
+{
+	static constexpr uint32_t NONE = 0xffffffff;
+
+	uint32_t at_ms; // since the first call, never decreasing
+	uint32_t src; // index into agents, NONE for an empty agent
+	uint32_t dst;
+	uint32_t skill; // index into skills, NONE for a null skill name
+	bool has_event; // false for tracking notifications, where ev is null
+	cbtevent ev;
+	uint64_t id;
+	uint64_t revision;
+};
+
+// A sequence of combat callbacks with the agents and skill names they point
+// to. Saved as "CBTR", a version, the inflated size and then the agents,
+// skills and calls deflated in one piece, about a third of the events
+// themselves.
+struct CombatRecording
+{
+	std::vector<CombatAgent> agents;
+	std::vector<std::string> skills;
+	std::vector<CombatCall> calls;
+
+	// The calls arcdps makes while a log is recorded: every player added,
+	// each event in order, then every player removed
+	bool read_evtc(EvtcReader& reader, std::string& error);
+
+	bool save(const std::filesystem::path& path, std::string& error) const;
+	bool load(const std::filesystem::path& path, std::string& error);
+};
@@ -0,0 +1,220 @@
+#include "CombatReplay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+// Values below are exact, above each power of two has this many buckets
+constexpr uint64_t SUB_BUCKETS = 8;
+constexpr size_t BUCKETS = SUB_BUCKETS + (64 - 3) * SUB_BUCKETS;
+
+int log2_floor(uint64_t v) {
+    int e = 0;
+    while (v >>= 1) ++e;
+    return e;
+}
+
+size_t bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) return (size_t)ns;
+    int e = log2_floor(ns);
+    uint64_t sub = (ns >> (e - 3)) & (SUB_BUCKETS - 1);
+    return (size_t)(SUB_BUCKETS + (e - 3) * SUB_BUCKETS + sub);
+}
+
+uint64_t bucket_upper(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    int e = (int)((bucket - SUB_BUCKETS) / SUB_BUCKETS) + 3;
+    uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    uint64_t width = 1ull << (e - 3);
+    return ((SUB_BUCKETS + sub) << (e - 3)) + width - 1;
+}
+
+uint64_t nanoseconds(Clock::duration d) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d)
+        .count();
+}
+
+// Sleeping is only accurate to a millisecond or so, the rest is spun
+void wait_until(Clock::time_point at) {
+    Clock::time_point now = Clock::now();
+    if (at - now > std::chrono::milliseconds(2)) {
+        std::this_thread::sleep_until(at - std::chrono::milliseconds(1));
+    }
+    while (Clock::now() < at) {
+        std::this_thread::yield();
+    }
+}
+
+struct Worker
+{
+    uint64_t calls = 0;
+    uint64_t dropped = 0;
+    LatencyHistogram latency;
+    LatencyHistogram delay;
+};
+
+// When each call of a pass is due, from the start of the pass, and how
+// long a pass takes. Empty if not paced.
+struct Schedule
+{
+    std::vector<uint64_t> due_ns;
+    uint64_t period_ns = 0;
+
+    bool paced() const { return !due_ns.empty(); }
+    uint64_t due(uint64_t call) const {
+        return call / due_ns.size() * period_ns + due_ns[call % due_ns.size()];
+    }
+    // Calls due by ns, the one due at ns included
+    uint64_t arrived(uint64_t ns) const {
+        uint64_t passes = ns / period_ns;
+        auto in_pass = std::upper_bound(due_ns.begin(), due_ns.end(),
+                                        ns % period_ns);
+        return passes * due_ns.size() + (in_pass - due_ns.begin());
+    }
+};
+
+void run(const CombatRecording& recording, CombatCallback callback,
+         const ReplayOptions& options, const Schedule& schedule,
+         Clock::time_point start, Worker& worker) {
+    // Callbacks get char*, they are not expected to write through them
+    std::vector<ag> agents;
+    agents.reserve(recording.agents.size());
+    for (const CombatAgent& a : recording.agents) {
+        ag agent = {};
+        agent.name = a.name.empty() ? nullptr : const_cast<char*>(a.name.c_str());
+        agent.id = (uintptr_t)a.id;
+        agent.prof = a.prof;
+        agent.elite = a.elite;
+        agent.self = a.self;
+        agent.team = a.team;
+        agents.push_back(agent);
+    }
+    std::vector<char*> skills;
+    skills.reserve(recording.skills.size());
+    for (const std::string& s : recording.skills) {
+        skills.push_back(const_cast<char*>(s.c_str()));
+    }
+    const ag empty = {};
+
+    size_t n = recording.calls.size();
+    uint64_t total = (uint64_t)n * options.passes;
+    wait_until(start);
+
+    uint64_t k = 0;
+    while (k < total) {
+        uint64_t due = 0;
+        if (schedule.paced()) {
+            due = schedule.due(k);
+            uint64_t now = nanoseconds(Clock::now() - start);
+            if (now < due) {
+                wait_until(start + std::chrono::nanoseconds(due));
+            } else {
+                uint64_t behind = (std::min)(schedule.arrived(now), total) - k;
+                if (behind > options.backlog) {
+                    worker.dropped += behind - options.backlog;
+                    k += behind - options.backlog;
+                    continue;
+                }
+            }
+        }
+
+        const CombatCall& call = recording.calls[k % n];
+        cbtevent ev = call.ev;
+        ag src = call.src == CombatCall::NONE ? empty : agents[call.src];
+        ag dst = call.dst == CombatCall::NONE ? empty : agents[call.dst];
+        char* skillname =
+            call.skill == CombatCall::NONE ? nullptr : skills[call.skill];
+        uint64_t id = call.id + k / n * n;
+
+        Clock::time_point before = Clock::now();
+        callback(call.has_event ? &ev : nullptr, &src, &dst, skillname, id,
+                 call.revision);
+        Clock::time_point after = Clock::now();
+
+        worker.latency.add(nanoseconds(after - before));
+        if (schedule.paced()) {
+            worker.delay.add(nanoseconds(after - start) - due);
+        }
+        ++worker.calls;
+        ++k;
+    }
+}
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : counts(BUCKETS) {}
+
+void LatencyHistogram::add(uint64_t ns) {
+    ++counts[bucket_of(ns)];
+    ++total;
+    largest = (std::max)(largest, ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    largest = (std::max)(largest, other.largest);
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    if (!total) return 0;
+    uint64_t rank = (uint64_t)std::ceil(q * total);
+    rank = (std::max)(rank, (uint64_t)1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return (std::min)(bucket_upper(i), largest);
+    }
+    return largest;
+}
+
+ReplayResult replay(const CombatRecording& recording, CombatCallback callback,
+                    const ReplayOptions& options) {
+    ReplayResult result;
+    size_t n = recording.calls.size();
+    if (!n || !options.threads || !options.passes) return result;
+
+    Schedule schedule;
+    if (options.speed > 0) {
+        schedule.due_ns.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            schedule.due_ns[i] =
+                (uint64_t)(recording.calls[i].at_ms * 1e6 / options.speed);
+        }
+        // A pass ends a millisecond of recorded time after its last call
+        schedule.period_ns = schedule.due_ns.back() + (uint64_t)(1e6 / options.speed) + 1;
+    } else if (options.rate > 0) {
+        schedule.due_ns.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            schedule.due_ns[i] = (uint64_t)(i * 1e9 / options.rate);
+        }
+        schedule.period_ns = (std::max)((uint64_t)(n * 1e9 / options.rate), (uint64_t)1);
+    }
+
+    std::vector<Worker> workers(options.threads);
+    std::vector<std::thread> threads;
+    // Threads start together, so their calls overlap from the first one
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(20);
+    for (unsigned t = 0; t < options.threads; ++t) {
+        threads.emplace_back(run, std::cref(recording), callback,
+                             std::cref(options), std::cref(schedule), start,
+                             std::ref(workers[t]));
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    result.seconds = nanoseconds(Clock::now() - start) / 1e9;
+
+    for (const Worker& w : workers) {
+        result.calls += w.calls;
+        result.dropped += w.dropped;
+        result.latency.merge(w.latency);
+        result.delay.merge(w.delay);
+    }
+    return result;
+}
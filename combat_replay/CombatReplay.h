@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "CombatRecording.h"
+
+// Signature of arcdps_exports::combat
+using CombatCallback = uintptr_t (*)(cbtevent* ev, ag* src, ag* dst,
+	char* skillname, uint64_t id, uint64_t revision);
+
+// Call latencies in buckets an eighth of a power of two wide, so any
+// percentile is within 12.5% of the real one. Adding is a few instructions
+// and no allocation, each replay thread keeps its own.
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void add(uint64_t ns);
+	void merge(const LatencyHistogram& other);
+
+	uint64_t count() const { return total; }
+	uint64_t max() const { return largest; }
+	// Upper end of the bucket holding quantile q (0 to 1)
+	uint64_t percentile(double q) const;
+
+private:
+	std::vector<uint64_t> counts;
+	uint64_t total = 0;
+	uint64_t largest = 0;
+};
+
+struct ReplayOptions
+{
+	unsigned threads = 1;
+	// Calls per second per thread, 0 for as fast as the callback returns
+	double rate = 0;
+	// Instead of rate, the recorded pace times speed
+	double speed = 0;
+	// Calls a thread may fall behind before the oldest are dropped, like the
+	// bounded queue a game thread hands events to
+	uint64_t backlog = 4096;
+	// Times each thread goes through the recording
+	unsigned passes = 1;
+};
+
+struct ReplayResult
+{
+	uint64_t calls = 0; // made, over all threads
+	uint64_t dropped = 0; // due but skipped because the backlog was full
+	double seconds = 0;
+	LatencyHistogram latency; // inside the callback
+	LatencyHistogram delay; // from when the call was due until it returned, paced only
+};
+
+// Every thread replays its own copy of the recording into callback, the
+// agents and events it passes are fresh copies for each call
+ReplayResult replay(const CombatRecording& recording, CombatCallback callback,
+	const ReplayOptions& options);
@@ -0,0 +1,205 @@
+// combat_replay: records combat callback sequences and replays them into
+// mod_combat and arc_logging::on_combat, to see what the callback costs the
+// game. arcdps calls it for every event, from more than one thread.
+//
+//   combat_replay record <file> [--evtc <log>] [--events <n>] [--players <n>]
+//                               [--seed <n>]
+//   combat_replay replay <file> [--target mod_combat|arc_logging|noop|all]
+//                               [--threads <n>] [--rate <calls/s>]
+//                               [--speed <x>] [--backlog <n>] [--passes <n>]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CombatRecording.h"
+#include "CombatReplay.h"
+#include "EvtcGenerator.h"
+#include "EvtcReader.h"
+#include "Uploader.h"
+#include "arc_logging.h"
+#include "loguru.hpp"
+#include "mod_combat.h"
+
+namespace fs = std::filesystem;
+
+static arc_logging* raw_log;
+
+static uintptr_t arc_logging_combat(cbtevent* ev, ag* src, ag* dst,
+                                    char* skillname, uint64_t /*id*/,
+                                    uint64_t /*revision*/) {
+    raw_log->on_combat(ev, src, dst, skillname);
+    return 0;
+}
+
+// Baseline: what the harness itself adds to every call
+static uintptr_t noop_combat(cbtevent* /*ev*/, ag* /*src*/, ag* /*dst*/,
+                             char* /*skillname*/, uint64_t /*id*/,
+                             uint64_t /*revision*/) {
+    return 0;
+}
+
+static void print_usage(const char* exe) {
+    fprintf(stderr,
+            "Usage: %s record <file> [options]\n"
+            "  --evtc <log>       calls arcdps made while recording this"
+            " .evtc/.zevtc\n"
+            "                     (default a synthetic fight)\n"
+            "  --events <n>       synthetic events (default 200000)\n"
+            "  --players <n>      synthetic players (default 10)\n"
+            "  --seed <n>         synthetic seed (default 1)\n"
+            "Usage: %s replay <file> [options]\n"
+            "  --target <name>    mod_combat, arc_logging, noop or all"
+            " (default mod_combat)\n"
+            "  --threads <n>      threads calling at once (default 1)\n"
+            "  --rate <calls/s>   per thread, 0 for flat out (default 0)\n"
+            "  --speed <x>        recorded pace times x, instead of --rate\n"
+            "  --backlog <n>      calls a thread may fall behind before"
+            " dropping (default 4096)\n"
+            "  --passes <n>       times through the recording (default 1)\n"
+            "arc_logging writes to $COMBAT_REPLAY_DOCUMENTS, or the working"
+            " directory.\n",
+            exe, exe);
+}
+
+static int record(const fs::path& file, const fs::path& evtc,
+                  const EvtcSpec& spec) {
+    CombatRecording recording;
+    std::string error;
+    EvtcReader reader;
+    std::vector<char> generated;
+    if (!evtc.empty()) {
+        if (!reader.open(evtc)) {
+            fprintf(stderr, "%s\n", reader.error().c_str());
+            return 1;
+        }
+    } else {
+        generated = generate_evtc(spec);
+        if (!reader.open_memory((const uint8_t*)generated.data(),
+                                generated.size())) {
+            fprintf(stderr, "%s\n", reader.error().c_str());
+            return 1;
+        }
+    }
+    if (!recording.read_evtc(reader, error) || !recording.save(file, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    printf("%s: %zu calls, %zu agents, %zu skills, %llu bytes\n",
+           file.string().c_str(), recording.calls.size(),
+           recording.agents.size(), recording.skills.size(),
+           (unsigned long long)fs::file_size(file));
+    return 0;
+}
+
+static void print_histogram(const char* name, const LatencyHistogram& h) {
+    printf("  %-10s p50 %8llu  p90 %8llu  p99 %8llu  p99.9 %8llu  max %10llu\n",
+           name, (unsigned long long)h.percentile(0.5),
+           (unsigned long long)h.percentile(0.9),
+           (unsigned long long)h.percentile(0.99),
+           (unsigned long long)h.percentile(0.999),
+           (unsigned long long)h.max());
+}
+
+static void print_result(const char* target, const ReplayOptions& options,
+                         const ReplayResult& result) {
+    printf("%s: %u thread%s, %llu calls, %llu dropped, %.3f s, %.0f calls/s\n",
+           target, options.threads, options.threads == 1 ? "" : "s",
+           (unsigned long long)result.calls,
+           (unsigned long long)result.dropped, result.seconds,
+           result.seconds > 0 ? result.calls / result.seconds : 0.0);
+    printf("  ns\n");
+    print_histogram("latency", result.latency);
+    if (result.delay.count()) print_histogram("delay", result.delay);
+}
+
+static int replay_file(const fs::path& file, const std::string& target,
+                       const ReplayOptions& options) {
+    CombatRecording recording;
+    std::string error;
+    if (!recording.load(file, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    bool all = target == "all";
+    if (all || target == "noop") {
+        print_result("noop", options, replay(recording, noop_combat, options));
+    }
+    if (all || target == "mod_combat") {
+        // Not initialized, like in the moments after mod_init; mod_combat
+        // only needs it to exist
+        Uploader up(fs::temp_directory_path() / "combat_replay", std::nullopt);
+        mod_combat_attach(&up);
+        print_result("mod_combat", options,
+                     replay(recording, mod_combat, options));
+        mod_combat_attach(nullptr);
+    }
+    if (all || target == "arc_logging") {
+        char arcvers[] = "combat_replay";
+        auto logger = std::make_unique<arc_logging>(arcvers);
+        raw_log = logger.get();
+        print_result("arc_logging", options,
+                     replay(recording, arc_logging_combat, options));
+        raw_log = nullptr;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || (strcmp(argv[1], "record") && strcmp(argv[1], "replay"))) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    bool recording = !strcmp(argv[1], "record");
+    fs::path file = argv[2];
+
+    fs::path evtc;
+    EvtcSpec spec;
+    std::string target = "mod_combat";
+    ReplayOptions options;
+    for (int i = 3; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (recording && !strcmp(argv[i], "--evtc") && has_value) {
+            evtc = argv[++i];
+        } else if (recording && !strcmp(argv[i], "--events") && has_value) {
+            spec.events = strtoull(argv[++i], nullptr, 10);
+        } else if (recording && !strcmp(argv[i], "--players") && has_value) {
+            spec.players = (uint32_t)atoi(argv[++i]);
+        } else if (recording && !strcmp(argv[i], "--seed") && has_value) {
+            spec.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (!recording && !strcmp(argv[i], "--target") && has_value) {
+            target = argv[++i];
+        } else if (!recording && !strcmp(argv[i], "--threads") && has_value) {
+            options.threads = (unsigned)atoi(argv[++i]);
+        } else if (!recording && !strcmp(argv[i], "--rate") && has_value) {
+            options.rate = atof(argv[++i]);
+        } else if (!recording && !strcmp(argv[i], "--speed") && has_value) {
+            options.speed = atof(argv[++i]);
+        } else if (!recording && !strcmp(argv[i], "--backlog") && has_value) {
+            options.backlog = strtoull(argv[++i], nullptr, 10);
+        } else if (!recording && !strcmp(argv[i], "--passes") && has_value) {
+            options.passes = (unsigned)atoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!recording && target != "mod_combat" && target != "arc_logging" &&
+        target != "noop" && target != "all") {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    int log_argc = 1;
+    char* log_argv[] = {argv[0], nullptr};
+    loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+    loguru::init(log_argc, log_argv);
+
+    return recording ? record(file, evtc, spec)
+                     : replay_file(file, target, options);
+}
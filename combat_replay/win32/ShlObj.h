@@ -0,0 +1,42 @@
+#pragma once
+
+// Stand-ins for the shell and string calls arc_logging.cpp makes, so it
+// builds unchanged on Linux for the replay harness. "My Documents" is
+// $COMBAT_REPLAY_DOCUMENTS, or the working directory.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+
+#include "arcdps_defs.h"
+
+typedef wchar_t WCHAR;
+typedef char CHAR;
+typedef long HRESULT;
+
+#define S_OK 0L
+#define E_FAIL 0x80004005L
+#define MAX_PATH 260
+#define CSIDL_MYDOCUMENTS 0x0005
+#define SHGFP_TYPE_CURRENT 0
+#define CP_UTF8 65001
+#define _snprintf snprintf
+
+inline HRESULT SHGetFolderPath(HWND, int, HANDLE, DWORD, WCHAR* path)
+{
+	const char* dir = getenv("COMBAT_REPLAY_DOCUMENTS");
+	if (!dir || !*dir) dir = ".";
+	size_t n = mbstowcs(path, dir, MAX_PATH - 1);
+	if (n == (size_t)-1) return E_FAIL;
+	path[n] = 0;
+	return S_OK;
+}
+
+inline int WideCharToMultiByte(UINT, DWORD, const WCHAR* in, int, CHAR* out,
+	int size, const CHAR*, BOOL*)
+{
+	size_t n = wcstombs(out, in, (size_t)size - 1);
+	if (n == (size_t)-1) return 0;
+	out[n] = 0;
+	return (int)n + 1;
+}
@@ -0,0 +1,273 @@
+#include "CoordinationServer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <nlohmann/json.hpp>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#define close_socket close
+#define INVALID_SOCKET (-1)
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+// Requests are a few hundred bytes, anything bigger is not ours
+constexpr size_t MAX_REQUEST = 16 * 1024;
+constexpr int RECEIVE_TIMEOUT_MS = 5000;
+
+bool send_all(socket_t s, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = send(s, data.data() + sent, (int)(data.size() - sent), 0);
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+std::string header_value(const std::string& head, const char* name) {
+    // Case-insensitive search for "\r\nName:"
+    std::string needle = std::string("\r\n") + name + ":";
+    auto it = std::search(head.begin(), head.end(), needle.begin(),
+                          needle.end(), [](char a, char b) {
+                              return tolower((unsigned char)a) ==
+                                     tolower((unsigned char)b);
+                          });
+    if (it == head.end()) return "";
+    size_t start = (it - head.begin()) + needle.size();
+    size_t end = head.find("\r\n", start);
+    std::string value = head.substr(start, end - start);
+    while (!value.empty() && value.front() == ' ') value.erase(0, 1);
+    return value;
+}
+
+const char* reason(int code) {
+    switch (code) {
+        case 200:
+            return "OK";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 413:
+            return "Payload Too Large";
+        default:
+            return "Error";
+    }
+}
+
+std::string response(int code, const std::string& body) {
+    char head[256];
+    snprintf(head, sizeof(head),
+             "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+             "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+             code, reason(code), body.size());
+    return head + body;
+}
+
+std::string error_body(const std::string& error) {
+    Coordination::Claim claim;
+    claim.error = error;
+    return Coordination::to_json(claim);
+}
+}  // namespace
+
+CoordinationServer::CoordinationServer(CoordinationServerConfig config)
+    : config(config), fights(config.registry), running(true) {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse,
+               sizeof(reuse));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    listener_ok =
+        inet_pton(AF_INET, config.bind.c_str(), &addr.sin_addr) == 1 &&
+        bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0 &&
+        listen(listener, 64) == 0;
+    if (!listener_ok) {
+        running = false;
+        return;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listener, (sockaddr*)&addr, &len);
+    bound_port = ntohs(addr.sin_port);
+
+    accept_thread = std::thread(&CoordinationServer::accept_loop, this);
+    for (int i = 0; i < (std::max)(config.workers, 1); ++i) {
+        workers.emplace_back(&CoordinationServer::worker_loop, this);
+    }
+}
+
+CoordinationServer::~CoordinationServer() {
+    running = false;
+#ifdef _WIN32
+    shutdown(listener, SD_BOTH);
+#else
+    shutdown(listener, SHUT_RDWR);
+#endif
+    close_socket(listener);
+    if (accept_thread.joinable()) accept_thread.join();
+    accepted.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (socket_t s : pending) {
+        close_socket(s);
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+std::string CoordinationServer::url() const {
+    std::string host = config.bind == "0.0.0.0" ? "127.0.0.1" : config.bind;
+    return "http://" + host + ":" + std::to_string(bound_port);
+}
+
+std::string CoordinationServer::handle(const std::string& method,
+                                       const std::string& route,
+                                       const std::string& body,
+                                       int& status_code) {
+    status_code = 400;
+    if (method != "POST") {
+        status_code = 404;
+        return error_body("Unknown route");
+    }
+    json j = json::parse(body, nullptr, false);
+    if (!j.is_object()) return error_body("Body is not a JSON object");
+
+    Coordination::Claim claim;
+    try {
+        std::string client = j.at("client").get<std::string>();
+        if (client.empty()) return error_body("client is empty");
+        if (route == "/claim") {
+            FightFingerprint fingerprint;
+            fingerprint.boss_id = j.at("boss_id").get<uint16_t>();
+            fingerprint.server_start = j.at("server_start").get<uint32_t>();
+            std::string squad = j.at("squad").get<std::string>();
+            fingerprint.squad_hash = strtoull(squad.c_str(), nullptr, 16);
+            claim = fights.claim(fingerprint, client);
+        } else if (route == "/complete") {
+            claim = fights.complete(j.at("fight").get<std::string>(), client,
+                                    j.at("permalink").get<std::string>(),
+                                    j.value("boss_name", ""),
+                                    j.value("success", false));
+        } else if (route == "/release") {
+            claim = fights.release(j.at("fight").get<std::string>(), client);
+        } else {
+            status_code = 404;
+            return error_body("Unknown route");
+        }
+    } catch (const json::exception& e) {
+        return error_body(e.what());
+    }
+    status_code = claim.status == Coordination::Status::FAILED ? 404 : 200;
+    return Coordination::to_json(claim);
+}
+
+void CoordinationServer::accept_loop() {
+    while (running) {
+        socket_t client = accept(listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            if (!running) return;
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            pending.push_back(client);
+        }
+        accepted.notify_one();
+    }
+}
+
+void CoordinationServer::worker_loop() {
+    for (;;) {
+        socket_t client;
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            accepted.wait(lk, [this] { return !running || !pending.empty(); });
+            if (!running) return;
+            client = pending.front();
+            pending.pop_front();
+        }
+        serve(client);
+        close_socket(client);
+    }
+}
+
+void CoordinationServer::serve(socket_t client) {
+    // A stalled client only holds its worker this long
+#ifdef _WIN32
+    DWORD timeout = RECEIVE_TIMEOUT_MS;
+#else
+    timeval timeout = {RECEIVE_TIMEOUT_MS / 1000,
+                       RECEIVE_TIMEOUT_MS % 1000 * 1000};
+#endif
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout,
+               sizeof(timeout));
+
+    std::string data;
+    char buf[4096];
+    size_t head_end = std::string::npos;
+    size_t content_length = 0;
+    while (head_end == std::string::npos ||
+           data.size() < head_end + 4 + content_length) {
+        int n = recv(client, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        data.append(buf, (size_t)n);
+        if (head_end == std::string::npos) {
+            head_end = data.find("\r\n\r\n");
+            if (head_end != std::string::npos) {
+                content_length = (size_t)strtoull(
+                    header_value(data.substr(0, head_end + 2),
+                                 "Content-Length")
+                        .c_str(),
+                    nullptr, 10);
+            }
+        }
+        if (data.size() > MAX_REQUEST ||
+            (head_end != std::string::npos &&
+             head_end + 4 + content_length > MAX_REQUEST)) {
+            send_all(client, response(413, error_body("Request too large")));
+            return;
+        }
+        // curl waits a second for this before sending a body
+        if (head_end != std::string::npos && data.size() == head_end + 4 &&
+            content_length > 0 &&
+            !header_value(data.substr(0, head_end + 2), "Expect").empty()) {
+            send_all(client, "HTTP/1.1 100 Continue\r\n\r\n");
+        }
+    }
+
+    size_t sp = data.find(' ');
+    size_t sp2 = data.find(' ', sp + 1);
+    if (sp == std::string::npos || sp2 == std::string::npos || sp2 > head_end) {
+        send_all(client, response(400, error_body("Malformed request line")));
+        return;
+    }
+    std::string method = data.substr(0, sp);
+    std::string target = data.substr(sp + 1, sp2 - sp - 1);
+    std::string route = target.substr(0, target.find('?'));
+    int status_code = 0;
+    std::string body = handle(method, route,
+                              data.substr(head_end + 4, content_length),
+                              status_code);
+    send_all(client, response(status_code, body));
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Coordination.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+using socket_t = SOCKET;
+#else
+using socket_t = int;
+#endif
+
+struct CoordinationServerConfig
+{
+	std::string bind = "127.0.0.1";
+	uint16_t port = 0; // 0 picks a free one
+	int workers = 4;
+	Coordination::Registry::Options registry;
+};
+
+// Reference coordination server: the Coordination protocol over a minimal
+// HTTP/1.1 listener. A fixed set of workers answers one request per
+// connection, state lives in memory only. Meant for a squad's own machine
+// or a small VPS, not for exposing to the internet as is.
+class CoordinationServer
+{
+public:
+	explicit CoordinationServer(CoordinationServerConfig config = {});
+	~CoordinationServer();
+
+	// False if the address could not be bound
+	bool listening() const { return listener_ok; }
+	uint16_t port() const { return bound_port; }
+	std::string url() const;
+	Coordination::Registry& registry() { return fights; }
+
+	// Answer to one request, also usable without going through a socket
+	std::string handle(const std::string& method, const std::string& route,
+		const std::string& body, int& status_code);
+
+private:
+	CoordinationServerConfig config;
+	Coordination::Registry fights;
+	socket_t listener;
+	bool listener_ok = false;
+	uint16_t bound_port = 0;
+	std::atomic<bool> running;
+	std::thread accept_thread;
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable accepted;
+	std::deque<socket_t> pending;
+
+	void accept_loop();
+	void worker_loop();
+	void serve(socket_t client);
+};
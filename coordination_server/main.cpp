@@ -0,0 +1,85 @@
+// coordination_server: reference server for squad upload coordination.
+// Squad members point their uploader at it so each fight is uploaded once
+// and everyone else gets the permalink (see Coordination.h).
+//
+//   coordination_server [--bind 127.0.0.1] [--port 8787] [--lease 180]
+//                       [--tolerance 15] [--workers 4]
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "CoordinationServer.h"
+#include "loguru.hpp"
+
+static std::atomic<bool> running(true);
+
+static void on_signal(int) { running = false; }
+
+static void print_usage(const char* exe) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --bind <address>   address to listen on (default 127.0.0.1,"
+            " 0.0.0.0 for all)\n"
+            "  --port <port>      default 8787\n"
+            "  --lease <seconds>  how long an uncompleted claim holds"
+            " (default 180)\n"
+            "  --tolerance <seconds>  start times this close are the same"
+            " fight (default 15)\n"
+            "  --workers <n>      connections served at once (default 4)\n",
+            exe);
+}
+
+int main(int argc, char** argv) {
+    CoordinationServerConfig config;
+    config.port = 8787;
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--bind") && has_value) {
+            config.bind = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && has_value) {
+            config.port = (uint16_t)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--lease") && has_value) {
+            config.registry.lease = std::chrono::seconds(atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--tolerance") && has_value) {
+            config.registry.start_tolerance = (uint32_t)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--workers") && has_value) {
+            config.workers = atoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int log_argc = 1;
+    char* log_argv[] = {argv[0], nullptr};
+    loguru::init(log_argc, log_argv);
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    CoordinationServer server(config);
+    if (!server.listening()) {
+        LOG_F(ERROR, "Failed to listen on %s:%u", config.bind.c_str(),
+              (unsigned)config.port);
+        return 1;
+    }
+    LOG_F(INFO, "Coordinating uploads on %s", server.url().c_str());
+
+    size_t last_fights = 0;
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        size_t fights = server.registry().size();
+        if (fights != last_fights) {
+            LOG_F(INFO, "%zu fights tracked", fights);
+            last_fights = fights;
+        }
+    }
+    LOG_F(INFO, "Shutting down");
+    return 0;
+}